@@ -0,0 +1,597 @@
+#include "ArchiveVideo.h"
+#include "SessionIndex.h"
+
+#include <iostream>
+
+#ifdef WITH_FFV1
+
+#ifndef __STDC_CONSTANT_MACROS
+#define __STDC_CONSTANT_MACROS
+#endif
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <boost/thread.hpp>
+#include <boost/lexical_cast.hpp>
+
+extern "C"
+{
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/frame.h>
+#include <libavutil/dict.h>
+}
+
+static std::string Error(int code)
+{
+    char text[128];
+    av_strerror(code, text, sizeof(text));
+    return text;
+}
+
+//FFV1 only accepts slice counts that tile the frame evenly; the smallest one that keeps every thread busy
+static int Slices(int threads)
+{
+    const int counts[] = { 4, 6, 9, 12, 16, 24, 30 };
+    for(int i = 0; i < 7; i++)
+    {
+        if(counts[i] >= threads)
+            return counts[i];
+    }
+    return 30;
+}
+
+static const AVRational Milliseconds = { 1, 1000 };
+
+ArchiveVideoWriter::ArchiveVideoWriter()
+ : format(0),
+   codec(0),
+   stream(0),
+   picture(0),
+   packet(0),
+   syncFd(-1),
+   firstTimestamp(-1),
+   lastTimestamp(-1),
+   dayOffset(0),
+   lastPts(-1),
+   bytes(0)
+{
+
+}
+
+ArchiveVideoWriter::~ArchiveVideoWriter()
+{
+    Close();
+}
+
+bool ArchiveVideoWriter::Open(const std::string & path, const std::string & stream, int width, int height, int type, int threads)
+{
+    Close();
+    this->path = path;
+
+    if(type != CV_8UC1 && type != CV_16UC1)
+    {
+        std::cout << "Archive " << path << ": only 8 and 16 bit gray frames are supported" << std::endl;
+        return false;
+    }
+
+    const AVCodec * encoder = avcodec_find_encoder(AV_CODEC_ID_FFV1);
+    if(!encoder)
+    {
+        std::cout << "Archive " << path << ": FFmpeg has no FFV1 encoder" << std::endl;
+        return false;
+    }
+
+    int result = avformat_alloc_output_context2(&format, 0, "matroska", path.c_str());
+    if(result < 0)
+    {
+        std::cout << "Archive " << path << ": " << Error(result) << std::endl;
+        Close();
+        return false;
+    }
+
+    if(threads <= 0)
+        threads = std::max(1u, boost::thread::hardware_concurrency());
+
+    codec = avcodec_alloc_context3(encoder);
+    codec->width = width;
+    codec->height = height;
+    codec->pix_fmt = type == CV_16UC1 ? AV_PIX_FMT_GRAY16LE : AV_PIX_FMT_GRAY8;
+    codec->time_base = Milliseconds;
+    codec->gop_size = 1;
+    codec->thread_count = threads;
+    codec->thread_type = FF_THREAD_SLICE;
+    codec->level = 3;
+    if(format->oformat->flags & AVFMT_GLOBALHEADER)
+        codec->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+
+    //Version 3 with per-slice CRCs and the range coder: the best ratio FFV1 has, and damage stays within a slice
+    AVDictionary * options = 0;
+    av_dict_set(&options, "slices", boost::lexical_cast<std::string>(Slices(threads)).c_str(), 0);
+    av_dict_set(&options, "slicecrc", "1", 0);
+    av_dict_set(&options, "coder", "range_def", 0);
+    av_dict_set(&options, "context", "1", 0);
+    result = avcodec_open2(codec, encoder, &options);
+    av_dict_free(&options);
+    if(result < 0)
+    {
+        std::cout << "Archive " << path << ": cannot open the FFV1 encoder, " << Error(result) << std::endl;
+        Close();
+        return false;
+    }
+
+    this->stream = avformat_new_stream(format, 0);
+    avcodec_parameters_from_context(this->stream->codecpar, codec);
+    this->stream->time_base = Milliseconds;
+    av_dict_set(&this->stream->metadata, "title", stream.c_str(), 0);
+
+    result = avio_open(&format->pb, path.c_str(), AVIO_FLAG_WRITE);
+    if(result < 0)
+    {
+        std::cout << "Archive " << path << ": " << Error(result) << std::endl;
+        Close();
+        return false;
+    }
+    syncFd = open(path.c_str(), O_RDONLY);
+
+    picture = av_frame_alloc();
+    picture->format = codec->pix_fmt;
+    picture->width = width;
+    picture->height = height;
+    packet = av_packet_alloc();
+    if(av_frame_get_buffer(picture, 32) < 0 || !packet)
+    {
+        Close();
+        return false;
+    }
+
+    firstTimestamp = -1;
+    lastTimestamp = -1;
+    dayOffset = 0;
+    lastPts = -1;
+    bytes = 0;
+    return true;
+}
+
+bool ArchiveVideoWriter::WriteHeader()
+{
+    //Deferred to the first frame, the tag carries its timestamp
+    if(firstTimestamp >= 0)
+        av_dict_set(&stream->metadata, "FIRST_TIMESTAMP_US", boost::lexical_cast<std::string>(firstTimestamp).c_str(), 0);
+
+    int result = avformat_write_header(format, 0);
+    if(result < 0)
+    {
+        std::cout << "Archive " << path << ": " << Error(result) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void ArchiveVideoWriter::Close()
+{
+    if(format && format->pb)
+    {
+        if(firstTimestamp < 0)
+            WriteHeader();
+
+        if(codec && avcodec_is_open(codec))
+        {
+            avcodec_send_frame(codec, 0);
+            Drain();
+        }
+        av_write_trailer(format);
+        avio_closep(&format->pb);
+    }
+
+    if(syncFd >= 0)
+    {
+        fdatasync(syncFd);
+        close(syncFd);
+        syncFd = -1;
+    }
+
+    av_packet_free(&packet);
+    av_frame_free(&picture);
+    avcodec_free_context(&codec);
+    if(format)
+    {
+        avformat_free_context(format);
+        format = 0;
+    }
+    stream = 0;
+}
+
+bool ArchiveVideoWriter::IsOpen()
+{
+    return format != 0;
+}
+
+int64_t ArchiveVideoWriter::Append(const cv::Mat & frame, int64_t timestamp)
+{
+    if(!format || frame.rows != codec->height || frame.cols != codec->width ||
+       frame.type() != (codec->pix_fmt == AV_PIX_FMT_GRAY16LE ? CV_16UC1 : CV_8UC1))
+        return -1;
+
+    //Same unwrapping as the index: a jump back of more than half a day is midnight
+    int64_t unwrapped = timestamp + dayOffset;
+    while(lastTimestamp >= 0 && unwrapped + SESSIONINDEX_DAY / 2 < lastTimestamp)
+    {
+        dayOffset += SESSIONINDEX_DAY;
+        unwrapped = timestamp + dayOffset;
+    }
+    lastTimestamp = std::max(lastTimestamp, unwrapped);
+
+    if(firstTimestamp < 0)
+    {
+        firstTimestamp = unwrapped;
+        if(!WriteHeader())
+            return -1;
+    }
+
+    //Matroska keeps milliseconds; frames closer than that get consecutive pts
+    int64_t pts = std::max(lastPts + 1, (unwrapped - firstTimestamp) / 1000);
+
+    if(av_frame_make_writable(picture) < 0)
+        return -1;
+
+    size_t rowBytes = frame.cols * frame.elemSize();
+    for(int y = 0; y < frame.rows; y++)
+        memcpy(picture->data[0] + y * picture->linesize[0], frame.ptr<uint8_t>(y), rowBytes);
+    picture->pts = pts;
+
+    int result = avcodec_send_frame(codec, picture);
+    if(result < 0)
+    {
+        std::cout << "Archive " << path << ": " << Error(result) << std::endl;
+        return -1;
+    }
+    if(!Drain())
+        return -1;
+
+    lastPts = pts;
+    return pts;
+}
+
+bool ArchiveVideoWriter::Drain()
+{
+    while(true)
+    {
+        int result = avcodec_receive_packet(codec, packet);
+        if(result == AVERROR(EAGAIN) || result == AVERROR_EOF)
+            return true;
+        if(result < 0)
+            return false;
+
+        //Frames are looked up one by one, a frame that needs its predecessors would make Read wrong
+        if(!(packet->flags & AV_PKT_FLAG_KEY))
+        {
+            std::cout << "Archive " << path << ": encoder produced a frame that is not a keyframe" << std::endl;
+            av_packet_unref(packet);
+            return false;
+        }
+
+        av_packet_rescale_ts(packet, codec->time_base, stream->time_base);
+        packet->stream_index = stream->index;
+        bytes += packet->size;
+
+        //A single track needs no interleaving, packets go straight to the current cluster
+        result = av_write_frame(format, packet);
+        av_packet_unref(packet);
+        if(result < 0)
+        {
+            std::cout << "Archive " << path << ": " << Error(result) << std::endl;
+            return false;
+        }
+    }
+}
+
+bool ArchiveVideoWriter::Sync()
+{
+    if(!format || lastPts < 0)
+        return format != 0;
+
+    //Closes the open cluster, then the bytes go to disk
+    if(av_write_frame(format, 0) < 0)
+        return false;
+    avio_flush(format->pb);
+    if(format->pb->error < 0)
+        return false;
+
+    return syncFd < 0 || fdatasync(syncFd) == 0;
+}
+
+int64_t ArchiveVideoWriter::BytesWritten()
+{
+    return bytes;
+}
+
+ArchiveVideoReader::ArchiveVideoReader()
+ : format(0),
+   codec(0),
+   picture(0),
+   packet(0),
+   streamIndex(-1),
+   firstTimestamp(-1),
+   draining(false)
+{
+
+}
+
+ArchiveVideoReader::~ArchiveVideoReader()
+{
+    Close();
+}
+
+bool ArchiveVideoReader::Open(const std::string & path)
+{
+    Close();
+
+    if(avformat_open_input(&format, path.c_str(), 0, 0) < 0)
+        return false;
+
+    for(unsigned int i = 0; i < format->nb_streams; i++)
+    {
+        if(format->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO)
+        {
+            streamIndex = int(i);
+            break;
+        }
+    }
+    if(streamIndex < 0)
+    {
+        Close();
+        return false;
+    }
+
+    AVStream * stream = format->streams[streamIndex];
+    const AVCodec * decoder = avcodec_find_decoder(stream->codecpar->codec_id);
+    codec = decoder ? avcodec_alloc_context3(decoder) : 0;
+    if(!codec || avcodec_parameters_to_context(codec, stream->codecpar) < 0)
+    {
+        Close();
+        return false;
+    }
+
+    //Slices decode in parallel as well
+    codec->thread_count = 0;
+    codec->thread_type = FF_THREAD_SLICE;
+    if(avcodec_open2(codec, decoder, 0) < 0)
+    {
+        Close();
+        return false;
+    }
+
+    AVDictionaryEntry * tag = av_dict_get(stream->metadata, "FIRST_TIMESTAMP_US", 0, 0);
+    firstTimestamp = tag ? strtoll(tag->value, 0, 10) : -1;
+
+    picture = av_frame_alloc();
+    packet = av_packet_alloc();
+    draining = false;
+    return picture && packet;
+}
+
+void ArchiveVideoReader::Close()
+{
+    av_packet_free(&packet);
+    av_frame_free(&picture);
+    avcodec_free_context(&codec);
+    if(format)
+        avformat_close_input(&format);
+    streamIndex = -1;
+    firstTimestamp = -1;
+}
+
+int64_t ArchiveVideoReader::FirstTimestamp()
+{
+    return firstTimestamp;
+}
+
+bool ArchiveVideoReader::Receive(cv::Mat & frame, int64_t & pts)
+{
+    if(avcodec_receive_frame(codec, picture) < 0)
+        return false;
+
+    int type = picture->format == AV_PIX_FMT_GRAY16LE ? CV_16UC1 : CV_8UC1;
+    if(picture->format != AV_PIX_FMT_GRAY16LE && picture->format != AV_PIX_FMT_GRAY8)
+    {
+        av_frame_unref(picture);
+        return false;
+    }
+
+    frame.create(picture->height, picture->width, type);
+    size_t rowBytes = frame.cols * frame.elemSize();
+    for(int y = 0; y < frame.rows; y++)
+        memcpy(frame.ptr<uint8_t>(y), picture->data[0] + y * picture->linesize[0], rowBytes);
+
+    pts = av_rescale_q(picture->best_effort_timestamp, format->streams[streamIndex]->time_base, Milliseconds);
+    av_frame_unref(picture);
+    return true;
+}
+
+bool ArchiveVideoReader::Next(cv::Mat & frame, int64_t & pts)
+{
+    if(!codec)
+        return false;
+
+    while(true)
+    {
+        if(Receive(frame, pts))
+            return true;
+        if(draining)
+            return false;
+
+        int result = av_read_frame(format, packet);
+        if(result < 0)
+        {
+            draining = true;
+            avcodec_send_packet(codec, 0);
+            continue;
+        }
+
+        if(packet->stream_index == streamIndex)
+            result = avcodec_send_packet(codec, packet);
+        av_packet_unref(packet);
+        if(result < 0 && result != AVERROR(EAGAIN))
+            return false;
+    }
+}
+
+bool ArchiveVideoReader::Skip(int64_t & pts)
+{
+    if(!format)
+        return false;
+
+    while(av_read_frame(format, packet) >= 0)
+    {
+        bool ours = packet->stream_index == streamIndex;
+        if(ours)
+            pts = av_rescale_q(packet->pts, format->streams[streamIndex]->time_base, Milliseconds);
+        av_packet_unref(packet);
+        if(ours)
+            return true;
+    }
+    return false;
+}
+
+bool ArchiveVideoReader::Read(int64_t pts, cv::Mat & frame)
+{
+    if(!codec)
+        return false;
+
+    //Every frame is a keyframe, so the seek lands on or just before it; files without cues fall back to a scan
+    AVStream * stream = format->streams[streamIndex];
+    int64_t target = av_rescale_q(pts, Milliseconds, stream->time_base);
+    if(av_seek_frame(format, streamIndex, target, AVSEEK_FLAG_BACKWARD) < 0 &&
+       av_seek_frame(format, streamIndex, 0, AVSEEK_FLAG_BACKWARD) < 0)
+        return false;
+    avcodec_flush_buffers(codec);
+    draining = false;
+
+    int64_t found;
+    while(Next(frame, found))
+    {
+        if(found == pts)
+            return true;
+        if(found > pts)
+            break;
+    }
+    frame.release();
+    return false;
+}
+
+#else
+
+ArchiveVideoWriter::ArchiveVideoWriter()
+ : format(0),
+   codec(0),
+   stream(0),
+   picture(0),
+   packet(0),
+   syncFd(-1),
+   firstTimestamp(-1),
+   lastTimestamp(-1),
+   dayOffset(0),
+   lastPts(-1),
+   bytes(0)
+{
+
+}
+
+ArchiveVideoWriter::~ArchiveVideoWriter()
+{
+
+}
+
+bool ArchiveVideoWriter::Open(const std::string & path, const std::string &, int, int, int, int)
+{
+    std::cout << "Archive " << path << ": built without FFmpeg, no FFV1 support" << std::endl;
+    return false;
+}
+
+void ArchiveVideoWriter::Close()
+{
+
+}
+
+bool ArchiveVideoWriter::IsOpen()
+{
+    return false;
+}
+
+int64_t ArchiveVideoWriter::Append(const cv::Mat &, int64_t)
+{
+    return -1;
+}
+
+bool ArchiveVideoWriter::Sync()
+{
+    return false;
+}
+
+int64_t ArchiveVideoWriter::BytesWritten()
+{
+    return 0;
+}
+
+ArchiveVideoReader::ArchiveVideoReader()
+ : format(0),
+   codec(0),
+   picture(0),
+   packet(0),
+   streamIndex(-1),
+   firstTimestamp(-1),
+   draining(false)
+{
+
+}
+
+ArchiveVideoReader::~ArchiveVideoReader()
+{
+
+}
+
+bool ArchiveVideoReader::Open(const std::string & path)
+{
+    std::cout << "Archive " << path << ": built without FFmpeg, no FFV1 support" << std::endl;
+    return false;
+}
+
+void ArchiveVideoReader::Close()
+{
+
+}
+
+bool ArchiveVideoReader::Next(cv::Mat &, int64_t &)
+{
+    return false;
+}
+
+bool ArchiveVideoReader::Read(int64_t, cv::Mat &)
+{
+    return false;
+}
+
+bool ArchiveVideoReader::Skip(int64_t &)
+{
+    return false;
+}
+
+int64_t ArchiveVideoReader::FirstTimestamp()
+{
+    return -1;
+}
+
+#endif
+
+cv::Mat ArchiveVideoLoad(const std::string & path, int64_t offset)
+{
+    ArchiveVideoReader reader;
+    cv::Mat frame;
+    if(reader.Open(path))
+        reader.Read(ArchiveVideoPts(offset), frame);
+    return frame;
+}
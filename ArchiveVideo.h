@@ -0,0 +1,127 @@
+/*
+ * ArchiveVideo.h
+ *
+ *  Created on: 19/10 2026
+ *      Author: Baobei Xu
+ */
+
+#ifndef ARCHIVEVIDEO_H_
+#define ARCHIVEVIDEO_H_
+
+#include <string>
+#include <stdint.h>
+#include <opencv2/opencv.hpp>
+
+struct AVFormatContext;
+struct AVCodecContext;
+struct AVStream;
+struct AVFrame;
+struct AVPacket;
+
+/////////////////////////////////////Lossless archive of one stream as a Matroska file with a single FFV1 video track,
+/// <stream folder>/frames.mkv (frames_<n>.mkv for later recordings into the same folder, see
+/// IndexRecord::VideoFileName). 16 bit streams are stored as gray16le and 8 bit ones as gray, so decoding gives back
+/// the exact pixel values, and ffmpeg, ffplay or VLC play the files as they are. FFV1 is intra-only: every frame is
+/// a keyframe and any frame can be decoded on its own.
+///
+/// Packet timestamps are the capture timestamps in milliseconds since the first frame of the file (Matroska's
+/// resolution), made strictly increasing; the capture timestamp of the first frame (microseconds since local
+/// midnight) is the track's FIRST_TIMESTAMP_US tag. Index records of archived frames carry INDEX_FLAG_VIDEO and
+/// ArchiveVideoOffset(segment, pts) as their offset, and keep the exact microsecond timestamps.
+///
+/// Built without FFmpeg (WITH_FFV1 undefined) every Open fails with a message.
+
+#define ARCHIVEVIDEO_FILE "frames.mkv"
+
+inline int64_t ArchiveVideoOffset(int segment, int64_t pts)
+{
+    return (int64_t(segment) << 32) | pts;
+}
+
+inline int64_t ArchiveVideoPts(int64_t offset)
+{
+    return offset & 0xFFFFFFFFLL;
+}
+
+class ArchiveVideoWriter
+{
+public:
+    ArchiveVideoWriter();
+    virtual ~ArchiveVideoWriter();
+
+    /////////////////////////////////////Creates (replaces) path. type is CV_8UC1 or CV_16UC1. The encoder splits
+    /// every frame into slices coded on threads threads, 0 for one per core.
+    bool Open(const std::string & path, const std::string & stream, int width, int height, int type, int threads);
+
+    /////////////////////////////////////Writes the trailer (cues, duration); a file that was not closed still
+    /// plays and decodes, only seeking in it is slower
+    void Close();
+    bool IsOpen();
+
+    /////////////////////////////////////pts of the frame in the file, -1 on error. timestamp is the raw capture
+    /// timestamp and may wrap at midnight.
+    int64_t Append(const cv::Mat & frame, int64_t timestamp);
+
+    /////////////////////////////////////Make everything appended so far durable (muxer flush + fdatasync). FFV1 has
+    /// no encoder delay, so every frame Append returned a pts for is included.
+    bool Sync();
+
+    int64_t BytesWritten();
+
+private:
+    std::string path;
+    AVFormatContext * format;
+    AVCodecContext * codec;
+    AVStream * stream;
+    AVFrame * picture;
+    AVPacket * packet;
+    int syncFd;
+
+    int64_t firstTimestamp;
+    int64_t lastTimestamp;
+    int64_t dayOffset;
+    int64_t lastPts;
+    int64_t bytes;
+
+    bool WriteHeader();
+    bool Drain();
+};
+
+class ArchiveVideoReader
+{
+public:
+    ArchiveVideoReader();
+    virtual ~ArchiveVideoReader();
+
+    bool Open(const std::string & path);
+    void Close();
+
+    /////////////////////////////////////Next frame in file order and its pts, false at the end or on error
+    bool Next(cv::Mat & frame, int64_t & pts);
+
+    /////////////////////////////////////Frame with exactly this pts
+    bool Read(int64_t pts, cv::Mat & frame);
+
+    /////////////////////////////////////pts of the next packet without decoding it, false at the end of what was
+    /// written (for rebuilding an index)
+    bool Skip(int64_t & pts);
+
+    /////////////////////////////////////Capture timestamp of the first frame, from the FIRST_TIMESTAMP_US tag
+    int64_t FirstTimestamp();
+
+private:
+    AVFormatContext * format;
+    AVCodecContext * codec;
+    AVFrame * picture;
+    AVPacket * packet;
+    int streamIndex;
+    int64_t firstTimestamp;
+    bool draining;
+
+    bool Receive(cv::Mat & frame, int64_t & pts);
+};
+
+/////////////////////////////////////One frame of an archive by index offset (see ContainerLoad)
+cv::Mat ArchiveVideoLoad(const std::string & path, int64_t offset);
+
+#endif /* ARCHIVEVIDEO_H_ */
@@ -0,0 +1,284 @@
+#include "Backpressure.h"
+
+#include <cstdio>
+#include <iostream>
+#include <boost/lexical_cast.hpp>
+#include <boost/filesystem.hpp>
+
+bool BackpressureConfig::Parse(const std::string & spec, BackpressureConfig & config)
+{
+    std::string::size_type colon = spec.find(':');
+    std::string action = spec.substr(0, colon);
+    std::string argument = colon == std::string::npos ? "" : spec.substr(colon + 1);
+
+    if(action == "none")
+    {
+        config.action = None;
+    }
+    else if(action == "lower-compression")
+    {
+        config.action = LowerCompression;
+    }
+    else if(action == "decimate")
+    {
+        std::string::size_type factor = argument.find(':');
+        config.action = Decimate;
+        config.decimateStream = argument.substr(0, factor);
+        if(factor != std::string::npos)
+        {
+            try
+            {
+                config.decimateFactor = boost::lexical_cast<int>(argument.substr(factor + 1));
+            }
+            catch(const boost::bad_lexical_cast &)
+            {
+                return false;
+            }
+        }
+        if(config.decimateStream.empty() || config.decimateFactor < 2)
+            return false;
+    }
+    else if(action == "spill")
+    {
+        config.action = Spill;
+        config.spillRoot = argument;
+        if(config.spillRoot.empty())
+            return false;
+    }
+    else if(action == "stop")
+    {
+        config.action = Stop;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+std::string BackpressureConfig::ToString() const
+{
+    switch(action)
+    {
+        case None:
+            return "none";
+        case LowerCompression:
+            return "lower-compression";
+        case Decimate:
+            return "decimate:" + decimateStream + ":" + boost::lexical_cast<std::string>(decimateFactor);
+        case Spill:
+            return "spill:" + spillRoot;
+        case Stop:
+            return "stop";
+    }
+    return "";
+}
+
+BackpressureMonitor::BackpressureMonitor(const BackpressureConfig & config,
+                                         const std::vector<StreamWriter *> & writers,
+                                         SessionMetadata & metadata,
+                                         int normalCompression)
+ : config(config),
+   writers(writers),
+   metadata(metadata),
+   normalCompression(normalCompression),
+   monitorThread(0)
+{
+    monitoring.assignValue(false);
+    sessionStopped.assignValue(false);
+    level.assignValue(0);
+}
+
+BackpressureMonitor::~BackpressureMonitor()
+{
+    Stop();
+}
+
+void BackpressureMonitor::Start()
+{
+    if(monitorThread || config.action == BackpressureConfig::None)
+        return;
+
+    monitoring.assignValue(true);
+    monitorThread = new boost::thread(boost::bind(&BackpressureMonitor::MonitorThread,
+                                                  this));
+}
+
+void BackpressureMonitor::Stop()
+{
+    if(!monitorThread)
+        return;
+
+    monitoring.assignValue(false);
+    monitorThread->join();
+    delete monitorThread;
+    monitorThread = 0;
+}
+
+void BackpressureMonitor::SetStopCallback(const boost::function<void ()> & callback)
+{
+    stopCallback = callback;
+}
+
+bool BackpressureMonitor::SessionStopped()
+{
+    return sessionStopped.getValue();
+}
+
+int BackpressureMonitor::Level()
+{
+    return level.getValue();
+}
+
+int BackpressureMonitor::MaxLevel()
+{
+    switch(config.action)
+    {
+        case BackpressureConfig::LowerCompression:
+            return normalCompression > 1 ? 2 : normalCompression;
+        case BackpressureConfig::Decimate:
+            return 3;
+        case BackpressureConfig::Spill:
+        case BackpressureConfig::Stop:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+void BackpressureMonitor::ApplyLevel(int newLevel, const std::string & reason)
+{
+    std::string transition;
+
+    switch(config.action)
+    {
+        case BackpressureConfig::LowerCompression:
+        {
+            //Step down to compression 1, then to uncompressed PNG
+            int compression = newLevel == 0 ? normalCompression : MaxLevel() - newLevel;
+            for(size_t i = 0; i < writers.size(); i++)
+                writers[i]->SetCompression(compression);
+            transition = "png compression " + boost::lexical_cast<std::string>(compression);
+            break;
+        }
+        case BackpressureConfig::Decimate:
+        {
+            int factor = 1;
+            for(int i = 0; i < newLevel; i++)
+                factor *= config.decimateFactor;
+            for(size_t i = 0; i < writers.size(); i++)
+            {
+                if(writers[i]->name == config.decimateStream)
+                    writers[i]->SetDecimation(factor);
+            }
+            transition = "decimate " + config.decimateStream + " 1/" + boost::lexical_cast<std::string>(factor);
+            break;
+        }
+        case BackpressureConfig::Spill:
+        {
+            for(size_t i = 0; i < writers.size(); i++)
+            {
+                std::string folder = writers[i]->baseFolder;
+                if(newLevel > 0)
+                {
+                    folder = config.spillRoot + "/" + writers[i]->baseFolder;
+                    boost::system::error_code error;
+                    boost::filesystem::create_directories(folder, error);
+                    if(error)
+                    {
+                        metadata.Event("backpressure cannot create spill folder " + folder + ": " + error.message());
+                        return;
+                    }
+                }
+                writers[i]->SetFolder(folder);
+            }
+            transition = newLevel > 0 ? "spill to " + config.spillRoot : "back to primary folders";
+            break;
+        }
+        case BackpressureConfig::Stop:
+        {
+            if(!stopCallback)
+            {
+                for(size_t i = 0; i < writers.size(); i++)
+                    writers[i]->Stop();
+            }
+            transition = "stop recording";
+            sessionStopped.assignValue(true);
+            break;
+        }
+        default:
+            return;
+    }
+
+    level.assignValue(newLevel);
+    metadata.Event("backpressure level " + boost::lexical_cast<std::string>(newLevel) + " (" + reason + "): " + transition);
+    std::cout << "Backpressure: " << transition << " (" << reason << ")" << std::endl;
+
+    if(sessionStopped.getValue())
+    {
+        metadata.Event("session closed by backpressure policy");
+
+        //The owner commits and closes the session, which ends this thread
+        if(stopCallback)
+            stopCallback();
+    }
+}
+
+void BackpressureMonitor::MonitorThread()
+{
+    const int sampleMs = 200;
+    const int settleSamples = 10;
+
+    std::vector<int> lastBacklog(writers.size(), 0);
+    int overSamples = 0;
+    int underSamples = 0;
+
+    while(monitoring.getValue() && !sessionStopped.getValue())
+    {
+        boost::this_thread::sleep(boost::posix_time::milliseconds(sampleMs));
+
+        float pressure = 0;
+        float latency = 0;
+        bool growing = false;
+        std::string worst;
+
+        for(size_t i = 0; i < writers.size(); i++)
+        {
+            int backlog = writers[i]->Backlog();
+            float fill = float(backlog) / writers[i]->Capacity();
+            if(fill >= pressure)
+            {
+                pressure = fill;
+                worst = writers[i]->name;
+            }
+            latency = std::max(latency, writers[i]->LatencyMs());
+            growing = growing || backlog > lastBacklog[i];
+            lastBacklog[i] = backlog;
+        }
+
+        bool over = pressure >= config.highWater ||
+                    (latency > config.maxLatencyMs && growing && pressure > config.lowWater);
+        bool under = pressure <= config.lowWater && latency < config.maxLatencyMs * 0.7f;
+
+        overSamples = over ? overSamples + 1 : 0;
+        underSamples = under ? underSamples + 1 : 0;
+
+        char reason[128];
+        snprintf(reason, sizeof(reason), "%s backlog %d%%, write latency %.1f ms",
+                 worst.c_str(), int(pressure * 100), latency);
+
+        int current = level.getValue();
+
+        //Degrade immediately, then escalate only if a level has had time to take effect
+        if(over && current < MaxLevel() && (current == 0 || overSamples >= settleSamples))
+        {
+            ApplyLevel(current + 1, reason);
+            overSamples = 0;
+        }
+        else if(under && current > 0 && underSamples >= settleSamples)
+        {
+            ApplyLevel(current - 1, reason);
+            underSamples = 0;
+        }
+    }
+}
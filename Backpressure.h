@@ -0,0 +1,104 @@
+/*
+ * Backpressure.h
+ *
+ *  Created on: 19/10 2026
+ *      Author: Baobei Xu
+ */
+
+#ifndef BACKPRESSURE_H_
+#define BACKPRESSURE_H_
+
+#include <string>
+#include <vector>
+#include <boost/thread.hpp>
+#include <boost/function.hpp>
+
+#include "ThreadMutexObject.h"
+#include "SessionMetadata.h"
+#include "StreamWriter.h"
+
+/////////////////////////////////////What the recorder does when storage cannot keep up with capture
+struct BackpressureConfig
+{
+    enum Action
+    {
+        None,
+        LowerCompression,
+        Decimate,
+        Spill,
+        Stop
+    };
+
+    BackpressureConfig()
+     : action(LowerCompression),
+       decimateFactor(2),
+       highWater(0.5f),
+       lowWater(0.1f),
+       maxLatencyMs(33.0f)
+    {}
+
+    Action action;
+
+    /////////////////////////////////////Decimate: writer name ("depth", "thermal") and factor per step
+    std::string decimateStream;
+    int decimateFactor;
+
+    /////////////////////////////////////Spill: secondary root, each writer goes to <spillRoot>/<folder>
+    std::string spillRoot;
+
+    /////////////////////////////////////Backlog as a fraction of the ring to degrade at / recover below
+    float highWater;
+    float lowWater;
+
+    /////////////////////////////////////Write latency above which a growing backlog counts as pressure
+    float maxLatencyMs;
+
+    /////////////////////////////////////"none", "lower-compression", "decimate:<stream>[:N]", "spill:<path>" or "stop"
+    static bool Parse(const std::string & spec, BackpressureConfig & config);
+    std::string ToString() const;
+};
+
+/////////////////////////////////////Samples queue depth and write latency of the writers and degrades or
+/// restores them according to the config. Every transition is written to the session metadata.
+class BackpressureMonitor
+{
+public:
+    BackpressureMonitor(const BackpressureConfig & config,
+                        const std::vector<StreamWriter *> & writers,
+                        SessionMetadata & metadata,
+                        int normalCompression);
+    virtual ~BackpressureMonitor();
+
+    void Start();
+    void Stop();
+
+    /////////////////////////////////////Called on the monitor thread by the Stop action, after its events are written,
+    /// so the owner ends the recording the normal way; it must not join the monitor (Stop). Without one the action
+    /// stops the writers itself. Set before Start.
+    void SetStopCallback(const boost::function<void ()> & callback);
+
+    /////////////////////////////////////Set once the Stop action has closed the session
+    bool SessionStopped();
+
+    /////////////////////////////////////0 is normal, higher is more degraded
+    int Level();
+
+private:
+    const BackpressureConfig config;
+    std::vector<StreamWriter *> writers;
+    SessionMetadata & metadata;
+    const int normalCompression;
+
+    boost::thread * monitorThread;
+    ThreadMutexObject<bool> monitoring;
+    ThreadMutexObject<bool> sessionStopped;
+    ThreadMutexObject<int> level;
+
+    boost::function<void ()> stopCallback;
+
+    void MonitorThread();
+    int MaxLevel();
+    void ApplyLevel(int newLevel, const std::string & reason);
+};
+
+#endif /* BACKPRESSURE_H_ */
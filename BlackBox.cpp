@@ -0,0 +1,315 @@
+#include "BlackBox.h"
+#include "ThreadPolicy.h"
+#include "SessionMetadata.h"
+
+#include <fstream>
+#include <iostream>
+#include <boost/lexical_cast.hpp>
+#include <boost/filesystem.hpp>
+
+volatile sig_atomic_t BlackBox::signalled = 0;
+
+BlackBox::BlackBox(const BlackBoxConfig & config, const std::vector<FrameSource> & sources)
+ : config(config),
+   maxBytes(size_t(config.maxMegabytes) * 1024 * 1024 / std::max<size_t>(1, sources.size())),
+   dumpThread(0)
+{
+    capturing.assignValue(false);
+    dumping.assignValue(false);
+
+    for(size_t i = 0; i < sources.size(); i++)
+    {
+        Lane * lane = new Lane;
+        lane->source = sources[i];
+        lane->thread = 0;
+        lane->historyBytes = 0;
+        lane->pendingBytes = 0;
+        lane->dropped = 0;
+        lanes.push_back(lane);
+    }
+}
+
+BlackBox::~BlackBox()
+{
+    Stop();
+
+    for(size_t i = 0; i < lanes.size(); i++)
+    {
+        for(size_t j = 0; j < lanes[i]->history.size(); j++)
+            delete lanes[i]->history[j];
+        for(size_t j = 0; j < lanes[i]->pending.size(); j++)
+            delete lanes[i]->pending[j];
+        delete lanes[i];
+    }
+}
+
+void BlackBox::Start()
+{
+    if(dumpThread)
+        return;
+
+    capturing.assignValue(true);
+    dumping.assignValue(true);
+    for(size_t i = 0; i < lanes.size(); i++)
+        lanes[i]->thread = new boost::thread(boost::bind(&BlackBox::LaneThread, this, lanes[i]));
+    dumpThread = new boost::thread(boost::bind(&BlackBox::DumpThread, this));
+}
+
+void BlackBox::Stop()
+{
+    if(!dumpThread)
+        return;
+
+    capturing.assignValue(false);
+    for(size_t i = 0; i < lanes.size(); i++)
+    {
+        lanes[i]->thread->join();
+        delete lanes[i]->thread;
+        lanes[i]->thread = 0;
+    }
+
+    //The dump thread finishes writing whatever was already triggered
+    dumping.assignValue(false);
+    dumpThread->join();
+    delete dumpThread;
+    dumpThread = 0;
+}
+
+void BlackBox::SignalHandler(int)
+{
+    signalled = 1;
+}
+
+float BlackBox::HistorySeconds()
+{
+    float seconds = -1;
+    for(size_t i = 0; i < lanes.size(); i++)
+    {
+        boost::mutex::scoped_lock lock(lanes[i]->mutex);
+        float span = 0;
+        if(lanes[i]->history.size() > 1)
+            span = (lanes[i]->history.back()->arrival - lanes[i]->history.front()->arrival).total_milliseconds() / 1000.0f;
+        seconds = seconds < 0 ? span : std::min(seconds, span);
+    }
+    return std::max(seconds, 0.0f);
+}
+
+int64_t BlackBox::Dropped(const std::string & stream)
+{
+    for(size_t i = 0; i < lanes.size(); i++)
+    {
+        if(lanes[i]->source.name == stream)
+            return lanes[i]->pendingDropped.Get();
+    }
+    return -1;
+}
+
+void BlackBox::Trigger(const std::string & reason)
+{
+    boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+
+    boost::mutex::scoped_lock lock(eventMutex);
+
+    bool newEvent = eventFolder.empty() || now > eventUntil;
+    if(newEvent)
+    {
+        eventFolder = config.folder + "/" + boost::posix_time::to_iso_string(boost::posix_time::microsec_clock::local_time());
+        for(size_t i = 0; i < lanes.size(); i++)
+        {
+            boost::system::error_code error;
+            boost::filesystem::create_directories(eventFolder + "/" + lanes[i]->source.name, error);
+            if(error)
+            {
+                std::cout << "Black box cannot create " << eventFolder << ": " << error.message() << std::endl;
+                eventFolder.clear();
+                return;
+            }
+        }
+    }
+
+    eventUntil = now + boost::posix_time::milliseconds(long(config.postSeconds * 1000));
+
+    SessionMetadata metadata;
+    metadata.Open(eventFolder + "/event.txt");
+    metadata.Event((newEvent ? "trigger: " : "extended by trigger: ") + reason);
+    if(newEvent)
+    {
+        metadata.Set("history_seconds", boost::lexical_cast<std::string>(HistorySeconds()));
+        metadata.Set("post_seconds", boost::lexical_cast<std::string>(config.postSeconds));
+    }
+
+    for(size_t i = 0; i < lanes.size(); i++)
+    {
+        boost::mutex::scoped_lock laneLock(lanes[i]->mutex);
+        for(size_t j = 0; j < lanes[i]->history.size(); j++)
+        {
+            lanes[i]->history[j]->event = eventFolder;
+            Queue(lanes[i], lanes[i]->history[j]);
+        }
+        lanes[i]->history.clear();
+        lanes[i]->historyBytes = 0;
+        lanes[i]->recordUntil = eventUntil;
+        lanes[i]->event = eventFolder;
+    }
+
+    std::cout << "Black box triggered (" << reason << "), writing to " << eventFolder << std::endl;
+}
+
+void BlackBox::LaneThread(Lane * lane)
+{
+    ThreadPolicies::Apply("blackbox", "bbox-" + lane->source.name);
+
+    const FrameSource & source = lane->source;
+    cv::Mat frame(source.height, source.width, source.type);
+    cv::Mat fframe;
+
+    std::vector<int> params(2);
+    params[0] = CV_IMWRITE_PNG_COMPRESSION;
+    params[1] = 1;
+
+    const boost::posix_time::time_duration window = boost::posix_time::milliseconds(long(config.historySeconds * 1000));
+
+    int nextSeq = -1;
+
+    while(capturing.getValue())
+    {
+        int latest = source.latestIndex->getValue();
+        if(latest == -1 || latest < nextSeq)
+        {
+            boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+            continue;
+        }
+
+        if(nextSeq == -1)
+            nextSeq = latest;
+
+        if(latest - nextSeq >= source.numBuffers - 2)
+        {
+            int resume = latest - source.numBuffers / 2;
+            lane->dropped += resume - nextSeq;
+            nextSeq = resume;
+        }
+
+        //A frame overwritten while it was copied is left out of the history rather than kept torn
+        int64_t timestamp;
+        if(!source.Read(nextSeq, frame.data, timestamp))
+        {
+            lane->dropped++;
+            nextSeq++;
+            continue;
+        }
+
+        Frame * entry = new Frame;
+        entry->timestamp = timestamp;
+        entry->arrival = boost::posix_time::microsec_clock::universal_time();
+        nextSeq++;
+
+        if(source.flip)
+            cv::flip(frame, fframe, 0);
+        const cv::Mat & oriented = source.flip ? fframe : frame;
+
+        if(config.compress)
+        {
+            std::vector<uchar> encoded;
+            cv::imencode(".png", oriented, encoded, params);
+            entry->data.assign(encoded.begin(), encoded.end());
+        }
+        else
+        {
+            entry->data.assign(oriented.data, oriented.data + source.FrameSize());
+        }
+
+        boost::mutex::scoped_lock lock(lane->mutex);
+
+        if(!lane->event.empty() && entry->arrival <= lane->recordUntil)
+        {
+            entry->event = lane->event;
+            Queue(lane, entry);
+            continue;
+        }
+
+        lane->history.push_back(entry);
+        lane->historyBytes += entry->data.size();
+
+        //Trim by age first; the byte limit only shortens the window when memory runs out
+        while(!lane->history.empty() &&
+              (entry->arrival - lane->history.front()->arrival > window || lane->historyBytes > maxBytes))
+        {
+            lane->historyBytes -= lane->history.front()->data.size();
+            delete lane->history.front();
+            lane->history.pop_front();
+        }
+    }
+}
+
+void BlackBox::Queue(Lane * lane, Frame * frame)
+{
+    //If the disk cannot keep up, what waits for it is held to the same memory as the history; the frames that
+    //do not fit are dropped and counted, keeping the older, already queued part of the event contiguous
+    if(lane->pendingBytes + frame->data.size() > maxBytes)
+    {
+        lane->pendingDropped.Add();
+        delete frame;
+        return;
+    }
+
+    lane->pending.push_back(frame);
+    lane->pendingBytes += frame->data.size();
+}
+
+void BlackBox::WriteFrame(Lane * lane, Frame * frame)
+{
+    std::string filename = frame->event + "/" + lane->source.name + "/" +
+                           boost::lexical_cast<std::string>(frame->timestamp) + ".png";
+
+    if(config.compress)
+    {
+        std::ofstream file(filename.c_str(), std::ios::out | std::ios::binary);
+        file.write((const char *)&frame->data[0], frame->data.size());
+    }
+    else
+    {
+        cv::Mat image(lane->source.height, lane->source.width, lane->source.type, &frame->data[0]);
+        cv::imwrite(filename, image);
+    }
+}
+
+void BlackBox::DumpThread()
+{
+    ThreadPolicies::Apply("writer", "bbox-dump");
+
+    while(true)
+    {
+        if(signalled)
+        {
+            signalled = 0;
+            Trigger("signal");
+        }
+
+        bool idle = true;
+        for(size_t i = 0; i < lanes.size(); i++)
+        {
+            std::deque<Frame *> batch;
+            {
+                boost::mutex::scoped_lock lock(lanes[i]->mutex);
+                batch.swap(lanes[i]->pending);
+                lanes[i]->pendingBytes = 0;
+            }
+
+            for(size_t j = 0; j < batch.size(); j++)
+            {
+                WriteFrame(lanes[i], batch[j]);
+                delete batch[j];
+            }
+            idle = idle && batch.empty();
+        }
+
+        if(idle)
+        {
+            //Lanes have stopped and nothing is left to write
+            if(!dumping.getValue())
+                break;
+            boost::this_thread::sleep(boost::posix_time::milliseconds(5));
+        }
+    }
+}
@@ -0,0 +1,118 @@
+/*
+ * BlackBox.h
+ *
+ *  Created on: 19/10 2026
+ *      Author: Baobei Xu
+ */
+
+#ifndef BLACKBOX_H_
+#define BLACKBOX_H_
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <csignal>
+#include <stdint.h>
+#include <boost/thread.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include "ThreadMutexObject.h"
+#include "FrameSource.h"
+#include "Telemetry.h"
+
+struct BlackBoxConfig
+{
+    BlackBoxConfig()
+     : historySeconds(0),
+       postSeconds(5),
+       compress(false),
+       maxMegabytes(2048),
+       folder("events")
+    {}
+
+    /////////////////////////////////////Length of the in-memory history, 0 disables the black box
+    float historySeconds;
+
+    /////////////////////////////////////How long recording continues after a trigger
+    float postSeconds;
+
+    /////////////////////////////////////Keep the history PNG-encoded (fast level) to fit a longer window
+    bool compress;
+
+    /////////////////////////////////////Hard limit for the history of all streams together
+    int maxMegabytes;
+
+    /////////////////////////////////////Each trigger writes <folder>/<time>/<stream>/<timestamp>.png
+    std::string folder;
+};
+
+/////////////////////////////////////Keeps the last N seconds of every stream in memory, independent of the
+/// writers, and dumps it together with the following M seconds to disk when triggered.
+class BlackBox
+{
+public:
+    BlackBox(const BlackBoxConfig & config, const std::vector<FrameSource> & sources);
+    virtual ~BlackBox();
+
+    void Start();
+    void Stop();
+
+    /////////////////////////////////////Dump the history and keep recording for postSeconds. A trigger
+    /// during an active event extends it.
+    void Trigger(const std::string & reason);
+
+    /////////////////////////////////////Install with signal(SIGUSR1, BlackBox::SignalHandler)
+    static void SignalHandler(int signal);
+
+    /////////////////////////////////////Seconds of history currently held by the shortest stream
+    float HistorySeconds();
+
+    /////////////////////////////////////Frames of stream lost because the dump fell behind and its queue hit the
+    /// history memory limit, -1 for a stream the black box does not hold
+    int64_t Dropped(const std::string & stream);
+
+private:
+    struct Frame
+    {
+        int64_t timestamp;
+        boost::posix_time::ptime arrival;
+        std::vector<uint8_t> data;
+        std::string event;
+    };
+
+    struct Lane
+    {
+        FrameSource source;
+        boost::thread * thread;
+        boost::mutex mutex;
+        std::deque<Frame *> history;
+        std::deque<Frame *> pending;
+        size_t historyBytes;
+        size_t pendingBytes;
+        boost::posix_time::ptime recordUntil;
+        std::string event;
+        int dropped;
+        TelemetryCounter pendingDropped;
+    };
+
+    const BlackBoxConfig config;
+    size_t maxBytes;
+    std::vector<Lane *> lanes;
+
+    ThreadMutexObject<bool> capturing;
+    ThreadMutexObject<bool> dumping;
+    boost::thread * dumpThread;
+
+    boost::mutex eventMutex;
+    std::string eventFolder;
+    boost::posix_time::ptime eventUntil;
+
+    static volatile sig_atomic_t signalled;
+
+    void LaneThread(Lane * lane);
+    void Queue(Lane * lane, Frame * frame);
+    void DumpThread();
+    void WriteFrame(Lane * lane, Frame * frame);
+};
+
+#endif /* BLACKBOX_H_ */
@@ -0,0 +1,414 @@
+/*
+ * CalibrateRig.cpp
+ *
+ *  Created on: 19/10 2026
+ *      Author: Baobei Xu
+ *
+ *  Offline IR / thermal calibration from recorded sessions of a heated target. IR and thermal frames are paired by
+ *  nearest timestamp, the target is detected in all pairs in parallel (blurred frames are rejected by the variance
+ *  of their Laplacian), then both intrinsics and the IR -> thermal extrinsics are solved and written for
+ *  --calibration.
+ *
+ *      CalibrateRig [--pattern chessboard|circles|acircles] [--board 9x6] [--square 0.03] [--max-dt 15]
+ *                   [--ir-stream infrared] [--thermal-stream thermal] [--step N] [--min-sharpness 20]
+ *                   [--max-views 60] [--threads N] [--out calibration.yml]
+ *                   session...
+ */
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <opencv2/opencv.hpp>
+
+#include "WorkStealingPool.h"
+#include "SessionIndex.h"
+#include "SessionContainer.h"
+#include "RigCalibration.h"
+
+struct CalibrationOptions
+{
+    enum Pattern
+    {
+        Chessboard,
+        Circles,
+        AsymmetricCircles
+    };
+
+    CalibrationOptions()
+     : pattern(Chessboard),
+       board(9, 6),
+       square(0.03f),
+       maxDtMs(15),
+       step(1),
+       minSharpness(20),
+       maxViews(60),
+       threads(0),
+       irStream("infrared"),
+       thermalStream("thermal"),
+       out("calibration.yml")
+    {}
+
+    Pattern pattern;
+    cv::Size board;
+    float square;
+    int maxDtMs;
+    int step;
+    double minSharpness;
+    int maxViews;
+    int threads;
+    std::string irStream;
+    std::string thermalStream;
+    std::string out;
+};
+
+enum DetectionResult
+{
+    DETECT_FOUND,
+    DETECT_BLURRED,
+    DETECT_MISSING,
+    DETECT_UNREADABLE
+};
+
+struct FramePair
+{
+    std::string irPath;
+    std::string thermalPath;
+    int64_t irOffset;
+    int64_t thermalOffset;
+
+    DetectionResult irResult;
+    DetectionResult thermalResult;
+    std::vector<cv::Point2f> irCorners;
+    std::vector<cv::Point2f> thermalCorners;
+};
+
+static bool TimestampBefore(const IndexRecord & a, const IndexRecord & b)
+{
+    return a.timestamp < b.timestamp;
+}
+
+static cv::Size Frame8Bit(const std::string & path, int64_t offset, cv::Mat & gray)
+{
+    cv::Mat image = ContainerLoad(path, offset);
+    if(image.empty())
+        return cv::Size();
+
+    //16-bit IR only uses the bottom of its range, stretch it so the detectors see contrast
+    if(image.depth() != CV_8U)
+        cv::normalize(image, gray, 0, 255, CV_MINMAX, CV_8U);
+    else
+        gray = image;
+
+    return image.size();
+}
+
+static DetectionResult Detect(const CalibrationOptions & options, const std::string & path, int64_t offset,
+                              std::vector<cv::Point2f> & corners)
+{
+    cv::Mat gray;
+    if(Frame8Bit(path, offset, gray).width == 0)
+        return DETECT_UNREADABLE;
+
+    cv::Mat laplacian;
+    cv::Scalar mean, deviation;
+    cv::Laplacian(gray, laplacian, CV_64F);
+    cv::meanStdDev(laplacian, mean, deviation);
+    if(deviation[0] * deviation[0] < options.minSharpness)
+        return DETECT_BLURRED;
+
+    bool found = false;
+    if(options.pattern == CalibrationOptions::Chessboard)
+    {
+        found = cv::findChessboardCorners(gray, options.board, corners,
+                                          CV_CALIB_CB_ADAPTIVE_THRESH | CV_CALIB_CB_NORMALIZE_IMAGE | CV_CALIB_CB_FAST_CHECK);
+        if(found)
+            cv::cornerSubPix(gray, corners, cv::Size(5, 5), cv::Size(-1, -1),
+                             cv::TermCriteria(CV_TERMCRIT_EPS | CV_TERMCRIT_ITER, 30, 0.01));
+    }
+    else
+    {
+        int flags = options.pattern == CalibrationOptions::Circles ? cv::CALIB_CB_SYMMETRIC_GRID : cv::CALIB_CB_ASYMMETRIC_GRID;
+
+        //Heated circles are bright on the thermal image, the blob detector looks for dark ones
+        found = cv::findCirclesGrid(gray, options.board, corners, flags);
+        if(!found)
+        {
+            cv::Mat inverted = 255 - gray;
+            found = cv::findCirclesGrid(inverted, options.board, corners, flags);
+        }
+    }
+
+    return found ? DETECT_FOUND : DETECT_MISSING;
+}
+
+static void DetectPair(const CalibrationOptions & options, FramePair & pair)
+{
+    pair.irResult = Detect(options, pair.irPath, pair.irOffset, pair.irCorners);
+    pair.thermalResult = Detect(options, pair.thermalPath, pair.thermalOffset, pair.thermalCorners);
+}
+
+static std::vector<cv::Point3f> BoardPoints(const CalibrationOptions & options)
+{
+    std::vector<cv::Point3f> points;
+    for(int i = 0; i < options.board.height; i++)
+    {
+        for(int j = 0; j < options.board.width; j++)
+        {
+            float x = options.pattern == CalibrationOptions::AsymmetricCircles ? (2 * j + i % 2) * options.square : j * options.square;
+            points.push_back(cv::Point3f(x, i * options.square, 0));
+        }
+    }
+    return points;
+}
+
+//Evenly spread subset, calibration time grows quickly with the number of views
+static std::vector<size_t> Spread(size_t count, int maxViews)
+{
+    std::vector<size_t> picked;
+    size_t n = std::min(count, size_t(maxViews));
+    for(size_t i = 0; i < n; i++)
+        picked.push_back(i * count / n);
+    return picked;
+}
+
+struct MonoCalibration
+{
+    std::vector<std::vector<cv::Point3f> > objectPoints;
+    std::vector<std::vector<cv::Point2f> > imagePoints;
+    cv::Size size;
+    cv::Mat camera;
+    cv::Mat distortion;
+    double error;
+};
+
+static void CalibrateMono(MonoCalibration & mono)
+{
+    std::vector<cv::Mat> rotations, translations;
+    mono.error = cv::calibrateCamera(mono.objectPoints, mono.imagePoints, mono.size, mono.camera, mono.distortion,
+                                     rotations, translations);
+}
+
+static int Pair(const CalibrationOptions & options, const std::string & session, std::vector<FramePair> & pairs)
+{
+    SessionIndex index;
+    index.Open(session);
+
+    std::vector<IndexRecord> ir, thermal;
+    if(!index.Frames(options.irStream, ir) || !index.Frames(options.thermalStream, thermal))
+    {
+        std::cout << session << ": needs both " << options.irStream << " and " << options.thermalStream << std::endl;
+        return 0;
+    }
+
+    int count = 0;
+    for(size_t i = 0; i < ir.size(); i += options.step)
+    {
+        std::vector<IndexRecord>::iterator it = std::lower_bound(thermal.begin(), thermal.end(), ir[i], &TimestampBefore);
+
+        std::vector<IndexRecord>::iterator best = thermal.end();
+        if(it != thermal.end())
+            best = it;
+        if(it != thermal.begin() && (best == thermal.end() || ir[i].timestamp - (it - 1)->timestamp < best->timestamp - ir[i].timestamp))
+            best = it - 1;
+
+        if(best == thermal.end() || llabs(best->timestamp - ir[i].timestamp) > options.maxDtMs * 1000LL)
+            continue;
+
+        FramePair pair;
+        pair.irPath = index.FramePath(options.irStream, ir[i]);
+        pair.thermalPath = index.FramePath(options.thermalStream, *best);
+        pair.irOffset = ir[i].offset;
+        pair.thermalOffset = best->offset;
+        pairs.push_back(pair);
+        count++;
+    }
+
+    std::cout << session << ": " << count << " IR / thermal pairs within " << options.maxDtMs << " ms" << std::endl;
+    return count;
+}
+
+static void Usage()
+{
+    std::cout << "CalibrateRig [--pattern chessboard|circles|acircles] [--board 9x6] [--square 0.03] [--max-dt 15]" << std::endl
+              << "             [--ir-stream infrared] [--thermal-stream thermal] [--step N] [--min-sharpness 20]" << std::endl
+              << "             [--max-views 60] [--threads N] [--out calibration.yml]" << std::endl
+              << "             session..." << std::endl;
+}
+
+int main(int argc, char ** argv)
+{
+    CalibrationOptions options;
+    std::vector<std::string> sessions;
+
+    for(int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if(arg == "--pattern" && hasValue)
+        {
+            std::string pattern = argv[++i];
+            options.pattern = pattern == "circles" ? CalibrationOptions::Circles :
+                              pattern == "acircles" ? CalibrationOptions::AsymmetricCircles :
+                                                      CalibrationOptions::Chessboard;
+        }
+        else if(arg == "--board" && hasValue)
+        {
+            if(sscanf(argv[++i], "%dx%d", &options.board.width, &options.board.height) != 2)
+            {
+                Usage();
+                return 1;
+            }
+        }
+        else if(arg == "--square" && hasValue)
+            options.square = atof(argv[++i]);
+        else if(arg == "--ir-stream" && hasValue)
+            options.irStream = argv[++i];
+        else if(arg == "--thermal-stream" && hasValue)
+            options.thermalStream = argv[++i];
+        else if(arg == "--max-dt" && hasValue)
+            options.maxDtMs = atoi(argv[++i]);
+        else if(arg == "--step" && hasValue)
+            options.step = std::max(1, atoi(argv[++i]));
+        else if(arg == "--min-sharpness" && hasValue)
+            options.minSharpness = atof(argv[++i]);
+        else if(arg == "--max-views" && hasValue)
+            options.maxViews = std::max(3, atoi(argv[++i]));
+        else if(arg == "--threads" && hasValue)
+            options.threads = atoi(argv[++i]);
+        else if(arg == "--out" && hasValue)
+            options.out = argv[++i];
+        else if(arg.compare(0, 2, "--") == 0)
+        {
+            Usage();
+            return 1;
+        }
+        else
+            sessions.push_back(arg);
+    }
+
+    if(sessions.empty())
+    {
+        Usage();
+        return 1;
+    }
+
+    std::vector<FramePair> pairs;
+    for(size_t i = 0; i < sessions.size(); i++)
+        Pair(options, sessions[i], pairs);
+
+    if(pairs.empty())
+        return 1;
+
+    //Detection is independent per pair; results land in the pair itself
+    {
+        WorkStealingPool pool(options.threads, 0, "calibrate");
+        for(size_t i = 0; i < pairs.size(); i++)
+            pool.Submit(boost::bind(&DetectPair, boost::cref(options), boost::ref(pairs[i])));
+        pool.Wait();
+    }
+
+    MonoCalibration ir, thermal;
+    std::vector<size_t> irViews, thermalViews, stereoViews;
+    int blurred = 0, missing = 0, unreadable = 0;
+
+    for(size_t i = 0; i < pairs.size(); i++)
+    {
+        DetectionResult results[2] = {pairs[i].irResult, pairs[i].thermalResult};
+        for(int c = 0; c < 2; c++)
+        {
+            blurred += results[c] == DETECT_BLURRED;
+            missing += results[c] == DETECT_MISSING;
+            unreadable += results[c] == DETECT_UNREADABLE;
+        }
+
+        if(pairs[i].irResult == DETECT_FOUND)
+            irViews.push_back(i);
+        if(pairs[i].thermalResult == DETECT_FOUND)
+            thermalViews.push_back(i);
+        if(pairs[i].irResult == DETECT_FOUND && pairs[i].thermalResult == DETECT_FOUND)
+            stereoViews.push_back(i);
+    }
+
+    std::cout << "Detected: " << irViews.size() << " IR, " << thermalViews.size() << " thermal, "
+              << stereoViews.size() << " both; rejected " << blurred << " blurred, " << missing << " without target, "
+              << unreadable << " unreadable" << std::endl;
+
+    if(irViews.size() < 3 || thermalViews.size() < 3 || stereoViews.size() < 3)
+    {
+        std::cout << "Need at least 3 views of the target in each camera and in both at once" << std::endl;
+        return 1;
+    }
+
+    std::vector<cv::Point3f> board = BoardPoints(options);
+    cv::Mat gray;
+    ir.size = Frame8Bit(pairs[irViews[0]].irPath, pairs[irViews[0]].irOffset, gray);
+    thermal.size = Frame8Bit(pairs[thermalViews[0]].thermalPath, pairs[thermalViews[0]].thermalOffset, gray);
+
+    std::vector<size_t> picked = Spread(irViews.size(), options.maxViews);
+    for(size_t i = 0; i < picked.size(); i++)
+    {
+        ir.objectPoints.push_back(board);
+        ir.imagePoints.push_back(pairs[irViews[picked[i]]].irCorners);
+    }
+
+    picked = Spread(thermalViews.size(), options.maxViews);
+    for(size_t i = 0; i < picked.size(); i++)
+    {
+        thermal.objectPoints.push_back(board);
+        thermal.imagePoints.push_back(pairs[thermalViews[picked[i]]].thermalCorners);
+    }
+
+    //The two intrinsic solves are independent
+    boost::thread irThread(boost::bind(&CalibrateMono, boost::ref(ir)));
+    CalibrateMono(thermal);
+    irThread.join();
+
+    std::cout << "IR intrinsics: " << ir.objectPoints.size() << " views, RMS " << ir.error << " px" << std::endl;
+    std::cout << "Thermal intrinsics: " << thermal.objectPoints.size() << " views, RMS " << thermal.error << " px" << std::endl;
+
+    std::vector<std::vector<cv::Point3f> > objectPoints;
+    std::vector<std::vector<cv::Point2f> > irPoints, thermalPoints;
+    picked = Spread(stereoViews.size(), options.maxViews);
+    for(size_t i = 0; i < picked.size(); i++)
+    {
+        objectPoints.push_back(board);
+        irPoints.push_back(pairs[stereoViews[picked[i]]].irCorners);
+        thermalPoints.push_back(pairs[stereoViews[picked[i]]].thermalCorners);
+    }
+
+    RigCalibration calibration;
+    calibration.irCamera = ir.camera;
+    calibration.irDistortion = ir.distortion;
+    calibration.irSize = ir.size;
+    calibration.irError = ir.error;
+    calibration.thermalCamera = thermal.camera;
+    calibration.thermalDistortion = thermal.distortion;
+    calibration.thermalSize = thermal.size;
+    calibration.thermalError = thermal.error;
+    calibration.views = objectPoints.size();
+
+    cv::Mat E, F;
+    calibration.stereoError = cv::stereoCalibrate(objectPoints, irPoints, thermalPoints,
+                                                  calibration.irCamera, calibration.irDistortion,
+                                                  calibration.thermalCamera, calibration.thermalDistortion,
+                                                  ir.size, calibration.R, calibration.T, E, F,
+                                                  cv::TermCriteria(CV_TERMCRIT_EPS | CV_TERMCRIT_ITER, 100, 1e-6),
+                                                  CV_CALIB_FIX_INTRINSIC);
+
+    std::cout << "IR -> thermal extrinsics: " << calibration.views << " views, RMS " << calibration.stereoError << " px" << std::endl;
+
+    if(!calibration.Save(options.out))
+    {
+        std::cout << "Cannot write " << options.out << std::endl;
+        return 1;
+    }
+
+    std::cout << "Wrote " << options.out << std::endl;
+    return 0;
+}
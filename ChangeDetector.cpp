@@ -0,0 +1,230 @@
+#include "ChangeDetector.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <boost/lexical_cast.hpp>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+ChangeConfig::ChangeConfig()
+ : enabled(false),
+   blockSize(16),
+   keyframeInterval(300)
+{
+    //Kinect depth noise grows with range, a few mm on average and tens of mm per pixel are still the same scene
+    thresholds["depth"] = ChangeThreshold(4, 60, 1, true);
+    thresholds["infrared"] = ChangeThreshold(8, 200, 1, false);
+    thresholds["thermal"] = ChangeThreshold(1, 12, 1, false);
+}
+
+ChangeThreshold ChangeConfig::For(const std::string & stream) const
+{
+    std::map<std::string, ChangeThreshold>::const_iterator it = thresholds.find(stream);
+    if(it != thresholds.end())
+        return it->second;
+
+    size_t slash = stream.rfind('/');
+    if(slash != std::string::npos)
+    {
+        it = thresholds.find(stream.substr(slash + 1));
+        if(it != thresholds.end())
+            return it->second;
+    }
+    return ChangeThreshold();
+}
+
+bool ChangeConfig::Parse(const std::string & rule)
+{
+    size_t equals = rule.find('=');
+    if(equals == std::string::npos)
+        return false;
+
+    std::string stream = rule.substr(0, equals);
+    ChangeThreshold threshold = For(stream);
+    int blocks = threshold.blocks;
+    int fields = sscanf(rule.c_str() + equals + 1, "%d,%d,%d", &threshold.meanDelta, &threshold.maxDelta, &blocks);
+    if(fields < 2)
+        return false;
+
+    threshold.blocks = std::max(1, blocks);
+    thresholds[stream] = threshold;
+    return true;
+}
+
+std::string ChangeConfig::ToString() const
+{
+    if(!enabled)
+        return "off";
+
+    std::string text = "block " + boost::lexical_cast<std::string>(blockSize) +
+                       ", keyframe every " + boost::lexical_cast<std::string>(keyframeInterval);
+    for(std::map<std::string, ChangeThreshold>::const_iterator it = thresholds.begin(); it != thresholds.end(); ++it)
+    {
+        text += ", " + it->first + "=" + boost::lexical_cast<std::string>(it->second.meanDelta) + "," +
+                boost::lexical_cast<std::string>(it->second.maxDelta) + "," +
+                boost::lexical_cast<std::string>(it->second.blocks);
+    }
+    return text;
+}
+
+ChangeDetector::ChangeDetector(const ChangeThreshold & threshold, int blockSize, int keyframeInterval)
+ : threshold(threshold),
+   blockSize(std::max(4, blockSize)),
+   keyframeInterval(std::max(1, keyframeInterval)),
+   sinceKeyframe(0),
+   lastChangedBlocks(0)
+{
+}
+
+bool ChangeDetector::IsRedundant(const cv::Mat & frame)
+{
+    bool keep = keyframe.empty() || keyframe.size() != frame.size() || keyframe.type() != frame.type() ||
+                ++sinceKeyframe >= keyframeInterval;
+
+    lastChangedBlocks = keep ? 0 : ChangedBlocks(frame);
+
+    if(keep || lastChangedBlocks >= threshold.blocks)
+    {
+        frame.copyTo(keyframe);
+        sinceKeyframe = 0;
+        return false;
+    }
+    return true;
+}
+
+void ChangeDetector::Reset()
+{
+    keyframe.release();
+    sinceKeyframe = 0;
+}
+
+int ChangeDetector::LastChangedBlocks()
+{
+    return lastChangedBlocks;
+}
+
+//Sum and maximum of |a - b| over a block of rows x n pixels, row strides in elements
+static void BlockDiff8(const uint8_t * a, const uint8_t * b, int n, int rows, size_t strideA, size_t strideB, uint64_t & sum, int & max)
+{
+    sum = 0;
+    max = 0;
+
+    for(int y = 0; y < rows; y++, a += strideA, b += strideB)
+    {
+        int x = 0;
+
+#ifdef __SSE2__
+        const __m128i zero = _mm_setzero_si128();
+        __m128i vsum = zero;
+        __m128i vmax = zero;
+
+        for(; x + 16 <= n; x += 16)
+        {
+            __m128i va = _mm_loadu_si128((const __m128i *)(a + x));
+            __m128i vb = _mm_loadu_si128((const __m128i *)(b + x));
+            __m128i d = _mm_or_si128(_mm_subs_epu8(va, vb), _mm_subs_epu8(vb, va));
+            vmax = _mm_max_epu8(vmax, d);
+            vsum = _mm_add_epi64(vsum, _mm_sad_epu8(d, zero));
+        }
+
+        uint8_t maxes[16];
+        uint64_t sums[2];
+        _mm_storeu_si128((__m128i *)maxes, vmax);
+        _mm_storeu_si128((__m128i *)sums, vsum);
+        sum += sums[0] + sums[1];
+        for(int i = 0; i < 16; i++)
+            max = std::max(max, int(maxes[i]));
+#endif
+
+        for(; x < n; x++)
+        {
+            int d = std::abs(int(a[x]) - int(b[x]));
+            sum += d;
+            max = std::max(max, d);
+        }
+    }
+}
+
+static void BlockDiff16(const uint16_t * a, const uint16_t * b, int n, int rows, size_t strideA, size_t strideB, bool ignoreZero,
+                        uint64_t & sum, int & max)
+{
+    sum = 0;
+    max = 0;
+
+    for(int y = 0; y < rows; y++, a += strideA, b += strideB)
+    {
+        int x = 0;
+
+#ifdef __SSE2__
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i bias = _mm_set1_epi16(short(0x8000));
+        __m128i vsum = zero;
+        __m128i vmax = bias;
+
+        for(; x + 8 <= n; x += 8)
+        {
+            __m128i va = _mm_loadu_si128((const __m128i *)(a + x));
+            __m128i vb = _mm_loadu_si128((const __m128i *)(b + x));
+            __m128i d = _mm_or_si128(_mm_subs_epu16(va, vb), _mm_subs_epu16(vb, va));
+            if(ignoreZero)
+                d = _mm_andnot_si128(_mm_or_si128(_mm_cmpeq_epi16(va, zero), _mm_cmpeq_epi16(vb, zero)), d);
+
+            //No unsigned 16 bit max before SSE4.1: compare biased values as signed
+            vmax = _mm_max_epi16(vmax, _mm_xor_si128(d, bias));
+            vsum = _mm_add_epi32(vsum, _mm_add_epi32(_mm_unpacklo_epi16(d, zero), _mm_unpackhi_epi16(d, zero)));
+        }
+
+        uint16_t maxes[8];
+        uint32_t sums[4];
+        _mm_storeu_si128((__m128i *)maxes, _mm_xor_si128(vmax, bias));
+        _mm_storeu_si128((__m128i *)sums, vsum);
+        sum += uint64_t(sums[0]) + sums[1] + sums[2] + sums[3];
+        for(int i = 0; i < 8; i++)
+            max = std::max(max, int(maxes[i]));
+#endif
+
+        for(; x < n; x++)
+        {
+            if(ignoreZero && (a[x] == 0 || b[x] == 0))
+                continue;
+            int d = std::abs(int(a[x]) - int(b[x]));
+            sum += d;
+            max = std::max(max, d);
+        }
+    }
+}
+
+int ChangeDetector::ChangedBlocks(const cv::Mat & frame)
+{
+    const bool wide = frame.depth() == CV_16U;
+    int changed = 0;
+
+    for(int y = 0; y < frame.rows; y += blockSize)
+    {
+        int rows = std::min(blockSize, frame.rows - y);
+        for(int x = 0; x < frame.cols; x += blockSize)
+        {
+            int n = std::min(blockSize, frame.cols - x);
+            uint64_t sum;
+            int max;
+
+            if(wide)
+                BlockDiff16(frame.ptr<uint16_t>(y) + x, keyframe.ptr<uint16_t>(y) + x, n, rows,
+                            frame.step1(), keyframe.step1(), threshold.ignoreZero, sum, max);
+            else
+                BlockDiff8(frame.ptr<uint8_t>(y) + x, keyframe.ptr<uint8_t>(y) + x, n, rows,
+                           frame.step1(), keyframe.step1(), sum, max);
+
+            if(max > threshold.maxDelta || sum > uint64_t(threshold.meanDelta) * n * rows)
+            {
+                //Enough to decide, the rest of the frame does not matter
+                if(++changed >= threshold.blocks)
+                    return changed;
+            }
+        }
+    }
+    return changed;
+}
@@ -0,0 +1,91 @@
+/*
+ * ChangeDetector.h
+ *
+ *  Created on: 19/10 2026
+ *      Author: Baobei Xu
+ */
+
+#ifndef CHANGEDETECTOR_H_
+#define CHANGEDETECTOR_H_
+
+#include <map>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <opencv2/opencv.hpp>
+
+/////////////////////////////////////When a frame counts as changed. The frame is split into blocks; a block changed
+/// if its mean absolute difference to the keyframe exceeds meanDelta or any pixel differs by more than maxDelta,
+/// the frame changed if at least `blocks` blocks did. Units are raw pixel values (mm for depth).
+struct ChangeThreshold
+{
+    ChangeThreshold(int meanDelta = 2, int maxDelta = 32, int blocks = 1, bool ignoreZero = false)
+     : meanDelta(meanDelta),
+       maxDelta(maxDelta),
+       blocks(blocks),
+       ignoreZero(ignoreZero)
+    {}
+
+    int meanDelta;
+    int maxDelta;
+    int blocks;
+
+    /////////////////////////////////////Pixels that are 0 in either frame do not count (invalid depth flickering)
+    bool ignoreZero;
+};
+
+struct ChangeConfig
+{
+    ChangeConfig();
+
+    bool enabled;
+
+    /////////////////////////////////////Block edge in pixels
+    int blockSize;
+
+    /////////////////////////////////////A full frame is stored at least every keyframeInterval frames
+    int keyframeInterval;
+
+    /////////////////////////////////////Per stream, looked up by full name ("kinect1/depth") then by stream kind
+    /// ("depth"); preset for depth, infrared and thermal
+    std::map<std::string, ChangeThreshold> thresholds;
+
+    ChangeThreshold For(const std::string & stream) const;
+
+    /////////////////////////////////////"<stream>=<mean>,<max>[,<blocks>]"
+    bool Parse(const std::string & rule);
+
+    std::string ToString() const;
+};
+
+/////////////////////////////////////Decides per frame whether it is close enough to the last stored keyframe to be
+/// recorded as a reference to it. Block statistics use SSE2 where available. One instance per writer lane.
+class ChangeDetector
+{
+public:
+    ChangeDetector(const ChangeThreshold & threshold, int blockSize, int keyframeInterval);
+
+    /////////////////////////////////////True if frame may be stored as a reference; otherwise frame becomes the
+    /// keyframe and must be stored in full
+    bool IsRedundant(const cv::Mat & frame);
+
+    /////////////////////////////////////Next frame is a keyframe, e.g. after the output folder changed
+    void Reset();
+
+    /////////////////////////////////////Blocks that changed in the last compared frame (stops counting at the
+    /// threshold)
+    int LastChangedBlocks();
+
+private:
+    const ChangeThreshold threshold;
+    const int blockSize;
+    const int keyframeInterval;
+
+    cv::Mat keyframe;
+    int sinceKeyframe;
+    int lastChangedBlocks;
+
+    int ChangedBlocks(const cv::Mat & frame);
+};
+
+#endif /* CHANGEDETECTOR_H_ */
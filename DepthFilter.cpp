@@ -0,0 +1,424 @@
+#include "DepthFilter.h"
+#include "ThreadPolicy.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <boost/lexical_cast.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+DepthFilter::DepthFilter(const DepthFilterConfig & config, const FrameSource & depth)
+ : config(config),
+   depth(depth),
+   width(depth.width),
+   height(depth.height),
+   numThreads(config.threads),
+   alphaQ15(int16_t(std::max(0.0f, std::min(0.999f, config.alpha)) * 32768)),
+   state(depth.width * depth.height, 0),
+   work(depth.width * depth.height, 0),
+   raw(depth.width * depth.height, 0),
+   input(0),
+   output(0),
+   filterThread(0),
+   barrier(0),
+   stopping(false)
+{
+    if(numThreads <= 0)
+        numThreads = std::max(1u, boost::thread::hardware_concurrency() / 2);
+    numThreads = std::min(numThreads, height);
+
+    running.assignValue(false);
+    banded.assignValue(false);
+    latency.assignValue(0);
+    latestDepthIndex.assignValue(-1);
+
+    for(int i = 0; i < numBuffers; i++)
+    {
+        uint8_t * newDepth = (uint8_t *)calloc(width * height * 2, sizeof(uint8_t));
+        frameBuffers[i] = std::pair<uint8_t *, int64_t>(newDepth, 0);
+    }
+}
+
+DepthFilter::~DepthFilter()
+{
+    Stop();
+
+    for(int i = 0; i < numBuffers; i++)
+        free(frameBuffers[i].first);
+}
+
+FrameSource DepthFilter::Output()
+{
+    return FrameSource(depth.name,
+                       frameBuffers,
+                       numBuffers,
+                       latestDepthIndex,
+                       width,
+                       height,
+                       depth.type,
+                       depth.flip,
+                       slots,
+                       depth.pixels);
+}
+
+float DepthFilter::LatencyMs()
+{
+    return latency.getValue();
+}
+
+void DepthFilter::Start()
+{
+    if(filterThread)
+        return;
+
+    running.assignValue(true);
+    banded.assignValue(true);
+    stopping = false;
+
+    //The dispatcher works on band 0 itself
+    barrier = new boost::barrier(numThreads);
+    for(int band = 1; band < numThreads; band++)
+        workers.create_thread(boost::bind(&DepthFilter::WorkerThread, this, band));
+
+    filterThread = new boost::thread(boost::bind(&DepthFilter::FilterThread, this));
+}
+
+void DepthFilter::Stop()
+{
+    if(!filterThread)
+        return;
+
+    running.assignValue(false);
+    filterThread->join();
+    delete filterThread;
+    filterThread = 0;
+
+    workers.join_all();
+    banded.assignValue(false);
+    delete barrier;
+    barrier = 0;
+}
+
+void DepthFilter::WorkerThread(int band)
+{
+    ThreadPolicies::Apply("filter", "dfilter-" + boost::lexical_cast<std::string>(band));
+
+    while(true)
+    {
+        barrier->wait();
+        if(stopping)
+            break;
+        RunStages(band);
+        barrier->wait();
+    }
+}
+
+void DepthFilter::FilterThread()
+{
+    ThreadPolicies::Apply("filter", "dfilter-0");
+
+    int nextSeq = -1;
+
+    while(running.getValue())
+    {
+        int latest = depth.latestIndex->getValue();
+        if(latest == -1 || latest < nextSeq)
+        {
+            boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+            continue;
+        }
+
+        //The filter is a live stage: always take the newest frame
+        int64_t timestamp;
+        if(!depth.Snapshot((uint8_t *)&raw[0], nextSeq, timestamp))
+            continue;
+
+        boost::posix_time::ptime begin = boost::posix_time::microsec_clock::local_time();
+
+        int outSeq = latestDepthIndex.getValue() + 1;
+        int outIndex = outSeq % numBuffers;
+        FrameSlotBeginWrite(slots[outIndex]);
+        Process(&raw[0], (uint16_t *)frameBuffers[outIndex].first);
+        frameBuffers[outIndex].second = timestamp;
+        FrameSlotEndWrite(slots[outIndex], outSeq);
+        latestDepthIndex++;
+
+        float ms = (boost::posix_time::microsec_clock::local_time() - begin).total_microseconds() / 1000.0f;
+        float smoothed = latency.getValue();
+        latency.assignValue(smoothed == 0 ? ms : smoothed * 0.9f + ms * 0.1f);
+
+        nextSeq++;
+    }
+
+    //Release the workers waiting for the next frame
+    stopping = true;
+    barrier->wait();
+}
+
+void DepthFilter::Process(const uint16_t * input, uint16_t * output)
+{
+    this->input = input;
+    this->output = output;
+
+    if(banded.getValue())
+    {
+        barrier->wait();
+        RunStages(0);
+        barrier->wait();
+    }
+    else
+    {
+        int threads = numThreads;
+        numThreads = 1;
+        RunStages(0);
+        numThreads = threads;
+    }
+}
+
+void DepthFilter::RunStages(int band)
+{
+    const int y0 = height * band / numThreads;
+    const int y1 = height * (band + 1) / numThreads;
+    const int x0 = width * band / numThreads;
+    const int x1 = width * (band + 1) / numThreads;
+    boost::barrier * sync = numThreads > 1 ? barrier : 0;
+
+    if(config.temporal)
+        Temporal(y0, y1);
+    else
+        memcpy(&work[y0 * width], input + y0 * width, (y1 - y0) * width * 2);
+
+    if(sync)
+        sync->wait();
+
+    if(config.holes)
+    {
+        FillRows(y0, y1);
+        if(sync)
+            sync->wait();
+        FillColumns(x0, x1);
+        if(sync)
+            sync->wait();
+    }
+
+    if(config.spatial)
+        Spatial(y0, y1);
+    else
+        memcpy(output + y0 * width, &work[y0 * width], (y1 - y0) * width * 2);
+}
+
+void DepthFilter::Temporal(int y0, int y1)
+{
+    const int begin = y0 * width;
+    const int end = y1 * width;
+    const uint16_t base = config.motionBase;
+    const int shift = config.motionShift;
+    int i = begin;
+
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i vbase = _mm_set1_epi16(base);
+    const __m128i valpha = _mm_set1_epi16(alphaQ15);
+
+    for(; i + 8 <= end; i += 8)
+    {
+        __m128i in = _mm_loadu_si128((const __m128i *)(input + i));
+        __m128i s = _mm_loadu_si128((const __m128i *)(&state[i]));
+
+        //|in - s| and the motion threshold, all unsigned 16 bit
+        __m128i absdiff = _mm_or_si128(_mm_subs_epu16(in, s), _mm_subs_epu16(s, in));
+        __m128i threshold = _mm_adds_epu16(_mm_srl_epi16(s, _mm_cvtsi32_si128(shift)), vbase);
+        __m128i motion = _mm_xor_si128(_mm_cmpeq_epi16(_mm_subs_epu16(absdiff, threshold), zero), _mm_set1_epi16(-1));
+        __m128i reset = _mm_or_si128(motion, _mm_cmpeq_epi16(s, zero));
+        __m128i invalid = _mm_cmpeq_epi16(in, zero);
+
+        //s + alpha * (in - s); depth fits in int16 so the difference does too
+        __m128i diff = _mm_sub_epi16(in, s);
+        __m128i step = _mm_slli_epi16(_mm_mulhi_epi16(diff, valpha), 1);
+        __m128i smoothed = _mm_add_epi16(s, step);
+
+        __m128i next = _mm_or_si128(_mm_and_si128(reset, in), _mm_andnot_si128(reset, smoothed));
+        next = _mm_or_si128(_mm_and_si128(invalid, s), _mm_andnot_si128(invalid, next));
+
+        _mm_storeu_si128((__m128i *)(&state[i]), next);
+        _mm_storeu_si128((__m128i *)(&work[i]), _mm_andnot_si128(invalid, next));
+    }
+#endif
+
+    for(; i < end; i++)
+    {
+        uint16_t in = input[i];
+        uint16_t s = state[i];
+
+        //Invalid input keeps the state for when the pixel comes back
+        if(in == 0)
+        {
+            work[i] = 0;
+            continue;
+        }
+
+        int diff = int(in) - int(s);
+        int threshold = (s >> shift) + base;
+        if(s == 0 || std::abs(diff) > threshold)
+            s = in;
+        else
+            s = uint16_t(s + ((diff * alphaQ15) >> 16) * 2);
+
+        state[i] = s;
+        work[i] = s;
+    }
+}
+
+void DepthFilter::FillRows(int y0, int y1)
+{
+    for(int y = y0; y < y1; y++)
+    {
+        uint16_t * row = &work[y * width];
+        int x = 0;
+        while(x < width)
+        {
+            if(row[x])
+            {
+                x++;
+                continue;
+            }
+
+            int start = x;
+            while(x < width && !row[x])
+                x++;
+
+            //Only bounded runs are filled, with the farther side so foreground does not grow
+            if(start > 0 && x < width && x - start <= config.maxHole)
+            {
+                uint16_t fill = std::max(row[start - 1], row[x]);
+                for(int i = start; i < x; i++)
+                    row[i] = fill;
+            }
+        }
+    }
+}
+
+void DepthFilter::FillColumns(int x0, int x1)
+{
+    for(int x = x0; x < x1; x++)
+    {
+        int y = 0;
+        while(y < height)
+        {
+            if(work[y * width + x])
+            {
+                y++;
+                continue;
+            }
+
+            int start = y;
+            while(y < height && !work[y * width + x])
+                y++;
+
+            if(start > 0 && y < height && y - start <= config.maxHole)
+            {
+                uint16_t fill = std::max(work[(start - 1) * width + x], work[y * width + x]);
+                for(int i = start; i < y; i++)
+                    work[i * width + x] = fill;
+            }
+        }
+    }
+}
+
+//Edge-preserving 3x3 mean of one pixel, clamped at the borders
+static uint16_t SpatialPixel(const uint16_t * const rows[3], int x, int width, int base, int shift)
+{
+    const int c = rows[1][x];
+    if(c == 0)
+        return 0;
+
+    //Neighbours across a depth edge (or invalid ones) are left out of the mean
+    const int threshold = (c >> shift) + base;
+    const int xl = std::max(0, x - 1);
+    const int xr = std::min(width - 1, x + 1);
+    int sum = 0;
+    int count = 0;
+    for(int r = 0; r < 3; r++)
+    {
+        const int v[3] = { rows[r][xl], rows[r][x], rows[r][xr] };
+        for(int k = 0; k < 3; k++)
+        {
+            const int use = v[k] != 0 && std::abs(v[k] - c) <= threshold;
+            sum += use * v[k];
+            count += use;
+        }
+    }
+    return uint16_t(sum / count);
+}
+
+void DepthFilter::Spatial(int y0, int y1)
+{
+    const int base = config.edgeBase;
+    const int shift = config.edgeShift;
+
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi16(1);
+    const __m128i vbase = _mm_set1_epi16(base);
+    const __m128i vshift = _mm_cvtsi32_si128(shift);
+    const __m128i bias32 = _mm_set1_epi32(32768);
+    const __m128i bias16 = _mm_set1_epi16(-32768);
+#endif
+
+    for(int y = y0; y < y1; y++)
+    {
+        const uint16_t * const rows[3] = { &work[std::max(0, y - 1) * width],
+                                           &work[y * width],
+                                           &work[std::min(height - 1, y + 1) * width] };
+        uint16_t * out = output + y * width;
+
+        out[0] = SpatialPixel(rows, 0, width, base, shift);
+        int x = 1;
+
+#ifdef __SSE2__
+        //Interior pixels 8 at a time, the same masks as SpatialPixel; the sums need 32 bits (9 * 65535)
+        for(; x + 9 <= width; x += 8)
+        {
+            __m128i c = _mm_loadu_si128((const __m128i *)(rows[1] + x));
+            __m128i threshold = _mm_adds_epu16(_mm_srl_epi16(c, vshift), vbase);
+            __m128i sumLo = zero;
+            __m128i sumHi = zero;
+            __m128i count = zero;
+
+            for(int r = 0; r < 3; r++)
+            {
+                for(int k = -1; k <= 1; k++)
+                {
+                    __m128i v = _mm_loadu_si128((const __m128i *)(rows[r] + x + k));
+                    __m128i absdiff = _mm_or_si128(_mm_subs_epu16(v, c), _mm_subs_epu16(c, v));
+                    __m128i within = _mm_cmpeq_epi16(_mm_subs_epu16(absdiff, threshold), zero);
+                    __m128i use = _mm_andnot_si128(_mm_cmpeq_epi16(v, zero), within);
+                    __m128i used = _mm_and_si128(use, v);
+                    sumLo = _mm_add_epi32(sumLo, _mm_unpacklo_epi16(used, zero));
+                    sumHi = _mm_add_epi32(sumHi, _mm_unpackhi_epi16(used, zero));
+                    count = _mm_sub_epi16(count, use);
+                }
+            }
+
+            //sum < 2^24 and count <= 9, so the float quotient truncates to the integer one
+            count = _mm_max_epi16(count, one);
+            __m128 meanLo = _mm_div_ps(_mm_cvtepi32_ps(sumLo), _mm_cvtepi32_ps(_mm_unpacklo_epi16(count, zero)));
+            __m128 meanHi = _mm_div_ps(_mm_cvtepi32_ps(sumHi), _mm_cvtepi32_ps(_mm_unpackhi_epi16(count, zero)));
+
+            //Unsigned 16 bit pack through the signed one
+            __m128i mean = _mm_packs_epi32(_mm_sub_epi32(_mm_cvttps_epi32(meanLo), bias32),
+                                           _mm_sub_epi32(_mm_cvttps_epi32(meanHi), bias32));
+            mean = _mm_xor_si128(mean, bias16);
+
+            _mm_storeu_si128((__m128i *)(out + x), _mm_andnot_si128(_mm_cmpeq_epi16(c, zero), mean));
+        }
+#endif
+
+        for(; x < width; x++)
+            out[x] = SpatialPixel(rows, x, width, base, shift);
+    }
+}
@@ -0,0 +1,126 @@
+/*
+ * DepthFilter.h
+ *
+ *  Created on: 19/10 2026
+ *      Author: Baobei Xu
+ */
+
+#ifndef DEPTHFILTER_H_
+#define DEPTHFILTER_H_
+
+#include <vector>
+#include <stdint.h>
+#include <boost/thread.hpp>
+#include <boost/thread/barrier.hpp>
+
+#include "ThreadMutexObject.h"
+#include "FrameSource.h"
+
+struct DepthFilterConfig
+{
+    DepthFilterConfig()
+     : enabled(false),
+       temporal(true),
+       holes(true),
+       spatial(true),
+       alpha(0.4f),
+       motionBase(20),
+       motionShift(5),
+       maxHole(16),
+       edgeBase(10),
+       edgeShift(6),
+       threads(0),
+       preview(true),
+       record(false)
+    {}
+
+    bool enabled;
+
+    /////////////////////////////////////Stages
+    bool temporal;
+    bool holes;
+    bool spatial;
+
+    /////////////////////////////////////Temporal: state += alpha * (depth - state), reset where the change exceeds
+    /// motionBase + (state >> motionShift) mm
+    float alpha;
+    int motionBase;
+    int motionShift;
+
+    /////////////////////////////////////Hole filling: longest zero run (pixels) that is filled, row then column
+    int maxHole;
+
+    /////////////////////////////////////Spatial: 3x3 mean over neighbours within edgeBase + (depth >> edgeShift) mm
+    int edgeBase;
+    int edgeShift;
+
+    /////////////////////////////////////Worker threads including the dispatcher, 0 picks half the cores
+    int threads;
+
+    /////////////////////////////////////Use the filtered stream for the preview / the recorders
+    bool preview;
+    bool record;
+};
+
+/////////////////////////////////////Optional stage between the Kinect depth ring and its consumers. Each frame is
+/// split into bands processed by a fixed set of threads; the result goes to a ring of its own.
+class DepthFilter
+{
+public:
+    DepthFilter(const DepthFilterConfig & config, const FrameSource & depth);
+    virtual ~DepthFilter();
+
+    void Start();
+    void Stop();
+
+    /////////////////////////////////////Filter one frame synchronously (worker threads are used if started)
+    void Process(const uint16_t * input, uint16_t * output);
+
+    /////////////////////////////////////Filtered ring, same layout and timestamps as the raw one
+    static const int numBuffers = 30;
+    ThreadMutexObject<int> latestDepthIndex;
+    std::pair<uint8_t *, int64_t> frameBuffers[numBuffers];
+    FrameSlot slots[numBuffers];
+    FrameSource Output();
+
+    /////////////////////////////////////Smoothed processing time of one frame
+    float LatencyMs();
+
+private:
+    const DepthFilterConfig config;
+    const FrameSource depth;
+    const int width, height;
+    int numThreads;
+    int16_t alphaQ15;
+
+    std::vector<uint16_t> state;
+    std::vector<uint16_t> work;
+    std::vector<uint16_t> raw;
+    const uint16_t * input;
+    uint16_t * output;
+
+    boost::thread * filterThread;
+    boost::thread_group workers;
+    boost::barrier * barrier;
+    ThreadMutexObject<bool> running;
+
+    /////////////////////////////////////Set by the dispatcher before its last barrier round, so it and the workers
+    /// always agree whether a round is a frame or the end; the barrier orders the accesses
+    bool stopping;
+
+    /////////////////////////////////////Set before the dispatcher and workers start and cleared once they are joined;
+    /// Process only splits the frame over the barrier while it is set
+    ThreadMutexObject<bool> banded;
+    ThreadMutexObject<float> latency;
+
+    void FilterThread();
+    void WorkerThread(int band);
+    void RunStages(int band);
+
+    void Temporal(int y0, int y1);
+    void FillRows(int y0, int y1);
+    void FillColumns(int x0, int x1);
+    void Spatial(int y0, int y1);
+};
+
+#endif /* DEPTHFILTER_H_ */
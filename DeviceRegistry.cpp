@@ -0,0 +1,235 @@
+#include "DeviceRegistry.h"
+
+#include <deque>
+#include <boost/lexical_cast.hpp>
+
+DeviceRegistry::DeviceRegistry()
+{
+}
+
+DeviceRegistry::~DeviceRegistry()
+{
+    StopAll();
+
+    for(size_t i = 0; i < flirs.size(); i++)
+        delete flirs[i];
+    for(size_t i = 0; i < kinects.size(); i++)
+        delete kinects[i];
+}
+
+void DeviceRegistry::OpenKinect(const std::string & uri, OpenNI2Interface ** result)
+{
+    OpenNI2Interface * kinect = new OpenNI2Interface(512, 424, 30, uri);
+    if(!kinect->ok())
+    {
+        std::cout << "Open Kinect " << (uri.empty() ? "(any)" : uri) << " failed: " << kinect->error() << std::endl;
+        delete kinect;
+        kinect = 0;
+    }
+    *result = kinect;
+}
+
+void DeviceRegistry::OpenFlir(const std::string & id, EbusFlirInterface ** result)
+{
+    EbusFlirInterface * flir = new EbusFlirInterface(id);
+    if(!flir->IsOK())
+    {
+        std::cout << "Open FLIR " << id << " failed" << std::endl;
+        delete flir;
+        flir = 0;
+    }
+    *result = flir;
+}
+
+int DeviceRegistry::OpenKinects(const std::vector<std::string> & uris)
+{
+    std::vector<OpenNI2Interface *> opened(uris.size(), (OpenNI2Interface *)0);
+
+    boost::thread_group threads;
+    for(size_t i = 0; i < uris.size(); i++)
+        threads.create_thread(boost::bind(&DeviceRegistry::OpenKinect, uris[i], &opened[i]));
+    threads.join_all();
+
+    int count = 0;
+    for(size_t i = 0; i < opened.size(); i++)
+    {
+        if(opened[i])
+        {
+            AddKinect(opened[i]);
+            count++;
+        }
+    }
+    return count;
+}
+
+int DeviceRegistry::OpenFlirs(const std::vector<std::string> & ids)
+{
+    std::vector<EbusFlirInterface *> opened(ids.size(), (EbusFlirInterface *)0);
+
+    boost::thread_group threads;
+    for(size_t i = 0; i < ids.size(); i++)
+        threads.create_thread(boost::bind(&DeviceRegistry::OpenFlir, ids[i], &opened[i]));
+    threads.join_all();
+
+    int count = 0;
+    for(size_t i = 0; i < opened.size(); i++)
+    {
+        if(opened[i])
+        {
+            AddFlir(opened[i]);
+            count++;
+        }
+    }
+    return count;
+}
+
+void DeviceRegistry::AddKinect(OpenNI2Interface * kinect)
+{
+    boost::mutex::scoped_lock lock(mutex);
+    kinects.push_back(kinect);
+}
+
+void DeviceRegistry::AddFlir(EbusFlirInterface * flir)
+{
+    boost::mutex::scoped_lock lock(mutex);
+    flirs.push_back(flir);
+}
+
+int DeviceRegistry::NumKinects()
+{
+    boost::mutex::scoped_lock lock(mutex);
+    return kinects.size();
+}
+
+int DeviceRegistry::NumFlirs()
+{
+    boost::mutex::scoped_lock lock(mutex);
+    return flirs.size();
+}
+
+OpenNI2Interface * DeviceRegistry::Kinect(int i)
+{
+    boost::mutex::scoped_lock lock(mutex);
+    return i >= 0 && i < int(kinects.size()) ? kinects[i] : 0;
+}
+
+EbusFlirInterface * DeviceRegistry::Flir(int i)
+{
+    boost::mutex::scoped_lock lock(mutex);
+    return i >= 0 && i < int(flirs.size()) ? flirs[i] : 0;
+}
+
+std::string DeviceRegistry::KinectName(int i)
+{
+    return "kinect" + boost::lexical_cast<std::string>(i);
+}
+
+std::string DeviceRegistry::FlirName(int i)
+{
+    return "flir" + boost::lexical_cast<std::string>(i);
+}
+
+bool DeviceRegistry::SingleRig()
+{
+    return NumKinects() <= 1 && NumFlirs() <= 1;
+}
+
+std::string DeviceRegistry::StreamName(const std::string & device, const std::string & stream)
+{
+    return SingleRig() ? stream : device + "/" + stream;
+}
+
+void DeviceRegistry::StartKinect(OpenNI2Interface * kinect, bool * started)
+{
+    *started = kinect->Start();
+    if(!*started)
+        std::cout << "Start Kinect " << kinect->Uri() << " failed: " << kinect->error() << std::endl;
+}
+
+bool DeviceRegistry::StartAll()
+{
+    //OpenNI blocks in stream start for a while per device, so each gets a thread; the FLIRs only spawn theirs
+    std::deque<bool> started(kinects.size(), false);
+
+    boost::thread_group threads;
+    for(size_t i = 0; i < kinects.size(); i++)
+        threads.create_thread(boost::bind(&DeviceRegistry::StartKinect, kinects[i], &started[i]));
+
+    for(size_t i = 0; i < flirs.size(); i++)
+        flirs[i]->StartAcquire();
+
+    threads.join_all();
+
+    bool ok = true;
+    for(size_t i = 0; i < started.size(); i++)
+        ok = ok && started[i];
+    for(size_t i = 0; i < flirs.size(); i++)
+        ok = ok && flirs[i]->isAcquisition.getValue();
+    return ok;
+}
+
+void DeviceRegistry::StopAll()
+{
+    for(size_t i = 0; i < flirs.size(); i++)
+        flirs[i]->StopAcquire();
+    for(size_t i = 0; i < kinects.size(); i++)
+        kinects[i]->Stop();
+}
+
+FrameSource DeviceRegistry::Depth(int i)
+{
+    OpenNI2Interface * kinect = Kinect(i);
+    return FrameSource(StreamName(KinectName(i), "depth"),
+                       kinect->frameBuffers,
+                       OpenNI2Interface::numBuffers,
+                       kinect->latestDepthIndex,
+                       kinect->width,
+                       kinect->height,
+                       CV_16UC1,
+                       false,
+                       kinect->depthSlots,
+                       FRAME_DEPTH_MM);
+}
+
+FrameSource DeviceRegistry::Infrared(int i)
+{
+    OpenNI2Interface * kinect = Kinect(i);
+    return FrameSource(StreamName(KinectName(i), "infrared"),
+                       kinect->infraredFrameBuffers,
+                       OpenNI2Interface::numBuffers,
+                       kinect->latestInfraredIndex,
+                       kinect->width,
+                       kinect->height,
+                       CV_16UC1,
+                       false,
+                       kinect->infraredSlots);
+}
+
+FrameSource DeviceRegistry::Thermal(int i)
+{
+    EbusFlirInterface * flir = Flir(i);
+    return FrameSource(StreamName(FlirName(i), "thermal"),
+                       flir->frameBuffers,
+                       EbusFlirInterface::numBuffers,
+                       flir->latestThermalIndex,
+                       flir->width,
+                       flir->height,
+                       CV_8UC1,
+                       true,
+                       flir->slots);
+}
+
+std::vector<FrameSource> DeviceRegistry::Sources()
+{
+    std::vector<FrameSource> sources;
+
+    for(int i = 0; i < NumKinects(); i++)
+    {
+        sources.push_back(Depth(i));
+        sources.push_back(Infrared(i));
+    }
+    for(int i = 0; i < NumFlirs(); i++)
+        sources.push_back(Thermal(i));
+
+    return sources;
+}
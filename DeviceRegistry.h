@@ -0,0 +1,73 @@
+/*
+ * DeviceRegistry.h
+ *
+ *  Created on: 19/10 2026
+ *      Author: Baobei Xu
+ */
+
+#ifndef DEVICEREGISTRY_H_
+#define DEVICEREGISTRY_H_
+
+#include <string>
+#include <vector>
+#include <boost/thread.hpp>
+
+#include "FlirKinect/OpenNI2Interface.h"
+#include "FlirKinect/EbusFlirInterface.h"
+#include "FrameSource.h"
+
+/////////////////////////////////////All sensors of one capture process. Every device keeps its own acquisition
+/// thread (FLIR) or callbacks (OpenNI) and its own rings, so nothing is shared between devices on the frame path;
+/// the registry only opens, starts and stops them (concurrently) and names their streams.
+class DeviceRegistry
+{
+public:
+    DeviceRegistry();
+    virtual ~DeviceRegistry();
+
+    /////////////////////////////////////Open devices in parallel, one thread each. An empty URI is any Kinect, FLIR
+    /// IDs are MAC, IP, serial or user defined name. Devices that fail are reported and left out; returns how
+    /// many opened.
+    int OpenKinects(const std::vector<std::string> & uris);
+    int OpenFlirs(const std::vector<std::string> & ids);
+
+    /////////////////////////////////////Take ownership of a device opened elsewhere (the FLIR picked in the GUI)
+    void AddKinect(OpenNI2Interface * kinect);
+    void AddFlir(EbusFlirInterface * flir);
+
+    int NumKinects();
+    int NumFlirs();
+    OpenNI2Interface * Kinect(int i);
+    EbusFlirInterface * Flir(int i);
+
+    /////////////////////////////////////"kinect0", "flir1", ... in the order the devices were given
+    std::string KinectName(int i);
+    std::string FlirName(int i);
+
+    /////////////////////////////////////One Kinect and one FLIR: streams keep the single-rig names and folders
+    bool SingleRig();
+
+    /////////////////////////////////////Start / stop every device at the same time
+    bool StartAll();
+    void StopAll();
+
+    /////////////////////////////////////Rings named "depth", "infrared", "thermal" on a single rig and
+    /// "<device>/<stream>" otherwise, which is also the output folder of the stream
+    FrameSource Depth(int i);
+    FrameSource Infrared(int i);
+    FrameSource Thermal(int i);
+    std::vector<FrameSource> Sources();
+
+private:
+    boost::mutex mutex;
+    std::vector<OpenNI2Interface *> kinects;
+    std::vector<EbusFlirInterface *> flirs;
+
+    std::string StreamName(const std::string & device, const std::string & stream);
+
+    static void OpenKinect(const std::string & uri, OpenNI2Interface ** result);
+    static void OpenFlir(const std::string & id, EbusFlirInterface ** result);
+    static void StartKinect(OpenNI2Interface * kinect, bool * started);
+};
+
+#endif /* DEVICEREGISTRY_H_ */
@@ -0,0 +1,16 @@
+#include "DisplayConvert.h"
+
+void Normalize(const cv::Mat & src, cv::Mat & dst, float scale)
+{
+    int width = src.rows;
+    int height = src.cols;
+    for(int i = 0; i < width; ++i)
+    {
+        const unsigned short * s = src.ptr<unsigned short>(i);
+        unsigned char * d = dst.ptr<unsigned char>(i);
+        for(int j = 0; j < height; ++j)
+        {
+            d[j] = float(s[j]) * scale / 65535.0 * 255.0;
+        }
+    }
+}
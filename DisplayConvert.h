@@ -0,0 +1,17 @@
+/*
+ * DisplayConvert.h
+ *
+ *  Created on: 19/10 2026
+ *      Author: Baobei Xu
+ */
+
+#ifndef DISPLAYCONVERT_H_
+#define DISPLAYCONVERT_H_
+
+#include <opencv2/opencv.hpp>
+
+/////////////////////////////////////16 bit to 8 bit for display as the live view draws it: value * scale / 65535 * 255,
+/// without saturation. dst must already have the size of src.
+void Normalize(const cv::Mat & src, cv::Mat & dst, float scale);
+
+#endif /* DISPLAYCONVERT_H_ */
@@ -1,10 +1,12 @@
 #include "EbusFlirInterface.h"
+#include "../ThreadPolicy.h"
 #include <libusb.h>
 
 using namespace std;
 
 EbusFlirInterface::EbusFlirInterface(int BUFFER_COUNT, int width, int height)
-    :lDeviceInfo(NULL),
+    :lSystem(NULL),
+     lDeviceInfo(NULL),
      lDevice(NULL),
      lStream(NULL),
      initSuccessful(false),
@@ -25,18 +27,71 @@ EbusFlirInterface::EbusFlirInterface(int BUFFER_COUNT, int width, int height)
     }
 
     if(lResult.IsOK())
+        Init(BUFFER_COUNT);
+}
+
+EbusFlirInterface::EbusFlirInterface(const std::string &deviceID, int BUFFER_COUNT, int width, int height)
+    :lSystem(NULL),
+     lDeviceInfo(NULL),
+     lDevice(NULL),
+     lStream(NULL),
+     initSuccessful(false),
+     lSize(0),
+     acquisitionThread(0),
+     width(width),
+     height(height)
+{
+    isAcquisition.assignValue(false);
+
+    if(FindDevice(deviceID).IsOK())
+        Init(BUFFER_COUNT);
+}
+
+std::vector<std::string> EbusFlirInterface::EnumerateDevices()
+{
+    std::vector<std::string> ids;
+
+    PvSystem lSystem;
+    lSystem.Find();
+    for(uint32_t i = 0; i < lSystem.GetInterfaceCount(); i++)
     {
-        lResult = Connect2Device();
+        const PvInterface *lInterface = lSystem.GetInterface(i);
+        for(uint32_t j = 0; j < lInterface->GetDeviceCount(); j++)
+        {
+            const PvDeviceInfoGEV *lDeviceGEV = dynamic_cast<const PvDeviceInfoGEV *>( lInterface->GetDeviceInfo(j) );
+            if(lDeviceGEV)
+                ids.push_back(lDeviceGEV->GetMACAddress().GetAscii());
+            else
+                ids.push_back(lInterface->GetDeviceInfo(j)->GetConnectionID().GetAscii());
+        }
+    }
+
+    return ids;
+}
+
+PvResult EbusFlirInterface::FindDevice( const std::string &aDeviceID )
+{
+    lSystem = new PvSystem;
+    PvResult lResult = lSystem->FindDevice( aDeviceID.c_str(), &lDeviceInfo );
+    if ( !lResult.IsOK() )
+    {
+        cout << "Device " << aDeviceID << " not found." << endl;
+    }
+    return lResult;
+}
+
+void EbusFlirInterface::Init(int BUFFER_COUNT)
+{
+    PvResult lResult = Connect2Device();
+    if(lResult.IsOK())
+    {
+        lResult = OpenStream();
         if(lResult.IsOK())
         {
-            lResult = OpenStream();
-            if(lResult.IsOK())
-            {
-                ConfigureStream();
-                CreateStreamBuffers(BUFFER_COUNT);
-                initSuccessful = true;
-                latestThermalIndex.assignValue(-1);
-            }
+            ConfigureStream();
+            CreateStreamBuffers(BUFFER_COUNT);
+            initSuccessful = true;
+            latestThermalIndex.assignValue(-1);
         }
     }
 
@@ -83,7 +138,10 @@ void EbusFlirInterface::StopAcquire()
 EbusFlirInterface::~EbusFlirInterface()
 {
     if(!initSuccessful)
+    {
+        delete lSystem;
         return;
+    }
     StopAcquire();
     FreeStreamBuffers();
     // Close the stream
@@ -101,6 +159,7 @@ EbusFlirInterface::~EbusFlirInterface()
             free(frameBuffers[i].first);
         }
     }
+    delete lSystem;
 }
 
 PvResult EbusFlirInterface::SelectDevice( PvDeviceFinderWnd *aDeviceFinderWnd )
@@ -212,6 +271,8 @@ void EbusFlirInterface::FreeStreamBuffers()
 
 void EbusFlirInterface::AcquireThread()
 {
+    ThreadPolicies::Apply("acquire", "flir-acquire");
+
     // Get device parameters need to control streaming
     PvGenParameterArray *lDeviceParams = lDevice->GetParameters();
 
@@ -224,6 +285,8 @@ void EbusFlirInterface::AcquireThread()
     lDevice->StreamEnable();
     lStart->Execute();
 
+    uint64_t lastBlockID = 0;
+
     // Acquire images until the user instructs us to stop.
     while ( isAcquisition.getValue() )
     {
@@ -234,6 +297,12 @@ void EbusFlirInterface::AcquireThread()
         PvResult lResult = lStream->RetrieveBuffer( &lBuffer, &lOperationResult, 1000 );
         if ( lResult.IsOK() )
         {
+            // Block IDs wrap (16 bit on GEV 1.x), only count forward gaps
+            uint64_t lBlockID = lBuffer->GetBlockID();
+            if ( lastBlockID != 0 && lBlockID > lastBlockID + 1 )
+                thermalDropped.Add( lBlockID - lastBlockID - 1 );
+            lastBlockID = lBlockID;
+
             if ( lOperationResult.IsOK() )
             {
                 PvPayloadType lType;
@@ -243,12 +312,13 @@ void EbusFlirInterface::AcquireThread()
                 if ( lType == PvPayloadTypeImage )
                 {
                     // Get buffer pointer interface.
-                    int bufferIndex = (latestThermalIndex.getValue() + 1) % numBuffers;
+                    int sequence = latestThermalIndex.getValue() + 1;
+                    int bufferIndex = sequence % numBuffers;
+                    FrameSlotBeginWrite(slots[bufferIndex]);
                     memcpy(frameBuffers[bufferIndex].first, lBuffer->GetDataPointer(), lSize);
-                    boost::posix_time::ptime time = boost::posix_time::microsec_clock::local_time();
-                    boost::posix_time::time_duration duration(time.time_of_day());
 //                    frameBuffers[bufferIndex].second = float(lBuffer->GetTimestamp()) / 69513.0 * 33365.0;
-                    frameBuffers[bufferIndex].second = duration.total_microseconds();
+                    frameBuffers[bufferIndex].second = SessionClock::Now();
+                    FrameSlotEndWrite(slots[bufferIndex], sequence);
                     latestThermalIndex++;
                 }
                 else
@@ -259,7 +329,8 @@ void EbusFlirInterface::AcquireThread()
             }
             else
             {
-                // Non OK operational result
+                // Non OK operational result, the frame is lost
+                thermalDropped.Add();
                 cout << lOperationResult.GetCodeString().GetAscii() << "\n";
             }
 
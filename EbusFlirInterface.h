@@ -12,6 +12,9 @@
 #include <PvStreamU3V.h>
 #include <PvBuffer.h>
 #include <PvDeviceFinderWnd.h>
+#include <PvSystem.h>
+#include <PvInterface.h>
+#include <PvDeviceInfoGEV.h>
 #include <PvGenBrowserWnd.h>
 #include <qstring.h>
 #include <limits>
@@ -19,17 +22,23 @@
 #include <iostream>
 
 #include "../ThreadMutexObject.h"
+#include "../SessionClock.h"
+#include "../Telemetry.h"
+#include "../FrameSlot.h"
 
 #ifndef EBUSFLIRINTERFACE_H_
 #define EBUSFLIRINTERFACE_H_
 
 #include <list>
+#include <string>
+#include <vector>
 typedef std::list<PvBuffer *> BufferList;
 
 class EbusFlirInterface
 {
 private:
     /////////////////////////////////////lDevice, lStream and lBufferList
+    PvSystem *lSystem; //////////////////Owns lDeviceInfo when the device was found by ID
     const PvDeviceInfo *lDeviceInfo;
     PvDevice *lDevice;
     PvStream *lStream ;
@@ -41,6 +50,12 @@ private:
     /////////////////////////////////////Select device through GUI
     PvResult SelectDevice( PvDeviceFinderWnd *aDeviceFinderWnd );
 
+    /////////////////////////////////////Select device by MAC, IP, serial number or user defined name
+    PvResult FindDevice( const std::string &aDeviceID );
+
+    /////////////////////////////////////Connect, open and configure the stream of the selected device
+    void Init(int BUFFER_COUNT);
+
     /////////////////////////////////////Connect device
     PvResult Connect2Device();
 
@@ -63,6 +78,12 @@ public:
     /// open and config stream and create pvbuffer.
     EbusFlirInterface(int BUFFER_COUNT = 16, int width = 640, int height = 512);
 
+    /////////////////////////////////////Same without the GUI, for the device with the given ID
+    EbusFlirInterface(const std::string &deviceID, int BUFFER_COUNT = 16, int width = 640, int height = 512);
+
+    /////////////////////////////////////IDs (MAC addresses) of all reachable eBUS devices
+    static std::vector<std::string> EnumerateDevices();
+
     /////////////////////////////////////Close the device and release all memory.
     ~EbusFlirInterface();
 
@@ -78,6 +99,10 @@ public:
     static const int numBuffers = 100;
     ThreadMutexObject<int> latestThermalIndex;
     std::pair<uint8_t *, int64_t> frameBuffers[numBuffers];
+    FrameSlot slots[numBuffers];
+
+    /////////////////////////////////////Frames lost on the wire: incomplete buffers and gaps in the GigE block ID
+    TelemetryCounter thermalDropped;
 
 
     /////////////////////////////////////Check the init successful
@@ -0,0 +1,26 @@
+# - Find the FFmpeg libraries used for the lossless FFV1 / Matroska archive
+#
+# If the FFMPEG_ROOT environment variable is defined, it will be used as base path.
+# The following standard variables get defined:
+#  FFmpeg_FOUND:        true if libavformat, libavcodec and libavutil were found
+#  FFmpeg_INCLUDE_DIRS: the directory that contains libavformat/avformat.h
+#  FFmpeg_LIBRARIES:    the libraries
+
+FIND_PATH(FFmpeg_INCLUDE_DIRS
+  NAMES libavformat/avformat.h
+  PATHS
+    ENV FFMPEG_ROOT
+  PATH_SUFFIXES
+    include
+    include/ffmpeg
+)
+
+FIND_LIBRARY(FFmpeg_AVFORMAT_LIBRARY NAMES avformat PATHS ENV FFMPEG_ROOT PATH_SUFFIXES lib)
+FIND_LIBRARY(FFmpeg_AVCODEC_LIBRARY NAMES avcodec PATHS ENV FFMPEG_ROOT PATH_SUFFIXES lib)
+FIND_LIBRARY(FFmpeg_AVUTIL_LIBRARY NAMES avutil PATHS ENV FFMPEG_ROOT PATH_SUFFIXES lib)
+
+SET(FFmpeg_LIBRARIES ${FFmpeg_AVFORMAT_LIBRARY} ${FFmpeg_AVCODEC_LIBRARY} ${FFmpeg_AVUTIL_LIBRARY})
+
+INCLUDE(FindPackageHandleStandardArgs)
+FIND_PACKAGE_HANDLE_STANDARD_ARGS(FFmpeg FOUND_VAR FFmpeg_FOUND
+  REQUIRED_VARS FFmpeg_AVFORMAT_LIBRARY FFmpeg_AVCODEC_LIBRARY FFmpeg_AVUTIL_LIBRARY FFmpeg_INCLUDE_DIRS)
@@ -0,0 +1,104 @@
+/*
+ * FrameBus.h
+ *
+ *  Created on: 19/10 2026
+ *      Author: Baobei Xu
+ */
+
+#ifndef FRAMEBUS_H_
+#define FRAMEBUS_H_
+
+#include <stdint.h>
+
+/////////////////////////////////////Published layout of the shared-memory frame bus. The segment is
+///
+///   FrameBusHeader | stream 0 slots | stream 1 slots | ...
+///
+/// and every slot is a FrameBusSlot followed by the frame data, slotStride bytes apart. One capture process
+/// writes, any number of processes map it read-only. Slots use a generation counter (seqlock): it is odd while
+/// the slot is written, so a reader copies, re-reads the generation and retries if it moved. The writer never
+/// waits for readers.
+
+#define FRAMEBUS_MAGIC 0x53554246u /* "FBUS" */
+#define FRAMEBUS_VERSION 3
+#define FRAMEBUS_MAX_STREAMS 64 /* room for every stream of a multi-device rig plus the processed outputs */
+#define FRAMEBUS_NAME_LENGTH 32
+#define FRAMEBUS_DEFAULT_NAME "/flirkinect"
+
+enum FrameBusFormat
+{
+    FRAMEBUS_FORMAT_GRAY8 = 1,
+    FRAMEBUS_FORMAT_GRAY16 = 2,
+    FRAMEBUS_FORMAT_DEPTH16 = 3 /* millimetres, 0 = invalid */
+};
+
+enum FrameBusFlags
+{
+    FRAMEBUS_FLAG_FLIPPED = 1 /* rows are stored bottom-up */
+};
+
+struct FrameBusSlot
+{
+    uint64_t generation;
+    uint64_t sequence;
+    int64_t timestamp;
+    uint64_t reserved;
+};
+
+struct FrameBusStream
+{
+    char name[FRAMEBUS_NAME_LENGTH];
+    uint32_t format;
+    uint32_t flags;
+    uint32_t width;
+    uint32_t height;
+    uint32_t bytesPerPixel;
+    uint32_t numSlots;
+    uint64_t frameSize;
+    uint64_t slotStride;
+    uint64_t slotsOffset;
+
+    /////////////////////////////////////Sequence of the newest complete frame + 1, 0 while none was published
+    uint64_t published;
+};
+
+struct FrameBusHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t headerSize;
+    uint32_t numStreams;
+    uint64_t segmentSize;
+
+    /////////////////////////////////////Pid of the capture process, 0 once it has closed the bus
+    int32_t writerPid;
+    uint32_t reserved;
+
+    /////////////////////////////////////Incremented by the writer about every 100 ms
+    uint64_t heartbeat;
+
+    FrameBusStream streams[FRAMEBUS_MAX_STREAMS];
+};
+
+/////////////////////////////////////Ordered accessors for the fields shared between processes
+inline uint64_t FrameBusLoad(const uint64_t * value)
+{
+    return __atomic_load_n(value, __ATOMIC_ACQUIRE);
+}
+
+inline void FrameBusStore(uint64_t * value, uint64_t newValue)
+{
+    __atomic_store_n(value, newValue, __ATOMIC_RELEASE);
+}
+
+inline FrameBusSlot * FrameBusSlotAt(void * segment, const FrameBusStream & stream, uint64_t sequence)
+{
+    return (FrameBusSlot *)((uint8_t *)segment + stream.slotsOffset + (sequence % stream.numSlots) * stream.slotStride);
+}
+
+inline uint8_t * FrameBusData(FrameBusSlot * slot)
+{
+    return (uint8_t *)(slot + 1);
+}
+
+#endif /* FRAMEBUS_H_ */
@@ -0,0 +1,187 @@
+#include "FrameBusClient.h"
+
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+FrameBusClient::FrameBusClient()
+ : fd(-1),
+   segment(MAP_FAILED),
+   segmentSize(0),
+   header(0)
+{
+}
+
+FrameBusClient::~FrameBusClient()
+{
+    Detach();
+}
+
+bool FrameBusClient::Attach(const std::string & name)
+{
+    Detach();
+
+    fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if(fd < 0)
+        return false;
+
+    struct stat info;
+    if(fstat(fd, &info) != 0 || size_t(info.st_size) < sizeof(FrameBusHeader))
+    {
+        Detach();
+        return false;
+    }
+
+    segmentSize = info.st_size;
+    segment = mmap(0, segmentSize, PROT_READ, MAP_SHARED, fd, 0);
+    if(segment == MAP_FAILED)
+    {
+        Detach();
+        return false;
+    }
+
+    header = (FrameBusHeader *)segment;
+    if(__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != FRAMEBUS_MAGIC ||
+       header->version != FRAMEBUS_VERSION ||
+       header->segmentSize > segmentSize)
+    {
+        Detach();
+        return false;
+    }
+
+    return true;
+}
+
+void FrameBusClient::Detach()
+{
+    header = 0;
+
+    if(segment != MAP_FAILED)
+    {
+        munmap(segment, segmentSize);
+        segment = MAP_FAILED;
+    }
+
+    if(fd >= 0)
+    {
+        close(fd);
+        fd = -1;
+    }
+}
+
+bool FrameBusClient::IsAttached()
+{
+    return header != 0;
+}
+
+bool FrameBusClient::WriterAlive()
+{
+    if(!header)
+        return false;
+
+    int32_t pid = __atomic_load_n(&header->writerPid, __ATOMIC_ACQUIRE);
+    return pid != 0 && kill(pid, 0) == 0;
+}
+
+int FrameBusClient::NumStreams()
+{
+    return header ? header->numStreams : 0;
+}
+
+const FrameBusStream * FrameBusClient::Stream(int stream)
+{
+    if(!header || stream < 0 || stream >= int(header->numStreams))
+        return 0;
+    return &header->streams[stream];
+}
+
+int FrameBusClient::FindStream(const std::string & name)
+{
+    for(int i = 0; i < NumStreams(); i++)
+    {
+        if(name == header->streams[i].name)
+            return i;
+    }
+    return -1;
+}
+
+FrameBusSlot * FrameBusClient::Slot(int stream, int64_t sequence)
+{
+    return FrameBusSlotAt(segment, header->streams[stream], sequence);
+}
+
+int64_t FrameBusClient::LatestSequence(int stream)
+{
+    const FrameBusStream * info = Stream(stream);
+    if(!info)
+        return -1;
+    return int64_t(FrameBusLoad(&info->published)) - 1;
+}
+
+bool FrameBusClient::ReadSequence(int stream, int64_t sequence, uint8_t * data, int64_t & timestamp)
+{
+    const FrameBusStream * info = Stream(stream);
+    if(!info || sequence < 0)
+        return false;
+
+    FrameBusSlot * slot = Slot(stream, sequence);
+
+    //A few attempts are enough: the writer needs a whole frame period to come back to this slot
+    for(int attempt = 0; attempt < 4; attempt++)
+    {
+        uint64_t before = FrameBusLoad(&slot->generation);
+        if(before & 1)
+            continue;
+
+        memcpy(data, FrameBusData(slot), info->frameSize);
+        int64_t slotSequence = slot->sequence;
+        timestamp = slot->timestamp;
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if(FrameBusLoad(&slot->generation) != before)
+            continue;
+
+        return slotSequence == sequence;
+    }
+    return false;
+}
+
+bool FrameBusClient::ReadLatest(int stream, uint8_t * data, int64_t & sequence, int64_t & timestamp)
+{
+    for(int attempt = 0; attempt < 4; attempt++)
+    {
+        sequence = LatestSequence(stream);
+        if(sequence < 0)
+            return false;
+        if(ReadSequence(stream, sequence, data, timestamp))
+            return true;
+    }
+    return false;
+}
+
+const uint8_t * FrameBusClient::Peek(int stream, int64_t & sequence, int64_t & timestamp, uint64_t & generation)
+{
+    sequence = LatestSequence(stream);
+    if(sequence < 0)
+        return 0;
+
+    FrameBusSlot * slot = Slot(stream, sequence);
+    generation = FrameBusLoad(&slot->generation);
+    if(generation & 1 || int64_t(slot->sequence) != sequence)
+        return 0;
+
+    timestamp = slot->timestamp;
+    return FrameBusData(slot);
+}
+
+bool FrameBusClient::Validate(int stream, int64_t sequence, uint64_t generation)
+{
+    if(!Stream(stream))
+        return false;
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return FrameBusLoad(&Slot(stream, sequence)->generation) == generation;
+}
@@ -0,0 +1,59 @@
+/*
+ * FrameBusClient.h
+ *
+ *  Created on: 19/10 2026
+ *      Author: Baobei Xu
+ */
+
+#ifndef FRAMEBUSCLIENT_H_
+#define FRAMEBUSCLIENT_H_
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "FrameBus.h"
+
+/////////////////////////////////////Read-only consumer of the shared-memory frame bus. Only depends on POSIX, so
+/// analysis processes can link it without Qt, OpenNI or eBUS. A slow reader only ever misses frames.
+class FrameBusClient
+{
+public:
+    FrameBusClient();
+    virtual ~FrameBusClient();
+
+    /////////////////////////////////////Map the segment read-only; fails until the capture process has published it
+    bool Attach(const std::string & name = FRAMEBUS_DEFAULT_NAME);
+    void Detach();
+    bool IsAttached();
+
+    /////////////////////////////////////False once the capture process closed the bus (re-attach to follow a restart)
+    bool WriterAlive();
+
+    int NumStreams();
+    const FrameBusStream * Stream(int stream);
+    int FindStream(const std::string & name);
+
+    /////////////////////////////////////Sequence of the newest frame, -1 if none yet
+    int64_t LatestSequence(int stream);
+
+    /////////////////////////////////////Copy the newest frame (or a given one, if still held by the bus) into data,
+    /// which must hold Stream(stream)->frameSize bytes. Returns false if nothing consistent could be read.
+    bool ReadLatest(int stream, uint8_t * data, int64_t & sequence, int64_t & timestamp);
+    bool ReadSequence(int stream, int64_t sequence, uint8_t * data, int64_t & timestamp);
+
+    /////////////////////////////////////Zero-copy access: Peek returns the slot data in place and the generation
+    /// it was read at; after processing, Validate tells whether the writer touched the slot meanwhile.
+    const uint8_t * Peek(int stream, int64_t & sequence, int64_t & timestamp, uint64_t & generation);
+    bool Validate(int stream, int64_t sequence, uint64_t generation);
+
+private:
+    int fd;
+    void * segment;
+    size_t segmentSize;
+    FrameBusHeader * header;
+
+    FrameBusSlot * Slot(int stream, int64_t sequence);
+};
+
+#endif /* FRAMEBUSCLIENT_H_ */
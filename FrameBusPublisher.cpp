@@ -0,0 +1,210 @@
+#include "FrameBusPublisher.h"
+#include "ThreadPolicy.h"
+
+#include <cstring>
+#include <cerrno>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+FrameBusPublisher::FrameBusPublisher(const std::string & name, const std::vector<FrameSource> & sources, int numSlots)
+ : name(name),
+   sources(sources),
+   numSlots(numSlots),
+   fd(-1),
+   segment(MAP_FAILED),
+   segmentSize(0),
+   header(0),
+   publishThread(0)
+{
+    publishing.assignValue(false);
+
+    //Streams that do not fit the layout are left out, never truncated, and named so the rig can be fixed
+    this->sources.clear();
+    for(size_t i = 0; i < sources.size(); i++)
+    {
+        if(sources[i].name.size() >= FRAMEBUS_NAME_LENGTH)
+            std::cout << "Frame bus " << name << ": stream " << sources[i].name << " not exported, name longer than "
+                      << FRAMEBUS_NAME_LENGTH - 1 << " characters" << std::endl;
+        else if(this->sources.size() == FRAMEBUS_MAX_STREAMS)
+            std::cout << "Frame bus " << name << ": stream " << sources[i].name << " not exported, more than "
+                      << FRAMEBUS_MAX_STREAMS << " streams" << std::endl;
+        else
+            this->sources.push_back(sources[i]);
+    }
+}
+
+FrameBusPublisher::~FrameBusPublisher()
+{
+    Stop();
+}
+
+bool FrameBusPublisher::Start()
+{
+    if(publishThread)
+        return true;
+
+    //Slots are 64 byte aligned so frame data starts on a cache line
+    size_t offset = (sizeof(FrameBusHeader) + 63) & ~size_t(63);
+    std::vector<size_t> strides(sources.size());
+    for(size_t i = 0; i < sources.size(); i++)
+    {
+        strides[i] = (sizeof(FrameBusSlot) + sources[i].FrameSize() + 63) & ~size_t(63);
+        offset += strides[i] * numSlots;
+    }
+    segmentSize = offset;
+
+    //A stale segment from a crashed run is replaced, attached readers keep their old mapping
+    shm_unlink(name.c_str());
+    fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if(fd < 0 || ftruncate(fd, segmentSize) != 0)
+    {
+        std::cout << "Cannot create frame bus " << name << ": " << strerror(errno) << std::endl;
+        Stop();
+        return false;
+    }
+
+    segment = mmap(0, segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(segment == MAP_FAILED)
+    {
+        std::cout << "Cannot map frame bus " << name << ": " << strerror(errno) << std::endl;
+        Stop();
+        return false;
+    }
+
+    memset(segment, 0, segmentSize);
+    header = (FrameBusHeader *)segment;
+    header->version = FRAMEBUS_VERSION;
+    header->headerSize = sizeof(FrameBusHeader);
+    header->numStreams = sources.size();
+    header->segmentSize = segmentSize;
+    header->writerPid = getpid();
+
+    offset = (sizeof(FrameBusHeader) + 63) & ~size_t(63);
+    for(size_t i = 0; i < sources.size(); i++)
+    {
+        FrameBusStream & stream = header->streams[i];
+        strncpy(stream.name, sources[i].name.c_str(), FRAMEBUS_NAME_LENGTH - 1);
+        stream.bytesPerPixel = CV_ELEM_SIZE(sources[i].type);
+        stream.format = stream.bytesPerPixel == 1 ? FRAMEBUS_FORMAT_GRAY8 :
+                        sources[i].pixels == FRAME_DEPTH_MM ? FRAMEBUS_FORMAT_DEPTH16 : FRAMEBUS_FORMAT_GRAY16;
+        stream.flags = sources[i].flip ? FRAMEBUS_FLAG_FLIPPED : 0;
+        stream.width = sources[i].width;
+        stream.height = sources[i].height;
+        stream.numSlots = numSlots;
+        stream.frameSize = sources[i].FrameSize();
+        stream.slotStride = strides[i];
+        stream.slotsOffset = offset;
+        offset += strides[i] * numSlots;
+    }
+
+    //Readers check the magic last, so it is only set once the layout is complete
+    __atomic_store_n(&header->magic, FRAMEBUS_MAGIC, __ATOMIC_RELEASE);
+
+    publishing.assignValue(true);
+    publishThread = new boost::thread(boost::bind(&FrameBusPublisher::PublishThread, this));
+
+    std::cout << "Frame bus " << name << " published (" << segmentSize / 1024 << " KB)" << std::endl;
+    return true;
+}
+
+void FrameBusPublisher::Stop()
+{
+    if(publishThread)
+    {
+        publishing.assignValue(false);
+        publishThread->join();
+        delete publishThread;
+        publishThread = 0;
+
+        for(size_t i = 0; i < torn.size(); i++)
+        {
+            if(torn[i] > 0)
+                std::cout << "Frame bus skipped " << torn[i] << " " << sources[i].name << " frames overwritten while copying" << std::endl;
+        }
+    }
+
+    if(header)
+    {
+        header->writerPid = 0;
+        header = 0;
+    }
+
+    if(segment != MAP_FAILED)
+    {
+        munmap(segment, segmentSize);
+        segment = MAP_FAILED;
+    }
+
+    if(fd >= 0)
+    {
+        close(fd);
+        fd = -1;
+        shm_unlink(name.c_str());
+    }
+}
+
+bool FrameBusPublisher::Publish(int stream, int64_t sequence)
+{
+    FrameBusStream & info = header->streams[stream];
+    FrameBusSlot * slot = FrameBusSlotAt(segment, info, sequence);
+
+    uint64_t generation = slot->generation;
+    FrameBusStore(&slot->generation, generation + 1);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    //Straight from the capture ring into the bus slot; a frame the capture side overwrote meanwhile leaves the slot
+    //without a sequence, so no reader takes it, and is not announced
+    int64_t timestamp;
+    bool whole = sources[stream].Read(sequence, FrameBusData(slot), timestamp);
+    slot->sequence = whole ? uint64_t(sequence) : ~uint64_t(0);
+    slot->timestamp = whole ? timestamp : 0;
+
+    FrameBusStore(&slot->generation, generation + 2);
+    if(whole)
+        FrameBusStore(&info.published, sequence + 1);
+    return whole;
+}
+
+void FrameBusPublisher::PublishThread()
+{
+    ThreadPolicies::Apply("bus", "frame-bus");
+
+    std::vector<int> nextSeq(sources.size(), -1);
+    torn.assign(sources.size(), 0);
+    boost::posix_time::ptime lastBeat = boost::posix_time::microsec_clock::universal_time();
+
+    while(publishing.getValue())
+    {
+        bool idle = true;
+
+        for(size_t i = 0; i < sources.size(); i++)
+        {
+            const FrameSource & source = sources[i];
+            int latest = source.latestIndex->getValue();
+            if(latest == -1 || latest < nextSeq[i])
+                continue;
+
+            //The bus carries the live stream: lagging behind skips straight to the newest frame
+            if(nextSeq[i] == -1 || latest - nextSeq[i] >= source.numBuffers - 2)
+                nextSeq[i] = latest;
+
+            if(!Publish(i, nextSeq[i]))
+                torn[i]++;
+            nextSeq[i]++;
+            idle = false;
+        }
+
+        boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+        if((now - lastBeat).total_milliseconds() >= 100)
+        {
+            FrameBusStore(&header->heartbeat, header->heartbeat + 1);
+            lastBeat = now;
+        }
+
+        if(idle)
+            boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+    }
+}
@@ -0,0 +1,52 @@
+/*
+ * FrameBusPublisher.h
+ *
+ *  Created on: 19/10 2026
+ *      Author: Baobei Xu
+ */
+
+#ifndef FRAMEBUSPUBLISHER_H_
+#define FRAMEBUSPUBLISHER_H_
+
+#include <string>
+#include <vector>
+#include <boost/thread.hpp>
+
+#include "ThreadMutexObject.h"
+#include "FrameSource.h"
+#include "FrameBus.h"
+
+/////////////////////////////////////Capture side of the shared-memory frame bus: creates the segment and copies
+/// every new frame of the given rings straight into its bus slot, with no intermediate buffer. See FrameBus.h for
+/// the layout and FrameBusClient for readers.
+class FrameBusPublisher
+{
+public:
+    FrameBusPublisher(const std::string & name, const std::vector<FrameSource> & sources, int numSlots = 8);
+    virtual ~FrameBusPublisher();
+
+    bool Start();
+    void Stop();
+
+private:
+    const std::string name;
+    std::vector<FrameSource> sources;
+    const int numSlots;
+
+    int fd;
+    void * segment;
+    size_t segmentSize;
+    FrameBusHeader * header;
+
+    boost::thread * publishThread;
+    ThreadMutexObject<bool> publishing;
+
+    void PublishThread();
+    /////////////////////////////////////Frames per stream that were overwritten while copied and not published
+    std::vector<int> torn;
+
+    /////////////////////////////////////Copy frame sequence of a stream into its slot, false if it came out torn
+    bool Publish(int stream, int64_t sequence);
+};
+
+#endif /* FRAMEBUSPUBLISHER_H_ */
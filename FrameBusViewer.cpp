@@ -0,0 +1,101 @@
+/*
+ * FrameBusViewer.cpp
+ *
+ *  Created on: 19/10 2026
+ *      Author: Baobei Xu
+ *
+ *  Example consumer of the shared-memory frame bus: attaches to a running capture, follows its restarts and
+ *  prints rate, latency and value range of every stream once per second.
+ *
+ *      FrameBusViewer [/flirkinect]
+ */
+
+#include <iostream>
+#include <vector>
+#include <csignal>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "FrameBusClient.h"
+
+static volatile sig_atomic_t quit = 0;
+
+static void OnSignal(int)
+{
+    quit = 1;
+}
+
+static int64_t TimeOfDayMicroseconds()
+{
+    //Same clock the capture process stamps frames with
+    struct timeval now;
+    gettimeofday(&now, 0);
+    struct tm local;
+    localtime_r(&now.tv_sec, &local);
+    return (int64_t(local.tm_hour) * 3600 + local.tm_min * 60 + local.tm_sec) * 1000000 + now.tv_usec;
+}
+
+int main(int argc, char ** argv)
+{
+    std::string name = argc > 1 ? argv[1] : FRAMEBUS_DEFAULT_NAME;
+
+    signal(SIGINT, OnSignal);
+    signal(SIGTERM, OnSignal);
+
+    FrameBusClient client;
+
+    while(!quit)
+    {
+        if(!client.IsAttached() || !client.WriterAlive())
+        {
+            if(!client.Attach(name))
+            {
+                usleep(500000);
+                continue;
+            }
+            std::cout << "Attached to " << name << " with " << client.NumStreams() << " streams" << std::endl;
+        }
+
+        int numStreams = client.NumStreams();
+        std::vector<int64_t> first(numStreams, -1);
+        std::vector<std::vector<uint8_t> > frames(numStreams);
+        for(int i = 0; i < numStreams; i++)
+        {
+            frames[i].resize(client.Stream(i)->frameSize);
+            first[i] = client.LatestSequence(i);
+        }
+
+        sleep(1);
+
+        for(int i = 0; i < numStreams && client.IsAttached(); i++)
+        {
+            const FrameBusStream * stream = client.Stream(i);
+            int64_t sequence, timestamp;
+            if(!client.ReadLatest(i, &frames[i][0], sequence, timestamp))
+            {
+                std::cout << stream->name << ": no frame" << std::endl;
+                continue;
+            }
+
+            unsigned minValue = 0xFFFF, maxValue = 0;
+            size_t pixels = size_t(stream->width) * stream->height;
+            for(size_t p = 0; p < pixels; p++)
+            {
+                unsigned v = stream->bytesPerPixel == 2 ? ((uint16_t *)&frames[i][0])[p] : frames[i][p];
+                if(v && v < minValue)
+                    minValue = v;
+                if(v > maxValue)
+                    maxValue = v;
+            }
+
+            std::cout << stream->name << " " << stream->width << "x" << stream->height
+                      << " seq " << sequence
+                      << " fps " << (first[i] < 0 ? 0 : sequence - first[i])
+                      << " age " << (TimeOfDayMicroseconds() - timestamp) / 1000 << " ms"
+                      << " range " << minValue << "-" << maxValue << std::endl;
+        }
+    }
+
+    client.Detach();
+    return 0;
+}
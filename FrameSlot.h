@@ -0,0 +1,41 @@
+/*
+ * FrameSlot.h
+ *
+ *  Created on: 19/10 2026
+ *      Author: Baobei Xu
+ */
+
+#ifndef FRAMESLOT_H_
+#define FRAMESLOT_H_
+
+#include <stdint.h>
+
+/////////////////////////////////////Seqlock of one ring slot, kept next to frameBuffers[i]: the generation is odd while
+/// the capture side rewrites the slot, sequence is the latest index of the frame it holds once complete. Readers
+/// check that the generation did not move during their copy, so the capture side never waits for them (same
+/// scheme as the frame bus slots).
+struct FrameSlot
+{
+    FrameSlot()
+     : generation(0),
+       sequence(-1)
+    {}
+
+    uint64_t generation;
+    int64_t sequence;
+};
+
+/////////////////////////////////////Capture side, around the copy of frame sequence and its timestamp into the slot
+inline void FrameSlotBeginWrite(FrameSlot & slot)
+{
+    __atomic_store_n(&slot.generation, slot.generation + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+inline void FrameSlotEndWrite(FrameSlot & slot, int64_t sequence)
+{
+    __atomic_store_n(&slot.sequence, sequence, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot.generation, slot.generation + 1, __ATOMIC_RELEASE);
+}
+
+#endif /* FRAMESLOT_H_ */
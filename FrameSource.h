@@ -0,0 +1,155 @@
+/*
+ * FrameSource.h
+ *
+ *  Created on: 19/10 2026
+ *      Author: Baobei Xu
+ */
+
+#ifndef FRAMESOURCE_H_
+#define FRAMESOURCE_H_
+
+#include <string>
+#include <cstring>
+#include <stdint.h>
+#include <opencv2/opencv.hpp>
+
+#include "ThreadMutexObject.h"
+#include "FrameSlot.h"
+
+/////////////////////////////////////What the pixels of a ring hold, set where the ring is described so consumers do not
+/// guess it from the stream name
+enum FramePixels
+{
+    FRAME_GRAY = 0, /* intensities: infrared, thermal, upsampled thermal */
+    FRAME_DEPTH_MM = 1 /* depth in millimetres, 0 = invalid */
+};
+
+/////////////////////////////////////Description of one capture ring (frameBuffers + latest index) so that
+/// consumers do not need to know which interface owns it.
+struct FrameSource
+{
+    FrameSource()
+     : frameBuffers(0),
+       numBuffers(0),
+       latestIndex(0),
+       slots(0),
+       width(0),
+       height(0),
+       type(CV_8UC1),
+       flip(false),
+       pixels(FRAME_GRAY)
+    {}
+
+    FrameSource(const std::string & name,
+                std::pair<uint8_t *, int64_t> * frameBuffers,
+                int numBuffers,
+                ThreadMutexObject<int> & latestIndex,
+                int width,
+                int height,
+                int type,
+                bool flip,
+                FrameSlot * slots = 0,
+                FramePixels pixels = FRAME_GRAY)
+     : name(name),
+       frameBuffers(frameBuffers),
+       numBuffers(numBuffers),
+       latestIndex(&latestIndex),
+       slots(slots),
+       width(width),
+       height(height),
+       type(type),
+       flip(flip),
+       pixels(pixels)
+    {}
+
+    std::string name;
+    std::pair<uint8_t *, int64_t> * frameBuffers;
+    int numBuffers;
+    ThreadMutexObject<int> * latestIndex;
+
+    /////////////////////////////////////numBuffers seqlocks, 0 for a ring whose slots are read unguarded
+    FrameSlot * slots;
+
+    int width, height, type;
+
+    /////////////////////////////////////Frames of this ring are stored upside down (FLIR) and flipped on write
+    bool flip;
+
+    FramePixels pixels;
+
+    size_t FrameSize() const
+    {
+        return size_t(width) * height * CV_ELEM_SIZE(type);
+    }
+
+    bool IsValid() const
+    {
+        return frameBuffers && latestIndex;
+    }
+
+    /////////////////////////////////////Copy frame sequence and its timestamp out of the ring. False if the slot no
+    /// longer (or not yet) holds that frame, or the capture side rewrote it during the copy.
+    bool Read(int sequence, uint8_t * data, int64_t & timestamp) const
+    {
+        const int bufferIndex = sequence % numBuffers;
+
+        if(!slots)
+        {
+            memcpy(data, frameBuffers[bufferIndex].first, FrameSize());
+            timestamp = frameBuffers[bufferIndex].second;
+            return true;
+        }
+
+        FrameSlot & slot = slots[bufferIndex];
+        uint64_t before = __atomic_load_n(&slot.generation, __ATOMIC_ACQUIRE);
+        if(before & 1 || __atomic_load_n(&slot.sequence, __ATOMIC_RELAXED) != sequence)
+            return false;
+
+        memcpy(data, frameBuffers[bufferIndex].first, FrameSize());
+        timestamp = frameBuffers[bufferIndex].second;
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        return __atomic_load_n(&slot.generation, __ATOMIC_RELAXED) == before;
+    }
+
+    /////////////////////////////////////Timestamp of frame sequence without copying the frame, e.g. to pick the
+    /// nearest frame before reading it. False if the slot no longer (or not yet) holds that frame.
+    bool Timestamp(int sequence, int64_t & timestamp) const
+    {
+        const int bufferIndex = sequence % numBuffers;
+
+        if(!slots)
+        {
+            timestamp = frameBuffers[bufferIndex].second;
+            return true;
+        }
+
+        FrameSlot & slot = slots[bufferIndex];
+        uint64_t before = __atomic_load_n(&slot.generation, __ATOMIC_ACQUIRE);
+        if(before & 1 || __atomic_load_n(&slot.sequence, __ATOMIC_RELAXED) != sequence)
+            return false;
+
+        timestamp = frameBuffers[bufferIndex].second;
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        return __atomic_load_n(&slot.generation, __ATOMIC_RELAXED) == before;
+    }
+
+    /////////////////////////////////////Copy of the newest complete frame, with its sequence and timestamp. A copy
+    /// that was overwritten is retried on the then newest frame; false if there is none or every attempt lost.
+    bool Snapshot(uint8_t * data, int & sequence, int64_t & timestamp) const
+    {
+        //The capture side needs numBuffers - 1 frames to come back to the newest slot, a few attempts are plenty
+        for(int attempt = 0; attempt < 4; attempt++)
+        {
+            sequence = latestIndex->getValue();
+            if(sequence == -1)
+                return false;
+            if(Read(sequence, data, timestamp))
+                return true;
+        }
+        return false;
+    }
+};
+
+#endif /* FRAMESOURCE_H_ */
@@ -1,142 +1,697 @@
 #include "Logger.h"
 
-Logger::Logger()
-    : kinect(0),
-      flir(0),
-      lastDepthWritten(-1),
-      writeDepthThread(0),
-      lastThermalWritten(-1),
-      writeThermalThread(0),
-      singleWrite(0)
+#include <boost/filesystem.hpp>
+
+Logger::Logger(const LoggerOptions & options)
+    : flir(0),
+      options(options),
+      stripes(0),
+      backpressure(0),
+      preview(0),
+      blackBox(0),
+      roiStats(0),
+      depthFilter(0),
+      thermalFilter(0),
+      upsampler(0),
+      reconstruction(0),
+      frameBus(0),
+      snapshots(0),
+      backpressureStopThread(0),
+      kinectConnectThread(0),
+      firstFrameThread(0)
 {
+    firstKinect.assignValue(0);
     writing.assignValue(false);
+    capturing.assignValue(false);
     tfolderName = "thermal";
     dfolderName = "depth";
     ifolderName = "infrared";
+
+    if(!options.calibration.empty() && calibration.Load(options.calibration))
+        std::cout << "Calibration " << options.calibration << ": IR -> thermal RMS " << calibration.stereoError << " px" << std::endl;
 }
 
 Logger::~Logger()
 {
+    //Finishes the queued snapshots while the rings they reference still exist
+    delete snapshots;
     if(writing.getValue())
     {
-        assert(writeDepthThread && writeThermalThread);
+        assert(!writers.empty());
         StopWriting();
     }
-    if(flir)
-    {
-        delete flir;
-        flir = 0;
-    }
-    if(kinect)
-    {
-        delete kinect;
-        kinect = 0;
-    }
+    JoinBackpressureStop();
+    StopBlackBox();
+    StopAnalysis();
+    StopFrameBus();
+    StopFilter();
+    StopCapture();
+    WaitKinect();
+
+    //The registry owns every device, kinect and flir only point at the first ones
+    firstKinect.assignValue(0);
+    flir = 0;
 }
 
 bool Logger::ConnectCamera()
 {
-    flir = new EbusFlirInterface();
-    if(!flir->IsOK())
+    boost::posix_time::ptime begin = boost::posix_time::microsec_clock::local_time();
+
+    if(options.flirs.empty())
+    {
+        EbusFlirInterface * picked = new EbusFlirInterface();
+        if(!picked->IsOK())
+        {
+            delete picked;
+            return false;
+        }
+        devices.AddFlir(picked);
+    }
+    else if(devices.OpenFlirs(options.flirs) == 0)
     {
-        delete flir;
-        flir = 0;
         return false;
     }
+
+    flir = devices.Flir(0);
+
+    std::cout << "Startup: " << devices.NumFlirs() << " flir connected in "
+              << (boost::posix_time::microsec_clock::local_time() - begin).total_milliseconds()
+              << (options.flirs.empty() ? " ms (including device selection)" : " ms") << std::endl;
     return true;
 }
 
 bool Logger::ConnectKinect()
 {
-    kinect = new OpenNI2Interface();
-    if(!kinect->ok())
+    WaitKinect();
+
+    if(!getKinect())
+        ConnectKinectThread();
+
+    return getKinect() != 0;
+}
+
+void Logger::ConnectKinectAsync()
+{
+    if(getKinect() || kinectConnectThread)
+        return;
+
+    kinectConnectThread = new boost::thread(boost::bind(&Logger::ConnectKinectThread, this));
+}
+
+void Logger::WaitKinect()
+{
+    if(!kinectConnectThread)
+        return;
+
+    kinectConnectThread->join();
+    delete kinectConnectThread;
+    kinectConnectThread = 0;
+}
+
+void Logger::ConnectKinectThread()
+{
+    boost::posix_time::ptime begin = boost::posix_time::microsec_clock::local_time();
+
+    std::vector<std::string> uris = options.kinects;
+    if(uris.empty())
+        uris.push_back("");
+
+    if(devices.OpenKinects(uris) == 0)
+        return;
+
+    std::cout << "Startup: " << devices.NumKinects() << " kinect open in "
+              << (boost::posix_time::microsec_clock::local_time() - begin).total_milliseconds() << " ms" << std::endl;
+    firstKinect.assignValue(devices.Kinect(0));
+}
+
+bool Logger::StartCapture()
+{
+    if(!flir || !flir->IsOK() || !ConnectKinect())
+        return false;
+
+    if(capturing.getValue())
+        return true;
+
+    boost::posix_time::ptime begin = boost::posix_time::microsec_clock::local_time();
+    std::vector<FrameSource> sources = devices.Sources();
+    std::vector<int> from;
+    for(size_t i = 0; i < sources.size(); i++)
+        from.push_back(sources[i].latestIndex->getValue());
+
+    if(!devices.StartAll())
     {
-        delete kinect;
-        kinect = 0;
+        std::cout << "Start Capture Failed" << std::endl;
+        devices.StopAll();
         return false;
     }
+
+    std::cout << "Startup: streams started in "
+              << (boost::posix_time::microsec_clock::local_time() - begin).total_milliseconds() << " ms" << std::endl;
+
+    capturing.assignValue(true);
+    firstFrameThread = new boost::thread(boost::bind(&Logger::FirstFrameThread, this, begin, sources, from));
     return true;
 }
 
-void Logger::StartWriting()
+void Logger::StopCapture()
 {
-    if(!(flir->IsOK() && flir->isAcquisition.getValue()) || !kinect->ok())
+    if(!capturing.getValue())
         return;
 
-    if(writeDepthThread || writing.getValue() || writeThermalThread)
+    capturing.assignValue(false);
+    if(firstFrameThread)
+    {
+        firstFrameThread->join();
+        delete firstFrameThread;
+        firstFrameThread = 0;
+    }
+
+    devices.StopAll();
+}
+
+void Logger::FirstFrameThread(boost::posix_time::ptime begin, std::vector<FrameSource> sources, std::vector<int> from)
+{
+    //Polls the ring indices only, nothing on the frame path changes for this
+    std::vector<bool> seen(sources.size(), false);
+    size_t remaining = sources.size();
+
+    while(remaining > 0 && capturing.getValue())
+    {
+        int64_t elapsed = (boost::posix_time::microsec_clock::local_time() - begin).total_milliseconds();
+
+        for(size_t i = 0; i < sources.size(); i++)
+        {
+            if(seen[i] || sources[i].latestIndex->getValue() == from[i])
+                continue;
+
+            std::cout << "Startup: first " << sources[i].name << " frame after " << elapsed << " ms" << std::endl;
+            seen[i] = true;
+            remaining--;
+        }
+
+        if(elapsed > 10000)
+        {
+            for(size_t i = 0; i < sources.size(); i++)
+            {
+                if(!seen[i])
+                    std::cout << "Startup: no " << sources[i].name << " frame after 10 s" << std::endl;
+            }
+            break;
+        }
+
+        boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+    }
+}
+
+void Logger::StartWriting()
+{
+    OpenNI2Interface * kinect = getKinect();
+    if(!kinect || !(flir->IsOK() && flir->isAcquisition.getValue()) || !kinect->ok())
         return;
 
-    if(!MkDir(tfolderName) || !MkDir(dfolderName)){
-        std::cout << "make folder failed! Fuck!\n";
+    //A session the backpressure policy stopped is committed first; not under writingMutex, the stop needs it
+    JoinBackpressureStop();
+
+    boost::mutex::scoped_lock lock(writingMutex);
+    if(!writers.empty() || writing.getValue())
         return;
+
+    //One writer lane per recorded stream of every device, each into its own folder
+    std::vector<FrameSource> sources;
+    for(int i = 0; i < devices.NumKinects(); i++)
+    {
+        FrameSource depth = devices.Depth(i);
+        if(i == 0)
+        {
+            std::string name = depth.name;
+            depth = RecordDepthSource();
+            depth.name = name;
+        }
+        sources.push_back(depth);
+    }
+    for(int i = 0; options.recordInfrared && i < devices.NumKinects(); i++)
+        sources.push_back(devices.Infrared(i));
+    for(int i = 0; i < devices.NumFlirs(); i++)
+    {
+        FrameSource thermal = devices.Thermal(i);
+        if(i == 0)
+        {
+            std::string name = thermal.name;
+            thermal = RecordThermalSource();
+            thermal.name = name;
+        }
+        sources.push_back(thermal);
+    }
+
+    //The index of every stream lives in the session folder, the frames may also go to the stripe roots
+    std::vector<std::string> folders;
+    for(size_t i = 0; i < sources.size(); i++)
+    {
+        folders.push_back(sources[i].name);
+        for(size_t r = 0; r < options.stripes.roots.size(); r++)
+        {
+            if(options.stripes.roots[r] != ".")
+                folders.push_back(options.stripes.roots[r] + "/" + sources[i].name);
+        }
+    }
+    for(size_t i = 0; i < folders.size(); i++)
+    {
+        boost::system::error_code error;
+        boost::filesystem::create_directories(folders[i], error);
+        if(error){
+            std::cout << "make folder " << folders[i] << " failed: " << error.message() << std::endl;
+            return;
+        }
+    }
+
+    //The last session in this folder never committed: repair it before appending to it
+    std::vector<StreamRecovery> recovered;
+    if(options.journal.recover && SessionRecovery::NeedsRecovery("."))
+    {
+        boost::posix_time::ptime begin = boost::posix_time::microsec_clock::local_time();
+        recovered = SessionRecovery::Recover(".");
+        for(size_t i = 0; i < recovered.size(); i++)
+            std::cout << "Recovered " << recovered[i].ToString() << std::endl;
+        std::cout << "Recovery took " << (boost::posix_time::microsec_clock::local_time() - begin).total_milliseconds()
+                  << " ms" << std::endl;
+    }
+
+    metadata.Open("session.txt");
+    for(size_t i = 0; i < recovered.size(); i++)
+        metadata.Event("recovered " + recovered[i].ToString());
+    metadata.Event("session start");
+    metadata.Set("clock", "microseconds since local midnight, shared by all devices");
+    for(int i = 0; i < devices.NumKinects(); i++)
+        metadata.Set(devices.KinectName(i), devices.Kinect(i)->Uri());
+    metadata.Set("png_compression", boost::lexical_cast<std::string>(options.pngCompression));
+    metadata.Set("backpressure", options.backpressure.ToString());
+    metadata.Set("journal", options.journal.ToString());
+    metadata.Set("change_detection", options.change.ToString());
+    if(options.backpressure.action == BackpressureConfig::Spill)
+        metadata.Set("location 1", options.backpressure.spillRoot);
+    if(options.stripes.Active())
+    {
+        stripes = new StripeSet(options.stripes);
+        metadata.Set("stripes", options.stripes.ToString());
+        for(int i = 0; i < stripes->Size(); i++)
+        {
+            if(stripes->Location(i) != 0)
+                metadata.Set("location " + boost::lexical_cast<std::string>(stripes->Location(i)), stripes->Root(i));
+        }
     }
+    metadata.Set("depth", depthFilter && options.depthFilter.record ? "filtered" : "raw");
+    metadata.Set("thermal", thermalFilter && options.thermalFilter.record ? "filtered" : "raw");
+    if(thermalFilter && options.thermalFilter.fixedPattern && !options.thermalFilter.offsetPath.empty())
+        metadata.Set("thermal_offsets", options.thermalFilter.offsetPath);
+    if(calibration.IsValid())
+        metadata.Set("calibration", options.calibration);
+
+    metadata.Set("sparse_recording", options.sparse.ToString());
+    metadata.Set("preview", options.preview.ToString());
+
+    for(size_t i = 0; i < sources.size(); i++)
+    {
+        //Thermal of the first FLIR is gated by the recorded depth of the first Kinect, the pair the rig
+        //calibration belongs to
+        SparseEncoder * sparse = 0;
+        if(options.sparse.Active(sources[i].name))
+        {
+            bool calibrated = devices.NumFlirs() > 0 && sources[i].name == devices.Thermal(0).name;
+            sparse = new SparseEncoder(options.sparse, sources[i], calibrated ? sources[0] : FrameSource(), calibration);
+            metadata.Set(sources[i].name + "_sparse", sparse->Describe());
+        }
+        writers.push_back(new StreamWriter(sources[i], sources[i].name, metadata, options.journal, options.change, sparse, stripes));
+    }
+
+    backpressure = new BackpressureMonitor(options.backpressure, writers, metadata, options.pngCompression);
+    backpressure->SetStopCallback(boost::bind(&Logger::BackpressureStop, this));
 
     writing.assignValue(true);
-    writeDepthThread = new boost::thread(boost::bind(&Logger::DepthWritingThread,
-                                                            this));
-    writeThermalThread = new boost::thread(boost::bind(&Logger::ThermalWritingThread,
-                                                            this));
+    for(size_t i = 0; i < writers.size(); i++)
+        writers[i]->Start(options.pngCompression);
+    backpressure->Start();
+
+    if(options.preview.enabled)
+    {
+        preview = new PreviewRecorder(options.preview, sources, metadata);
+        preview->Start();
+    }
 }
 
 void Logger::StopWriting()
 {
+    boost::mutex::scoped_lock lock(writingMutex);
     if(!writing.getValue())
         return;
 
     writing.assignValue(false);
-    writeDepthThread->join();
-    writeThermalThread->join();
-    delete writeDepthThread;
-    writeDepthThread = 0;
-    delete writeThermalThread;
-    writeThermalThread = 0;
+    backpressure->Stop();
+    for(size_t i = 0; i < writers.size(); i++)
+        writers[i]->Stop();
+    if(preview)
+    {
+        preview->Stop();
+        metadata.Set("preview_written", boost::lexical_cast<std::string>(preview->Written()));
+        delete preview;
+        preview = 0;
+    }
+
+    for(size_t i = 0; i < writers.size(); i++)
+    {
+        metadata.Set(writers[i]->name + "_written", boost::lexical_cast<std::string>(writers[i]->Written()));
+        metadata.Set(writers[i]->name + "_dropped", boost::lexical_cast<std::string>(writers[i]->Dropped()));
+        metadata.Set(writers[i]->name + "_decimated", boost::lexical_cast<std::string>(writers[i]->Decimated()));
+        metadata.Set(writers[i]->name + "_referenced", boost::lexical_cast<std::string>(writers[i]->Referenced()));
+    }
+    if(stripes)
+    {
+        for(int i = 0; i < stripes->Size(); i++)
+        {
+            metadata.Set("stripe " + stripes->Root(i), boost::lexical_cast<std::string>(stripes->Chunks(i)) + " chunks, " +
+                         boost::lexical_cast<std::string>(int(stripes->Throughput(i))) + " MB/s");
+        }
+    }
+
+    //Every writer has made its last group durable, recovery can skip this session
+    metadata.Event("session committed");
+    if(!backpressure->SessionStopped())
+        metadata.Event("session closed");
+    metadata.Close();
+
+    delete backpressure;
+    backpressure = 0;
+    for(size_t i = 0; i < writers.size(); i++)
+        delete writers[i];
+    writers.clear();
+    delete stripes;
+    stripes = 0;
+}
+
+void Logger::BackpressureStop()
+{
+    //On the monitor thread, which StopWriting joins
+    boost::mutex::scoped_lock lock(backpressureStopMutex);
+    if(!backpressureStopThread)
+        backpressureStopThread = new boost::thread(boost::bind(&Logger::StopWriting, this));
+}
+
+void Logger::JoinBackpressureStop()
+{
+    boost::thread * stopThread;
+    {
+        boost::mutex::scoped_lock lock(backpressureStopMutex);
+        stopThread = backpressureStopThread;
+        backpressureStopThread = 0;
+    }
+
+    if(stopThread)
+    {
+        stopThread->join();
+        delete stopThread;
+    }
+}
+
+static void ReportSnapshot(const SnapshotResult & result)
+{
+    if(result.ok)
+        std::cout << "Snapshot " << result.ticket << " saved after " << result.ms << " ms" << std::endl;
+    else
+        std::cout << "Snapshot " << result.ticket << " failed: " << result.error << std::endl;
 }
 
-void Logger::SingleWriting()
+int Logger::SingleWriting()
 {
-    if(!kinect->ok() || !flir->IsOK())
+    OpenNI2Interface * kinect = getKinect();
+    if(!kinect || !kinect->ok() || !flir->IsOK())
+        return -1;
+
+    if(!snapshots)
+    {
+        snapshots = new SnapshotWriter(options.pngCompression);
+        snapshots->SetCallback(&ReportSnapshot);
+    }
+
+    //Depth first, infrared and thermal are matched to its timestamp
+    std::vector<SnapshotWriter::Stream> streams(3);
+    streams[0].source = RecordDepthSource();
+    streams[0].folder = dfolderName;
+    streams[0].prefix = "depth";
+    streams[1].source = InfraredSource();
+    streams[1].folder = ifolderName;
+    streams[1].prefix = "infrared";
+    streams[2].source = RecordThermalSource();
+    streams[2].folder = tfolderName;
+    streams[2].prefix = "thermal";
+
+    return snapshots->Request(streams);
+}
+
+bool Logger::BlackBoxEnabled()
+{
+    return options.blackBox.historySeconds > 0;
+}
+
+void Logger::StartBlackBox()
+{
+    if(!BlackBoxEnabled() || blackBox)
         return;
 
-    int latestDepth = kinect->latestDepthIndex.getValue();
-    if(latestDepth == -1)
+    OpenNI2Interface * kinect = getKinect();
+    if(!kinect || !kinect->ok() || !flir || !flir->IsOK())
+        return;
+
+    //Every stream of every device, with the first Kinect's depth as it is recorded
+    std::vector<FrameSource> sources = devices.Sources();
+    std::string name = sources[0].name;
+    sources[0] = RecordDepthSource();
+    sources[0].name = name;
+    for(size_t i = 0; i < sources.size(); i++)
     {
+        if(sources[i].name == devices.Thermal(0).name)
+        {
+            sources[i] = RecordThermalSource();
+            sources[i].name = devices.Thermal(0).name;
+        }
+    }
+
+    blackBox = new BlackBox(options.blackBox, sources);
+    blackBox->Start();
+}
+
+void Logger::StopBlackBox()
+{
+    if(!blackBox)
+        return;
+
+    delete blackBox;
+    blackBox = 0;
+}
+
+void Logger::Trigger(const std::string & reason)
+{
+    std::cout << "Trigger: " << reason << std::endl;
+    if(blackBox)
+        blackBox->Trigger(reason);
+}
+
+void Logger::StartAnalysis()
+{
+    if(options.roi.rois.empty() || roiStats)
+        return;
+
+    if(!flir || !flir->IsOK())
         return;
+
+    roiStats = new RoiStatsEngine(options.roi, ThermalSource());
+    roiStats->SetTriggerCallback(boost::bind(&Logger::Trigger, this, _1));
+    roiStats->Start();
+}
+
+void Logger::StopAnalysis()
+{
+    if(!roiStats)
+        return;
+
+    delete roiStats;
+    roiStats = 0;
+}
+
+FrameSource Logger::PreviewDepthSource()
+{
+    return DepthSource(options.depthFilter.preview);
+}
+
+FrameSource Logger::RecordDepthSource()
+{
+    return DepthSource(options.depthFilter.record);
+}
+
+FrameSource Logger::PreviewThermalSource()
+{
+    return ThermalSource(options.thermalFilter.preview);
+}
+
+FrameSource Logger::RecordThermalSource()
+{
+    return ThermalSource(options.thermalFilter.record);
+}
+
+void Logger::StartFilter()
+{
+    OpenNI2Interface * kinect = getKinect();
+    if(options.depthFilter.enabled && !depthFilter && kinect && kinect->ok())
+    {
+        depthFilter = new DepthFilter(options.depthFilter, DepthSource());
+        depthFilter->Start();
     }
-    int depthBufferIndex = latestDepth % OpenNI2Interface::numBuffers;
 
-    int latestInfrared = kinect->latestInfraredIndex.getValue();
-    if(latestInfrared == -1)
+    //Freezes land in the session log while recording
+    if(options.thermalFilter.enabled && !thermalFilter && flir && flir->IsOK())
     {
-        return;
+        thermalFilter = new ThermalFilter(options.thermalFilter, ThermalSource());
+        thermalFilter->SetEventCallback(boost::bind(&SessionMetadata::Event, &metadata, _1));
+        thermalFilter->Start();
+    }
+
+    //Filtered streams where available, the bilateral pass follows depth edges better without the noise
+    if(options.upsample.enabled && !upsampler && kinect && kinect->ok() && flir && flir->IsOK())
+    {
+        upsampler = new ThermalUpsampler(options.upsample, calibration, DepthSource(true), InfraredSource(), ThermalSource(true));
+        if(upsampler->IsValid())
+        {
+            upsampler->Start();
+        }
+        else
+        {
+            delete upsampler;
+            upsampler = 0;
+        }
+    }
+
+    //Fuses the thermal levels on the depth grid when the upsampler runs, geometry alone otherwise
+    if(options.reconstruction.enabled && !reconstruction && kinect && kinect->ok())
+    {
+        FrameSource depth = DepthSource(true);
+        CameraIntrinsics camera(365.0f, 365.0f, 255.5f, 211.5f, depth.width, depth.height);
+        if(calibration.IsValid() && calibration.irSize == cv::Size(depth.width, depth.height))
+        {
+            camera.fx = calibration.irCamera.at<double>(0, 0);
+            camera.fy = calibration.irCamera.at<double>(1, 1);
+            camera.cx = calibration.irCamera.at<double>(0, 2);
+            camera.cy = calibration.irCamera.at<double>(1, 2);
+        }
+        else
+        {
+            std::cout << "Reconstruction: no IR calibration, using nominal Kinect v2 intrinsics" << std::endl;
+        }
+
+        reconstruction = new Reconstruction(options.reconstruction, camera, depth, UpsampledThermalSource());
+        reconstruction->SetEventCallback(boost::bind(&SessionMetadata::Event, &metadata, _1));
+        reconstruction->Start();
+    }
+}
+
+void Logger::StopFilter()
+{
+    //Every consumer of the filter rings is joined before the rings are freed: the writer lanes and the preview
+    //track, the black box, the analysis, the frame bus and queued snapshots
+    StopWriting();
+    StopBlackBox();
+    StopAnalysis();
+    StopFrameBus();
+    if(snapshots)
+        snapshots->Wait();
+
+    //Reads the upsampler and filter rings, goes first
+    if(reconstruction)
+    {
+        delete reconstruction;
+        reconstruction = 0;
+    }
+
+    //Reads the filter rings
+    if(upsampler)
+    {
+        delete upsampler;
+        upsampler = 0;
+    }
+
+    if(depthFilter)
+    {
+        delete depthFilter;
+        depthFilter = 0;
     }
-    int infraredBufferIndex = latestInfrared % OpenNI2Interface::numBuffers;
 
-    int latestThermal = flir->latestThermalIndex.getValue();
-    if(latestThermal == -1)
+    if(thermalFilter)
     {
+        delete thermalFilter;
+        thermalFilter = 0;
+    }
+}
+
+bool Logger::CaptureThermalOffsets()
+{
+    if(!thermalFilter)
+        return false;
+
+    thermalFilter->CaptureOffsets();
+    return true;
+}
+
+bool Logger::ExportMesh()
+{
+    if(!reconstruction)
+        return false;
+
+    std::cout << "Exporting mesh of " << reconstruction->NumBlocks() << " blocks to " << options.reconstruction.meshPath << std::endl;
+    return reconstruction->ExportMesh(options.reconstruction.meshPath, options.roi.scale, options.roi.offset);
+}
+
+void Logger::StartFrameBus()
+{
+    if(options.frameBus.empty() || frameBus)
+        return;
+
+    OpenNI2Interface * kinect = getKinect();
+    if(!kinect || !kinect->ok() || !flir || !flir->IsOK())
         return;
+
+    std::vector<FrameSource> sources = devices.Sources();
+    if(depthFilter)
+    {
+        FrameSource filtered = depthFilter->Output();
+        filtered.name = "depth_filtered";
+        sources.push_back(filtered);
     }
-    int thermalBufferIndex = latestThermal % OpenNI2Interface::numBuffers;
+    if(thermalFilter)
+    {
+        FrameSource filtered = thermalFilter->Output();
+        filtered.name = "thermal_filtered";
+        sources.push_back(filtered);
+    }
+    if(upsampler)
+        sources.push_back(upsampler->Output());
 
-    cv::Mat depth(kinect->height, kinect->width, CV_16UC1);
-    memcpy(depth.data, kinect->frameBuffers[depthBufferIndex].first, kinect->height * kinect->width * 2);
-    cv::Mat infrared(kinect->height, kinect->width, CV_16UC1);
-    memcpy(infrared.data, kinect->infraredFrameBuffers[infraredBufferIndex].first, kinect->height * kinect->width * 2);
-    cv::Mat thermal(flir->height, flir->width, CV_8UC1);
-    memcpy(thermal.data, flir->frameBuffers[thermalBufferIndex].first, flir->height * flir->width);
-    cv::Mat fthermal;
-    cv::flip(thermal, fthermal, 0);
+    frameBus = new FrameBusPublisher(options.frameBus, sources);
+    if(!frameBus->Start())
+    {
+        delete frameBus;
+        frameBus = 0;
+    }
+}
 
-    std::string num;
-    num = boost::lexical_cast<std::string>(singleWrite);
-    std::string depthfile = dfolderName + "/depth" + num + ".png";
-    std::string infraredfile = ifolderName + "/infrared" + num + ".png";
-    std::string thermalfile = tfolderName + "/thermal" + num + ".png";
-    cv::imwrite(depthfile, depth);
-    cv::imwrite(infraredfile, infrared);
-    cv::imwrite(thermalfile, fthermal);
+void Logger::StopFrameBus()
+{
+    if(!frameBus)
+        return;
 
-    singleWrite++;
+    delete frameBus;
+    frameBus = 0;
+}
+
+RoiStatsEngine * Logger::getRoiStats()
+{
+    return roiStats;
 }
 
 void Logger::ShowGenWindow( PvGenBrowserWnd *aWnd, PvGenParameterArray *aArray, const QString &aTitle, QWidget * gui )
@@ -156,7 +711,7 @@ void Logger::ShowGenWindow( PvGenBrowserWnd *aWnd, PvGenParameterArray *aArray,
 
 OpenNI2Interface * Logger::getKinect()
 {
-    return kinect;
+    return firstKinect.getValue();
 }
 
 EbusFlirInterface * Logger::getFlir()
@@ -164,66 +719,99 @@ EbusFlirInterface * Logger::getFlir()
     return flir;
 }
 
-void Logger::ThermalWritingThread()
+DeviceRegistry & Logger::getDevices()
 {
-    while(writing.getValue())
-    {
-        int lastThermal = flir->latestThermalIndex.getValue();
-        if(lastThermal == -1)
-        {
-            continue;
-        }
+    return devices;
+}
 
-        int bufferIndex = lastThermal % EbusFlirInterface::numBuffers;
-        if(lastThermalWritten == bufferIndex)
-        {
-            continue;
-        }
+const RigCalibration & Logger::getCalibration()
+{
+    return calibration;
+}
 
-        cv::Mat1b thermal(flir->height, flir->width, flir->frameBuffers[bufferIndex].first);
-        cv::Mat fthermal;
-        cv::flip(thermal, fthermal, 0);
-        std::string imagename = "";
-        imagename = boost::lexical_cast<std::string>(flir->frameBuffers[bufferIndex].second);
-        imagename = tfolderName + "/" + imagename + ".png";
-        cv::imwrite(imagename, fthermal);
+FrameSource Logger::DepthSource(bool filtered)
+{
+    if(filtered && depthFilter)
+        return depthFilter->Output();
 
-        lastThermalWritten = bufferIndex;
-    }
+    return devices.Depth(0);
 }
 
-void Logger::DepthWritingThread()
+FrameSource Logger::InfraredSource()
 {
-    while(writing.getValue())
-    {
-        int lastDepth = kinect->latestDepthIndex.getValue();
-        if(lastDepth == -1)
-        {
-            continue;
-        }
+    return devices.Infrared(0);
+}
 
-        int bufferIndex = lastDepth % OpenNI2Interface::numBuffers;
-        if(lastDepthWritten == bufferIndex)
-        {
-            continue;
-        }
+FrameSource Logger::ThermalSource(bool filtered)
+{
+    if(filtered && thermalFilter)
+        return thermalFilter->Output();
+
+    return devices.Thermal(0);
+}
 
-        cv::Mat1w depth(kinect->height, kinect->width, (unsigned short *)kinect->frameBuffers[bufferIndex].first);
-        std::string imagename = "";
-        imagename = boost::lexical_cast<std::string>(kinect->frameBuffers[bufferIndex].second);
-        imagename = dfolderName + "/" + imagename + ".png";
-        cv::imwrite(imagename, depth);
+FrameSource Logger::UpsampledThermalSource()
+{
+    if(upsampler)
+        return upsampler->Output();
 
-        lastDepthWritten = bufferIndex;
-    }
+    return FrameSource();
 }
 
-bool Logger::MkDir(std::string dirFolder)
+bool Logger::IsCapturing()
 {
-    if(access(dirFolder.c_str(), 0) == 0)
-        return true;
-    else{
-        int flag = mkdir(dirFolder.c_str(), S_IRWXU);
-        return flag == 0;
+    return capturing.getValue();
+}
+
+bool Logger::IsWriting()
+{
+    return writing.getValue();
+}
+
+std::vector<StreamCounters> Logger::CollectTelemetry()
+{
+    std::vector<StreamCounters> counters;
+
+    for(int i = 0; i < devices.NumKinects(); i++)
+    {
+        StreamCounters depth, infrared;
+        depth.name = devices.Depth(i).name;
+        depth.captured = devices.Kinect(i)->latestDepthIndex.getValue() + 1;
+        depth.deviceDropped = devices.Kinect(i)->depthDropped.Get();
+        infrared.name = devices.Infrared(i).name;
+        infrared.captured = devices.Kinect(i)->latestInfraredIndex.getValue() + 1;
+        infrared.deviceDropped = devices.Kinect(i)->infraredDropped.Get();
+        counters.push_back(depth);
+        counters.push_back(infrared);
     }
+    for(int i = 0; i < devices.NumFlirs(); i++)
+    {
+        StreamCounters thermal;
+        thermal.name = devices.Thermal(i).name;
+        thermal.captured = devices.Flir(i)->latestThermalIndex.getValue() + 1;
+        thermal.deviceDropped = devices.Flir(i)->thermalDropped.Get();
+        counters.push_back(thermal);
+    }
+
+    for(size_t j = 0; blackBox && j < counters.size(); j++)
+        counters[j].blackBoxDropped = std::max<int64_t>(0, blackBox->Dropped(counters[j].name));
+
+    //The backpressure stop deletes the writers on a thread of its own under writingMutex; while a recording starts
+    //or stops the writer columns skip a tick rather than stalling the GUI
+    boost::mutex::scoped_try_lock lock(writingMutex);
+    for(size_t i = 0; lock.owns_lock() && i < writers.size(); i++)
+    {
+        for(size_t j = 0; j < counters.size(); j++)
+        {
+            if(counters[j].name != writers[i]->name)
+                continue;
+            counters[j].recording = true;
+            counters[j].ringDropped = writers[i]->Dropped();
+            counters[j].bytesWritten = writers[i]->BytesWritten();
+            counters[j].backlog = writers[i]->Backlog();
+            counters[j].capacity = writers[i]->Capacity();
+        }
+    }
+
+    return counters;
 }
@@ -15,46 +15,193 @@
 #include <sys/stat.h>
 #include "FlirKinect/OpenNI2Interface.h"
 #include "FlirKinect/EbusFlirInterface.h"
+#include "DeviceRegistry.h"
+#include "SessionMetadata.h"
+#include "StreamWriter.h"
+#include "Striping.h"
+#include "Backpressure.h"
+#include "BlackBox.h"
+#include "RoiStats.h"
+#include "DepthFilter.h"
+#include "ThermalFilter.h"
+#include "ThermalUpsampler.h"
+#include "Reconstruction.h"
+#include "FrameBusPublisher.h"
+#include "RigCalibration.h"
+#include "Telemetry.h"
+#include "SessionJournal.h"
+#include "ChangeDetector.h"
+#include "SparseRecording.h"
+#include "PreviewTrack.h"
+#include "Snapshot.h"
+
+/////////////////////////////////////Recording settings given on the command line
+struct LoggerOptions
+{
+    LoggerOptions()
+     : pngCompression(3),
+       recordInfrared(false)
+    {}
+
+    int pngCompression;
+
+    /////////////////////////////////////Also record the Kinect IR streams, e.g. as CalibrateRig input
+    bool recordInfrared;
+    BackpressureConfig backpressure;
+    BlackBoxConfig blackBox;
+    RoiConfig roi;
+    DepthFilterConfig depthFilter;
+    ThermalFilterConfig thermalFilter;
+    UpsampleConfig upsample;
+    ReconstructionConfig reconstruction;
+    JournalConfig journal;
+    StripeConfig stripes;
+    ChangeConfig change;
+    SparseConfig sparse;
+    PreviewConfig preview;
+
+    /////////////////////////////////////Shared-memory segment name for the frame bus, empty disables it
+    std::string frameBus;
+
+    /////////////////////////////////////Devices to open; no Kinect URI means any one Kinect, no FLIR ID means the
+    /// FLIR is picked in the eBUS device finder
+    std::vector<std::string> kinects;
+    std::vector<std::string> flirs;
+
+    /////////////////////////////////////IR / thermal calibration written by CalibrateRig, empty for none
+    std::string calibration;
+};
 
 class Logger
 {
 public:
-    Logger();
+    Logger(const LoggerOptions & options = LoggerOptions());
     virtual ~Logger();
 
     bool ConnectCamera();
 
+    /////////////////////////////////////Opens the Kinect once, later calls reuse it. ConnectKinectAsync does it in the
+    /// background so it overlaps the FLIR device picker; ConnectKinect waits for that attempt first.
     bool ConnectKinect();
+    void ConnectKinectAsync();
+
+    /////////////////////////////////////Start / stop both sensors' streams concurrently without reopening anything,
+    /// and report the time to the first frame of every stream
+    bool StartCapture();
+    void StopCapture();
 
     void StartWriting();
     void StopWriting();
-    void SingleWriting();
+
+    /////////////////////////////////////Queue a snapshot of the newest depth frame and its infrared and thermal partners
+    /// and return its ticket at once (-1 without frames); the PNGs are written in the background and reported on
+    /// the console
+    int SingleWriting();
+
+    /////////////////////////////////////Pre-trigger history of all three streams, needs a running capture
+    bool BlackBoxEnabled();
+    void StartBlackBox();
+    void StopBlackBox();
+    void Trigger(const std::string & reason);
+
+    /////////////////////////////////////Per-frame thermal ROI statistics, runs whenever ROIs are configured
+    void StartAnalysis();
+    void StopAnalysis();
+    RoiStatsEngine * getRoiStats();
 
     void ShowGenWindow( PvGenBrowserWnd *aWnd, PvGenParameterArray *aArray, const QString &aTitle, QWidget * gui );
 
+    /////////////////////////////////////First Kinect / FLIR, which the preview, depth filter and ROI analysis use
     OpenNI2Interface * getKinect();
     EbusFlirInterface * getFlir();
+    DeviceRegistry & getDevices();
+
+    /////////////////////////////////////Rig calibration from --calibration, IsValid() is false without one
+    const RigCalibration & getCalibration();
+
+    /////////////////////////////////////Capture rings of the first devices, valid once the cameras are connected
+    FrameSource DepthSource(bool filtered = false);
+    FrameSource InfraredSource();
+    FrameSource ThermalSource(bool filtered = false);
+
+    /////////////////////////////////////Depth and thermal as selected for preview / recording (raw or filtered)
+    FrameSource PreviewDepthSource();
+    FrameSource RecordDepthSource();
+    FrameSource PreviewThermalSource();
+    FrameSource RecordThermalSource();
+
+    /////////////////////////////////////Thermal on the depth grid, invalid unless the upsampler runs
+    FrameSource UpsampledThermalSource();
+
+    /////////////////////////////////////Depth and thermal filtering stages, the thermal upsampler and the 3D
+    /// reconstruction after them, run while capturing if enabled. StopFilter first stops the recording, black box,
+    /// analysis and frame bus, which may read the filter rings.
+    void StartFilter();
+    void StopFilter();
+
+    /////////////////////////////////////Capture a new thermal offset map from the next frames, the camera must look
+    /// at a uniform reference meanwhile. False without a running thermal filter.
+    bool CaptureThermalOffsets();
+
+    /////////////////////////////////////Write the reconstructed mesh to the configured PLY, temperatures in ROI units.
+    /// False without a running reconstruction.
+    bool ExportMesh();
+
+    /////////////////////////////////////Export the capture rings to other processes through shared memory
+    void StartFrameBus();
+    void StopFrameBus();
+
+    /////////////////////////////////////Snapshot of the lock-free counters of every stream for the telemetry panel,
+    /// only reads counters and never waits on the frame path. Call from the GUI thread.
+    std::vector<StreamCounters> CollectTelemetry();
+    bool IsCapturing();
+    bool IsWriting();
 
 private:
-    OpenNI2Interface * kinect;
+    DeviceRegistry devices;
+
+    /////////////////////////////////////Set by the (possibly background) Kinect connect, read through getKinect
+    ThreadMutexObject<OpenNI2Interface *> firstKinect;
     EbusFlirInterface * flir;
 
-    int lastDepthWritten;
-    boost::thread * writeDepthThread;
-    int lastThermalWritten;
-    boost::thread * writeThermalThread;
+    LoggerOptions options;
+    RigCalibration calibration;
+
+    std::vector<StreamWriter *> writers;
+    StripeSet * stripes;
+    BackpressureMonitor * backpressure;
+    PreviewRecorder * preview;
+    BlackBox * blackBox;
+    RoiStatsEngine * roiStats;
+    DepthFilter * depthFilter;
+    ThermalFilter * thermalFilter;
+    ThermalUpsampler * upsampler;
+    Reconstruction * reconstruction;
+    FrameBusPublisher * frameBus;
+    SessionMetadata metadata;
     ThreadMutexObject<bool> writing;
 
-    int singleWrite;
+    /////////////////////////////////////Serialises StartWriting / StopWriting, which the backpressure Stop action
+    /// also runs, on a thread of its own since StopWriting joins the monitor
+    boost::mutex writingMutex;
+    boost::mutex backpressureStopMutex;
+    boost::thread * backpressureStopThread;
+
+    SnapshotWriter * snapshots;
 
     std::string tfolderName;
     std::string dfolderName;
     std::string ifolderName;
 
-    void ThermalWritingThread();
-    void DepthWritingThread();
+    boost::thread * kinectConnectThread;
+    boost::thread * firstFrameThread;
+    ThreadMutexObject<bool> capturing;
 
-    bool MkDir(std::string dirFolder);
+    void WaitKinect();
+    void BackpressureStop();
+    void JoinBackpressureStop();
+    void ConnectKinectThread();
+    void FirstFrameThread(boost::posix_time::ptime begin, std::vector<FrameSource> sources, std::vector<int> from);
 };
 
 #endif /* LOGGER_H_ */
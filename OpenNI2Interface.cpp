@@ -7,22 +7,57 @@
 
 #include "OpenNI2Interface.h"
 
-OpenNI2Interface::OpenNI2Interface(int inWidth, int inHeight, int fps)
+boost::once_flag OpenNI2Interface::openniOnce = BOOST_ONCE_INIT;
+std::string OpenNI2Interface::openniError;
+
+void OpenNI2Interface::DoInitializeOpenNI()
+{
+    openni::OpenNI::initialize();
+    openniError = openni::OpenNI::getExtendedError();
+}
+
+bool OpenNI2Interface::InitializeOpenNI(std::string & error)
+{
+    //Driver enumeration is the slow part of bring-up, and OpenNI is not meant to be re-initialized per device
+    boost::call_once(openniOnce, &OpenNI2Interface::DoInitializeOpenNI);
+    error = openniError;
+    return openniError.empty();
+}
+
+std::vector<std::string> OpenNI2Interface::EnumerateDevices()
+{
+    std::vector<std::string> uris;
+
+    std::string error;
+    if(!InitializeOpenNI(error))
+        return uris;
+
+    openni::Array<openni::DeviceInfo> devices;
+    openni::OpenNI::enumerateDevices(&devices);
+    for(int i = 0; i < devices.getSize(); i++)
+        uris.push_back(devices[i].getUri());
+
+    return uris;
+}
+
+OpenNI2Interface::OpenNI2Interface(int inWidth, int inHeight, int fps, const std::string & uri)
  : width(inWidth),
    height(inHeight),
    fps(fps),
-   initSuccessful(true)
+   uri(uri),
+   depthCallback(0),
+   infraredCallback(0),
+   initSuccessful(true),
+   streaming(false)
 {
     //Setup
     openni::Status rc = openni::STATUS_OK;
 
-    const char * deviceURI = openni::ANY_DEVICE;
-
-    rc = openni::OpenNI::initialize();
+    const char * deviceURI = uri.empty() ? openni::ANY_DEVICE : uri.c_str();
 
-    std::string errorString(openni::OpenNI::getExtendedError());
+    std::string errorString;
 
-    if(errorString.length() > 0)
+    if(!InitializeOpenNI(errorString))
     {
         errorText.append(errorString);
         initSuccessful = false;
@@ -34,11 +69,12 @@ OpenNI2Interface::OpenNI2Interface(int inWidth, int inHeight, int fps)
         {
             std::cout << "Open Kinect Failed!\n";
             errorText.append(openni::OpenNI::getExtendedError());
-            openni::OpenNI::shutdown();
             initSuccessful = false;
         }
         else
         {
+            this->uri = device.getDeviceInfo().getUri();
+
             openni::VideoMode depthMode;
             depthMode.setFps(fps);
             depthMode.setPixelFormat(openni::PIXEL_FORMAT_DEPTH_1_MM);
@@ -52,8 +88,7 @@ OpenNI2Interface::OpenNI2Interface(int inWidth, int inHeight, int fps)
             rc = depthStream.create(device, openni::SENSOR_DEPTH);
             if (rc == openni::STATUS_OK)
             {
-                depthStream.setVideoMode(depthMode);
-                rc = depthStream.start();
+                rc = depthStream.setVideoMode(depthMode);
                 if (rc != openni::STATUS_OK)
                 {
                     errorText.append(openni::OpenNI::getExtendedError());
@@ -70,8 +105,7 @@ OpenNI2Interface::OpenNI2Interface(int inWidth, int inHeight, int fps)
             rc = infraredStream.create(device, openni::SENSOR_IR);
             if (rc == openni::STATUS_OK)
             {
-                infraredStream.setVideoMode(infraredMode);
-                rc = infraredStream.start();
+                rc = infraredStream.setVideoMode(infraredMode);
                 if (rc != openni::STATUS_OK)
                 {
                     errorText.append(openni::OpenNI::getExtendedError());
@@ -88,7 +122,9 @@ OpenNI2Interface::OpenNI2Interface(int inWidth, int inHeight, int fps)
             if (!depthStream.isValid() || !infraredStream.isValid())
             {
                 errorText.append(openni::OpenNI::getExtendedError());
-                openni::OpenNI::shutdown();
+                depthStream.destroy();
+                infraredStream.destroy();
+                device.close();
                 initSuccessful = false;
             }
 
@@ -107,11 +143,15 @@ OpenNI2Interface::OpenNI2Interface(int inWidth, int inHeight, int fps)
 
                 depthCallback = new DepthCallback(lastDepthTime,
                                                   latestDepthIndex,
-                                                  frameBuffers);
+                                                  frameBuffers,
+                                                  depthSlots,
+                                                  depthDropped);
 
                 infraredCallback = new InfraredCallback(lastInfraredTime,
                                                         latestInfraredIndex,
-                                                        infraredFrameBuffers);
+                                                        infraredFrameBuffers,
+                                                        infraredSlots,
+                                                        infraredDropped);
 
                 depthStream.setMirroringEnabled(false);
                 infraredStream.setMirroringEnabled(false);
@@ -127,15 +167,14 @@ OpenNI2Interface::~OpenNI2Interface()
 {
     if(initSuccessful)
     {
+        Stop();
         depthStream.removeNewFrameListener(depthCallback);
         infraredStream.removeNewFrameListener(infraredCallback);
-        depthStream.stop();
-        infraredStream.stop();
         depthStream.destroy();
         infraredStream.destroy();
 
+        //OpenNI itself stays initialized for the next interface of this process
         device.close();
-        openni::OpenNI::shutdown();
 
         for(int i = 0; i < numBuffers; i++)
         {
@@ -148,6 +187,40 @@ OpenNI2Interface::~OpenNI2Interface()
     }
 }
 
+bool OpenNI2Interface::Start()
+{
+    if(!initSuccessful)
+        return false;
+    if(streaming)
+        return true;
+
+    //Both streams or none, a half started Kinect is no use to the logger
+    if(depthStream.start() != openni::STATUS_OK)
+    {
+        errorText.append(openni::OpenNI::getExtendedError());
+        return false;
+    }
+    if(infraredStream.start() != openni::STATUS_OK)
+    {
+        errorText.append(openni::OpenNI::getExtendedError());
+        depthStream.stop();
+        return false;
+    }
+
+    streaming = true;
+    return true;
+}
+
+void OpenNI2Interface::Stop()
+{
+    if(!streaming)
+        return;
+
+    depthStream.stop();
+    infraredStream.stop();
+    streaming = false;
+}
+
 bool OpenNI2Interface::findMode(int x, int y, int fps)
 {
     const openni::Array<openni::VideoMode> & depthModes = depthStream.getSensorInfo().getSupportedVideoModes();
@@ -8,6 +8,7 @@
 #include <OpenNI.h>
 #include <PS1080.h>
 #include <string>
+#include <vector>
 #include <iostream>
 #include <algorithm>
 #include <map>
@@ -18,6 +19,10 @@
 #include <boost/date_time/posix_time/posix_time_types.hpp>
 
 #include "../ThreadMutexObject.h"
+#include "../ThreadPolicy.h"
+#include "../SessionClock.h"
+#include "../Telemetry.h"
+#include "../FrameSlot.h"
 
 #ifndef OPENNI2INTERFACE_H_
 #define OPENNI2INTERFACE_H_
@@ -26,11 +31,32 @@
 class OpenNI2Interface
 {
     public:
-        OpenNI2Interface(int inWidth = 512, int inHeight = 424, int fps = 30);
+        /////////////////////////////////////Opens the device and sets up both streams and their buffers, the
+        /// streams only run between Start and Stop so a capture restart does not repeat any of this
+        OpenNI2Interface(int inWidth = 512, int inHeight = 424, int fps = 30, const std::string & uri = "");
         virtual ~OpenNI2Interface();
 
         const int width, height, fps;
 
+        bool Start();
+        void Stop();
+        bool IsStreaming()
+        {
+            return streaming;
+        }
+
+        /////////////////////////////////////OpenNI::initialize runs once per process, later calls return its result
+        static bool InitializeOpenNI(std::string & error);
+
+        /////////////////////////////////////URIs of all connected OpenNI devices
+        static std::vector<std::string> EnumerateDevices();
+
+        /////////////////////////////////////Device this interface opened
+        const std::string & Uri()
+        {
+            return uri;
+        }
+
         void printModes();
         bool findMode(int x, int y, int fps);
 
@@ -48,43 +74,74 @@ class OpenNI2Interface
         static const int numBuffers = 100;
         ThreadMutexObject<int> latestDepthIndex;
         std::pair<uint8_t *, int64_t> frameBuffers[numBuffers];
+        FrameSlot depthSlots[numBuffers];
         ThreadMutexObject<int> latestInfraredIndex;
         std::pair<uint8_t *, int64_t> infraredFrameBuffers[numBuffers];
+        FrameSlot infraredSlots[numBuffers];
+
+        /////////////////////////////////////Frames the sensor or USB lost, from gaps in the OpenNI frame index
+        TelemetryCounter depthDropped;
+        TelemetryCounter infraredDropped;
 
         class DepthCallback : public openni::VideoStream::NewFrameListener
         {
             public:
                 DepthCallback(int64_t & lastDepthTime,
                               ThreadMutexObject<int> & latestDepthIndex,
-                              std::pair<uint8_t *, int64_t> * frameBuffers)
-                 : lastDepthTime(lastDepthTime),
+                              std::pair<uint8_t *, int64_t> * frameBuffers,
+                              FrameSlot * slots,
+                              TelemetryCounter & dropped)
+                 : policyApplied(false),
+                   lastFrameIndex(-1),
+                   lastDepthTime(lastDepthTime),
                    latestDepthIndex(latestDepthIndex),
-                   frameBuffers(frameBuffers)
+                   frameBuffers(frameBuffers),
+                   slots(slots),
+                   dropped(dropped)
                 {}
 
                 void onNewFrame(openni::VideoStream& stream)
                 {
+                    //The callback thread belongs to OpenNI, so it gets its policy on the first frame
+                    if(!policyApplied)
+                    {
+                        ThreadPolicies::Apply("callback", "ni-depth-cb");
+                        policyApplied = true;
+                    }
+
                     stream.readFrame(&frame);
 
-                    boost::posix_time::ptime time = boost::posix_time::microsec_clock::local_time();
-                    boost::posix_time::time_duration duration(time.time_of_day());
-                    lastDepthTime = duration.total_microseconds();
+                    lastDepthTime = SessionClock::Now();
+
+                    int frameIndex = frame.getFrameIndex();
+                    if(lastFrameIndex != -1 && frameIndex > lastFrameIndex + 1)
+                        dropped.Add(frameIndex - lastFrameIndex - 1);
+                    lastFrameIndex = frameIndex;
+
+                    int sequence = latestDepthIndex.getValue() + 1;
+                    int bufferIndex = sequence % numBuffers;
 
-                    int bufferIndex = (latestDepthIndex.getValue() + 1) % numBuffers;
+                    FrameSlotBeginWrite(slots[bufferIndex]);
 
                     memcpy(frameBuffers[bufferIndex].first, frame.getData(), frame.getWidth() * frame.getHeight() * 2);
 
                     frameBuffers[bufferIndex].second = lastDepthTime;
 
+                    FrameSlotEndWrite(slots[bufferIndex], sequence);
+
                     latestDepthIndex++;
                 }
 
             private:
+                bool policyApplied;
+                int lastFrameIndex;
                 openni::VideoFrameRef frame;
                 int64_t & lastDepthTime;
                 ThreadMutexObject<int> & latestDepthIndex;
 
                 std::pair<uint8_t *, int64_t> * frameBuffers;
+                FrameSlot * slots;
+                TelemetryCounter & dropped;
         };
 
         class InfraredCallback : public openni::VideoStream::NewFrameListener
@@ -92,38 +149,64 @@ class OpenNI2Interface
             public:
                 InfraredCallback(int64_t & lastInfraredTime,
                                  ThreadMutexObject<int> & latestInfraredIndex,
-                                 std::pair<uint8_t *, int64_t> * infraredFrameBuffers)
-                 : lastInfraredTime(lastInfraredTime),
+                                 std::pair<uint8_t *, int64_t> * infraredFrameBuffers,
+                                 FrameSlot * slots,
+                                 TelemetryCounter & dropped)
+                 : policyApplied(false),
+                   lastFrameIndex(-1),
+                   lastInfraredTime(lastInfraredTime),
                    latestInfraredIndex(latestInfraredIndex),
-                   infraredFrameBuffers(infraredFrameBuffers)
+                   infraredFrameBuffers(infraredFrameBuffers),
+                   slots(slots),
+                   dropped(dropped)
                 {}
 
                 void onNewFrame(openni::VideoStream& stream)
                 {
+                    //The callback thread belongs to OpenNI, so it gets its policy on the first frame
+                    if(!policyApplied)
+                    {
+                        ThreadPolicies::Apply("callback", "ni-ir-cb");
+                        policyApplied = true;
+                    }
+
                     stream.readFrame(&frame);
 
-                    boost::posix_time::ptime time = boost::posix_time::microsec_clock::local_time();
-                    boost::posix_time::time_duration duration(time.time_of_day());
-                    lastInfraredTime = duration.total_microseconds();
+                    lastInfraredTime = SessionClock::Now();
 
-                    int bufferIndex = (latestInfraredIndex.getValue() + 1) % numBuffers;
+                    int frameIndex = frame.getFrameIndex();
+                    if(lastFrameIndex != -1 && frameIndex > lastFrameIndex + 1)
+                        dropped.Add(frameIndex - lastFrameIndex - 1);
+                    lastFrameIndex = frameIndex;
 
-                    memcpy(infraredFrameBuffers[bufferIndex].first, frame.getData(), frame.getWidth() * frame.getHeight());
+                    int sequence = latestInfraredIndex.getValue() + 1;
+                    int bufferIndex = sequence % numBuffers;
+
+                    FrameSlotBeginWrite(slots[bufferIndex]);
+
+                    memcpy(infraredFrameBuffers[bufferIndex].first, frame.getData(), frame.getWidth() * frame.getHeight() * 2);
 
                     infraredFrameBuffers[bufferIndex].second = lastInfraredTime;
 
+                    FrameSlotEndWrite(slots[bufferIndex], sequence);
+
                     latestInfraredIndex++;
                 }
 
             private:
+                bool policyApplied;
+                int lastFrameIndex;
                 openni::VideoFrameRef frame;
                 int64_t & lastInfraredTime;
                 ThreadMutexObject<int> & latestInfraredIndex;
 
                 std::pair<uint8_t *, int64_t> * infraredFrameBuffers;
+                FrameSlot * slots;
+                TelemetryCounter & dropped;
         };
 
     private:
+        std::string uri;
         openni::Device device;
 
         openni::VideoStream depthStream;
@@ -139,8 +222,13 @@ class OpenNI2Interface
         InfraredCallback * infraredCallback;
 
         bool initSuccessful;
+        bool streaming;
         std::string errorText;
 
+        static boost::once_flag openniOnce;
+        static std::string openniError;
+        static void DoInitializeOpenNI();
+
         //For removing tabs from OpenNI's error messages
         static bool isTab(char c)
         {
@@ -0,0 +1,142 @@
+#include "PlaybackCache.h"
+#include "ThreadPolicy.h"
+
+#include <algorithm>
+#include <boost/lexical_cast.hpp>
+
+PlaybackCache::PlaybackCache(const Loader & loader, size_t maxBytes, int threads)
+ : loader(loader),
+   maxBytes(maxBytes),
+   bytes(0),
+   hits(0),
+   misses(0),
+   stopping(false)
+{
+    for(int i = 0; i < std::max(1, threads); i++)
+        this->threads.create_thread(boost::bind(&PlaybackCache::PrefetchThread, this, i));
+}
+
+PlaybackCache::~PlaybackCache()
+{
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        stopping = true;
+        queue.clear();
+    }
+    queued.notify_all();
+    threads.join_all();
+}
+
+cv::Mat PlaybackCache::Get(const Key & key)
+{
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        std::map<Key, Entry>::iterator it = entries.find(key);
+        if(it != entries.end())
+        {
+            lru.splice(lru.begin(), lru, it->second.position);
+            hits++;
+            return it->second.frame;
+        }
+        misses++;
+    }
+
+    //Decoded outside the lock; a prefetcher working on the same frame just loses the race
+    cv::Mat frame = loader(key);
+
+    boost::mutex::scoped_lock lock(mutex);
+    Insert(key, frame);
+    return frame;
+}
+
+bool PlaybackCache::Peek(const Key & key, cv::Mat & frame)
+{
+    boost::mutex::scoped_lock lock(mutex);
+    std::map<Key, Entry>::iterator it = entries.find(key);
+    if(it == entries.end())
+        return false;
+
+    lru.splice(lru.begin(), lru, it->second.position);
+    frame = it->second.frame;
+    return true;
+}
+
+void PlaybackCache::Prefetch(const std::vector<Key> & keys)
+{
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        queue.clear();
+        for(size_t i = 0; i < keys.size(); i++)
+        {
+            if(!entries.count(keys[i]) && !loading.count(keys[i]))
+                queue.push_back(keys[i]);
+        }
+    }
+    queued.notify_all();
+}
+
+size_t PlaybackCache::Bytes()
+{
+    boost::mutex::scoped_lock lock(mutex);
+    return bytes;
+}
+
+int PlaybackCache::Hits()
+{
+    boost::mutex::scoped_lock lock(mutex);
+    return hits;
+}
+
+int PlaybackCache::Misses()
+{
+    boost::mutex::scoped_lock lock(mutex);
+    return misses;
+}
+
+void PlaybackCache::PrefetchThread(int id)
+{
+    ThreadPolicies::Apply("playback", "playback-" + boost::lexical_cast<std::string>(id));
+
+    boost::mutex::scoped_lock lock(mutex);
+    while(true)
+    {
+        while(queue.empty() && !stopping)
+            queued.wait(lock);
+        if(stopping)
+            return;
+
+        Key key = queue.front();
+        queue.pop_front();
+        if(entries.count(key) || loading.count(key))
+            continue;
+
+        loading.insert(key);
+        lock.unlock();
+        cv::Mat frame = loader(key);
+        lock.lock();
+        loading.erase(key);
+
+        Insert(key, frame);
+    }
+}
+
+void PlaybackCache::Insert(const Key & key, const cv::Mat & frame)
+{
+    if(frame.empty() || entries.count(key))
+        return;
+
+    lru.push_front(key);
+    Entry & entry = entries[key];
+    entry.frame = frame;
+    entry.position = lru.begin();
+    bytes += frame.total() * frame.elemSize();
+
+    //The frame just inserted always stays
+    while(bytes > maxBytes && lru.size() > 1)
+    {
+        std::map<Key, Entry>::iterator it = entries.find(lru.back());
+        bytes -= it->second.frame.total() * it->second.frame.elemSize();
+        entries.erase(it);
+        lru.pop_back();
+    }
+}
@@ -0,0 +1,101 @@
+/*
+ * PlaybackCache.h
+ *
+ *  Created on: 19/10 2026
+ *      Author: Baobei Xu
+ */
+
+#ifndef PLAYBACKCACHE_H_
+#define PLAYBACKCACHE_H_
+
+#include <map>
+#include <set>
+#include <list>
+#include <deque>
+#include <vector>
+#include <utility>
+#include <opencv2/opencv.hpp>
+#include <boost/thread.hpp>
+#include <boost/function.hpp>
+
+struct PlaybackConfig
+{
+    PlaybackConfig()
+     : cacheMegabytes(1024),
+       threads(2),
+       ahead(30),
+       behind(10)
+    {}
+
+    /////////////////////////////////////Budget of decoded frames kept in memory
+    int cacheMegabytes;
+
+    /////////////////////////////////////Prefetch decoders ("playback" thread-policy role)
+    int threads;
+
+    /////////////////////////////////////Frames per stream decoded ahead of / behind the playhead; ahead is multiplied
+    /// by the play speed
+    int ahead;
+    int behind;
+};
+
+/////////////////////////////////////Decoded frames of a recorded session, least recently used evicted first once the
+/// byte budget is exceeded. Worker threads decode the frames of the prefetch queue in order; a new Prefetch replaces
+/// the queue, so a jump of the playhead drops the requests around the old position instead of finishing them first.
+class PlaybackCache
+{
+public:
+    /////////////////////////////////////Stream and frame (record) number within the stream
+    typedef std::pair<int, long> Key;
+    typedef boost::function<cv::Mat(const Key &)> Loader;
+
+    /////////////////////////////////////loader decodes one frame; it is called from several threads at once
+    PlaybackCache(const Loader & loader, size_t maxBytes, int threads);
+    virtual ~PlaybackCache();
+
+    /////////////////////////////////////Decoded frame, decoded on the calling thread on a miss
+    cv::Mat Get(const Key & key);
+
+    /////////////////////////////////////Cached frame only, false on a miss
+    bool Peek(const Key & key, cv::Mat & frame);
+
+    /////////////////////////////////////Replace the prefetch queue by keys, most wanted first. Frames that are cached or
+    /// being decoded are skipped.
+    void Prefetch(const std::vector<Key> & keys);
+
+    size_t Bytes();
+    int Hits();
+    int Misses();
+
+private:
+    struct Entry
+    {
+        cv::Mat frame;
+        std::list<Key>::iterator position;
+    };
+
+    const Loader loader;
+    const size_t maxBytes;
+
+    boost::mutex mutex;
+    boost::condition_variable queued;
+
+    /////////////////////////////////////Most recently used at the front
+    std::list<Key> lru;
+    std::map<Key, Entry> entries;
+    std::set<Key> loading;
+    std::deque<Key> queue;
+    size_t bytes;
+    int hits;
+    int misses;
+    bool stopping;
+
+    boost::thread_group threads;
+
+    void PrefetchThread(int id);
+
+    /////////////////////////////////////Needs mutex
+    void Insert(const Key & key, const cv::Mat & frame);
+};
+
+#endif /* PLAYBACKCACHE_H_ */
@@ -0,0 +1,366 @@
+#include "PlaybackWindow.h"
+#include "SessionContainer.h"
+
+#include <limits>
+#include <algorithm>
+#include <QHBoxLayout>
+#include <QVBoxLayout>
+#include <QPixmap>
+#include <QImage>
+#include <QKeySequence>
+#include <boost/bind.hpp>
+
+static std::string StreamKind(const std::string & stream)
+{
+    size_t slash = stream.rfind('/');
+    return slash == std::string::npos ? stream : stream.substr(slash + 1);
+}
+
+static bool RecordBefore(const IndexRecord & record, int64_t timestamp)
+{
+    return record.timestamp < timestamp;
+}
+
+static bool TimestampBefore(int64_t timestamp, const IndexRecord & record)
+{
+    return timestamp < record.timestamp;
+}
+
+PlaybackWindow::PlaybackWindow(const std::string & root, const PlaybackConfig & config)
+ : config(config),
+   cache(0),
+   begin(0),
+   end(0),
+   position(0),
+   playing(false),
+   speed(1),
+   timer(0)
+{
+    setWindowTitle(QString::fromStdString("Playback " + root));
+
+    //Same order as the live view: thermal, depth, infrared
+    index.Open(root);
+    std::vector<std::string> streams = index.Streams();
+    const char * kinds[] = { "thermal", "depth", "infrared" };
+    for(int k = 0; k < 3; k++)
+    {
+        for(size_t i = 0; i < streams.size(); i++)
+        {
+            Track track;
+            track.stream = streams[i];
+            if(StreamKind(track.stream) != kinds[k] || !index.Frames(track.stream, track.records) || track.records.empty())
+                continue;
+
+            track.scale = kinds[k] == std::string("depth") ? 8.0f : 1.0f;
+            track.label = 0;
+            index.Preview(track.stream, track.preview);
+            track.previewPath = index.PreviewPath(track.stream);
+            track.shown = -1;
+            track.previewShown = -1;
+            tracks.push_back(track);
+            break;
+        }
+    }
+
+    begin = std::numeric_limits<int64_t>::max();
+    end = 0;
+    for(size_t i = 0; i < tracks.size(); i++)
+    {
+        begin = std::min(begin, tracks[i].records.front().timestamp);
+        end = std::max(end, tracks[i].records.back().timestamp);
+    }
+    if(tracks.empty())
+        begin = 0;
+    position = begin;
+
+    cache = new PlaybackCache(boost::bind(&PlaybackWindow::Load, this, _1), size_t(config.cacheMegabytes) << 20, config.threads);
+
+    QVBoxLayout * wrapperLayout = new QVBoxLayout;
+    QHBoxLayout * framesLayout = new QHBoxLayout;
+    QHBoxLayout * controlLayout = new QHBoxLayout;
+
+    wrapperLayout->addLayout(framesLayout);
+    for(size_t i = 0; i < tracks.size(); i++)
+    {
+        tracks[i].label = new QLabel(QString::fromStdString(tracks[i].stream), this);
+        tracks[i].label->setAlignment(Qt::AlignCenter);
+        if(StreamKind(tracks[i].stream) == "thermal")
+            tracks[i].label->setFixedSize(640, 512);
+        else
+            tracks[i].label->setFixedSize(512, 424);
+        framesLayout->addWidget(tracks[i].label);
+    }
+
+    //Slider in milliseconds from the first frame of the session
+    slider = new QSlider(Qt::Horizontal, this);
+    slider->setRange(0, int((end - begin) / 1000));
+    slider->setPageStep(1000);
+    connect(slider, SIGNAL(valueChanged(int)), this, SLOT(SliderChanged(int)));
+    connect(slider, SIGNAL(sliderReleased()), this, SLOT(SliderReleased()));
+    wrapperLayout->addWidget(slider);
+
+    wrapperLayout->addLayout(controlLayout);
+    backButton = new QPushButton("<", this);
+    backButton->setShortcut(QKeySequence(Qt::Key_Left));
+    connect(backButton, SIGNAL(clicked()), this, SLOT(StepBack()));
+    controlLayout->addWidget(backButton);
+
+    playButton = new QPushButton("Play", this);
+    playButton->setShortcut(QKeySequence(Qt::Key_Space));
+    connect(playButton, SIGNAL(clicked()), this, SLOT(PlayPause()));
+    controlLayout->addWidget(playButton);
+
+    forwardButton = new QPushButton(">", this);
+    forwardButton->setShortcut(QKeySequence(Qt::Key_Right));
+    connect(forwardButton, SIGNAL(clicked()), this, SLOT(StepForward()));
+    controlLayout->addWidget(forwardButton);
+
+    speedBox = new QComboBox(this);
+    const float speeds[] = { 0.25f, 0.5f, 1.0f, 2.0f, 4.0f, 8.0f };
+    for(int i = 0; i < 6; i++)
+        speedBox->addItem(QString::number(speeds[i]) + "x", QVariant(double(speeds[i])));
+    speedBox->setCurrentIndex(2);
+    connect(speedBox, SIGNAL(currentIndexChanged(int)), this, SLOT(SpeedChanged(int)));
+    controlLayout->addWidget(speedBox);
+
+    statusLabel = new QLabel(this);
+    controlLayout->addWidget(statusLabel, 1);
+
+    setLayout(wrapperLayout);
+
+    lastTick = boost::posix_time::microsec_clock::local_time();
+    timer = new QTimer(this);
+    connect(timer, SIGNAL(timeout()), this, SLOT(Tick()));
+    timer->start(15);
+
+    if(!tracks.empty())
+        Seek(begin, true);
+}
+
+PlaybackWindow::~PlaybackWindow()
+{
+    //The prefetchers call Load, stop them before the tracks go
+    delete cache;
+}
+
+bool PlaybackWindow::IsOpen()
+{
+    return !tracks.empty();
+}
+
+cv::Mat PlaybackWindow::Load(const PlaybackCache::Key & key)
+{
+    const Track & track = tracks[key.first];
+    const IndexRecord & record = track.records[key.second];
+    return ContainerLoad(index.FramePath(track.stream, record), record.offset);
+}
+
+long PlaybackWindow::Nearest(const std::vector<IndexRecord> & records, int64_t timestamp)
+{
+    if(records.empty())
+        return -1;
+
+    std::vector<IndexRecord>::const_iterator it = std::lower_bound(records.begin(), records.end(), timestamp, &RecordBefore);
+    if(it == records.end())
+        return long(records.size()) - 1;
+    if(it != records.begin() && timestamp - (it - 1)->timestamp < it->timestamp - timestamp)
+        --it;
+    return long(it - records.begin());
+}
+
+void PlaybackWindow::Seek(int64_t timestamp, bool exact)
+{
+    position = std::max(begin, std::min(end, timestamp));
+
+    std::vector<long> current(tracks.size());
+    std::vector<PlaybackCache::Key> wanted;
+
+    for(size_t i = 0; i < tracks.size(); i++)
+    {
+        Track & track = tracks[i];
+        current[i] = Nearest(track.records, position);
+        if(current[i] == track.shown)
+            continue;
+
+        PlaybackCache::Key key(i, current[i]);
+        cv::Mat frame;
+        if(exact)
+            frame = cache->Get(key);
+        else if(!cache->Peek(key, frame))
+        {
+            //Not decoded yet: it goes first in the queue, the preview stands in meanwhile
+            wanted.push_back(key);
+
+            long preview = Nearest(track.preview, position);
+            if(preview >= 0 && preview != track.previewShown)
+            {
+                cv::Mat small = ContainerLoad(track.previewPath, track.preview[preview].offset);
+                if(!small.empty())
+                {
+                    Show(track, small);
+                    track.previewShown = preview;
+                }
+            }
+            continue;
+        }
+
+        //A frame that does not decode keeps the last image instead of being retried
+        if(!frame.empty())
+            Show(track, frame);
+        track.shown = current[i];
+        track.previewShown = -1;
+    }
+
+    //Nearest frames first, interleaved across streams
+    int ahead = int(config.ahead * (playing ? std::max(1.0f, speed) : 1.0f));
+    for(int d = 1; d <= std::max(ahead, config.behind); d++)
+    {
+        for(size_t i = 0; i < tracks.size(); i++)
+        {
+            if(d <= ahead && current[i] + d < long(tracks[i].records.size()))
+                wanted.push_back(PlaybackCache::Key(i, current[i] + d));
+            if(d <= config.behind && current[i] - d >= 0)
+                wanted.push_back(PlaybackCache::Key(i, current[i] - d));
+        }
+    }
+    cache->Prefetch(wanted);
+
+    slider->blockSignals(true);
+    slider->setValue(int((position - begin) / 1000));
+    slider->blockSignals(false);
+
+    UpdateStatus();
+}
+
+void PlaybackWindow::Show(Track & track, const cv::Mat & frame)
+{
+    cv::Mat gray;
+    if(frame.depth() == CV_16U)
+        frame.convertTo(gray, CV_8U, track.scale * 255.0 / 65535.0);
+    else
+        gray = frame;
+
+    cv::Mat rgb;
+    cv::cvtColor(gray, rgb, CV_GRAY2RGB);
+
+    //Previews are scaled up to the size of the full frames
+    QImage image(rgb.data, rgb.cols, rgb.rows, int(rgb.step), QImage::Format_RGB888);
+    track.label->setPixmap(QPixmap::fromImage(image).scaled(track.label->size(), Qt::KeepAspectRatio));
+}
+
+void PlaybackWindow::UpdateStatus()
+{
+    int64_t ms = position % SESSIONINDEX_DAY / 1000;
+    QString text = QString("%1:%2:%3.%4")
+                   .arg(int(ms / 3600000), 2, 10, QChar('0'))
+                   .arg(int(ms / 60000 % 60), 2, 10, QChar('0'))
+                   .arg(int(ms / 1000 % 60), 2, 10, QChar('0'))
+                   .arg(int(ms % 1000), 3, 10, QChar('0'));
+
+    for(size_t i = 0; i < tracks.size(); i++)
+    {
+        text += "   " + QString::fromStdString(tracks[i].stream) + " " + QString::number(tracks[i].shown + 1) + "/" +
+                QString::number(tracks[i].records.size());
+    }
+
+    int hits = cache->Hits();
+    int misses = cache->Misses();
+    text += "   cache " + QString::number(cache->Bytes() >> 20) + " MB";
+    if(hits + misses > 0)
+        text += ", " + QString::number(100.0 * hits / (hits + misses), 'f', 0) + "% hits";
+
+    statusLabel->setText(text);
+}
+
+void PlaybackWindow::PlayPause()
+{
+    playing = !playing;
+    if(playing && position >= end)
+        Seek(begin, true);
+
+    lastTick = boost::posix_time::microsec_clock::local_time();
+    playButton->setText(playing ? "Pause" : "Play");
+}
+
+void PlaybackWindow::StepForward()
+{
+    playing = false;
+    playButton->setText("Play");
+
+    //Next frame of whichever stream has one soonest
+    int64_t next = std::numeric_limits<int64_t>::max();
+    for(size_t i = 0; i < tracks.size(); i++)
+    {
+        std::vector<IndexRecord>::const_iterator it =
+            std::upper_bound(tracks[i].records.begin(), tracks[i].records.end(), position, &TimestampBefore);
+        if(it != tracks[i].records.end())
+            next = std::min(next, it->timestamp);
+    }
+    if(next != std::numeric_limits<int64_t>::max())
+        Seek(next, true);
+}
+
+void PlaybackWindow::StepBack()
+{
+    playing = false;
+    playButton->setText("Play");
+
+    int64_t previous = -1;
+    for(size_t i = 0; i < tracks.size(); i++)
+    {
+        std::vector<IndexRecord>::const_iterator it =
+            std::lower_bound(tracks[i].records.begin(), tracks[i].records.end(), position, &RecordBefore);
+        if(it != tracks[i].records.begin())
+            previous = std::max(previous, (it - 1)->timestamp);
+    }
+    if(previous >= 0)
+        Seek(previous, true);
+}
+
+void PlaybackWindow::SpeedChanged(int item)
+{
+    speed = float(speedBox->itemData(item).toDouble());
+}
+
+void PlaybackWindow::SliderChanged(int value)
+{
+    //Dragging shows whatever is at hand, clicks on the groove and keys wait for full frames
+    Seek(begin + int64_t(value) * 1000, !slider->isSliderDown());
+}
+
+void PlaybackWindow::SliderReleased()
+{
+    Seek(position, true);
+}
+
+void PlaybackWindow::Tick()
+{
+    boost::posix_time::ptime now = boost::posix_time::microsec_clock::local_time();
+    int64_t elapsed = (now - lastTick).total_microseconds();
+    lastTick = now;
+
+    if(playing)
+    {
+        int64_t next = position + int64_t(elapsed * speed);
+        if(next >= end)
+        {
+            next = end;
+            playing = false;
+            playButton->setText("Play");
+        }
+        Seek(next, false);
+        return;
+    }
+
+    //Stopped on previews (end of play): replace them by the full frames
+    if(slider->isSliderDown())
+        return;
+    for(size_t i = 0; i < tracks.size(); i++)
+    {
+        if(tracks[i].shown != Nearest(tracks[i].records, position))
+        {
+            Seek(position, true);
+            return;
+        }
+    }
+}
@@ -0,0 +1,97 @@
+/*
+ * PlaybackWindow.h
+ *
+ *  Created on: 19/10 2026
+ *      Author: Baobei Xu
+ */
+
+#ifndef PLAYBACKWINDOW_H_
+#define PLAYBACKWINDOW_H_
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <QWidget>
+#include <QLabel>
+#include <QSlider>
+#include <QTimer>
+#include <QComboBox>
+#include <QPushButton>
+#include <opencv2/opencv.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include "SessionIndex.h"
+#include "PlaybackCache.h"
+
+/////////////////////////////////////Plays back a recorded session folder: the first depth, infrared and thermal stream
+/// side by side on one timeline of capture time, each showing its frame nearest to the playhead. Supports scrubbing,
+/// frame steps and 0.25x - 8x play. Decoded frames come from a PlaybackCache that prefetches around the playhead.
+/// While scrubbing, or when a frame is not decoded in time, the stream's preview track (see PreviewTrack.h) is shown
+/// instead if the session has one.
+class PlaybackWindow : public QWidget
+{
+    Q_OBJECT;
+
+public:
+    PlaybackWindow(const std::string & root, const PlaybackConfig & config = PlaybackConfig());
+    virtual ~PlaybackWindow();
+
+    /////////////////////////////////////False if root holds no indexed stream
+    bool IsOpen();
+
+private slots:
+    void PlayPause();
+    void StepForward();
+    void StepBack();
+    void SpeedChanged(int item);
+    void SliderChanged(int value);
+    void SliderReleased();
+    void Tick();
+
+private:
+    struct Track
+    {
+        std::string stream;
+        float scale;
+        QLabel * label;
+        std::vector<IndexRecord> records;
+        std::vector<IndexRecord> preview;
+        std::string previewPath;
+
+        /////////////////////////////////////Record on screen, or the preview standing in for it (-1 for none)
+        long shown;
+        long previewShown;
+    };
+
+    const PlaybackConfig config;
+    SessionIndex index;
+    PlaybackCache * cache;
+    std::vector<Track> tracks;
+
+    int64_t begin;
+    int64_t end;
+    int64_t position;
+    bool playing;
+    float speed;
+    boost::posix_time::ptime lastTick;
+
+    QSlider * slider;
+    QPushButton * backButton;
+    QPushButton * playButton;
+    QPushButton * forwardButton;
+    QComboBox * speedBox;
+    QLabel * statusLabel;
+    QTimer * timer;
+
+    cv::Mat Load(const PlaybackCache::Key & key);
+
+    /////////////////////////////////////Move the playhead; exact decodes missing frames right away, otherwise cached
+    /// frames or previews are shown and the rest is left to the prefetchers
+    void Seek(int64_t timestamp, bool exact);
+    void Show(Track & track, const cv::Mat & frame);
+    void UpdateStatus();
+
+    static long Nearest(const std::vector<IndexRecord> & records, int64_t timestamp);
+};
+
+#endif /* PLAYBACKWINDOW_H_ */
@@ -0,0 +1,277 @@
+#include "PreviewTrack.h"
+#include "ThreadPolicy.h"
+
+#include <iostream>
+#include <algorithm>
+#include <boost/lexical_cast.hpp>
+#include <boost/filesystem.hpp>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static const int64_t MINUTE = 60000000;
+static const int64_t SECOND = 1000000;
+
+std::string PreviewConfig::ToString() const
+{
+    if(!enabled)
+        return "off";
+
+    std::string text = "1/" + boost::lexical_cast<std::string>(scale);
+    if(contactSheets)
+        text += ", contact sheet per minute in " + boost::lexical_cast<std::string>(sheetColumns) + " columns";
+    return text;
+}
+
+//Each output pixel is the rounded mean of a 2x2 block
+static void Halve8(const cv::Mat & src, cv::Mat & dst)
+{
+    dst.create(src.rows / 2, src.cols / 2, src.type());
+
+    for(int y = 0; y < dst.rows; y++)
+    {
+        const uint8_t * a = src.ptr<uint8_t>(2 * y);
+        const uint8_t * b = src.ptr<uint8_t>(2 * y + 1);
+        uint8_t * out = dst.ptr<uint8_t>(y);
+        int x = 0;
+
+#ifdef __SSE2__
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i ones = _mm_set1_epi16(1);
+        const __m128i two = _mm_set1_epi32(2);
+
+        //16 source columns to 8 outputs: widen, add the rows, then add column pairs with madd
+        for(; x + 8 <= dst.cols; x += 8)
+        {
+            __m128i ra = _mm_loadu_si128((const __m128i *)(a + 2 * x));
+            __m128i rb = _mm_loadu_si128((const __m128i *)(b + 2 * x));
+            __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(ra, zero), _mm_unpacklo_epi8(rb, zero));
+            __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(ra, zero), _mm_unpackhi_epi8(rb, zero));
+            lo = _mm_srli_epi32(_mm_add_epi32(_mm_madd_epi16(lo, ones), two), 2);
+            hi = _mm_srli_epi32(_mm_add_epi32(_mm_madd_epi16(hi, ones), two), 2);
+            _mm_storel_epi64((__m128i *)(out + x), _mm_packus_epi16(_mm_packs_epi32(lo, hi), zero));
+        }
+#endif
+
+        for(; x < dst.cols; x++)
+            out[x] = uint8_t((a[2 * x] + a[2 * x + 1] + b[2 * x] + b[2 * x + 1] + 2) >> 2);
+    }
+}
+
+static void Halve16(const cv::Mat & src, cv::Mat & dst)
+{
+    dst.create(src.rows / 2, src.cols / 2, src.type());
+
+    for(int y = 0; y < dst.rows; y++)
+    {
+        const uint16_t * a = src.ptr<uint16_t>(2 * y);
+        const uint16_t * b = src.ptr<uint16_t>(2 * y + 1);
+        uint16_t * out = dst.ptr<uint16_t>(y);
+        int x = 0;
+
+#ifdef __SSE2__
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i two = _mm_set1_epi32(2);
+        const __m128i bias32 = _mm_set1_epi32(32768);
+        const __m128i bias16 = _mm_set1_epi16(short(0x8000));
+
+        //8 source columns to 4 outputs in 32 bit lanes
+        for(; x + 4 <= dst.cols; x += 4)
+        {
+            __m128i ra = _mm_loadu_si128((const __m128i *)(a + 2 * x));
+            __m128i rb = _mm_loadu_si128((const __m128i *)(b + 2 * x));
+            __m128i lo = _mm_add_epi32(_mm_unpacklo_epi16(ra, zero), _mm_unpacklo_epi16(rb, zero));
+            __m128i hi = _mm_add_epi32(_mm_unpackhi_epi16(ra, zero), _mm_unpackhi_epi16(rb, zero));
+
+            //Column pairs end up in lanes 0 and 2 of each half
+            lo = _mm_shuffle_epi32(_mm_add_epi32(lo, _mm_srli_epi64(lo, 32)), _MM_SHUFFLE(3, 1, 2, 0));
+            hi = _mm_shuffle_epi32(_mm_add_epi32(hi, _mm_srli_epi64(hi, 32)), _MM_SHUFFLE(3, 1, 2, 0));
+            __m128i sum = _mm_srli_epi32(_mm_add_epi32(_mm_unpacklo_epi64(lo, hi), two), 2);
+
+            //No unsigned 32 -> 16 bit pack before SSE4.1: pack biased values as signed
+            __m128i packed = _mm_packs_epi32(_mm_sub_epi32(sum, bias32), zero);
+            _mm_storel_epi64((__m128i *)(out + x), _mm_xor_si128(packed, bias16));
+        }
+#endif
+
+        for(; x < dst.cols; x++)
+            out[x] = uint16_t((uint32_t(a[2 * x]) + a[2 * x + 1] + b[2 * x] + b[2 * x + 1] + 2) >> 2);
+    }
+}
+
+void BoxDownsample(const cv::Mat & src, int factor, cv::Mat & dst)
+{
+    cv::Mat current = src;
+    for(; factor > 1; factor /= 2)
+    {
+        cv::Mat half;
+        if(current.depth() == CV_16U)
+            Halve16(current, half);
+        else
+            Halve8(current, half);
+        current = half;
+    }
+    dst = current;
+}
+
+PreviewRecorder::PreviewRecorder(const PreviewConfig & config, const std::vector<FrameSource> & sources, SessionMetadata & metadata)
+ : config(config),
+   metadata(metadata),
+   previewThread(0)
+{
+    for(size_t i = 0; i < sources.size(); i++)
+    {
+        Track * track = new Track;
+        track->source = sources[i];
+        track->folder = sources[i].name + "/" + SESSIONINDEX_PREVIEW_FOLDER;
+        track->lastSeq = -1;
+        track->sheetMinute = -1;
+        tracks.push_back(track);
+    }
+
+    running.assignValue(false);
+    written.assignValue(0);
+}
+
+PreviewRecorder::~PreviewRecorder()
+{
+    Stop();
+    for(size_t i = 0; i < tracks.size(); i++)
+        delete tracks[i];
+}
+
+void PreviewRecorder::Start()
+{
+    if(previewThread)
+        return;
+
+    for(size_t i = 0; i < tracks.size(); i++)
+    {
+        Track & track = *tracks[i];
+        const FrameSource & source = track.source;
+
+        boost::system::error_code error;
+        boost::filesystem::create_directories(track.folder, error);
+        if(error ||
+           !track.container.Open(track.folder + "/" + CONTAINER_FILE, source.name, source.width / config.scale,
+                                 source.height / config.scale, source.type, CONTAINER_PNG) ||
+           !track.index.Open(track.folder + "/index.bin", source.name))
+        {
+            metadata.Event(source.name + " cannot open preview track in " + track.folder);
+            track.container.Close();
+            continue;
+        }
+
+        track.frame.create(source.height, source.width, source.type);
+        track.lastSeq = source.latestIndex->getValue();
+    }
+
+    running.assignValue(true);
+    previewThread = new boost::thread(boost::bind(&PreviewRecorder::PreviewThread,
+                                                  this));
+}
+
+void PreviewRecorder::Stop()
+{
+    if(!previewThread)
+        return;
+
+    running.assignValue(false);
+    previewThread->join();
+    delete previewThread;
+    previewThread = 0;
+}
+
+int PreviewRecorder::Written()
+{
+    return written.getValue();
+}
+
+void PreviewRecorder::PreviewThread()
+{
+    ThreadPolicies::Apply("preview", "preview");
+
+    std::vector<uint8_t> payload;
+
+    while(running.getValue())
+    {
+        bool idle = true;
+
+        for(size_t i = 0; i < tracks.size(); i++)
+        {
+            Track & track = *tracks[i];
+            const FrameSource & source = track.source;
+            if(!track.container.IsOpen())
+                continue;
+
+            //Always the newest frame: a preview that falls behind skips, it never makes the ring overrun
+            int latest = source.latestIndex->getValue();
+            if(latest == -1 || latest <= track.lastSeq)
+                continue;
+            idle = false;
+
+            int64_t timestamp;
+            if(!source.Snapshot(track.frame.data, latest, timestamp))
+                continue;
+            track.lastSeq = latest;
+
+            BoxDownsample(track.frame, config.scale, track.small);
+            if(source.flip)
+                cv::flip(track.small, track.flipped, 0);
+            const cv::Mat & preview = source.flip ? track.flipped : track.small;
+
+            ContainerEncode(preview, CONTAINER_PNG, 1, payload);
+            int64_t offset = track.container.Append(latest, timestamp, payload.empty() ? 0 : &payload[0], payload.size());
+            if(offset >= 0)
+                track.index.Append(latest, timestamp, offset);
+
+            if(config.contactSheets)
+                AddToSheet(track, preview, timestamp);
+
+            written++;
+        }
+
+        if(idle)
+            boost::this_thread::sleep(boost::posix_time::milliseconds(5));
+    }
+
+    for(size_t i = 0; i < tracks.size(); i++)
+    {
+        WriteSheet(*tracks[i]);
+        tracks[i]->container.Close();
+        tracks[i]->index.Close();
+    }
+}
+
+void PreviewRecorder::AddToSheet(Track & track, const cv::Mat & preview, int64_t timestamp)
+{
+    int64_t minute = timestamp / MINUTE;
+    if(!track.sheet.empty() && minute != track.sheetMinute)
+        WriteSheet(track);
+
+    const int columns = std::max(1, config.sheetColumns);
+    if(track.sheet.empty())
+    {
+        int rows = (60 + columns - 1) / columns;
+        track.sheet = cv::Mat::zeros(rows * preview.rows, columns * preview.cols, preview.type());
+        track.sheetMinute = minute;
+    }
+
+    //The last preview of each second is its tile
+    int second = int(timestamp % MINUTE / SECOND);
+    cv::Mat tile = track.sheet(cv::Rect((second % columns) * preview.cols, (second / columns) * preview.rows,
+                                        preview.cols, preview.rows));
+    preview.copyTo(tile);
+}
+
+void PreviewRecorder::WriteSheet(Track & track)
+{
+    if(track.sheet.empty())
+        return;
+
+    std::string path = track.folder + "/sheet_" + boost::lexical_cast<std::string>(track.sheetMinute * MINUTE) + ".png";
+    if(!cv::imwrite(path, track.sheet))
+        std::cout << "Could not write contact sheet " << path << std::endl;
+    track.sheet.release();
+}
@@ -0,0 +1,94 @@
+/*
+ * PreviewTrack.h
+ *
+ *  Created on: 19/10 2026
+ *      Author: Baobei Xu
+ */
+
+#ifndef PREVIEWTRACK_H_
+#define PREVIEWTRACK_H_
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <opencv2/opencv.hpp>
+#include <boost/thread.hpp>
+
+#include "ThreadMutexObject.h"
+#include "FrameSource.h"
+#include "SessionMetadata.h"
+#include "SessionIndex.h"
+#include "SessionContainer.h"
+
+struct PreviewConfig
+{
+    PreviewConfig()
+     : enabled(false),
+       scale(4),
+       contactSheets(false),
+       sheetColumns(10)
+    {}
+
+    bool enabled;
+
+    /////////////////////////////////////Preview frames are 1/scale of the full frames, a power of two
+    int scale;
+
+    /////////////////////////////////////One mosaic per stream and clock minute, a tile per second in sheetColumns
+    /// columns
+    bool contactSheets;
+    int sheetColumns;
+
+    std::string ToString() const;
+};
+
+/////////////////////////////////////Average of factor x factor pixel blocks (factor a power of two) for 8 and 16 bit
+/// single channel frames, in 2x2 halving steps with SSE2 where available. Partial blocks at the right and bottom
+/// edges are dropped.
+void BoxDownsample(const cv::Mat & src, int factor, cv::Mat & dst);
+
+/////////////////////////////////////Low-resolution preview track of every recorded stream, for browsing sessions
+/// without opening full frames: <stream folder>/preview/frames.fks (PNG payloads) and index.bin with the sequence
+/// and timestamp of the full frame each preview was made from (see SessionIndex::Preview), plus per-minute contact
+/// sheets sheet_<timestamp>.png. Reads the capture rings itself on one low-priority thread ("preview" role) and
+/// always takes the newest frame, so it skips frames rather than ever holding back the writers.
+class PreviewRecorder
+{
+public:
+    PreviewRecorder(const PreviewConfig & config, const std::vector<FrameSource> & sources, SessionMetadata & metadata);
+    virtual ~PreviewRecorder();
+
+    void Start();
+    void Stop();
+
+    int Written();
+
+private:
+    struct Track
+    {
+        FrameSource source;
+        std::string folder;
+        int lastSeq;
+        SessionIndexWriter index;
+        SessionContainerWriter container;
+        cv::Mat frame;
+        cv::Mat small;
+        cv::Mat flipped;
+        cv::Mat sheet;
+        int64_t sheetMinute;
+    };
+
+    const PreviewConfig config;
+    SessionMetadata & metadata;
+    std::vector<Track *> tracks;
+
+    boost::thread * previewThread;
+    ThreadMutexObject<bool> running;
+    ThreadMutexObject<int> written;
+
+    void PreviewThread();
+    void AddToSheet(Track & track, const cv::Mat & preview, int64_t timestamp);
+    void WriteSheet(Track & track);
+};
+
+#endif /* PREVIEWTRACK_H_ */
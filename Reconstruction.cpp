@@ -0,0 +1,472 @@
+#include "Reconstruction.h"
+#include "ThreadPolicy.h"
+
+#include <cmath>
+#include <limits>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+//Blocks per integration task, and the frames between evictions
+static const int INTEGRATE_CHUNK = 128;
+static const int EVICT_INTERVAL = 30;
+
+//A frame moving further than this from the last one is taken as a tracking failure
+static const double MAX_TRANSLATION = 0.3;
+static const double MAX_ROTATION = 0.5;
+
+//Solve A x = b for a symmetric positive definite 6x6 A (Cholesky), false if it is not
+static bool Solve6(const double A[36], const double b[6], double x[6])
+{
+    double L[36] = {0};
+    for(int i = 0; i < 6; i++)
+    {
+        for(int j = 0; j <= i; j++)
+        {
+            double sum = A[i * 6 + j];
+            for(int k = 0; k < j; k++)
+                sum -= L[i * 6 + k] * L[j * 6 + k];
+
+            if(i == j)
+            {
+                if(sum <= 1e-12)
+                    return false;
+                L[i * 6 + i] = sqrt(sum);
+            }
+            else
+            {
+                L[i * 6 + j] = sum / L[j * 6 + j];
+            }
+        }
+    }
+
+    double y[6];
+    for(int i = 0; i < 6; i++)
+    {
+        double sum = b[i];
+        for(int k = 0; k < i; k++)
+            sum -= L[i * 6 + k] * y[k];
+        y[i] = sum / L[i * 6 + i];
+    }
+    for(int i = 5; i >= 0; i--)
+    {
+        double sum = y[i];
+        for(int k = i + 1; k < 6; k++)
+            sum -= L[k * 6 + i] * x[k];
+        x[i] = sum / L[i * 6 + i];
+    }
+    return true;
+}
+
+Reconstruction::Reconstruction(const ReconstructionConfig & config,
+                               const CameraIntrinsics & camera,
+                               const FrameSource & depth,
+                               const FrameSource & thermal)
+ : config(config),
+   camera(camera),
+   half(camera.Scaled(2)),
+   depth(depth),
+   thermal(thermal),
+   volume(config.voxelSize, config.truncation, config.maxWeight, config.maxBlocks),
+   pool(config.threads, 0, "reconstruct"),
+   numBands(pool.NumThreads() * 4),
+   hasModel(false),
+   lostTracking(false),
+   full(false),
+   frames(0),
+   vertices(half.width * half.height * 3, 0),
+   normals(half.width * half.height * 3, 0),
+   modelVertices(half.width * half.height * 3, 0),
+   modelNormals(half.width * half.height * 3, 0),
+   rawDepth(camera.width * camera.height, 0),
+   rawThermal(camera.width * camera.height, 0),
+   reconstructionThread(0)
+{
+    running.assignValue(false);
+    resetRequested.assignValue(false);
+    currentPose.assignValue(Pose());
+    numBlocks.assignValue(0);
+    fused.assignValue(0);
+    lost.assignValue(0);
+    latency.assignValue(0);
+}
+
+Reconstruction::~Reconstruction()
+{
+    Stop();
+}
+
+void Reconstruction::SetEventCallback(const boost::function<void (const std::string &)> & callback)
+{
+    eventCallback = callback;
+}
+
+void Reconstruction::Event(const std::string & what)
+{
+    std::cout << what << std::endl;
+    if(eventCallback)
+        eventCallback(what);
+}
+
+Pose Reconstruction::CurrentPose()
+{
+    return currentPose.getValue();
+}
+
+int Reconstruction::NumBlocks()
+{
+    return numBlocks.getValue();
+}
+
+int Reconstruction::Fused()
+{
+    return fused.getValue();
+}
+
+int Reconstruction::Lost()
+{
+    return lost.getValue();
+}
+
+float Reconstruction::LatencyMs()
+{
+    return latency.getValue();
+}
+
+void Reconstruction::Reset()
+{
+    resetRequested.assignValue(true);
+}
+
+bool Reconstruction::ExportMesh(const std::string & path, float scale, float offset)
+{
+    boost::mutex::scoped_lock lock(volumeMutex);
+    return volume.ExportPly(path, scale, offset, pool.NumThreads());
+}
+
+void Reconstruction::Start()
+{
+    if(reconstructionThread)
+        return;
+
+    running.assignValue(true);
+    reconstructionThread = new boost::thread(boost::bind(&Reconstruction::ReconstructionThread, this));
+}
+
+void Reconstruction::Stop()
+{
+    if(!reconstructionThread)
+        return;
+
+    running.assignValue(false);
+    reconstructionThread->join();
+    delete reconstructionThread;
+    reconstructionThread = 0;
+}
+
+void Reconstruction::ReconstructionThread()
+{
+    ThreadPolicies::Apply("reconstruct", "reconstruct");
+
+    //Thermal on the depth grid is the slower stream and carries the depth timestamps, it paces the loop
+    const bool withThermal = thermal.IsValid();
+    const FrameSource & driver = withThermal ? thermal : depth;
+    int nextSeq = -1;
+
+    while(running.getValue())
+    {
+        int latest = driver.latestIndex->getValue();
+        if(latest == -1 || latest < nextSeq)
+        {
+            boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+            continue;
+        }
+
+        int64_t timestamp;
+        if(withThermal)
+        {
+            if(!thermal.Snapshot(&rawThermal[0], nextSeq, timestamp))
+                continue;
+            if(!Nearest(depth, timestamp, 1000, (uint8_t *)&rawDepth[0]))
+            {
+                nextSeq++;
+                continue;
+            }
+        }
+        else if(!depth.Snapshot((uint8_t *)&rawDepth[0], nextSeq, timestamp))
+        {
+            continue;
+        }
+
+        boost::posix_time::ptime begin = boost::posix_time::microsec_clock::local_time();
+
+        Process(&rawDepth[0], withThermal ? &rawThermal[0] : 0);
+
+        float ms = (boost::posix_time::microsec_clock::local_time() - begin).total_microseconds() / 1000.0f;
+        float smoothed = latency.getValue();
+        latency.assignValue(smoothed == 0 ? ms : smoothed * 0.9f + ms * 0.1f);
+
+        nextSeq++;
+    }
+}
+
+bool Reconstruction::Nearest(const FrameSource & source, int64_t timestamp, int64_t maxDt, uint8_t * data)
+{
+    int latest = source.latestIndex->getValue();
+    if(latest == -1)
+        return false;
+
+    int best = -1;
+    int64_t bestDt = maxDt + 1;
+    for(int seq = latest; seq >= 0 && seq > latest - std::min(8, source.numBuffers / 2); seq--)
+    {
+        int64_t slotTimestamp;
+        if(!source.Timestamp(seq, slotTimestamp))
+            continue;
+        int64_t dt = llabs(slotTimestamp - timestamp);
+        if(dt < bestDt)
+        {
+            best = seq;
+            bestDt = dt;
+        }
+    }
+
+    int64_t read;
+    return best != -1 && source.Read(best, data, read) && llabs(read - timestamp) <= maxDt;
+}
+
+bool Reconstruction::Process(const uint16_t * depthFrame, const uint8_t * thermalFrame)
+{
+    boost::mutex::scoped_lock lock(volumeMutex);
+
+    if(resetRequested.getValue())
+    {
+        volume.Reset();
+        hasModel = false;
+        lostTracking = false;
+        full = false;
+        resetRequested.assignValue(false);
+    }
+
+    for(int band = 0; band < numBands; band++)
+        pool.Submit(boost::bind(&Reconstruction::Measure, this, depthFrame,
+                                half.height * band / numBands, half.height * (band + 1) / numBands));
+    pool.Wait();
+
+    Pose estimate = pose;
+    if(hasModel && !Track(estimate))
+    {
+        lost++;
+        if(!lostTracking)
+            Event("Reconstruction lost tracking, frames are not fused until the camera sees the model again");
+        lostTracking = true;
+        return false;
+    }
+
+    if(lostTracking)
+        Event("Reconstruction tracking regained after " + boost::lexical_cast<std::string>(lost.getValue()) + " lost frames");
+    lostTracking = false;
+    pose = estimate;
+
+    //Every other pixel finds the blocks, the band is wider than the gaps
+    if(!volume.Allocate(depthFrame, camera, pose, config.minDepth, config.maxDepth, 2, visible) && !full)
+    {
+        Event("Reconstruction volume full at " + boost::lexical_cast<std::string>(volume.NumBlocks()) +
+              " blocks, new surfaces are not added until blocks are evicted");
+        full = true;
+    }
+
+    for(size_t begin = 0; begin < visible.size(); begin += INTEGRATE_CHUNK)
+    {
+        int count = int(std::min(visible.size() - begin, size_t(INTEGRATE_CHUNK)));
+        pool.Submit(boost::bind(&TsdfVolume::Integrate, &volume, &visible[begin], count, depthFrame, thermalFrame,
+                                boost::cref(camera), boost::cref(pose), config.maxDepth));
+    }
+    pool.Wait();
+
+    //Model for tracking the next frame
+    for(int band = 0; band < numBands; band++)
+        pool.Submit(boost::bind(&TsdfVolume::Raycast, &volume, boost::cref(half), boost::cref(pose), config.minDepth,
+                                config.maxDepth, half.height * band / numBands, half.height * (band + 1) / numBands,
+                                &modelVertices[0], &modelNormals[0]));
+    pool.Wait();
+    modelPose = pose;
+    hasModel = true;
+
+    if(++frames % EVICT_INTERVAL == 0)
+    {
+        float position[3] = {float(pose.t[0]), float(pose.t[1]), float(pose.t[2])};
+        if(volume.Evict(position, config.evictDistance) > 0)
+            full = false;
+    }
+
+    currentPose.assignValue(pose);
+    numBlocks.assignValue(volume.NumBlocks());
+    fused++;
+    return true;
+}
+
+void Reconstruction::Measure(const uint16_t * depthFrame, int y0, int y1)
+{
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+
+    for(int y = y0; y < y1; y++)
+    {
+        for(int x = 0; x < half.width; x++)
+        {
+            float * vertex = &vertices[3 * (y * half.width + x)];
+            float * normal = &normals[3 * (y * half.width + x)];
+            vertex[0] = normal[0] = nan;
+
+            //This pixel and its right and lower neighbours, every other pixel of the full frame
+            float points[3][3];
+            bool complete = true;
+            const int neighbours[3][2] = {{x, y}, {x + 1, y}, {x, y + 1}};
+            for(int k = 0; k < 3 && complete; k++)
+            {
+                int nx = neighbours[k][0], ny = neighbours[k][1];
+                float z = nx < half.width && ny < half.height ? depthFrame[2 * ny * camera.width + 2 * nx] * 0.001f : 0;
+                complete = z >= config.minDepth && z <= config.maxDepth;
+                points[k][0] = (nx - half.cx) / half.fx * z;
+                points[k][1] = (ny - half.cy) / half.fy * z;
+                points[k][2] = z;
+            }
+            if(!complete)
+                continue;
+
+            float a[3], b[3];
+            for(int r = 0; r < 3; r++)
+            {
+                a[r] = points[1][r] - points[0][r];
+                b[r] = points[2][r] - points[0][r];
+            }
+            float n[3] = {a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0]};
+            float norm = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            if(norm < 1e-12f)
+                continue;
+
+            //Facing the camera, like the model normals
+            if(n[0] * points[0][0] + n[1] * points[0][1] + n[2] * points[0][2] > 0)
+                norm = -norm;
+
+            for(int r = 0; r < 3; r++)
+            {
+                vertex[r] = points[0][r];
+                normal[r] = n[r] / norm;
+            }
+        }
+    }
+}
+
+void Reconstruction::Accumulate(const Pose & estimate, const Pose & modelView, int y0, int y1, IcpSums & sums)
+{
+    const float maxDistance = config.icpDistance * config.icpDistance;
+    const float minCosine = cosf(config.icpAngle * float(M_PI) / 180.0f);
+
+    memset(&sums, 0, sizeof(sums));
+
+    for(int y = y0; y < y1; y++)
+    {
+        for(int x = 0; x < half.width; x++)
+        {
+            const float * vertex = &vertices[3 * (y * half.width + x)];
+            if(vertex[0] != vertex[0])
+                continue;
+
+            //Projective association: where the model camera sees the transformed point
+            float p[3], c[3];
+            estimate.Apply(vertex, p);
+            modelView.Apply(p, c);
+            if(c[2] <= 0)
+                continue;
+
+            int u = int(half.fx * c[0] / c[2] + half.cx + 0.5f);
+            int v = int(half.fy * c[1] / c[2] + half.cy + 0.5f);
+            if(u < 0 || v < 0 || u >= half.width || v >= half.height)
+                continue;
+
+            const float * q = &modelVertices[3 * (v * half.width + u)];
+            const float * n = &modelNormals[3 * (v * half.width + u)];
+            if(q[0] != q[0])
+                continue;
+
+            float d[3] = {p[0] - q[0], p[1] - q[1], p[2] - q[2]};
+            if(d[0] * d[0] + d[1] * d[1] + d[2] * d[2] > maxDistance)
+                continue;
+
+            float normal[3];
+            estimate.Rotate(&normals[3 * (y * half.width + x)], normal);
+            if(normal[0] * n[0] + normal[1] * n[1] + normal[2] * n[2] < minCosine)
+                continue;
+
+            //Point-to-plane residual and its derivative by a small rotation w and translation t of the point
+            double r = d[0] * n[0] + d[1] * n[1] + d[2] * n[2];
+            double J[6] = {p[1] * n[2] - p[2] * n[1], p[2] * n[0] - p[0] * n[2], p[0] * n[1] - p[1] * n[0], n[0], n[1], n[2]};
+            for(int i = 0; i < 6; i++)
+            {
+                for(int j = i; j < 6; j++)
+                    sums.A[i * 6 + j] += J[i] * J[j];
+                sums.b[i] -= J[i] * r;
+            }
+            sums.inliers++;
+        }
+    }
+}
+
+bool Reconstruction::Track(Pose & estimate)
+{
+    const Pose modelView = modelPose.Inverse();
+
+    int valid = 0;
+    for(size_t i = 0; i < vertices.size(); i += 3)
+        valid += vertices[i] == vertices[i];
+
+    std::vector<IcpSums> sums(numBands);
+    for(int iteration = 0; iteration < config.icpIterations; iteration++)
+    {
+        for(int band = 0; band < numBands; band++)
+            pool.Submit(boost::bind(&Reconstruction::Accumulate, this, boost::cref(estimate), boost::cref(modelView),
+                                    half.height * band / numBands, half.height * (band + 1) / numBands,
+                                    boost::ref(sums[band])));
+        pool.Wait();
+
+        IcpSums total;
+        memset(&total, 0, sizeof(total));
+        for(int band = 0; band < numBands; band++)
+        {
+            for(int i = 0; i < 36; i++)
+                total.A[i] += sums[band].A[i];
+            for(int i = 0; i < 6; i++)
+                total.b[i] += sums[band].b[i];
+            total.inliers += sums[band].inliers;
+        }
+
+        if(total.inliers < std::max(100, valid / 10))
+            return false;
+
+        for(int i = 0; i < 6; i++)
+        {
+            for(int j = 0; j < i; j++)
+                total.A[i * 6 + j] = total.A[j * 6 + i];
+        }
+
+        double x[6];
+        if(!Solve6(total.A, total.b, x))
+            return false;
+
+        estimate = Pose::Twist(x, x + 3).Compose(estimate);
+
+        if(x[0] * x[0] + x[1] * x[1] + x[2] * x[2] + x[3] * x[3] + x[4] * x[4] + x[5] * x[5] < 1e-10)
+            break;
+    }
+
+    //Motion since the last fused frame
+    Pose motion = pose.Inverse().Compose(estimate);
+    double translation = sqrt(motion.t[0] * motion.t[0] + motion.t[1] * motion.t[1] + motion.t[2] * motion.t[2]);
+    double rotation = acos(std::max(-1.0, std::min(1.0, (motion.R[0] + motion.R[4] + motion.R[8] - 1) / 2)));
+    return translation < MAX_TRANSLATION && rotation < MAX_ROTATION;
+}
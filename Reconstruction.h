@@ -0,0 +1,167 @@
+/*
+ * Reconstruction.h
+ *
+ *  Created on: 19/10 2026
+ *      Author: Baobei Xu
+ */
+
+#ifndef RECONSTRUCTION_H_
+#define RECONSTRUCTION_H_
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <boost/thread.hpp>
+#include <boost/function.hpp>
+
+#include "ThreadMutexObject.h"
+#include "FrameSource.h"
+#include "TsdfVolume.h"
+#include "WorkStealingPool.h"
+
+struct ReconstructionConfig
+{
+    ReconstructionConfig()
+     : enabled(false),
+       voxelSize(0.01f),
+       truncation(0.04f),
+       minDepth(0.4f),
+       maxDepth(3.5f),
+       maxWeight(64),
+       maxBlocks(32768),
+       evictDistance(4.0f),
+       threads(0),
+       icpIterations(10),
+       icpDistance(0.1f),
+       icpAngle(30.0f),
+       meshPath("mesh.ply")
+    {}
+
+    bool enabled;
+
+    /////////////////////////////////////Volume: voxel edge and truncation band in metres, depth range used, weight at
+    /// which the running averages stop growing (so the model still follows changes)
+    float voxelSize;
+    float truncation;
+    float minDepth;
+    float maxDepth;
+    int maxWeight;
+
+    /////////////////////////////////////Memory bound: resident 8^3 blocks (about 6 kB each) and the distance from the
+    /// camera beyond which blocks are dropped
+    int maxBlocks;
+    float evictDistance;
+
+    /////////////////////////////////////Worker threads for tracking, integration and raycasting, 0 for one per core
+    int threads;
+
+    /////////////////////////////////////Point-to-plane ICP: iterations per frame, and the largest point distance (m) and
+    /// normal angle (degrees) of a correspondence
+    int icpIterations;
+    float icpDistance;
+    float icpAngle;
+
+    /////////////////////////////////////Where "Export Mesh" writes the PLY
+    std::string meshPath;
+};
+
+/////////////////////////////////////Optional live 3D reconstruction on the CPU: depth frames are tracked against the
+/// model (projective point-to-plane ICP on a half-resolution raycast of the volume) and fused into a sparse TSDF
+/// (TsdfVolume.h) together with the thermal levels on the depth grid, so the model carries a per-voxel mean
+/// temperature. Tracking, integration of the visible blocks and raycasting are split over a work-stealing pool.
+///
+/// Frames come from the thermal upsampler output when it runs (its timestamps are those of the depth frames),
+/// otherwise from depth alone; the newest frame is taken each time, frames arriving meanwhile are skipped. A frame
+/// that cannot be tracked is not fused, and tracking resumes once the camera sees the model again.
+class Reconstruction
+{
+public:
+    Reconstruction(const ReconstructionConfig & config,
+                   const CameraIntrinsics & camera,
+                   const FrameSource & depth,
+                   const FrameSource & thermal);
+    virtual ~Reconstruction();
+
+    void Start();
+    void Stop();
+
+    /////////////////////////////////////Track and fuse one frame synchronously (thermal may be 0), false if tracking
+    /// failed and the frame was left out
+    bool Process(const uint16_t * depth, const uint8_t * thermal);
+
+    /////////////////////////////////////Start over with an empty volume at the current camera position
+    void Reset();
+
+    /////////////////////////////////////Mesh of the resident volume as PLY, "temperature" = level * scale + offset.
+    /// Safe while running: fusion waits meanwhile.
+    bool ExportMesh(const std::string & path, float scale, float offset);
+
+    /////////////////////////////////////Reports lost / regained tracking and a full volume, set before Start
+    void SetEventCallback(const boost::function<void (const std::string &)> & callback);
+
+    Pose CurrentPose();
+    int NumBlocks();
+    int Fused();
+    int Lost();
+    float LatencyMs();
+
+private:
+    struct IcpSums
+    {
+        double A[36];
+        double b[6];
+        int inliers;
+    };
+
+    const ReconstructionConfig config;
+    const CameraIntrinsics camera;
+    const CameraIntrinsics half;
+    const FrameSource depth;
+    const FrameSource thermal;
+
+    TsdfVolume volume;
+    boost::mutex volumeMutex;
+    WorkStealingPool pool;
+    int numBands;
+
+    Pose pose;
+    Pose modelPose;
+    bool hasModel;
+    bool lostTracking;
+    bool full;
+    int frames;
+
+    /////////////////////////////////////Half-resolution maps, 3 floats per pixel: the current frame in camera
+    /// coordinates, the raycast model in world coordinates (x NaN where none)
+    std::vector<float> vertices;
+    std::vector<float> normals;
+    std::vector<float> modelVertices;
+    std::vector<float> modelNormals;
+    std::vector<VoxelBlock *> visible;
+
+    std::vector<uint16_t> rawDepth;
+    std::vector<uint8_t> rawThermal;
+
+    boost::thread * reconstructionThread;
+    ThreadMutexObject<bool> running;
+    ThreadMutexObject<bool> resetRequested;
+    ThreadMutexObject<Pose> currentPose;
+    ThreadMutexObject<int> numBlocks;
+    ThreadMutexObject<int> fused;
+    ThreadMutexObject<int> lost;
+    ThreadMutexObject<float> latency;
+
+    boost::function<void (const std::string &)> eventCallback;
+
+    void ReconstructionThread();
+    void Event(const std::string & what);
+
+    /////////////////////////////////////Copy of the frame of source closest to timestamp, false if none within maxDt
+    bool Nearest(const FrameSource & source, int64_t timestamp, int64_t maxDt, uint8_t * data);
+
+    void Measure(const uint16_t * depth, int y0, int y1);
+    bool Track(Pose & estimate);
+    void Accumulate(const Pose & estimate, const Pose & modelView, int y0, int y1, IcpSums & sums);
+};
+
+#endif /* RECONSTRUCTION_H_ */
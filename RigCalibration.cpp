@@ -0,0 +1,70 @@
+#include "RigCalibration.h"
+
+#include <iostream>
+
+bool RigCalibration::Load(const std::string & path)
+{
+    cv::FileStorage file(path, cv::FileStorage::READ);
+    if(!file.isOpened())
+    {
+        std::cout << "Cannot open calibration " << path << std::endl;
+        return false;
+    }
+
+    file["ir_camera_matrix"] >> irCamera;
+    file["ir_distortion"] >> irDistortion;
+    irSize = cv::Size(int(file["ir_width"]), int(file["ir_height"]));
+
+    file["thermal_camera_matrix"] >> thermalCamera;
+    file["thermal_distortion"] >> thermalDistortion;
+    thermalSize = cv::Size(int(file["thermal_width"]), int(file["thermal_height"]));
+
+    file["R"] >> R;
+    file["T"] >> T;
+
+    irError = double(file["ir_rms"]);
+    thermalError = double(file["thermal_rms"]);
+    stereoError = double(file["stereo_rms"]);
+    views = int(file["views"]);
+
+    if(!IsValid())
+    {
+        std::cout << "Incomplete calibration " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool RigCalibration::Save(const std::string & path) const
+{
+    cv::FileStorage file(path, cv::FileStorage::WRITE);
+    if(!file.isOpened())
+        return false;
+
+    file << "ir_camera_matrix" << irCamera;
+    file << "ir_distortion" << irDistortion;
+    file << "ir_width" << irSize.width;
+    file << "ir_height" << irSize.height;
+
+    file << "thermal_camera_matrix" << thermalCamera;
+    file << "thermal_distortion" << thermalDistortion;
+    file << "thermal_width" << thermalSize.width;
+    file << "thermal_height" << thermalSize.height;
+
+    file << "R" << R;
+    file << "T" << T;
+
+    file << "ir_rms" << irError;
+    file << "thermal_rms" << thermalError;
+    file << "stereo_rms" << stereoError;
+    file << "views" << views;
+
+    file.release();
+    return true;
+}
+
+bool RigCalibration::IsValid() const
+{
+    return !irCamera.empty() && !thermalCamera.empty() && !R.empty() && !T.empty() &&
+           irSize.width > 0 && thermalSize.width > 0;
+}
@@ -0,0 +1,48 @@
+/*
+ * RigCalibration.h
+ *
+ *  Created on: 19/10 2026
+ *      Author: Baobei Xu
+ */
+
+#ifndef RIGCALIBRATION_H_
+#define RIGCALIBRATION_H_
+
+#include <string>
+#include <opencv2/opencv.hpp>
+
+/////////////////////////////////////Intrinsics of the Kinect IR and the FLIR camera and the IR -> thermal extrinsics,
+/// as written by CalibrateRig. Thermal parameters refer to the image as recorded (upright), not the flipped ring.
+/// A point X in IR camera coordinates is R * X + T in thermal camera coordinates (metres).
+struct RigCalibration
+{
+    RigCalibration()
+     : irError(0),
+       thermalError(0),
+       stereoError(0),
+       views(0)
+    {}
+
+    cv::Mat irCamera;
+    cv::Mat irDistortion;
+    cv::Size irSize;
+
+    cv::Mat thermalCamera;
+    cv::Mat thermalDistortion;
+    cv::Size thermalSize;
+
+    cv::Mat R;
+    cv::Mat T;
+
+    /////////////////////////////////////RMS reprojection errors in pixels and number of stereo views used
+    double irError;
+    double thermalError;
+    double stereoError;
+    int views;
+
+    bool Load(const std::string & path);
+    bool Save(const std::string & path) const;
+    bool IsValid() const;
+};
+
+#endif /* RIGCALIBRATION_H_ */
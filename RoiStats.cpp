@@ -0,0 +1,533 @@
+#include "RoiStats.h"
+#include "ThreadPolicy.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <iostream>
+#include <algorithm>
+#include <boost/lexical_cast.hpp>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static bool ParseNumbers(const std::string & text, std::vector<int> & numbers)
+{
+    std::string::size_type start = 0;
+    while(start <= text.size())
+    {
+        std::string::size_type end = text.find(',', start);
+        if(end == std::string::npos)
+            end = text.size();
+        try
+        {
+            numbers.push_back(boost::lexical_cast<int>(text.substr(start, end - start)));
+        }
+        catch(const boost::bad_lexical_cast &)
+        {
+            return false;
+        }
+        start = end + 1;
+    }
+    return true;
+}
+
+bool Roi::Parse(const std::string & spec, Roi & roi)
+{
+    std::string::size_type first = spec.find(':');
+    std::string::size_type second = first == std::string::npos ? first : spec.find(':', first + 1);
+    if(second == std::string::npos)
+        return false;
+
+    roi.name = spec.substr(0, first);
+    std::string kind = spec.substr(first + 1, second - first - 1);
+    std::vector<int> numbers;
+    if(roi.name.empty() || !ParseNumbers(spec.substr(second + 1), numbers))
+        return false;
+
+    roi.polygon.clear();
+    if(kind == "rect" && numbers.size() == 4)
+    {
+        int x = numbers[0], y = numbers[1], w = numbers[2], h = numbers[3];
+        if(w <= 0 || h <= 0)
+            return false;
+        roi.polygon.push_back(cv::Point(x, y));
+        roi.polygon.push_back(cv::Point(x + w - 1, y));
+        roi.polygon.push_back(cv::Point(x + w - 1, y + h - 1));
+        roi.polygon.push_back(cv::Point(x, y + h - 1));
+    }
+    else if(kind == "poly" && numbers.size() >= 6 && numbers.size() % 2 == 0)
+    {
+        for(size_t i = 0; i < numbers.size(); i += 2)
+            roi.polygon.push_back(cv::Point(numbers[i], numbers[i + 1]));
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+bool RoiRule::Parse(const std::string & spec, RoiRule & rule)
+{
+    std::string::size_type colon = spec.find(':');
+    std::string::size_type op = spec.find_first_of("<>", colon == std::string::npos ? 0 : colon);
+    if(colon == std::string::npos || op == std::string::npos)
+        return false;
+
+    rule.roi = spec.substr(0, colon);
+    rule.stat = spec.substr(colon + 1, op - colon - 1);
+    rule.above = spec[op] == '>';
+
+    std::string::size_type count = spec.find(':', op);
+    try
+    {
+        rule.threshold = boost::lexical_cast<float>(spec.substr(op + 1, count == std::string::npos ? std::string::npos : count - op - 1));
+        rule.frames = count == std::string::npos ? 1 : boost::lexical_cast<int>(spec.substr(count + 1));
+    }
+    catch(const boost::bad_lexical_cast &)
+    {
+        return false;
+    }
+
+    if(rule.stat != "min" && rule.stat != "max" && rule.stat != "mean" &&
+       !(rule.stat.size() > 1 && rule.stat[0] == 'p'))
+        return false;
+
+    return !rule.roi.empty() && rule.frames > 0;
+}
+
+std::string RoiRule::ToString() const
+{
+    return roi + ":" + stat + (above ? ">" : "<") + boost::lexical_cast<std::string>(threshold) +
+           ":" + boost::lexical_cast<std::string>(frames);
+}
+
+bool RoiConfig::CheckRules()
+{
+    bool ok = true;
+    for(size_t i = 0; i < rules.size(); )
+    {
+        const std::string & stat = rules[i].stat;
+        bool known = stat == "min" || stat == "max" || stat == "mean";
+        for(size_t p = 0; !known && p < percentiles.size(); p++)
+            known = stat[0] == 'p' && atoi(stat.c_str() + 1) == percentiles[p];
+
+        if(known)
+        {
+            i++;
+            continue;
+        }
+
+        std::cout << "ROI rule " << rules[i].ToString() << " ignored, " << stat
+                  << " is not among the reported percentiles (--roi-percentiles)" << std::endl;
+        rules.erase(rules.begin() + i);
+        ok = false;
+    }
+    return ok;
+}
+
+namespace
+{
+    struct Accumulator
+    {
+        uint32_t histograms[4][256];
+        uint64_t sum;
+        uint32_t count;
+        uint8_t min, max;
+    };
+
+    void MinMaxSum(const uint8_t * p, int n, Accumulator & acc)
+    {
+        int i = 0;
+        uint8_t mn = acc.min;
+        uint8_t mx = acc.max;
+        uint64_t sum = 0;
+
+#ifdef __SSE2__
+        if(n >= 16)
+        {
+            const __m128i zero = _mm_setzero_si128();
+            __m128i vmin = _mm_set1_epi8((char)0xFF);
+            __m128i vmax = zero;
+            __m128i vsum = zero;
+
+            for(; i + 16 <= n; i += 16)
+            {
+                __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+                vmin = _mm_min_epu8(vmin, v);
+                vmax = _mm_max_epu8(vmax, v);
+                vsum = _mm_add_epi64(vsum, _mm_sad_epu8(v, zero));
+            }
+
+            uint8_t lanes[16];
+            _mm_storeu_si128((__m128i *)lanes, vmin);
+            for(int j = 0; j < 16; j++)
+                mn = std::min(mn, lanes[j]);
+            _mm_storeu_si128((__m128i *)lanes, vmax);
+            for(int j = 0; j < 16; j++)
+                mx = std::max(mx, lanes[j]);
+
+            uint64_t sums[2];
+            _mm_storeu_si128((__m128i *)sums, vsum);
+            sum = sums[0] + sums[1];
+        }
+#endif
+
+        for(; i < n; i++)
+        {
+            mn = std::min(mn, p[i]);
+            mx = std::max(mx, p[i]);
+            sum += p[i];
+        }
+
+        acc.min = mn;
+        acc.max = mx;
+        acc.sum += sum;
+        acc.count += n;
+    }
+
+    //Four interleaved histograms, so runs of equal values (uniform ROIs) do not wait on the previous increment
+    void Histogram(const uint8_t * p, int n, uint32_t (* histograms)[256])
+    {
+        int i = 0;
+        for(; i + 4 <= n; i += 4)
+        {
+            histograms[0][p[i]]++;
+            histograms[1][p[i + 1]]++;
+            histograms[2][p[i + 2]]++;
+            histograms[3][p[i + 3]]++;
+        }
+        for(; i < n; i++)
+            histograms[0][p[i]]++;
+    }
+}
+
+RoiStatsEngine::RoiStatsEngine(const RoiConfig & config, const FrameSource & thermal)
+ : config(config),
+   thermal(thermal),
+   analysisThread(0),
+   ruleCounts(config.rules.size(), 0),
+   binaryLog(false)
+{
+    running.assignValue(false);
+    BuildSpans();
+
+    for(size_t i = 0; i < config.rules.size(); i++)
+    {
+        bool known = false;
+        for(size_t j = 0; j < config.rois.size(); j++)
+            known = known || config.rois[j].name == config.rules[i].roi;
+        if(!known)
+            std::cout << "ROI rule " << config.rules[i].ToString() << " refers to an unknown ROI" << std::endl;
+    }
+}
+
+RoiStatsEngine::~RoiStatsEngine()
+{
+    Stop();
+}
+
+void RoiStatsEngine::BuildSpans()
+{
+    spans.clear();
+
+    for(size_t r = 0; r < config.rois.size(); r++)
+    {
+        const Roi & roi = config.rois[r];
+        cv::Mat mask = cv::Mat::zeros(thermal.height, thermal.width, CV_8UC1);
+        const cv::Point * points[1] = { &roi.polygon[0] };
+        int counts[1] = { int(roi.polygon.size()) };
+        cv::fillPoly(mask, points, counts, 1, cv::Scalar(255));
+
+        for(int y = 0; y < thermal.height; y++)
+        {
+            const uint8_t * m = mask.ptr<uint8_t>(y);
+            //ROIs are given on the recorded image, the ring holds the thermal frame upside down
+            int row = thermal.flip ? thermal.height - 1 - y : y;
+            int x = 0;
+            while(x < thermal.width)
+            {
+                while(x < thermal.width && !m[x])
+                    x++;
+                int start = x;
+                while(x < thermal.width && m[x])
+                    x++;
+                if(x > start)
+                {
+                    Span span;
+                    span.roi = r;
+                    span.row = row;
+                    span.x0 = start;
+                    span.length = x - start;
+                    spans.push_back(span);
+                }
+            }
+        }
+    }
+
+    //Walk the frame top to bottom once for all ROIs
+    std::sort(spans.begin(), spans.end(), &RoiStatsEngine::SpanBefore);
+}
+
+bool RoiStatsEngine::SpanBefore(const Span & a, const Span & b)
+{
+    return a.row != b.row ? a.row < b.row : a.x0 < b.x0;
+}
+
+void RoiStatsEngine::Compute(const uint8_t * frame, std::vector<RoiResult> & results)
+{
+    const bool useHistogram = !config.percentiles.empty();
+
+    std::vector<Accumulator> acc(config.rois.size());
+    for(size_t i = 0; i < acc.size(); i++)
+    {
+        if(useHistogram)
+            memset(acc[i].histograms, 0, sizeof(acc[i].histograms));
+        acc[i].sum = 0;
+        acc[i].count = 0;
+        acc[i].min = 255;
+        acc[i].max = 0;
+    }
+
+    //Min, max and mean always come from the SIMD kernel; percentiles add a histogram of the same spans
+    for(size_t i = 0; i < spans.size(); i++)
+    {
+        const Span & span = spans[i];
+        const uint8_t * p = frame + size_t(span.row) * thermal.width + span.x0;
+        MinMaxSum(p, span.length, acc[span.roi]);
+        if(useHistogram)
+            Histogram(p, span.length, acc[span.roi].histograms);
+    }
+
+    results.resize(acc.size());
+    for(size_t i = 0; i < acc.size(); i++)
+    {
+        const Accumulator & a = acc[i];
+        RoiResult & result = results[i];
+        result.count = a.count;
+        result.percentiles.assign(config.percentiles.size(), std::numeric_limits<float>::quiet_NaN());
+
+        if(a.count == 0)
+        {
+            result.min = result.max = result.mean = std::numeric_limits<float>::quiet_NaN();
+            continue;
+        }
+
+        if(useHistogram)
+        {
+            //Every percentile falls out of one walk from min to max
+            std::vector<uint32_t> targets(config.percentiles.size());
+            std::vector<bool> found(targets.size(), false);
+            for(size_t p = 0; p < targets.size(); p++)
+                targets[p] = std::max<uint32_t>(1, uint32_t(std::ceil(config.percentiles[p] / 100.0 * a.count)));
+
+            uint32_t cumulative = 0;
+            for(int v = a.min; v <= a.max; v++)
+            {
+                cumulative += a.histograms[0][v] + a.histograms[1][v] + a.histograms[2][v] + a.histograms[3][v];
+                for(size_t p = 0; p < targets.size(); p++)
+                {
+                    if(cumulative >= targets[p] && !found[p])
+                    {
+                        result.percentiles[p] = v * config.scale + config.offset;
+                        found[p] = true;
+                    }
+                }
+            }
+        }
+
+        result.min = a.min * config.scale + config.offset;
+        result.max = a.max * config.scale + config.offset;
+        result.mean = float(double(a.sum) / a.count) * config.scale + config.offset;
+    }
+}
+
+void RoiStatsEngine::SetTriggerCallback(const boost::function<void (const std::string &)> & callback)
+{
+    triggerCallback = callback;
+}
+
+std::vector<RoiResult> RoiStatsEngine::Latest()
+{
+    return latest.getValue();
+}
+
+void RoiStatsEngine::Start()
+{
+    if(analysisThread || config.rois.empty())
+        return;
+
+    binaryLog = config.logPath.size() < 4 || config.logPath.substr(config.logPath.size() - 4) != ".csv";
+    log.open(config.logPath.c_str(), std::ios::out | std::ios::app | (binaryLog ? std::ios::binary : std::ios::out));
+    if(!log.is_open())
+    {
+        std::cout << "Cannot open ROI log " << config.logPath << std::endl;
+    }
+    else if(log.tellp() == std::streampos(0))
+    {
+        if(binaryLog)
+        {
+            //"ROIS", ROI count, percentile count, percentiles, then NUL-terminated ROI names
+            uint32_t counts[2] = { uint32_t(config.rois.size()), uint32_t(config.percentiles.size()) };
+            log.write("ROIS", 4);
+            log.write((const char *)counts, sizeof(counts));
+            for(size_t p = 0; p < config.percentiles.size(); p++)
+            {
+                int32_t percentile = config.percentiles[p];
+                log.write((const char *)&percentile, sizeof(percentile));
+            }
+            for(size_t r = 0; r < config.rois.size(); r++)
+                log.write(config.rois[r].name.c_str(), config.rois[r].name.size() + 1);
+        }
+        else
+        {
+            log << "timestamp,sequence,roi,count,min,max,mean";
+            for(size_t p = 0; p < config.percentiles.size(); p++)
+                log << ",p" << config.percentiles[p];
+            log << "\n";
+        }
+    }
+
+    running.assignValue(true);
+    analysisThread = new boost::thread(boost::bind(&RoiStatsEngine::AnalysisThread, this));
+}
+
+void RoiStatsEngine::Stop()
+{
+    if(!analysisThread)
+        return;
+
+    running.assignValue(false);
+    analysisThread->join();
+    delete analysisThread;
+    analysisThread = 0;
+
+    if(log.is_open())
+        log.close();
+}
+
+void RoiStatsEngine::WriteLog(int64_t timestamp, int seq, const std::vector<RoiResult> & results)
+{
+    if(!log.is_open())
+        return;
+
+    for(size_t r = 0; r < results.size(); r++)
+    {
+        const RoiResult & result = results[r];
+        if(binaryLog)
+        {
+            int32_t ids[2] = { seq, int32_t(r) };
+            float values[3] = { result.min, result.max, result.mean };
+            log.write((const char *)&timestamp, sizeof(timestamp));
+            log.write((const char *)ids, sizeof(ids));
+            log.write((const char *)values, sizeof(values));
+            if(!result.percentiles.empty())
+                log.write((const char *)&result.percentiles[0], result.percentiles.size() * sizeof(float));
+        }
+        else
+        {
+            log << timestamp << "," << seq << "," << config.rois[r].name << "," << result.count << ","
+                << result.min << "," << result.max << "," << result.mean;
+            for(size_t p = 0; p < result.percentiles.size(); p++)
+                log << "," << result.percentiles[p];
+            log << "\n";
+        }
+    }
+}
+
+float RoiStatsEngine::StatOf(const RoiRule & rule, const RoiResult & result)
+{
+    if(rule.stat == "min")
+        return result.min;
+    if(rule.stat == "max")
+        return result.max;
+    if(rule.stat == "mean")
+        return result.mean;
+
+    int percentile = atoi(rule.stat.c_str() + 1);
+    for(size_t p = 0; p < config.percentiles.size(); p++)
+    {
+        if(config.percentiles[p] == percentile)
+            return result.percentiles[p];
+    }
+    return std::numeric_limits<float>::quiet_NaN();
+}
+
+void RoiStatsEngine::EvaluateRules(int64_t timestamp, const std::vector<RoiResult> & results)
+{
+    for(size_t i = 0; i < config.rules.size(); i++)
+    {
+        const RoiRule & rule = config.rules[i];
+
+        bool holds = false;
+        for(size_t r = 0; r < config.rois.size(); r++)
+        {
+            if(config.rois[r].name != rule.roi)
+                continue;
+            float value = StatOf(rule, results[r]);
+            holds = rule.above ? value > rule.threshold : value < rule.threshold;
+            break;
+        }
+
+        ruleCounts[i] = holds ? ruleCounts[i] + 1 : 0;
+
+        //Fire once per excursion, when the condition has held for K frames
+        if(ruleCounts[i] == rule.frames)
+        {
+            std::string description = "roi " + rule.ToString() + " at " + boost::lexical_cast<std::string>(timestamp);
+            if(triggerCallback)
+                triggerCallback(description);
+            else
+                std::cout << "ROI rule fired: " << description << std::endl;
+        }
+    }
+}
+
+void RoiStatsEngine::AnalysisThread()
+{
+    ThreadPolicies::Apply("analysis", "roi-stats");
+
+    std::vector<uint8_t> frame(thermal.FrameSize());
+    std::vector<RoiResult> results;
+
+    int nextSeq = -1;
+    int torn = 0;
+
+    while(running.getValue())
+    {
+        int latestIndex = thermal.latestIndex->getValue();
+        if(latestIndex == -1 || latestIndex < nextSeq)
+        {
+            boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+            continue;
+        }
+
+        if(nextSeq == -1)
+            nextSeq = latestIndex;
+
+        if(latestIndex - nextSeq >= thermal.numBuffers - 2)
+        {
+            std::cout << "ROI statistics fell behind, skipping " << latestIndex - thermal.numBuffers / 2 - nextSeq << " frames" << std::endl;
+            nextSeq = latestIndex - thermal.numBuffers / 2;
+        }
+
+        //Statistics and rules only ever see whole frames
+        int64_t timestamp;
+        if(!thermal.Read(nextSeq, &frame[0], timestamp))
+        {
+            torn++;
+            std::cout << "ROI statistics: thermal frame " << nextSeq << " overwritten while copying, skipped (" << torn << " so far)" << std::endl;
+            nextSeq++;
+            continue;
+        }
+
+        Compute(&frame[0], results);
+        latest.assignValue(results);
+        WriteLog(timestamp, nextSeq, results);
+        EvaluateRules(timestamp, results);
+
+        nextSeq++;
+    }
+}
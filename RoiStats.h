@@ -0,0 +1,143 @@
+/*
+ * RoiStats.h
+ *
+ *  Created on: 19/10 2026
+ *      Author: Baobei Xu
+ */
+
+#ifndef ROISTATS_H_
+#define ROISTATS_H_
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <stdint.h>
+#include <opencv2/opencv.hpp>
+#include <boost/thread.hpp>
+#include <boost/function.hpp>
+
+#include "ThreadMutexObject.h"
+#include "FrameSource.h"
+
+/////////////////////////////////////Rectangle or polygon in image coordinates of the recorded (flipped) thermal frame
+struct Roi
+{
+    std::string name;
+    std::vector<cv::Point> polygon;
+
+    /////////////////////////////////////"name:rect:x,y,w,h" or "name:poly:x1,y1,x2,y2,x3,y3,..."
+    static bool Parse(const std::string & spec, Roi & roi);
+};
+
+/////////////////////////////////////Fires when a statistic of an ROI stays above / below a threshold for K frames
+struct RoiRule
+{
+    RoiRule()
+     : above(true),
+       threshold(0),
+       frames(1)
+    {}
+
+    std::string roi;
+    std::string stat;
+    bool above;
+    float threshold;
+    int frames;
+
+    /////////////////////////////////////"roi:stat>threshold[:K]" or "roi:stat<threshold[:K]", stat is min, max,
+    /// mean or pN (percentile)
+    static bool Parse(const std::string & spec, RoiRule & rule);
+    std::string ToString() const;
+};
+
+struct RoiConfig
+{
+    RoiConfig()
+     : scale(1.0f),
+       offset(0.0f),
+       logPath("thermal_roi.csv")
+    {
+        percentiles.push_back(5);
+        percentiles.push_back(50);
+        percentiles.push_back(95);
+    }
+
+    std::vector<Roi> rois;
+    std::vector<RoiRule> rules;
+
+    /////////////////////////////////////Percentiles to report, empty skips their histogram (min/max/mean are always SIMD)
+    std::vector<int> percentiles;
+
+    /////////////////////////////////////Reported value = raw * scale + offset (e.g. counts to degrees)
+    float scale;
+    float offset;
+
+    /////////////////////////////////////.csv for text, anything else for packed binary records
+    std::string logPath;
+
+    /////////////////////////////////////Drops every rule on a percentile missing from percentiles, which could never
+    /// fire, with an error message; false if any was dropped. Call once rules and percentiles are both set.
+    bool CheckRules();
+};
+
+struct RoiResult
+{
+    float min, max, mean;
+    uint32_t count;
+    std::vector<float> percentiles;
+};
+
+/////////////////////////////////////Computes statistics of every ROI on every thermal frame in one pass over the
+/// frame, logs them at full frame rate and raises triggers when a rule fires.
+class RoiStatsEngine
+{
+public:
+    RoiStatsEngine(const RoiConfig & config, const FrameSource & thermal);
+    virtual ~RoiStatsEngine();
+
+    void Start();
+    void Stop();
+
+    /////////////////////////////////////Called from the analysis thread with a description of the rule that fired
+    void SetTriggerCallback(const boost::function<void (const std::string &)> & callback);
+
+    /////////////////////////////////////Statistics of one frame (in ring orientation), usable without the thread
+    void Compute(const uint8_t * frame, std::vector<RoiResult> & results);
+
+    /////////////////////////////////////Latest results, one per ROI
+    std::vector<RoiResult> Latest();
+
+private:
+    struct Span
+    {
+        int roi;
+        int row;
+        int x0;
+        int length;
+    };
+
+    const RoiConfig config;
+    const FrameSource thermal;
+
+    /////////////////////////////////////Row-major runs of all ROIs, so a frame is walked once
+    std::vector<Span> spans;
+
+    boost::thread * analysisThread;
+    ThreadMutexObject<bool> running;
+    ThreadMutexObject<std::vector<RoiResult> > latest;
+
+    boost::function<void (const std::string &)> triggerCallback;
+    std::vector<int> ruleCounts;
+
+    std::ofstream log;
+    bool binaryLog;
+
+    void BuildSpans();
+    static bool SpanBefore(const Span & a, const Span & b);
+    void AnalysisThread();
+    void WriteLog(int64_t timestamp, int seq, const std::vector<RoiResult> & results);
+    void EvaluateRules(int64_t timestamp, const std::vector<RoiResult> & results);
+    float StatOf(const RoiRule & rule, const RoiResult & result);
+};
+
+#endif /* ROISTATS_H_ */
@@ -0,0 +1,27 @@
+/*
+ * SessionClock.h
+ *
+ *  Created on: 19/10 2026
+ *      Author: Baobei Xu
+ */
+
+#ifndef SESSIONCLOCK_H_
+#define SESSIONCLOCK_H_
+
+#include <stdint.h>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+/////////////////////////////////////The one clock all devices stamp their frames with: microseconds since local
+/// midnight, taken on arrival in the acquisition thread or callback. Frames of different devices in one process
+/// are directly comparable, which is what keeps multi-device sessions in sync.
+class SessionClock
+{
+public:
+    static int64_t Now()
+    {
+        boost::posix_time::ptime time = boost::posix_time::microsec_clock::local_time();
+        return time.time_of_day().total_microseconds();
+    }
+};
+
+#endif /* SESSIONCLOCK_H_ */
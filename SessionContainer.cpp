@@ -0,0 +1,445 @@
+#include "SessionContainer.h"
+#include "ArchiveVideo.h"
+
+#include <cstring>
+#include <unistd.h>
+#include <boost/crc.hpp>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+uint32_t ContainerCrc(const uint8_t * data, size_t size)
+{
+    boost::crc_32_type crc;
+    crc.process_bytes(data, size);
+    return crc.checksum();
+}
+
+void ContainerEncode(const cv::Mat & frame, ContainerEncoding encoding, int pngCompression, std::vector<uint8_t> & payload)
+{
+    if(encoding == CONTAINER_PNG)
+    {
+        std::vector<int> params(2);
+        params[0] = CV_IMWRITE_PNG_COMPRESSION;
+        params[1] = pngCompression;
+        cv::imencode(".png", frame, payload, params);
+        return;
+    }
+    if(encoding == CONTAINER_SPARSE)
+    {
+        ContainerEncodeSparse(frame, cv::Rect(0, 0, frame.cols, frame.rows), cv::Mat(), payload);
+        return;
+    }
+
+    cv::Mat continuous = frame.isContinuous() ? frame : frame.clone();
+    payload.assign(continuous.data, continuous.data + continuous.total() * continuous.elemSize());
+}
+
+//Mask bits of a box row are padded to whole bytes, the packed pixels start 4-byte aligned after all rows
+static size_t SparseMaskRowBytes(int width)
+{
+    return (size_t(width) + 7) / 8;
+}
+
+static size_t SparseValuesOffset(const SparseHeader & header)
+{
+    size_t mask = (header.flags & SPARSE_DENSE) ? 0 : SparseMaskRowBytes(header.width) * header.height;
+    return (sizeof(header) + mask + 3) & ~size_t(3);
+}
+
+//One bit per mask byte (non-zero = set), LSB first
+static void PackMaskBits(const uint8_t * mask, int n, uint8_t * bits)
+{
+    int x = 0;
+
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    for(; x + 16 <= n; x += 16)
+    {
+        __m128i m = _mm_loadu_si128((const __m128i *)(mask + x));
+        int set = ~_mm_movemask_epi8(_mm_cmpeq_epi8(m, zero));
+        bits[x / 8] = uint8_t(set);
+        bits[x / 8 + 1] = uint8_t(set >> 8);
+    }
+#endif
+
+    memset(bits + x / 8, 0, SparseMaskRowBytes(n) - x / 8);
+    for(; x < n; x++)
+    {
+        if(mask[x])
+            bits[x / 8] |= uint8_t(1 << (x % 8));
+    }
+}
+
+//Every pixel is stored, only kept ones advance the output; out needs room for n pixels
+template<typename T>
+static uint32_t PackPixels(const T * row, const uint8_t * mask, int n, T * out)
+{
+    uint32_t count = 0;
+    for(int x = 0; x < n; x++)
+    {
+        out[count] = row[x];
+        count += mask[x] != 0;
+    }
+    return count;
+}
+
+void ContainerEncodeSparse(const cv::Mat & frame, const cv::Rect & box, const cv::Mat & mask, std::vector<uint8_t> & payload)
+{
+    cv::Rect region = box & cv::Rect(0, 0, frame.cols, frame.rows);
+    const size_t elemSize = frame.elemSize();
+
+    SparseHeader header;
+    header.x = region.x;
+    header.y = region.y;
+    header.width = region.width;
+    header.height = region.height;
+    header.flags = mask.empty() ? SPARSE_DENSE : 0;
+    header.count = 0;
+
+    const size_t rowBytes = SparseMaskRowBytes(region.width);
+    const size_t values = SparseValuesOffset(header);
+    payload.assign(values + size_t(region.area()) * elemSize, 0);
+
+    uint8_t * out = &payload[values];
+    for(int y = 0; y < region.height; y++)
+    {
+        const uint8_t * row = frame.ptr<uint8_t>(region.y + y) + region.x * elemSize;
+        if(mask.empty())
+        {
+            memcpy(out, row, region.width * elemSize);
+            out += region.width * elemSize;
+            header.count += region.width;
+            continue;
+        }
+
+        const uint8_t * keep = mask.ptr<uint8_t>(region.y + y) + region.x;
+        PackMaskBits(keep, region.width, &payload[sizeof(header) + y * rowBytes]);
+
+        uint32_t count;
+        if(elemSize == 2)
+            count = PackPixels((const uint16_t *)row, keep, region.width, (uint16_t *)out);
+        else if(elemSize == 1)
+            count = PackPixels(row, keep, region.width, out);
+        else
+        {
+            count = 0;
+            for(int x = 0; x < region.width; x++)
+            {
+                if(keep[x])
+                    memcpy(out + count++ * elemSize, row + x * elemSize, elemSize);
+            }
+        }
+        out += count * elemSize;
+        header.count += count;
+    }
+
+    payload.resize(values + header.count * elemSize);
+    memcpy(&payload[0], &header, sizeof(header));
+}
+
+cv::Mat ContainerDecodeSparse(const std::vector<uint8_t> & payload, int width, int height, int type)
+{
+    SparseHeader header;
+    if(payload.size() < sizeof(header))
+        return cv::Mat();
+    memcpy(&header, &payload[0], sizeof(header));
+
+    cv::Mat frame = cv::Mat::zeros(height, width, type);
+    const size_t elemSize = frame.elemSize();
+    const size_t values = SparseValuesOffset(header);
+    if(header.x + header.width > width || header.y + header.height > height ||
+       payload.size() != values + size_t(header.count) * elemSize)
+        return cv::Mat();
+
+    const uint8_t * in = &payload[values];
+    if(header.flags & SPARSE_DENSE)
+    {
+        if(header.count != uint32_t(header.width) * header.height)
+            return cv::Mat();
+        for(int y = 0; y < header.height; y++, in += header.width * elemSize)
+            memcpy(frame.ptr<uint8_t>(header.y + y) + header.x * elemSize, in, header.width * elemSize);
+        return frame;
+    }
+
+    const size_t rowBytes = SparseMaskRowBytes(header.width);
+    uint32_t left = header.count;
+    for(int y = 0; y < header.height; y++)
+    {
+        const uint8_t * bits = &payload[sizeof(header) + y * rowBytes];
+        uint8_t * row = frame.ptr<uint8_t>(header.y + y) + header.x * elemSize;
+        for(int x = 0; x < header.width; x++)
+        {
+            if(!(bits[x / 8] & (1 << (x % 8))))
+                continue;
+            if(left-- == 0)
+                return cv::Mat();
+            memcpy(row + x * elemSize, in, elemSize);
+            in += elemSize;
+        }
+    }
+    return left == 0 ? frame : cv::Mat();
+}
+
+SessionContainerWriter::SessionContainerWriter()
+ : file(0),
+   size(0)
+{
+}
+
+SessionContainerWriter::~SessionContainerWriter()
+{
+    Close();
+}
+
+bool SessionContainerWriter::Open(const std::string & path, const std::string & stream, int width, int height, int type, ContainerEncoding encoding)
+{
+    Close();
+
+    file = fopen(path.c_str(), "a+b");
+    if(!file)
+        return false;
+
+    fseek(file, 0, SEEK_END);
+    size = ftell(file);
+
+    ContainerHeader header;
+    if(size >= int64_t(sizeof(header)))
+    {
+        fseek(file, 0, SEEK_SET);
+        if(fread(&header, sizeof(header), 1, file) != 1 ||
+           header.magic != CONTAINER_MAGIC ||
+           header.version != CONTAINER_VERSION ||
+           int(header.width) != width ||
+           int(header.height) != height ||
+           int(header.type) != type ||
+           header.encoding != uint32_t(encoding))
+        {
+            Close();
+            return false;
+        }
+        fseek(file, 0, SEEK_END);
+        return true;
+    }
+
+    if(size > 0 && ftruncate(fileno(file), 0) != 0)
+    {
+        Close();
+        return false;
+    }
+
+    memset(&header, 0, sizeof(header));
+    header.magic = CONTAINER_MAGIC;
+    header.version = CONTAINER_VERSION;
+    header.width = width;
+    header.height = height;
+    header.type = type;
+    header.encoding = encoding;
+    strncpy(header.stream, stream.c_str(), sizeof(header.stream) - 1);
+    fwrite(&header, sizeof(header), 1, file);
+    fflush(file);
+    size = sizeof(header);
+    return true;
+}
+
+void SessionContainerWriter::Close()
+{
+    if(!file)
+        return;
+
+    fclose(file);
+    file = 0;
+    size = 0;
+}
+
+bool SessionContainerWriter::IsOpen()
+{
+    return file != 0;
+}
+
+bool SessionContainerWriter::Truncate(int64_t size)
+{
+    if(!file || size < int64_t(sizeof(ContainerHeader)))
+        return false;
+
+    fflush(file);
+    if(ftruncate(fileno(file), size) != 0)
+        return false;
+
+    this->size = size;
+    fseek(file, 0, SEEK_END);
+    return true;
+}
+
+int64_t SessionContainerWriter::Append(int64_t sequence, int64_t timestamp, const uint8_t * data, uint32_t size)
+{
+    return Write(sequence, timestamp, 0, data, size);
+}
+
+int64_t SessionContainerWriter::AppendReference(int64_t sequence, int64_t timestamp, int64_t keyframe)
+{
+    return Write(sequence, timestamp, CONTAINER_RECORD_REFERENCE, (const uint8_t *)&keyframe, sizeof(keyframe));
+}
+
+int64_t SessionContainerWriter::Write(int64_t sequence, int64_t timestamp, uint32_t flags, const uint8_t * data, uint32_t size)
+{
+    if(!file)
+        return -1;
+
+    ContainerRecord record;
+    record.magic = CONTAINER_RECORD_MAGIC;
+    record.size = size;
+    record.sequence = sequence;
+    record.timestamp = timestamp;
+    record.crc = ContainerCrc(data, size);
+    record.flags = flags;
+
+    int64_t offset = this->size;
+    if(fwrite(&record, sizeof(record), 1, file) != 1 || fwrite(data, 1, size, file) != size)
+        return -1;
+
+    this->size += sizeof(record) + size;
+    return offset;
+}
+
+void SessionContainerWriter::Flush()
+{
+    if(file)
+        fflush(file);
+}
+
+bool SessionContainerWriter::Sync()
+{
+    if(!file)
+        return false;
+
+    return fflush(file) == 0 && fdatasync(fileno(file)) == 0;
+}
+
+int64_t SessionContainerWriter::Size()
+{
+    return size;
+}
+
+SessionContainerReader::SessionContainerReader()
+ : file(0),
+   size(0)
+{
+    memset(&header, 0, sizeof(header));
+}
+
+SessionContainerReader::~SessionContainerReader()
+{
+    Close();
+}
+
+bool SessionContainerReader::Open(const std::string & path)
+{
+    Close();
+
+    file = fopen(path.c_str(), "rb");
+    if(!file)
+        return false;
+
+    fseek(file, 0, SEEK_END);
+    size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    if(fread(&header, sizeof(header), 1, file) != 1 ||
+       header.magic != CONTAINER_MAGIC ||
+       header.version != CONTAINER_VERSION)
+    {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+void SessionContainerReader::Close()
+{
+    if(!file)
+        return;
+
+    fclose(file);
+    file = 0;
+    size = 0;
+}
+
+const ContainerHeader & SessionContainerReader::Header()
+{
+    return header;
+}
+
+int64_t SessionContainerReader::Size()
+{
+    return size;
+}
+
+bool SessionContainerReader::Read(int64_t offset, ContainerRecord & record, std::vector<uint8_t> & payload)
+{
+    if(!file || offset < int64_t(sizeof(header)) || offset + int64_t(sizeof(record)) > size)
+        return false;
+
+    fseeko(file, offset, SEEK_SET);
+    if(fread(&record, sizeof(record), 1, file) != 1 ||
+       record.magic != CONTAINER_RECORD_MAGIC ||
+       offset + int64_t(sizeof(record)) + record.size > size)
+        return false;
+
+    payload.resize(record.size);
+    if(record.size && fread(&payload[0], 1, record.size, file) != record.size)
+        return false;
+
+    return ContainerCrc(payload.empty() ? 0 : &payload[0], payload.size()) == record.crc;
+}
+
+int64_t SessionContainerReader::Next(int64_t offset)
+{
+    ContainerRecord record;
+    std::vector<uint8_t> payload;
+    if(!Read(offset, record, payload))
+        return -1;
+    return offset + sizeof(record) + record.size;
+}
+
+cv::Mat SessionContainerReader::Decode(const std::vector<uint8_t> & payload)
+{
+    if(header.encoding == CONTAINER_PNG)
+        return cv::imdecode(payload, CV_LOAD_IMAGE_UNCHANGED);
+    if(header.encoding == CONTAINER_SPARSE)
+        return ContainerDecodeSparse(payload, header.width, header.height, header.type);
+
+    cv::Mat frame(header.height, header.width, header.type);
+    if(payload.size() != frame.total() * frame.elemSize())
+        return cv::Mat();
+
+    memcpy(frame.data, &payload[0], payload.size());
+    return frame;
+}
+
+cv::Mat ContainerLoad(const std::string & path, int64_t offset)
+{
+    if(offset < 0)
+        return cv::imread(path, CV_LOAD_IMAGE_UNCHANGED);
+
+    if(path.size() > 4 && path.compare(path.size() - 4, 4, ".mkv") == 0)
+        return ArchiveVideoLoad(path, offset);
+
+    SessionContainerReader reader;
+    ContainerRecord record;
+    std::vector<uint8_t> payload;
+    if(!reader.Open(path) || !reader.Read(offset, record, payload))
+        return cv::Mat();
+
+    //Index records of repeated frames already point at the keyframe; the reference record itself is followed too
+    if((record.flags & CONTAINER_RECORD_REFERENCE) && payload.size() == sizeof(int64_t))
+    {
+        int64_t keyframe;
+        memcpy(&keyframe, &payload[0], sizeof(keyframe));
+        if(!reader.Read(keyframe, record, payload) || (record.flags & CONTAINER_RECORD_REFERENCE))
+            return cv::Mat();
+    }
+
+    return reader.Decode(payload);
+}
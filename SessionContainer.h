@@ -0,0 +1,157 @@
+/*
+ * SessionContainer.h
+ *
+ *  Created on: 19/10 2026
+ *      Author: Baobei Xu
+ */
+
+#ifndef SESSIONCONTAINER_H_
+#define SESSIONCONTAINER_H_
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <stdint.h>
+#include <opencv2/opencv.hpp>
+
+/////////////////////////////////////Single-file frame store of one stream, <stream folder>/frames.fks:
+///
+///   ContainerHeader | ContainerRecord payload | ContainerRecord payload | ...
+///
+/// Every payload carries its own CRC, so a reader can tell a torn or corrupt tail from good data and
+/// resynchronise on the record magic. Offsets of the records go into the stream's index.bin.
+
+#define CONTAINER_MAGIC 0x43534B46u /* "FKSC" */
+#define CONTAINER_RECORD_MAGIC 0x52464B46u /* "FKFR" */
+#define CONTAINER_VERSION 1
+#define CONTAINER_FILE "frames.fks"
+
+enum ContainerEncoding
+{
+    CONTAINER_RAW = 0,
+    CONTAINER_PNG = 1,
+    CONTAINER_SPARSE = 2 /* SparseHeader | mask bits | packed pixels, see ContainerEncodeSparse */
+};
+
+struct ContainerHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t type;
+    uint32_t encoding;
+    char stream[16];
+};
+
+enum ContainerRecordFlags
+{
+    CONTAINER_RECORD_REFERENCE = 1 /* payload is the int64 offset of the keyframe this frame repeats */
+};
+
+struct ContainerRecord
+{
+    uint32_t magic;
+    uint32_t size;
+    int64_t sequence;
+    int64_t timestamp;
+    uint32_t crc;
+    uint32_t flags;
+};
+
+/////////////////////////////////////Payload of a CONTAINER_SPARSE frame. Only the pixels of the box (in the full frame
+/// given by the container header) are stored; unless SPARSE_DENSE is set, the header is followed by one bit per box
+/// pixel, each row padded to a whole byte, LSB first, and only pixels whose bit is set are stored, packed in row
+/// order. Everything else decodes to 0.
+struct SparseHeader
+{
+    uint16_t x;
+    uint16_t y;
+    uint16_t width;
+    uint16_t height;
+    uint32_t flags;
+    uint32_t count;
+};
+
+enum SparseFlags
+{
+    SPARSE_DENSE = 1 /* every pixel of the box is stored, no mask */
+};
+
+class SessionContainerWriter
+{
+public:
+    SessionContainerWriter();
+    virtual ~SessionContainerWriter();
+
+    /////////////////////////////////////Creates the file, or appends if it exists with the same format
+    bool Open(const std::string & path, const std::string & stream, int width, int height, int type, ContainerEncoding encoding);
+    void Close();
+    bool IsOpen();
+
+    /////////////////////////////////////Cut the file back to size bytes, e.g. to the last indexed record on resume
+    bool Truncate(int64_t size);
+
+    /////////////////////////////////////Append an encoded frame (see Encode), returns its offset or -1
+    int64_t Append(int64_t sequence, int64_t timestamp, const uint8_t * data, uint32_t size);
+
+    /////////////////////////////////////Record a frame identical to the one stored at keyframe (see ChangeDetector.h),
+    /// returns the reference record's offset or -1
+    int64_t AppendReference(int64_t sequence, int64_t timestamp, int64_t keyframe);
+    void Flush();
+
+    /////////////////////////////////////Flush and make everything appended so far durable (fdatasync)
+    bool Sync();
+
+    int64_t Size();
+
+private:
+    FILE * file;
+    int64_t size;
+
+    int64_t Write(int64_t sequence, int64_t timestamp, uint32_t flags, const uint8_t * data, uint32_t size);
+};
+
+class SessionContainerReader
+{
+public:
+    SessionContainerReader();
+    virtual ~SessionContainerReader();
+
+    bool Open(const std::string & path);
+    void Close();
+
+    const ContainerHeader & Header();
+    int64_t Size();
+
+    /////////////////////////////////////Read the record at offset; false if it is torn or fails its CRC
+    bool Read(int64_t offset, ContainerRecord & record, std::vector<uint8_t> & payload);
+
+    /////////////////////////////////////Offset just past the record at offset, -1 if there is no valid record
+    int64_t Next(int64_t offset);
+
+    cv::Mat Decode(const std::vector<uint8_t> & payload);
+
+private:
+    FILE * file;
+    int64_t size;
+    ContainerHeader header;
+};
+
+/////////////////////////////////////Encode a frame as a container payload, png level is ignored for raw
+void ContainerEncode(const cv::Mat & frame, ContainerEncoding encoding, int pngCompression, std::vector<uint8_t> & payload);
+
+/////////////////////////////////////Encode the pixels of frame inside box as a CONTAINER_SPARSE payload; mask is CV_8U the size of
+/// frame (non-zero = keep) or empty to keep the whole box
+void ContainerEncodeSparse(const cv::Mat & frame, const cv::Rect & box, const cv::Mat & mask, std::vector<uint8_t> & payload);
+
+/////////////////////////////////////Full width x height frame of a CONTAINER_SPARSE payload, empty if it is malformed
+cv::Mat ContainerDecodeSparse(const std::vector<uint8_t> & payload, int width, int height, int type);
+
+uint32_t ContainerCrc(const uint8_t * data, size_t size);
+
+/////////////////////////////////////Frame at offset of the container at path, or the image file at path for offset -1,
+/// or of the video archive when path is a .mkv (see SessionIndex::FramePath). Opens its own reader, so it is safe to call from several threads.
+cv::Mat ContainerLoad(const std::string & path, int64_t offset);
+
+#endif /* SESSIONCONTAINER_H_ */
@@ -0,0 +1,561 @@
+/*
+ * SessionConverter.cpp
+ *
+ *  Created on: 19/10 2026
+ *      Author: Baobei Xu
+ *
+ *  Offline converter for recorded sessions (<session>/depth, infrared, thermal PNG folders). Frames are decoded,
+ *  transformed and encoded on a work-stealing pool and committed in order to <out>/<session>/<stream>/ together
+ *  with an index.bin, which doubles as the resume journal: rerunning the same command continues after the last
+ *  committed frame of every stream. A lossless video archive (--to mkv) cannot be appended to and is converted
+ *  again unless it was complete.
+ *
+ *      SessionConverter --out DIR [--to container|png|raw|mkv] [--png-compression N] [--container-encoding png|raw]
+ *                       [--video-threads N] [--flip stream]... [--streams a,b] [--threads N] [--in-flight N] session...
+ */
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <limits>
+#include <algorithm>
+#include <csignal>
+#include <cstdlib>
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/algorithm/string.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <opencv2/opencv.hpp>
+
+#include "WorkStealingPool.h"
+#include "SessionIndex.h"
+#include "SessionContainer.h"
+#include "ArchiveVideo.h"
+#include "SessionMetadata.h"
+
+static volatile sig_atomic_t quit = 0;
+
+static void OnSignal(int)
+{
+    quit = 1;
+}
+
+struct ConvertOptions
+{
+    enum Target
+    {
+        Container,
+        Png,
+        Raw,
+        Video
+    };
+
+    ConvertOptions()
+     : target(Container),
+       pngCompression(3),
+       encoding(CONTAINER_PNG),
+       videoThreads(0),
+       threads(0),
+       inFlight(0)
+    {}
+
+    Target target;
+    std::string out;
+    int pngCompression;
+    ContainerEncoding encoding;
+    int videoThreads;
+    std::vector<std::string> flip;
+    std::vector<std::string> streams;
+    int threads;
+    int inFlight;
+};
+
+struct SourceFrame
+{
+    int64_t sequence;
+    int64_t timestamp;
+    std::string path;
+    int64_t offset;
+};
+
+struct ConvertedFrame
+{
+    bool ready;
+    bool ok;
+    int width;
+    int height;
+    int type;
+    std::vector<uint8_t> payload;
+
+    /////////////////////////////////////Decoded frame for the video encoder
+    cv::Mat frame;
+};
+
+/////////////////////////////////////State shared by the tasks of one stream, results are handed back through a
+/// ring of in-flight slots that the committing thread drains in sequence order
+struct StreamJob
+{
+    const ConvertOptions * options;
+    std::string outFolder;
+    bool flip;
+    std::vector<SourceFrame> frames;
+
+    boost::mutex mutex;
+    boost::condition_variable done;
+    std::vector<ConvertedFrame> slots;
+};
+
+static std::string FrameName(int64_t timestamp)
+{
+    return boost::lexical_cast<std::string>(timestamp % SESSIONINDEX_DAY);
+}
+
+static bool ListFrames(SessionIndex & index, const std::string & stream, std::vector<SourceFrame> & frames)
+{
+    frames.clear();
+
+    std::vector<IndexRecord> records;
+    if(!index.Frames(stream, records))
+        return false;
+
+    for(size_t i = 0; i < records.size(); i++)
+    {
+        SourceFrame frame;
+        frame.sequence = records[i].sequence;
+        frame.timestamp = records[i].timestamp;
+        frame.path = index.FramePath(stream, records[i]);
+        frame.offset = records[i].offset;
+        frames.push_back(frame);
+    }
+    return true;
+}
+
+static void ConvertTask(StreamJob & job, size_t i)
+{
+    const SourceFrame & source = job.frames[i];
+    ConvertedFrame & result = job.slots[i % job.slots.size()];
+
+    std::vector<uint8_t> payload;
+    cv::Mat frame = ContainerLoad(source.path, source.offset);
+    bool ok = !frame.empty();
+
+    if(ok && job.flip)
+    {
+        cv::Mat flipped;
+        cv::flip(frame, flipped, 0);
+        frame = flipped;
+    }
+
+    //Per-frame targets write in parallel here, the container and the video are appended in order by the committer;
+    //the video encoder spreads each frame over its own slice threads
+    cv::Mat decoded;
+    if(ok)
+    {
+        const ConvertOptions & options = *job.options;
+        std::string name = job.outFolder + "/" + FrameName(source.timestamp);
+
+        if(options.target == ConvertOptions::Video)
+        {
+            decoded = frame;
+        }
+        else if(options.target == ConvertOptions::Container)
+        {
+            ContainerEncode(frame, options.encoding, options.pngCompression, payload);
+        }
+        else if(options.target == ConvertOptions::Png)
+        {
+            std::vector<int> params(2);
+            params[0] = CV_IMWRITE_PNG_COMPRESSION;
+            params[1] = options.pngCompression;
+            ok = cv::imwrite(name + ".png", frame, params);
+        }
+        else
+        {
+            cv::Mat continuous = frame.isContinuous() ? frame : frame.clone();
+            std::ofstream raw((name + ".raw").c_str(), std::ios::binary);
+            raw.write((const char *)continuous.data, continuous.total() * continuous.elemSize());
+            ok = raw.good();
+        }
+    }
+
+    boost::mutex::scoped_lock lock(job.mutex);
+    result.ok = ok;
+    result.width = frame.cols;
+    result.height = frame.rows;
+    result.type = frame.type();
+    result.payload.swap(payload);
+    result.frame = decoded;
+    result.ready = true;
+    job.done.notify_all();
+}
+
+static int ConvertStream(WorkStealingPool & pool,
+                         const ConvertOptions & options,
+                         SessionIndex & sessionIndex,
+                         const std::string & stream,
+                         const std::string & outFolder)
+{
+    StreamJob job;
+    job.options = &options;
+    job.outFolder = outFolder;
+    job.flip = std::find(options.flip.begin(), options.flip.end(), stream) != options.flip.end();
+
+    if(!ListFrames(sessionIndex, stream, job.frames) || job.frames.empty())
+        return 0;
+
+    boost::system::error_code error;
+    boost::filesystem::create_directories(outFolder, error);
+    if(error)
+    {
+        std::cout << "Cannot create " << outFolder << ": " << error.message() << std::endl;
+        return -1;
+    }
+
+    const std::string indexPath = outFolder + "/index.bin";
+    const std::string containerPath = outFolder + "/" + CONTAINER_FILE;
+    const std::string videoPath = outFolder + "/" + ARCHIVEVIDEO_FILE;
+
+    //Resume after the source frame of the last committed record; a container whose last indexed record did not make
+    //it to disk is started over. Frames are in timestamp order and a folder may hold several runs that restart their
+    //sequence numbers, so the frame is found by sequence and timestamp together, not by sequence alone.
+    size_t first = 0;
+    bool resuming = false;
+    int64_t containerEnd = sizeof(ContainerHeader);
+    SessionIndexReader previous;
+    if(previous.Open(indexPath) && previous.Size() > 0)
+    {
+        const IndexRecord & last = previous.Record(previous.Size() - 1);
+        for(size_t i = job.frames.size(); i-- > 0; )
+        {
+            if(job.frames[i].sequence == last.sequence &&
+               job.frames[i].timestamp % SESSIONINDEX_DAY == last.timestamp % SESSIONINDEX_DAY)
+            {
+                first = i + 1;
+                resuming = true;
+                break;
+            }
+        }
+
+        if(!resuming)
+        {
+            std::cout << stream << ": converted index does not match the session, starting over" << std::endl;
+        }
+        else if(options.target == ConvertOptions::Container)
+        {
+            SessionContainerReader container;
+            containerEnd = container.Open(containerPath) ? container.Next(last.offset) : -1;
+            if(containerEnd < 0)
+            {
+                std::cout << stream << ": container does not match its index, starting over" << std::endl;
+                resuming = false;
+                containerEnd = sizeof(ContainerHeader);
+            }
+        }
+        else if(options.target == ConvertOptions::Video && first < job.frames.size())
+        {
+            std::cout << stream << ": video archive was not finished, starting over" << std::endl;
+            resuming = false;
+        }
+    }
+    previous.Close();
+
+    if(!resuming)
+    {
+        first = 0;
+        boost::filesystem::remove(indexPath, error);
+        boost::filesystem::remove(containerPath, error);
+        boost::filesystem::remove(videoPath, error);
+    }
+
+    if(first == job.frames.size())
+    {
+        std::cout << stream << ": already converted" << std::endl;
+        return 0;
+    }
+
+    SessionIndexWriter index;
+    index.flushEvery = std::numeric_limits<int>::max();
+    if(!index.Open(indexPath, stream))
+    {
+        std::cout << "Cannot open " << indexPath << std::endl;
+        return -1;
+    }
+
+    SessionContainerWriter container;
+    ArchiveVideoWriter video;
+    job.slots.resize(pool.MaxPending());
+
+    int failed = 0;
+    size_t submitted = first;
+    size_t committed = first;
+    boost::posix_time::ptime begin = boost::posix_time::microsec_clock::local_time();
+
+    while(committed < job.frames.size())
+    {
+        //Keep the pool busy up to the in-flight bound, stop feeding it on interrupt
+        while(!quit && submitted < job.frames.size() && submitted - committed < job.slots.size())
+        {
+            ConvertedFrame & slot = job.slots[submitted % job.slots.size()];
+            slot.ready = false;
+            pool.Submit(boost::bind(&ConvertTask, boost::ref(job), submitted));
+            submitted++;
+        }
+
+        if(committed == submitted)
+            break;
+
+        boost::mutex::scoped_lock lock(job.mutex);
+        ConvertedFrame & result = job.slots[committed % job.slots.size()];
+        while(!result.ready)
+            job.done.wait(lock);
+        lock.unlock();
+
+        const SourceFrame & source = job.frames[committed];
+        int64_t offset = -1;
+        uint32_t flags = 0;
+
+        if(!result.ok)
+        {
+            std::cout << "Failed to convert " << source.path << std::endl;
+            failed++;
+            committed++;
+            continue;
+        }
+
+        if(options.target == ConvertOptions::Container)
+        {
+            if(!container.IsOpen())
+            {
+                if(!container.Open(containerPath, stream, result.width, result.height, result.type, options.encoding) ||
+                   !container.Truncate(containerEnd))
+                {
+                    std::cout << "Cannot open " << containerPath << std::endl;
+                    pool.Wait();
+                    return -1;
+                }
+            }
+
+            offset = container.Append(source.sequence, source.timestamp, &result.payload[0], result.payload.size());
+            std::vector<uint8_t>().swap(result.payload);
+            if(offset < 0)
+            {
+                std::cout << "Write to " << containerPath << " failed" << std::endl;
+                pool.Wait();
+                return -1;
+            }
+        }
+        else if(options.target == ConvertOptions::Video)
+        {
+            if(!video.IsOpen() &&
+               !video.Open(videoPath, stream, result.width, result.height, result.type, options.videoThreads))
+            {
+                pool.Wait();
+                return -1;
+            }
+
+            int64_t pts = video.Append(result.frame, source.timestamp);
+            result.frame.release();
+            if(pts < 0)
+            {
+                std::cout << "Write to " << videoPath << " failed" << std::endl;
+                pool.Wait();
+                return -1;
+            }
+            offset = ArchiveVideoOffset(0, pts);
+            flags = INDEX_FLAG_VIDEO;
+        }
+        else if(options.target == ConvertOptions::Raw && committed == first)
+        {
+            std::ofstream format((outFolder + "/format.txt").c_str());
+            format << "width: " << result.width << std::endl
+                   << "height: " << result.height << std::endl
+                   << "bytes_per_pixel: " << (result.type == CV_16UC1 ? 2 : 1) << std::endl;
+        }
+
+        index.Append(source.sequence, source.timestamp % SESSIONINDEX_DAY, offset, flags);
+        committed++;
+
+        //Frames before index records, so a resume never points past the data. A video index only becomes complete
+        //after the archive was closed.
+        if((committed - first) % 30 == 0 && options.target != ConvertOptions::Video)
+        {
+            container.Flush();
+            index.Flush();
+        }
+    }
+
+    pool.Wait();
+    container.Flush();
+    video.Close();
+    index.Flush();
+
+    float seconds = (boost::posix_time::microsec_clock::local_time() - begin).total_milliseconds() / 1000.0f;
+    std::cout << stream << ": " << committed - first << " frames in " << seconds << " s"
+              << " (" << (seconds > 0 ? (committed - first) / seconds : 0) << " fps)"
+              << (failed ? ", " + boost::lexical_cast<std::string>(failed) + " failed" : "")
+              << (quit ? ", interrupted" : "") << std::endl;
+
+    return failed ? -1 : 0;
+}
+
+static std::vector<std::string> SessionStreams(SessionIndex & index, const std::string & root)
+{
+    std::vector<std::string> streams = index.Streams();
+
+    boost::system::error_code error;
+    boost::filesystem::directory_iterator it(root, error), end;
+    for(; !error && it != end; it.increment(error))
+    {
+        std::string name = it->path().filename().string();
+        if(!boost::filesystem::is_directory(it->path()) ||
+           std::find(streams.begin(), streams.end(), name) != streams.end())
+            continue;
+
+        boost::filesystem::directory_iterator file(it->path(), error);
+        for(; !error && file != end; file.increment(error))
+        {
+            if(file->path().extension() == ".png")
+            {
+                streams.push_back(name);
+                break;
+            }
+        }
+        error.clear();
+    }
+
+    std::sort(streams.begin(), streams.end());
+    return streams;
+}
+
+static void Usage()
+{
+    std::cout << "SessionConverter --out DIR [--to container|png|raw|mkv] [--png-compression N]" << std::endl
+              << "                 [--container-encoding png|raw] [--video-threads N] [--flip stream]... [--streams a,b]" << std::endl
+              << "                 [--threads N] [--in-flight N] session..." << std::endl;
+}
+
+int main(int argc, char ** argv)
+{
+    ConvertOptions options;
+    std::vector<std::string> sessions;
+
+    for(int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if(arg == "--out" && hasValue)
+        {
+            options.out = argv[++i];
+        }
+        else if(arg == "--to" && hasValue)
+        {
+            std::string target = argv[++i];
+            if(target == "container")
+                options.target = ConvertOptions::Container;
+            else if(target == "png")
+                options.target = ConvertOptions::Png;
+            else if(target == "raw")
+                options.target = ConvertOptions::Raw;
+            else if(target == "mkv")
+                options.target = ConvertOptions::Video;
+            else
+            {
+                std::cout << "Unknown target " << target << std::endl;
+                return 1;
+            }
+        }
+        else if(arg == "--png-compression" && hasValue)
+        {
+            options.pngCompression = std::max(0, std::min(9, atoi(argv[++i])));
+        }
+        else if(arg == "--container-encoding" && hasValue)
+        {
+            options.encoding = std::string(argv[++i]) == "raw" ? CONTAINER_RAW : CONTAINER_PNG;
+        }
+        else if(arg == "--video-threads" && hasValue)
+        {
+            options.videoThreads = std::max(0, atoi(argv[++i]));
+        }
+        else if(arg == "--flip" && hasValue)
+        {
+            options.flip.push_back(argv[++i]);
+        }
+        else if(arg == "--streams" && hasValue)
+        {
+            boost::split(options.streams, argv[++i], boost::is_any_of(","));
+        }
+        else if(arg == "--threads" && hasValue)
+        {
+            options.threads = atoi(argv[++i]);
+        }
+        else if(arg == "--in-flight" && hasValue)
+        {
+            options.inFlight = atoi(argv[++i]);
+        }
+        else if(arg.compare(0, 2, "--") == 0)
+        {
+            Usage();
+            return 1;
+        }
+        else
+        {
+            sessions.push_back(arg);
+        }
+    }
+
+    if(options.out.empty() || sessions.empty())
+    {
+        Usage();
+        return 1;
+    }
+
+    signal(SIGINT, OnSignal);
+    signal(SIGTERM, OnSignal);
+
+    WorkStealingPool pool(options.threads, options.inFlight, "convert");
+    std::cout << "Converting " << sessions.size() << " sessions on " << pool.NumThreads() << " threads, "
+              << pool.MaxPending() << " frames in flight" << std::endl;
+
+    int status = 0;
+
+    for(size_t s = 0; s < sessions.size() && !quit; s++)
+    {
+        std::string root = boost::filesystem::path(sessions[s]).string();
+        std::string name = boost::filesystem::path(root).filename().string();
+        if(name.empty() || name == ".")
+            name = boost::filesystem::absolute(root).parent_path().filename().string();
+
+        std::string outSession = options.out + "/" + name;
+
+        SessionIndex index;
+        index.Open(root);
+
+        std::vector<std::string> streams = options.streams.empty() ? SessionStreams(index, root) : options.streams;
+        std::cout << root << ": " << streams.size() << " streams" << std::endl;
+
+        for(size_t i = 0; i < streams.size() && !quit; i++)
+        {
+            if(ConvertStream(pool, options, index, streams[i], outSession + "/" + streams[i]) != 0)
+                status = 1;
+        }
+
+        SessionMetadata metadata;
+        if(metadata.Open(outSession + "/session.txt"))
+        {
+            metadata.Event(quit ? "conversion interrupted" : "converted from " + root);
+        }
+    }
+
+    std::cout << "Steals: " << pool.Steals() << std::endl;
+
+    if(quit)
+    {
+        std::cout << "Interrupted, run the same command again to resume" << std::endl;
+        return 2;
+    }
+
+    return status;
+}
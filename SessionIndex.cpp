@@ -0,0 +1,559 @@
+#include "SessionIndex.h"
+
+#include <cstring>
+#include <cstddef>
+#include <fstream>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <boost/lexical_cast.hpp>
+#include <boost/filesystem.hpp>
+
+std::string IndexRecord::FileName() const
+{
+    return boost::lexical_cast<std::string>(timestamp % SESSIONINDEX_DAY) + ".png";
+}
+
+std::string IndexRecord::VideoFileName() const
+{
+    int64_t segment = offset >> 32;
+    return segment == 0 ? std::string("frames.mkv") : "frames_" + boost::lexical_cast<std::string>(segment) + ".mkv";
+}
+
+size_t IndexHeaderSize(uint32_t version)
+{
+    if(version == 1)
+        return offsetof(IndexHeader, stream) + 16;
+    if(version == SESSIONINDEX_VERSION)
+        return sizeof(IndexHeader);
+    return 0;
+}
+
+SessionIndexWriter::SessionIndexWriter()
+ : flushEvery(30),
+   file(0),
+   dayOffset(0),
+   lastTimestamp(-1),
+   unflushed(0)
+{
+}
+
+SessionIndexWriter::~SessionIndexWriter()
+{
+    Close();
+}
+
+bool SessionIndexWriter::Open(const std::string & path, const std::string & stream)
+{
+    Close();
+
+    dayOffset = 0;
+    lastTimestamp = -1;
+    unflushed = 0;
+
+    file = fopen(path.c_str(), "a+b");
+    if(!file)
+        return false;
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+
+    //An existing index keeps the header layout of its version, the records follow it
+    long headerSize = sizeof(IndexHeader);
+    IndexHeader existing;
+    if(size >= long(IndexHeaderSize(1)))
+    {
+        fseek(file, 0, SEEK_SET);
+        if(fread(&existing, IndexHeaderSize(1), 1, file) == 1 && existing.magic == SESSIONINDEX_MAGIC)
+            headerSize = IndexHeaderSize(existing.version);
+
+        if(headerSize == 0)
+        {
+            Close();
+            return false;
+        }
+    }
+
+    if(size < headerSize)
+    {
+        //New (or torn before the header was complete) index
+        if(size > 0 && ftruncate(fileno(file), 0) != 0)
+        {
+            Close();
+            return false;
+        }
+
+        IndexHeader header;
+        memset(&header, 0, sizeof(header));
+        header.magic = SESSIONINDEX_MAGIC;
+        header.version = SESSIONINDEX_VERSION;
+        header.recordSize = sizeof(IndexRecord);
+        strncpy(header.stream, stream.c_str(), sizeof(header.stream) - 1);
+        fwrite(&header, sizeof(header), 1, file);
+        fflush(file);
+        return true;
+    }
+
+    //Drop a torn tail and continue the unwrapped timeline of the last record
+    long records = (size - headerSize) / long(sizeof(IndexRecord));
+    long valid = headerSize + records * sizeof(IndexRecord);
+    if(valid != size && ftruncate(fileno(file), valid) != 0)
+    {
+        Close();
+        return false;
+    }
+
+    if(records > 0)
+    {
+        IndexRecord last;
+        fseek(file, valid - sizeof(IndexRecord), SEEK_SET);
+        if(fread(&last, sizeof(last), 1, file) == 1)
+        {
+            lastTimestamp = last.timestamp;
+            dayOffset = last.timestamp - last.timestamp % SESSIONINDEX_DAY;
+        }
+    }
+    fseek(file, 0, SEEK_END);
+    return true;
+}
+
+void SessionIndexWriter::Close()
+{
+    if(!file)
+        return;
+
+    fclose(file);
+    file = 0;
+}
+
+bool SessionIndexWriter::IsOpen()
+{
+    return file != 0;
+}
+
+void SessionIndexWriter::Append(int64_t sequence, int64_t timestamp, int64_t offset, uint32_t flags, uint32_t location)
+{
+    if(!file)
+        return;
+
+    //Capture timestamps restart at midnight
+    int64_t unwrapped = timestamp + dayOffset;
+    while(lastTimestamp >= 0 && unwrapped + SESSIONINDEX_DAY / 2 < lastTimestamp)
+    {
+        dayOffset += SESSIONINDEX_DAY;
+        unwrapped += SESSIONINDEX_DAY;
+    }
+    lastTimestamp = std::max(lastTimestamp, unwrapped);
+
+    IndexRecord record;
+    record.sequence = sequence;
+    record.timestamp = unwrapped;
+    record.offset = offset;
+    record.flags = flags;
+    record.location = location;
+    fwrite(&record, sizeof(record), 1, file);
+
+    if(++unflushed >= flushEvery)
+        Flush();
+}
+
+void SessionIndexWriter::Flush()
+{
+    if(!file)
+        return;
+
+    fflush(file);
+    unflushed = 0;
+}
+
+bool SessionIndexWriter::Sync()
+{
+    if(!file)
+        return false;
+
+    unflushed = 0;
+    return fflush(file) == 0 && fdatasync(fileno(file)) == 0;
+}
+
+SessionIndexReader::SessionIndexReader()
+ : fd(-1),
+   map(MAP_FAILED),
+   mapSize(0),
+   header(0),
+   headerSize(0),
+   records(0),
+   count(0)
+{
+}
+
+SessionIndexReader::~SessionIndexReader()
+{
+    Close();
+}
+
+bool SessionIndexReader::Open(const std::string & path)
+{
+    Close();
+    this->path = path;
+
+    fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+        return false;
+
+    if(!Refresh())
+    {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+void SessionIndexReader::Close()
+{
+    if(map != MAP_FAILED)
+    {
+        munmap(map, mapSize);
+        map = MAP_FAILED;
+    }
+    if(fd >= 0)
+    {
+        close(fd);
+        fd = -1;
+    }
+    header = 0;
+    headerSize = 0;
+    records = 0;
+    count = 0;
+}
+
+bool SessionIndexReader::Refresh()
+{
+    struct stat info;
+    if(fd < 0 || fstat(fd, &info) != 0 || size_t(info.st_size) < IndexHeaderSize(1))
+        return false;
+
+    if(size_t(info.st_size) != mapSize)
+    {
+        if(map != MAP_FAILED)
+            munmap(map, mapSize);
+
+        mapSize = info.st_size;
+        map = mmap(0, mapSize, PROT_READ, MAP_SHARED, fd, 0);
+        if(map == MAP_FAILED)
+            return false;
+    }
+
+    header = (const IndexHeader *)map;
+    headerSize = IndexHeaderSize(header->version);
+    if(header->magic != SESSIONINDEX_MAGIC || headerSize == 0 || mapSize < headerSize ||
+       header->recordSize != sizeof(IndexRecord))
+    {
+        header = 0;
+        return false;
+    }
+
+    records = (const IndexRecord *)((const uint8_t *)map + headerSize);
+    count = (mapSize - headerSize) / sizeof(IndexRecord);
+    return true;
+}
+
+std::string SessionIndexReader::Stream()
+{
+    if(!header)
+        return "";
+
+    //Version 1 names are 16 bytes, the header ends there
+    size_t length = headerSize - offsetof(IndexHeader, stream);
+    return std::string(header->stream, strnlen(header->stream, length));
+}
+
+size_t SessionIndexReader::Size()
+{
+    return count;
+}
+
+const IndexRecord & SessionIndexReader::Record(size_t i)
+{
+    return records[i];
+}
+
+size_t SessionIndexReader::LowerBound(int64_t timestamp)
+{
+    size_t low = 0;
+    size_t high = count;
+    while(low < high)
+    {
+        size_t mid = low + (high - low) / 2;
+        if(records[mid].timestamp < timestamp)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low;
+}
+
+long SessionIndexReader::Nearest(int64_t timestamp)
+{
+    if(count == 0)
+        return -1;
+
+    size_t i = LowerBound(timestamp);
+    if(i == count)
+        return count - 1;
+    if(i > 0 && timestamp - records[i - 1].timestamp <= records[i].timestamp - timestamp)
+        return i - 1;
+    return i;
+}
+
+void SessionIndexReader::Range(int64_t from, int64_t to, size_t & begin, size_t & end)
+{
+    begin = LowerBound(from);
+    end = std::max(begin, LowerBound(to));
+}
+
+SessionIndex::SessionIndex()
+{
+}
+
+SessionIndex::~SessionIndex()
+{
+    Close();
+}
+
+bool SessionIndex::Open(const std::string & root)
+{
+    Close();
+    this->root = root;
+    locations = Locations(root);
+
+    std::vector<std::string> folders = StreamFolders(root);
+    for(size_t i = 0; i < folders.size(); i++)
+    {
+        std::string index = root + "/" + folders[i] + "/index.bin";
+        if(!boost::filesystem::is_regular_file(index))
+            continue;
+
+        SessionIndexReader * reader = new SessionIndexReader;
+        if(!reader->Open(index))
+        {
+            delete reader;
+            continue;
+        }
+        names.push_back(folders[i]);
+        readers.push_back(reader);
+    }
+
+    return !readers.empty();
+}
+
+std::vector<std::string> SessionIndex::Locations(const std::string & root)
+{
+    std::vector<std::string> locations(1, root);
+
+    std::ifstream session((root + "/session.txt").c_str());
+    std::string line;
+    while(std::getline(session, line))
+    {
+        unsigned location;
+        size_t colon = line.find(": ");
+        if(line.compare(0, 9, "location ") != 0 || colon == std::string::npos ||
+           sscanf(line.c_str() + 9, "%u", &location) != 1 || location == 0)
+            continue;
+
+        if(location >= locations.size())
+            locations.resize(location + 1);
+        locations[location] = line.substr(colon + 2);
+    }
+
+    return locations;
+}
+
+static bool IsStreamFolder(const boost::filesystem::path & folder)
+{
+    if(boost::filesystem::is_regular_file(folder / "index.bin") || boost::filesystem::is_regular_file(folder / "frames.fks") ||
+       boost::filesystem::is_regular_file(folder / "frames.mkv"))
+        return true;
+
+    boost::system::error_code error;
+    boost::filesystem::directory_iterator it(folder, error), end;
+    for(; !error && it != end; it.increment(error))
+    {
+        if(it->path().extension() == ".png")
+            return true;
+    }
+    return false;
+}
+
+std::vector<std::string> SessionIndex::StreamFolders(const std::string & root)
+{
+    std::vector<std::string> folders;
+
+    boost::system::error_code error;
+    boost::filesystem::directory_iterator it(root, error), end;
+    for(; !error && it != end; it.increment(error))
+    {
+        if(!boost::filesystem::is_directory(it->path()))
+            continue;
+
+        std::string name = it->path().filename().string();
+        if(IsStreamFolder(it->path()))
+        {
+            folders.push_back(name);
+            continue;
+        }
+
+        //Multi-device sessions: <device>/<stream>
+        boost::system::error_code innerError;
+        boost::filesystem::directory_iterator inner(it->path(), innerError);
+        for(; !innerError && inner != end; inner.increment(innerError))
+        {
+            if(boost::filesystem::is_directory(inner->path()) && IsStreamFolder(inner->path()))
+                folders.push_back(name + "/" + inner->path().filename().string());
+        }
+    }
+
+    std::sort(folders.begin(), folders.end());
+    return folders;
+}
+
+void SessionIndex::Close()
+{
+    for(size_t i = 0; i < readers.size(); i++)
+        delete readers[i];
+    readers.clear();
+    names.clear();
+    locations.clear();
+}
+
+std::vector<std::string> SessionIndex::Streams()
+{
+    return names;
+}
+
+SessionIndexReader * SessionIndex::Stream(const std::string & name)
+{
+    for(size_t i = 0; i < names.size(); i++)
+    {
+        if(names[i] == name)
+            return readers[i];
+    }
+    return 0;
+}
+
+bool SessionIndex::Nearest(const std::string & stream, int64_t timestamp, IndexRecord & record)
+{
+    SessionIndexReader * reader = Stream(stream);
+    if(!reader)
+        return false;
+
+    long i = reader->Nearest(timestamp);
+    if(i < 0)
+        return false;
+
+    record = reader->Record(i);
+    return true;
+}
+
+void SessionIndex::Range(int64_t from, int64_t to, std::vector<std::pair<std::string, std::vector<IndexRecord> > > & result)
+{
+    result.clear();
+    for(size_t i = 0; i < readers.size(); i++)
+    {
+        size_t begin, end;
+        readers[i]->Range(from, to, begin, end);
+        result.push_back(std::make_pair(names[i], std::vector<IndexRecord>()));
+        for(size_t r = begin; r < end; r++)
+            result.back().second.push_back(readers[i]->Record(r));
+    }
+}
+
+bool SessionIndex::Frames(const std::string & stream, std::vector<IndexRecord> & records)
+{
+    records.clear();
+
+    SessionIndexReader * reader = Stream(stream);
+    if(reader)
+    {
+        for(size_t i = 0; i < reader->Size(); i++)
+            records.push_back(reader->Record(i));
+        return true;
+    }
+
+    boost::system::error_code error;
+    boost::filesystem::directory_iterator it(root + "/" + stream, error), end;
+    for(; !error && it != end; it.increment(error))
+    {
+        if(it->path().extension() != ".png")
+            continue;
+
+        IndexRecord record;
+        try
+        {
+            record.timestamp = boost::lexical_cast<int64_t>(it->path().stem().string());
+        }
+        catch(boost::bad_lexical_cast &)
+        {
+            continue;
+        }
+        record.offset = -1;
+        record.flags = 0;
+        record.location = 0;
+        records.push_back(record);
+    }
+
+    if(records.empty())
+        return false;
+
+    //Timestamps restart at midnight; a stream spanning more than half a day of clock is taken to cross it
+    int64_t first = records[0].timestamp, last = records[0].timestamp;
+    for(size_t i = 1; i < records.size(); i++)
+    {
+        first = std::min(first, records[i].timestamp);
+        last = std::max(last, records[i].timestamp);
+    }
+    for(size_t i = 0; i < records.size() && last - first > SESSIONINDEX_DAY / 2; i++)
+    {
+        if(records[i].timestamp < SESSIONINDEX_DAY / 2)
+            records[i].timestamp += SESSIONINDEX_DAY;
+    }
+
+    std::sort(records.begin(), records.end(), &SessionIndex::RecordBefore);
+    for(size_t i = 0; i < records.size(); i++)
+        records[i].sequence = i;
+
+    return true;
+}
+
+bool SessionIndex::RecordBefore(const IndexRecord & a, const IndexRecord & b)
+{
+    return a.timestamp < b.timestamp;
+}
+
+bool SessionIndex::Preview(const std::string & stream, std::vector<IndexRecord> & records)
+{
+    records.clear();
+
+    SessionIndexReader reader;
+    if(!reader.Open(root + "/" + stream + "/" + SESSIONINDEX_PREVIEW_FOLDER + "/index.bin"))
+        return false;
+
+    for(size_t i = 0; i < reader.Size(); i++)
+        records.push_back(reader.Record(i));
+    return true;
+}
+
+std::string SessionIndex::PreviewPath(const std::string & stream)
+{
+    return root + "/" + stream + "/" + SESSIONINDEX_PREVIEW_FOLDER + "/frames.fks";
+}
+
+std::string SessionIndex::FramePath(const std::string & stream, const IndexRecord & record)
+{
+    const std::string & base = record.location < locations.size() && !locations[record.location].empty() ?
+                               locations[record.location] : root;
+    if(record.flags & INDEX_FLAG_VIDEO)
+        return base + "/" + stream + "/" + record.VideoFileName();
+    return base + "/" + stream + "/" + (record.offset >= 0 ? std::string("frames.fks") : record.FileName());
+}
@@ -0,0 +1,191 @@
+/*
+ * SessionIndex.h
+ *
+ *  Created on: 19/10 2026
+ *      Author: Baobei Xu
+ */
+
+#ifndef SESSIONINDEX_H_
+#define SESSIONINDEX_H_
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <stdint.h>
+
+/////////////////////////////////////Per-stream index of a recording, <stream folder>/index.bin:
+///
+///   IndexHeader | IndexRecord | IndexRecord | ...
+///
+/// Records are appended as frames are written and flushed in small batches, so a crash loses at most the
+/// last batch; a torn last record is ignored by the reader. Timestamps are the capture timestamps
+/// (microseconds since local midnight) unwrapped across midnight, so they increase through the file.
+///
+/// Version 1 headers end after a 16 byte stream name; they are still read, and appended to in their own layout.
+
+#define SESSIONINDEX_MAGIC 0x58494B46u /* "FKIX" */
+#define SESSIONINDEX_VERSION 2
+#define SESSIONINDEX_NAME_LENGTH 48 /* fits "<device>/<stream>" names such as "kinect12/thermal_filtered" */
+#define SESSIONINDEX_DAY 86400000000LL
+#define SESSIONINDEX_PREVIEW_FOLDER "preview" /* <stream folder>/preview: index.bin + frames.fks of the preview track */
+#define SESSIONINDEX_SPILL_LOCATION 1 /* location of the backpressure spill root, stripe roots follow (Striping.h) */
+
+enum IndexFlags
+{
+    INDEX_FLAG_SPILLED = 1, /* written under the backpressure spill root (SESSIONINDEX_SPILL_LOCATION) */
+    INDEX_FLAG_RECOVERED = 2, /* re-indexed by session recovery, sequence is estimated */
+    INDEX_FLAG_REFERENCE = 4, /* unchanged frame: same data as its keyframe (hard link, or offset of the keyframe) */
+    INDEX_FLAG_VIDEO = 8 /* frame of a lossless video archive, offset is ArchiveVideoOffset(segment, pts) */
+};
+
+struct IndexHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t recordSize;
+    uint32_t reserved;
+    char stream[SESSIONINDEX_NAME_LENGTH];
+};
+
+/////////////////////////////////////Bytes before the first record in an index of version, 0 for unknown versions
+size_t IndexHeaderSize(uint32_t version);
+
+struct IndexRecord
+{
+    int64_t sequence;
+    int64_t timestamp;
+
+    /////////////////////////////////////Byte offset inside a container file, -1 for one file per frame
+    int64_t offset;
+    uint32_t flags;
+
+    /////////////////////////////////////Which file / root holds the frame, 0 for the stream folder
+    uint32_t location;
+
+    /////////////////////////////////////Name of the frame file in the stream folder ("<timestamp>.png")
+    std::string FileName() const;
+
+    /////////////////////////////////////Name of the video archive holding an INDEX_FLAG_VIDEO frame ("frames.mkv",
+    /// "frames_<segment>.mkv")
+    std::string VideoFileName() const;
+};
+
+class SessionIndexWriter
+{
+public:
+    SessionIndexWriter();
+    virtual ~SessionIndexWriter();
+
+    /////////////////////////////////////Appends to an existing index of the same stream
+    bool Open(const std::string & path, const std::string & stream);
+    void Close();
+    bool IsOpen();
+
+    /////////////////////////////////////timestamp is the raw capture timestamp, unwrapped here
+    void Append(int64_t sequence, int64_t timestamp, int64_t offset = -1, uint32_t flags = 0, uint32_t location = 0);
+    void Flush();
+
+    /////////////////////////////////////Flush and make the records durable (fdatasync)
+    bool Sync();
+
+    /////////////////////////////////////Records between flushes
+    int flushEvery;
+
+private:
+    FILE * file;
+    int64_t dayOffset;
+    int64_t lastTimestamp;
+    int unflushed;
+};
+
+/////////////////////////////////////Read access to one stream's index, memory-mapped so opening is O(1)
+class SessionIndexReader
+{
+public:
+    SessionIndexReader();
+    virtual ~SessionIndexReader();
+
+    bool Open(const std::string & path);
+    void Close();
+
+    /////////////////////////////////////Pick up records appended since Open (live sessions)
+    bool Refresh();
+
+    std::string Stream();
+    size_t Size();
+    const IndexRecord & Record(size_t i);
+
+    /////////////////////////////////////Index of the record closest in time, -1 if the index is empty
+    long Nearest(int64_t timestamp);
+
+    /////////////////////////////////////Records with from <= timestamp < to as [begin, end)
+    void Range(int64_t from, int64_t to, size_t & begin, size_t & end);
+
+private:
+    std::string path;
+    int fd;
+    void * map;
+    size_t mapSize;
+    const IndexHeader * header;
+    size_t headerSize;
+    const IndexRecord * records;
+    size_t count;
+
+    size_t LowerBound(int64_t timestamp);
+};
+
+/////////////////////////////////////All streams of a session folder, for lookups across streams
+class SessionIndex
+{
+public:
+    SessionIndex();
+    virtual ~SessionIndex();
+
+    /////////////////////////////////////Opens <root>/<stream>/index.bin for every stream folder that has one, and
+    /// reads the roots of other locations from the "location N: <root>" lines of <root>/session.txt
+    bool Open(const std::string & root);
+    void Close();
+
+    std::vector<std::string> Streams();
+    SessionIndexReader * Stream(const std::string & name);
+
+    /////////////////////////////////////Record of stream nearest to a timestamp, e.g. the thermal frame nearest a
+    /// depth frame. Returns false if the stream is unknown or empty.
+    bool Nearest(const std::string & stream, int64_t timestamp, IndexRecord & record);
+
+    /////////////////////////////////////Records of every stream within [from, to)
+    void Range(int64_t from, int64_t to, std::vector<std::pair<std::string, std::vector<IndexRecord> > > & result);
+
+    /////////////////////////////////////All records of a stream in time order. Streams recorded before the index
+    /// existed are listed from their <timestamp>.png files instead (sequence = position).
+    bool Frames(const std::string & stream, std::vector<IndexRecord> & records);
+
+    /////////////////////////////////////Full path of a record's frame file, or of its container or video archive when
+    /// the record has an offset (see ContainerLoad)
+    std::string FramePath(const std::string & stream, const IndexRecord & record);
+
+    /////////////////////////////////////Records of the stream's low-resolution preview track (see PreviewTrack.h), with the
+    /// sequence and timestamp of the full frame each was made from. False if the stream has no preview.
+    bool Preview(const std::string & stream, std::vector<IndexRecord> & records);
+
+    /////////////////////////////////////Container holding the preview frames of a stream (see ContainerLoad)
+    std::string PreviewPath(const std::string & stream);
+
+    /////////////////////////////////////Stream folders of a session relative to root ("thermal", "kinect1/depth"):
+    /// folders up to two levels deep holding an index.bin, a container or PNG frames
+    static std::vector<std::string> StreamFolders(const std::string & root);
+
+    /////////////////////////////////////Roots of all locations of a session, [0] is root itself, from the
+    /// "location N: <root>" lines of <root>/session.txt
+    static std::vector<std::string> Locations(const std::string & root);
+
+private:
+    std::string root;
+    std::vector<std::string> locations;
+    std::vector<std::string> names;
+    std::vector<SessionIndexReader *> readers;
+
+    static bool RecordBefore(const IndexRecord & a, const IndexRecord & b);
+};
+
+#endif /* SESSIONINDEX_H_ */
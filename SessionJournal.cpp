@@ -0,0 +1,297 @@
+#include "SessionJournal.h"
+#include "SessionIndex.h"
+#include "SessionContainer.h"
+#include "ArchiveVideo.h"
+
+#include <map>
+#include <fstream>
+#include <cstring>
+#include <algorithm>
+#include <unistd.h>
+#include <boost/lexical_cast.hpp>
+#include <boost/filesystem.hpp>
+
+std::string JournalConfig::ToString() const
+{
+    return std::string(video ? "mkv" : container ? "container" : "png") +
+           ", commit every " + boost::lexical_cast<std::string>(commitFrames) + " frames / " +
+           boost::lexical_cast<std::string>(commitMs) + " ms";
+}
+
+std::string StreamRecovery::ToString() const
+{
+    return stream + ": " + boost::lexical_cast<std::string>(kept) + " frames indexed, " +
+           boost::lexical_cast<std::string>(recovered) + " recovered, " +
+           boost::lexical_cast<std::string>(dropped) + " torn frames dropped, " +
+           boost::lexical_cast<std::string>(truncatedBytes) + " torn bytes truncated";
+}
+
+bool SessionRecovery::NeedsRecovery(const std::string & root)
+{
+    std::ifstream session((root + "/session.txt").c_str());
+    std::string line;
+    bool open = false;
+    while(std::getline(session, line))
+    {
+        if(line.find(" event: session start") != std::string::npos)
+            open = true;
+        else if(line.find(" event: session committed") != std::string::npos)
+            open = false;
+    }
+    return open;
+}
+
+bool SessionRecovery::IsCompletePng(const std::string & path)
+{
+    static const unsigned char signature[8] = {0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A};
+    static const unsigned char trailer[12] = {0, 0, 0, 0, 'I', 'E', 'N', 'D', 0xAE, 0x42, 0x60, 0x82};
+
+    FILE * file = fopen(path.c_str(), "rb");
+    if(!file)
+        return false;
+
+    unsigned char head[8], tail[12];
+    bool complete = fread(head, 1, sizeof(head), file) == sizeof(head) &&
+                    memcmp(head, signature, sizeof(head)) == 0 &&
+                    fseek(file, -long(sizeof(tail)), SEEK_END) == 0 &&
+                    fread(tail, 1, sizeof(tail), file) == sizeof(tail) &&
+                    memcmp(tail, trailer, sizeof(tail)) == 0;
+    fclose(file);
+    return complete;
+}
+
+//Identity of a frame independent of its sequence: location, container offset (-1 for files), clock time. A video
+//frame's offset alone identifies it, its clock time is only known to the millisecond from the archive.
+typedef std::pair<uint32_t, std::pair<int64_t, int64_t> > FrameKey;
+
+static FrameKey KeyOf(const IndexRecord & record)
+{
+    int64_t time = record.flags & INDEX_FLAG_VIDEO ? 0 : record.timestamp % SESSIONINDEX_DAY;
+    return FrameKey(record.location, std::make_pair(record.offset, time));
+}
+
+static bool RecoveredBefore(const IndexRecord & a, const IndexRecord & b)
+{
+    if(a.timestamp != b.timestamp)
+        return a.timestamp < b.timestamp;
+    return a.sequence < b.sequence;
+}
+
+static void ScanContainer(const std::string & path, uint32_t location, std::vector<IndexRecord> & records, StreamRecovery & result)
+{
+    if(!boost::filesystem::is_regular_file(path))
+        return;
+
+    SessionContainerReader reader;
+    if(!reader.Open(path))
+    {
+        //Not even the header made it to disk
+        if(boost::filesystem::file_size(path) < sizeof(ContainerHeader))
+        {
+            result.truncatedBytes += boost::filesystem::file_size(path);
+            boost::filesystem::remove(path);
+        }
+        return;
+    }
+
+    int64_t offset = sizeof(ContainerHeader);
+    ContainerRecord record;
+    std::vector<uint8_t> payload;
+    while(reader.Read(offset, record, payload))
+    {
+        IndexRecord frame;
+        frame.sequence = record.sequence;
+        frame.timestamp = record.timestamp % SESSIONINDEX_DAY;
+        frame.offset = offset;
+        frame.flags = location == SESSIONINDEX_SPILL_LOCATION ? INDEX_FLAG_SPILLED : 0;
+        frame.location = location;
+
+        //Repeated frames are indexed at their keyframe's data
+        if((record.flags & CONTAINER_RECORD_REFERENCE) && payload.size() == sizeof(int64_t))
+        {
+            memcpy(&frame.offset, &payload[0], sizeof(frame.offset));
+            frame.flags |= INDEX_FLAG_REFERENCE;
+        }
+        records.push_back(frame);
+
+        offset += sizeof(record) + record.size;
+    }
+
+    int64_t size = reader.Size();
+    reader.Close();
+
+    //Everything after the first bad record is a torn tail; appending after it would bury new frames behind it
+    if(offset < size && truncate(path.c_str(), offset) == 0)
+        result.truncatedBytes += size - offset;
+}
+
+static void ScanVideos(const std::string & folder, uint32_t location, std::vector<IndexRecord> & records)
+{
+    IndexRecord frame;
+    for(int segment = 0; ; segment++)
+    {
+        frame.offset = ArchiveVideoOffset(segment, 0);
+        std::string path = folder + "/" + frame.VideoFileName();
+        if(!boost::filesystem::is_regular_file(path))
+            return;
+
+        //Archives are never appended to, a torn tail stays where it is and the demuxer stops before it
+        ArchiveVideoReader reader;
+        if(!reader.Open(path) || reader.FirstTimestamp() < 0)
+            continue;
+
+        int64_t pts;
+        while(reader.Skip(pts))
+        {
+            frame.sequence = -1;
+            frame.timestamp = (reader.FirstTimestamp() + pts * 1000) % SESSIONINDEX_DAY;
+            frame.offset = ArchiveVideoOffset(segment, pts);
+            frame.flags = INDEX_FLAG_VIDEO | (location == SESSIONINDEX_SPILL_LOCATION ? INDEX_FLAG_SPILLED : 0);
+            frame.location = location;
+            records.push_back(frame);
+        }
+    }
+}
+
+static void ScanPngs(const std::string & folder, uint32_t location, std::vector<IndexRecord> & records, StreamRecovery & result)
+{
+    boost::system::error_code error;
+    boost::filesystem::directory_iterator it(folder, error), end;
+    for(; !error && it != end; it.increment(error))
+    {
+        if(it->path().extension() != ".png")
+            continue;
+
+        int64_t timestamp;
+        try
+        {
+            timestamp = boost::lexical_cast<int64_t>(it->path().stem().string());
+        }
+        catch(boost::bad_lexical_cast &)
+        {
+            continue;
+        }
+
+        if(!SessionRecovery::IsCompletePng(it->path().string()))
+        {
+            boost::system::error_code removeError;
+            boost::filesystem::remove(it->path(), removeError);
+            result.dropped++;
+            continue;
+        }
+
+        IndexRecord frame;
+        frame.sequence = -1;
+        frame.timestamp = timestamp;
+        frame.offset = -1;
+        frame.flags = location == SESSIONINDEX_SPILL_LOCATION ? INDEX_FLAG_SPILLED : 0;
+        frame.location = location;
+        records.push_back(frame);
+    }
+}
+
+static StreamRecovery RecoverStream(const std::vector<std::string> & locations, const std::string & stream)
+{
+    StreamRecovery result;
+    result.stream = stream;
+
+    std::vector<IndexRecord> records;
+    for(size_t l = 0; l < locations.size(); l++)
+    {
+        if(locations[l].empty())
+            continue;
+        std::string folder = locations[l] + "/" + stream;
+        ScanContainer(folder + "/" + CONTAINER_FILE, l, records, result);
+        ScanVideos(folder, l, records);
+        ScanPngs(folder, l, records, result);
+    }
+
+    //Sequences of files come from the old index where it has them
+    std::string indexPath = locations[0] + "/" + stream + "/index.bin";
+    std::map<FrameKey, IndexRecord> indexed;
+    SessionIndexReader old;
+    if(old.Open(indexPath))
+    {
+        for(size_t i = 0; i < old.Size(); i++)
+            indexed[KeyOf(old.Record(i))] = old.Record(i);
+    }
+
+    for(size_t i = 0; i < records.size(); i++)
+    {
+        std::map<FrameKey, IndexRecord>::iterator it = indexed.find(KeyOf(records[i]));
+        if(it == indexed.end())
+        {
+            records[i].flags |= INDEX_FLAG_RECOVERED;
+            result.recovered++;
+        }
+        else if(records[i].flags & INDEX_FLAG_VIDEO)
+        {
+            //The index has the exact capture time
+            records[i].sequence = it->second.sequence;
+            records[i].timestamp = it->second.timestamp % SESSIONINDEX_DAY;
+        }
+        else if(records[i].offset < 0)
+            records[i].sequence = it->second.sequence;
+    }
+
+    //Same midnight rule as SessionIndex::Frames
+    int64_t first = SESSIONINDEX_DAY, last = 0;
+    for(size_t i = 0; i < records.size(); i++)
+    {
+        first = std::min(first, records[i].timestamp);
+        last = std::max(last, records[i].timestamp);
+    }
+    for(size_t i = 0; i < records.size() && last - first > SESSIONINDEX_DAY / 2; i++)
+    {
+        if(records[i].timestamp < SESSIONINDEX_DAY / 2)
+            records[i].timestamp += SESSIONINDEX_DAY;
+    }
+    std::sort(records.begin(), records.end(), &RecoveredBefore);
+
+    for(size_t i = 0; i < records.size(); i++)
+    {
+        if(records[i].sequence < 0)
+            records[i].sequence = i > 0 ? records[i - 1].sequence + 1 : 0;
+    }
+
+    result.kept = records.size();
+    result.rebuilt = result.recovered > 0 || result.dropped > 0 || result.truncatedBytes > 0 ||
+                     size_t(result.kept) != old.Size();
+    old.Close();
+
+    if(!result.rebuilt)
+        return result;
+
+    //Build the new index beside the old one and swap it in atomically
+    std::string temporary = indexPath + ".recover";
+    boost::system::error_code error;
+    boost::filesystem::remove(temporary, error);
+
+    SessionIndexWriter index;
+    if(!index.Open(temporary, stream))
+    {
+        result.rebuilt = false;
+        return result;
+    }
+    for(size_t i = 0; i < records.size(); i++)
+        index.Append(records[i].sequence, records[i].timestamp % SESSIONINDEX_DAY, records[i].offset, records[i].flags, records[i].location);
+    bool synced = index.Sync();
+    index.Close();
+
+    if(!synced || rename(temporary.c_str(), indexPath.c_str()) != 0)
+        result.rebuilt = false;
+
+    return result;
+}
+
+std::vector<StreamRecovery> SessionRecovery::Recover(const std::string & root)
+{
+    std::vector<StreamRecovery> results;
+
+    std::vector<std::string> locations = SessionIndex::Locations(root);
+    std::vector<std::string> streams = SessionIndex::StreamFolders(root);
+    for(size_t i = 0; i < streams.size(); i++)
+        results.push_back(RecoverStream(locations, streams[i]));
+
+    return results;
+}
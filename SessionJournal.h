@@ -0,0 +1,87 @@
+/*
+ * SessionJournal.h
+ *
+ *  Created on: 19/10 2026
+ *      Author: Baobei Xu
+ */
+
+#ifndef SESSIONJOURNAL_H_
+#define SESSIONJOURNAL_H_
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+/////////////////////////////////////How recordings survive a crash or power loss. Writers commit in groups: the
+/// frame data of a group is made durable first (fdatasync of the container, or syncfs of the PNG folder), only
+/// then are the group's index records appended and synced. The index is therefore the journal: every record in it
+/// points at durable data, and frames after the last record are recovered (or discarded if torn) on the next start.
+struct JournalConfig
+{
+    JournalConfig()
+     : container(false),
+       video(false),
+       videoThreads(0),
+       commitFrames(30),
+       commitMs(1000),
+       recover(true)
+    {}
+
+    /////////////////////////////////////Record into one CRC-checked frames.fks per stream instead of PNG files
+    bool container;
+
+    /////////////////////////////////////Record into a lossless FFV1 frames.mkv per stream (see ArchiveVideo.h), with
+    /// the encoder's slices on this many threads (0 for one per core)
+    bool video;
+    int videoThreads;
+
+    /////////////////////////////////////A group is committed after this many frames or this long, whichever first
+    int commitFrames;
+    int commitMs;
+
+    /////////////////////////////////////Repair an uncommitted session before recording into it again
+    bool recover;
+
+    std::string ToString() const;
+};
+
+/////////////////////////////////////Outcome of recovering one stream
+struct StreamRecovery
+{
+    StreamRecovery()
+     : kept(0),
+       recovered(0),
+       dropped(0),
+       truncatedBytes(0),
+       rebuilt(false)
+    {}
+
+    std::string stream;
+
+    /////////////////////////////////////Frames in the rebuilt index, of which recovered were missing from the old
+    /// one; dropped torn frame files and bytes cut from torn container tails
+    int64_t kept;
+    int64_t recovered;
+    int64_t dropped;
+    int64_t truncatedBytes;
+    bool rebuilt;
+
+    std::string ToString() const;
+};
+
+class SessionRecovery
+{
+public:
+    /////////////////////////////////////True if <root>/session.txt has a "session start" that was never followed by
+    /// "session committed", i.e. the recorder died while writing
+    static bool NeedsRecovery(const std::string & root);
+
+    /////////////////////////////////////Truncate torn container tails, delete torn PNGs and rebuild every stream's
+    /// index.bin from the frames that are intact, in all locations of the session
+    static std::vector<StreamRecovery> Recover(const std::string & root);
+
+    /////////////////////////////////////PNG ends with a complete IEND chunk, i.e. the file was fully written
+    static bool IsCompletePng(const std::string & path);
+};
+
+#endif /* SESSIONJOURNAL_H_ */
@@ -0,0 +1,52 @@
+#include "SessionMetadata.h"
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+SessionMetadata::SessionMetadata()
+{
+}
+
+SessionMetadata::~SessionMetadata()
+{
+    Close();
+}
+
+bool SessionMetadata::Open(const std::string & path)
+{
+    boost::mutex::scoped_lock lock(mutex);
+    if(file.is_open())
+        file.close();
+    file.open(path.c_str(), std::ios::out | std::ios::app);
+    return file.is_open();
+}
+
+void SessionMetadata::Close()
+{
+    boost::mutex::scoped_lock lock(mutex);
+    if(file.is_open())
+        file.close();
+}
+
+bool SessionMetadata::IsOpen()
+{
+    boost::mutex::scoped_lock lock(mutex);
+    return file.is_open();
+}
+
+void SessionMetadata::Set(const std::string & key, const std::string & value)
+{
+    boost::mutex::scoped_lock lock(mutex);
+    if(!file.is_open())
+        return;
+    file << key << ": " << value << std::endl;
+}
+
+void SessionMetadata::Event(const std::string & what)
+{
+    boost::posix_time::ptime time = boost::posix_time::microsec_clock::local_time();
+
+    boost::mutex::scoped_lock lock(mutex);
+    if(!file.is_open())
+        return;
+    file << boost::posix_time::to_iso_extended_string(time) << " event: " << what << std::endl;
+}
@@ -0,0 +1,38 @@
+/*
+ * SessionMetadata.h
+ *
+ *  Created on: 19/10 2026
+ *      Author: Baobei Xu
+ */
+
+#ifndef SESSIONMETADATA_H_
+#define SESSIONMETADATA_H_
+
+#include <string>
+#include <fstream>
+#include <boost/thread.hpp>
+
+/////////////////////////////////////Append-only text record of a recording session: settings and every event
+/// (backpressure transitions, ring overruns, session close) with a timestamp, one per line.
+class SessionMetadata
+{
+public:
+    SessionMetadata();
+    ~SessionMetadata();
+
+    bool Open(const std::string & path);
+    void Close();
+    bool IsOpen();
+
+    /////////////////////////////////////"key: value"
+    void Set(const std::string & key, const std::string & value);
+
+    /////////////////////////////////////"<time> event: what"
+    void Event(const std::string & what);
+
+private:
+    boost::mutex mutex;
+    std::ofstream file;
+};
+
+#endif /* SESSIONMETADATA_H_ */
@@ -0,0 +1,231 @@
+#include "Snapshot.h"
+#include "ThreadPolicy.h"
+
+#include <map>
+#include <cstdlib>
+#include <unistd.h>
+#include <boost/lexical_cast.hpp>
+#include <boost/filesystem.hpp>
+
+SnapshotWriter::SnapshotWriter(int compression)
+ : compression(compression),
+   busy(false),
+   running(true),
+   nextTicket(0)
+{
+    completed.assignValue(0);
+    failed.assignValue(0);
+    snapshotThread = new boost::thread(boost::bind(&SnapshotWriter::SnapshotThread, this));
+}
+
+SnapshotWriter::~SnapshotWriter()
+{
+    //Queued snapshots are finished first, they were promised
+    Wait();
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        running = false;
+    }
+    queued.notify_all();
+    snapshotThread->join();
+    delete snapshotThread;
+}
+
+void SnapshotWriter::SetCallback(const boost::function<void (const SnapshotResult &)> & callback)
+{
+    this->callback = callback;
+}
+
+int SnapshotWriter::Request(const std::vector<Stream> & streams)
+{
+    if(streams.empty())
+        return -1;
+
+    //Only sequence numbers here, no copies: the set is the newest frame of the first ring and its partners
+    Ticket ticket;
+    ticket.time = boost::posix_time::microsec_clock::local_time();
+    ticket.streams = streams;
+
+    const FrameSource & first = streams[0].source;
+    int latest = first.latestIndex->getValue();
+    if(latest == -1)
+        return -1;
+    ticket.sequences.push_back(latest);
+
+    int64_t timestamp;
+    if(!first.Timestamp(latest, timestamp))
+        return -1;
+    for(size_t i = 1; i < streams.size(); i++)
+    {
+        int sequence = Nearest(streams[i].source, timestamp);
+        if(sequence == -1)
+            return -1;
+        ticket.sequences.push_back(sequence);
+    }
+
+    boost::mutex::scoped_lock lock(mutex);
+    ticket.ticket = nextTicket++;
+    tickets.push_back(ticket);
+    queued.notify_one();
+    return ticket.ticket;
+}
+
+void SnapshotWriter::Wait()
+{
+    boost::mutex::scoped_lock lock(mutex);
+    while(busy || !tickets.empty())
+        idle.wait(lock);
+}
+
+int SnapshotWriter::Pending()
+{
+    boost::mutex::scoped_lock lock(mutex);
+    return tickets.size() + (busy ? 1 : 0);
+}
+
+int SnapshotWriter::Completed()
+{
+    return completed.getValue();
+}
+
+int SnapshotWriter::Failed()
+{
+    return failed.getValue();
+}
+
+int SnapshotWriter::Nearest(const FrameSource & source, int64_t timestamp)
+{
+    int latest = source.latestIndex->getValue();
+    if(latest == -1)
+        return -1;
+
+    //Only recent slots, older ones are about to be overwritten; Read catches the rest
+    int best = -1;
+    int64_t bestDt = 0;
+    for(int seq = latest; seq >= 0 && seq > latest - std::min(8, source.numBuffers / 2); seq--)
+    {
+        int64_t slotTimestamp;
+        if(!source.Timestamp(seq, slotTimestamp))
+            continue;
+        int64_t dt = llabs(slotTimestamp - timestamp);
+        if(best == -1 || dt < bestDt)
+        {
+            best = seq;
+            bestDt = dt;
+        }
+    }
+    return best;
+}
+
+void SnapshotWriter::SnapshotThread()
+{
+    ThreadPolicies::Apply("writer", "snapshot");
+
+    std::vector<Ticket> batch;
+    while(true)
+    {
+        {
+            boost::mutex::scoped_lock lock(mutex);
+            busy = false;
+            if(tickets.empty())
+                idle.notify_all();
+            while(running && tickets.empty())
+                queued.wait(lock);
+            if(tickets.empty())
+                return;
+
+            //Everything clicked since the last batch goes in this one
+            batch.assign(tickets.begin(), tickets.end());
+            tickets.clear();
+            busy = true;
+        }
+
+        Process(batch);
+    }
+}
+
+void SnapshotWriter::Process(std::vector<Ticket> & batch)
+{
+    //Ring and sequence of a frame, so a burst shares frames
+    typedef std::pair<const void *, int> FrameKey;
+    std::map<FrameKey, cv::Mat> frames;
+    std::map<FrameKey, std::string> files;
+
+    //Copy the whole batch out of the rings before encoding anything, the slots are recycled within a second
+    for(size_t t = 0; t < batch.size(); t++)
+    {
+        for(size_t s = 0; s < batch[t].streams.size(); s++)
+        {
+            const FrameSource & source = batch[t].streams[s].source;
+            FrameKey key(source.frameBuffers, batch[t].sequences[s]);
+            if(frames.count(key))
+                continue;
+
+            cv::Mat frame(source.height, source.width, source.type);
+            int64_t timestamp;
+            if(source.Read(key.second, frame.data, timestamp))
+            {
+                if(source.flip)
+                    cv::flip(frame, frame, 0);
+                frames[key] = frame;
+            }
+            else
+            {
+                frames[key] = cv::Mat();
+            }
+        }
+    }
+
+    std::vector<int> params(2);
+    params[0] = CV_IMWRITE_PNG_COMPRESSION;
+    params[1] = compression;
+
+    for(size_t t = 0; t < batch.size(); t++)
+    {
+        SnapshotResult result;
+        result.ticket = batch[t].ticket;
+        result.ok = true;
+
+        std::string number = boost::lexical_cast<std::string>(batch[t].ticket);
+        for(size_t s = 0; s < batch[t].streams.size() && result.ok; s++)
+        {
+            const Stream & stream = batch[t].streams[s];
+            FrameKey key(stream.source.frameBuffers, batch[t].sequences[s]);
+            const cv::Mat & frame = frames[key];
+            if(frame.empty())
+            {
+                result.ok = false;
+                result.error = stream.source.name + " frame was overwritten before it could be copied";
+                break;
+            }
+
+            boost::system::error_code error;
+            boost::filesystem::create_directories(stream.folder, error);
+            std::string path = stream.folder + "/" + stream.prefix + number + ".png";
+
+            //A frame already written for an earlier snapshot of the batch is linked, not encoded again
+            std::map<FrameKey, std::string>::iterator written = files.find(key);
+            unlink(path.c_str());
+            if(written == files.end() || link(written->second.c_str(), path.c_str()) != 0)
+            {
+                if(!cv::imwrite(path, frame, params))
+                {
+                    result.ok = false;
+                    result.error = "cannot write " + path;
+                    break;
+                }
+                files[key] = path;
+            }
+            result.files.push_back(path);
+        }
+
+        result.ms = (boost::posix_time::microsec_clock::local_time() - batch[t].time).total_microseconds() / 1000.0f;
+        if(result.ok)
+            completed++;
+        else
+            failed++;
+
+        if(callback)
+            callback(result);
+    }
+}
@@ -0,0 +1,111 @@
+/*
+ * Snapshot.h
+ *
+ *  Created on: 19/10 2026
+ *      Author: Baobei Xu
+ */
+
+#ifndef SNAPSHOT_H_
+#define SNAPSHOT_H_
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <stdint.h>
+#include <opencv2/opencv.hpp>
+#include <boost/thread.hpp>
+#include <boost/function.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include "ThreadMutexObject.h"
+#include "FrameSource.h"
+
+/////////////////////////////////////Outcome of one single-shot capture
+struct SnapshotResult
+{
+    SnapshotResult()
+     : ticket(-1),
+       ok(false),
+       ms(0)
+    {}
+
+    int ticket;
+    bool ok;
+
+    /////////////////////////////////////Files written, or why the snapshot failed
+    std::vector<std::string> files;
+    std::string error;
+
+    /////////////////////////////////////From the request to the last file written
+    float ms;
+};
+
+/////////////////////////////////////Single-shot capture off the GUI thread. Request only notes which frame of every
+/// ring makes up the set (the newest frame of the first source and the frames nearest its timestamp in the others)
+/// and returns a ticket at once; a worker copies the frames out of the rings and encodes the PNGs
+/// <folder>/<prefix><ticket>.png.
+///
+/// The worker takes all requests queued meanwhile as one batch: every frame of the batch is copied out of the rings
+/// first, while the slots still hold it, then the batch is encoded. A frame shared by several snapshots of a burst
+/// (clicks faster than the frame rate) is encoded once and hard linked for the others.
+class SnapshotWriter
+{
+public:
+    /////////////////////////////////////One ring and where its frames go
+    struct Stream
+    {
+        FrameSource source;
+        std::string folder;
+        std::string prefix;
+    };
+
+    SnapshotWriter(int compression);
+    virtual ~SnapshotWriter();
+
+    /////////////////////////////////////Ticket of the queued snapshot, -1 if a ring has no frame yet. The sources must
+    /// stay valid until the snapshot completes (see Wait).
+    int Request(const std::vector<Stream> & streams);
+
+    /////////////////////////////////////Called on the worker thread for every completed ticket, set before Request
+    void SetCallback(const boost::function<void (const SnapshotResult &)> & callback);
+
+    /////////////////////////////////////Block until every queued snapshot is done
+    void Wait();
+
+    int Pending();
+    int Completed();
+    int Failed();
+
+private:
+    struct Ticket
+    {
+        int ticket;
+        boost::posix_time::ptime time;
+        std::vector<Stream> streams;
+        std::vector<int> sequences;
+    };
+
+    const int compression;
+
+    boost::mutex mutex;
+    boost::condition_variable queued;
+    boost::condition_variable idle;
+    std::deque<Ticket> tickets;
+    bool busy;
+    bool running;
+    int nextTicket;
+
+    ThreadMutexObject<int> completed;
+    ThreadMutexObject<int> failed;
+
+    boost::function<void (const SnapshotResult &)> callback;
+    boost::thread * snapshotThread;
+
+    void SnapshotThread();
+    void Process(std::vector<Ticket> & batch);
+
+    /////////////////////////////////////Frame of source nearest timestamp among its recent slots, -1 if none
+    static int Nearest(const FrameSource & source, int64_t timestamp);
+};
+
+#endif /* SNAPSHOT_H_ */
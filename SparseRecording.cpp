@@ -0,0 +1,298 @@
+#include "SparseRecording.h"
+#include "SessionContainer.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+#include <boost/lexical_cast.hpp>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+//Thermal frames are only gated by a depth frame at most this far apart, a stalled Kinect does not gate anything
+static const int64_t MAX_REGISTRATION_DT = 100000;
+
+static std::string StreamKind(const std::string & stream)
+{
+    size_t slash = stream.rfind('/');
+    return slash == std::string::npos ? stream : stream.substr(slash + 1);
+}
+
+cv::Rect SparseConfig::RoiFor(const std::string & stream, int width, int height) const
+{
+    cv::Rect frame(0, 0, width, height);
+
+    std::map<std::string, cv::Rect>::const_iterator it = rois.find(stream);
+    if(it == rois.end())
+        it = rois.find(StreamKind(stream));
+    if(it == rois.end())
+        return frame;
+
+    cv::Rect roi = it->second & frame;
+    return roi.area() > 0 ? roi : frame;
+}
+
+bool SparseConfig::Active(const std::string & stream) const
+{
+    std::string kind = StreamKind(stream);
+    return rois.count(stream) || rois.count(kind) || (gate && (kind == "depth" || kind == "thermal"));
+}
+
+bool SparseConfig::ParseRoi(const std::string & rule)
+{
+    size_t equals = rule.find('=');
+    if(equals == std::string::npos)
+        return false;
+
+    cv::Rect roi;
+    if(sscanf(rule.c_str() + equals + 1, "%d,%d,%d,%d", &roi.x, &roi.y, &roi.width, &roi.height) != 4 ||
+       roi.x < 0 || roi.y < 0 || roi.width <= 0 || roi.height <= 0)
+        return false;
+
+    rois[rule.substr(0, equals)] = roi;
+    return true;
+}
+
+bool SparseConfig::ParseGate(const std::string & range)
+{
+    int min, max;
+    if(sscanf(range.c_str(), "%d,%d", &min, &max) != 2 || min < 0 || max > 65535 || min > max)
+        return false;
+
+    gate = true;
+    gateMin = min;
+    gateMax = max;
+    return true;
+}
+
+std::string SparseConfig::ToString() const
+{
+    if(!gate && rois.empty())
+        return "off";
+
+    std::string text = gate ? "depth gate " + boost::lexical_cast<std::string>(gateMin) + "-" +
+                              boost::lexical_cast<std::string>(gateMax) + " mm" : "no depth gate";
+    for(std::map<std::string, cv::Rect>::const_iterator it = rois.begin(); it != rois.end(); ++it)
+    {
+        text += ", " + it->first + "=" + boost::lexical_cast<std::string>(it->second.x) + "," +
+                boost::lexical_cast<std::string>(it->second.y) + "," +
+                boost::lexical_cast<std::string>(it->second.width) + "," +
+                boost::lexical_cast<std::string>(it->second.height);
+    }
+    return text;
+}
+
+int DepthBandMask(const uint16_t * depth, int n, uint16_t min, uint16_t max, uint8_t * mask)
+{
+    int count = 0;
+    int i = 0;
+
+#ifdef __SSE2__
+    //No unsigned 16 bit compare in SSE2: compare biased values as signed
+    const __m128i bias = _mm_set1_epi16(short(0x8000));
+    const __m128i low = _mm_xor_si128(_mm_set1_epi16(short(min)), bias);
+    const __m128i high = _mm_xor_si128(_mm_set1_epi16(short(max)), bias);
+
+    for(; i + 16 <= n; i += 16)
+    {
+        __m128i a = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(depth + i)), bias);
+        __m128i b = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(depth + i + 8)), bias);
+        __m128i inA = _mm_andnot_si128(_mm_or_si128(_mm_cmplt_epi16(a, low), _mm_cmpgt_epi16(a, high)), _mm_set1_epi16(-1));
+        __m128i inB = _mm_andnot_si128(_mm_or_si128(_mm_cmplt_epi16(b, low), _mm_cmpgt_epi16(b, high)), _mm_set1_epi16(-1));
+
+        //0xFFFF / 0 lanes saturate to 0xFF / 0 bytes
+        __m128i in = _mm_packs_epi16(inA, inB);
+        _mm_storeu_si128((__m128i *)(mask + i), in);
+        count += __builtin_popcount(_mm_movemask_epi8(in));
+    }
+#endif
+
+    for(; i < n; i++)
+    {
+        bool in = depth[i] >= min && depth[i] <= max;
+        mask[i] = in ? 255 : 0;
+        count += in;
+    }
+    return count;
+}
+
+SparseEncoder::SparseEncoder(const SparseConfig & config,
+                             const FrameSource & source,
+                             const FrameSource & depth,
+                             const RigCalibration & calibration)
+ : source(source),
+   depth(depth),
+   roi(config.RoiFor(source.name, source.width, source.height)),
+   gateMin(config.gateMin),
+   gateMax(config.gateMax),
+   gate(None),
+   fx(0),
+   fy(0),
+   cx(0),
+   cy(0),
+   registeredSeq(-1),
+   tornDepth(0)
+{
+    std::string kind = StreamKind(source.name);
+    if(config.gate && kind == "depth" && source.type == CV_16UC1)
+        gate = Depth;
+
+    if(config.gate && kind == "thermal")
+    {
+        if(!depth.IsValid() || !calibration.IsValid() ||
+           calibration.irSize != cv::Size(depth.width, depth.height) ||
+           calibration.thermalSize != cv::Size(source.width, source.height))
+        {
+            std::cout << "Depth gating " << source.name << " needs a rig calibration (--calibration) matching the "
+                      << "Kinect and FLIR, recording it without the gate" << std::endl;
+        }
+        else
+        {
+            gate = Thermal;
+
+            std::vector<cv::Point2f> pixels;
+            pixels.reserve(depth.width * depth.height);
+            for(int y = 0; y < depth.height; y++)
+            {
+                for(int x = 0; x < depth.width; x++)
+                    pixels.push_back(cv::Point2f(x, y));
+            }
+            cv::undistortPoints(pixels, rays, calibration.irCamera, calibration.irDistortion);
+
+            cv::Mat r, t, k, ir;
+            calibration.R.convertTo(r, CV_32F);
+            calibration.T.convertTo(t, CV_32F);
+            calibration.thermalCamera.convertTo(k, CV_32F);
+            calibration.irCamera.convertTo(ir, CV_32F);
+            for(int i = 0; i < 9; i++)
+                R[i] = r.at<float>(i / 3, i % 3);
+            for(int i = 0; i < 3; i++)
+                T[i] = t.at<float>(i, 0);
+            fx = k.at<float>(0, 0);
+            fy = k.at<float>(1, 1);
+            cx = k.at<float>(0, 2);
+            cy = k.at<float>(1, 2);
+
+            //Depth pixels land this many thermal pixels apart; close the gaps so the gated area has no holes.
+            //Thermal lens distortion is ignored, the dilation also covers it at the FLIR's small FOV.
+            int spread = int(ceil(std::max(fx, fy) / std::max(1.0f, ir.at<float>(0, 0))));
+            int size = 2 * std::max(1, spread) + 1;
+            dilation = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(size, size));
+
+            depthFrame.create(depth.height, depth.width, depth.type);
+            depthMask.create(depth.height, depth.width, CV_8UC1);
+        }
+    }
+
+    if(gate != None)
+        mask.create(source.height, source.width, CV_8UC1);
+}
+
+void SparseEncoder::Encode(const cv::Mat & frame, int64_t timestamp, std::vector<uint8_t> & payload)
+{
+    bool gated = false;
+
+    if(gate == Depth)
+    {
+        DepthBandMask(frame.ptr<uint16_t>(0), frame.total(), gateMin, gateMax, mask.data);
+        gated = true;
+    }
+    else if(gate == Thermal)
+    {
+        gated = RegisterDepth(timestamp);
+    }
+
+    ContainerEncodeSparse(frame, roi, gated ? mask : cv::Mat(), payload);
+}
+
+bool SparseEncoder::RegisterDepth(int64_t timestamp)
+{
+    int latest = depth.latestIndex->getValue();
+    if(latest == -1)
+        return false;
+
+    //Closest depth frame among the recent ones that the capture side is not about to overwrite
+    int best = -1;
+    int64_t bestDt = MAX_REGISTRATION_DT + 1;
+    for(int seq = latest; seq >= 0 && seq > latest - std::min(8, depth.numBuffers / 2); seq--)
+    {
+        int64_t slotTimestamp;
+        if(!depth.Timestamp(seq, slotTimestamp))
+            continue;
+        int64_t dt = std::abs(slotTimestamp - timestamp);
+        if(dt < bestDt)
+        {
+            best = seq;
+            bestDt = dt;
+        }
+    }
+
+    if(best == -1)
+        return false;
+    if(best == registeredSeq)
+        return true;
+
+    //A torn depth frame would gate with a mask of two frames, the thermal frame is stored cropped only instead
+    int64_t depthTimestamp;
+    if(!depth.Read(best, depthFrame.data, depthTimestamp))
+    {
+        registeredSeq = -1;
+        tornDepth++;
+        return false;
+    }
+    registeredSeq = best;
+
+    DepthBandMask(depthFrame.ptr<uint16_t>(0), depthFrame.total(), gateMin, gateMax, depthMask.data);
+
+    //Project every depth pixel in band into the thermal image
+    memset(mask.data, 0, mask.total());
+    const uint16_t * d = depthFrame.ptr<uint16_t>(0);
+    const uint8_t * in = depthMask.ptr<uint8_t>(0);
+    for(size_t i = 0; i < rays.size(); i++)
+    {
+        if(!in[i])
+            continue;
+
+        float z = d[i] * 0.001f;
+        float x = rays[i].x * z;
+        float y = rays[i].y * z;
+
+        float tz = R[6] * x + R[7] * y + R[8] * z + T[2];
+        if(tz <= 0)
+            continue;
+        float tx = R[0] * x + R[1] * y + R[2] * z + T[0];
+        float ty = R[3] * x + R[4] * y + R[5] * z + T[1];
+
+        int u = int(fx * tx / tz + cx + 0.5f);
+        int v = int(fy * ty / tz + cy + 0.5f);
+        if(u >= 0 && v >= 0 && u < mask.cols && v < mask.rows)
+            mask.ptr<uint8_t>(v)[u] = 255;
+    }
+    cv::dilate(mask, mask, dilation);
+
+    return true;
+}
+
+std::string SparseEncoder::Describe() const
+{
+    std::string text = boost::lexical_cast<std::string>(roi.width) + "x" + boost::lexical_cast<std::string>(roi.height) +
+                       " at " + boost::lexical_cast<std::string>(roi.x) + "," + boost::lexical_cast<std::string>(roi.y) +
+                       " of " + boost::lexical_cast<std::string>(source.width) + "x" +
+                       boost::lexical_cast<std::string>(source.height);
+
+    if(gate == Depth)
+        text += ", depth in " + boost::lexical_cast<std::string>(gateMin) + "-" + boost::lexical_cast<std::string>(gateMax) + " mm";
+    else if(gate == Thermal)
+        text += ", registered depth in " + boost::lexical_cast<std::string>(gateMin) + "-" +
+                boost::lexical_cast<std::string>(gateMax) + " mm";
+    return text;
+}
+
+int SparseEncoder::TornDepth() const
+{
+    return tornDepth;
+}
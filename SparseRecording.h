@@ -0,0 +1,113 @@
+/*
+ * SparseRecording.h
+ *
+ *  Created on: 19/10 2026
+ *      Author: Baobei Xu
+ */
+
+#ifndef SPARSERECORDING_H_
+#define SPARSERECORDING_H_
+
+#include <map>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <opencv2/opencv.hpp>
+
+#include "FrameSource.h"
+#include "RigCalibration.h"
+
+/////////////////////////////////////Region-of-interest and depth-gated recording. A stream with an ROI only stores the
+/// pixels inside it; with a depth gate, depth only stores pixels within [gateMin, gateMax] mm and thermal only the
+/// pixels that depth in that band projects to (through the rig calibration). Such streams are recorded as
+/// CONTAINER_SPARSE frames (see SessionContainer.h), whose header keeps the full frame size, so ContainerLoad
+/// returns full frames with 0 outside the recorded pixels.
+struct SparseConfig
+{
+    SparseConfig()
+     : gate(false),
+       gateMin(500),
+       gateMax(2000)
+    {}
+
+    /////////////////////////////////////Per stream, looked up by full name ("kinect1/depth") then by stream kind
+    /// ("depth"), in recorded (upright) image coordinates
+    std::map<std::string, cv::Rect> rois;
+
+    bool gate;
+    int gateMin;
+    int gateMax;
+
+    /////////////////////////////////////ROI of stream clipped to a width x height frame, the whole frame without one
+    cv::Rect RoiFor(const std::string & stream, int width, int height) const;
+
+    /////////////////////////////////////Whether frames of stream are recorded sparse at all
+    bool Active(const std::string & stream) const;
+
+    /////////////////////////////////////"<stream>=x,y,w,h"
+    bool ParseRoi(const std::string & rule);
+
+    /////////////////////////////////////"<min>,<max>" in mm
+    bool ParseGate(const std::string & range);
+
+    std::string ToString() const;
+};
+
+/////////////////////////////////////Mask of depth pixels within [min, max] (255 in band, 0 otherwise), SSE2 where
+/// available. Returns the number of pixels in band.
+int DepthBandMask(const uint16_t * depth, int n, uint16_t min, uint16_t max, uint8_t * mask);
+
+/////////////////////////////////////Turns the frames of one writer lane into CONTAINER_SPARSE payloads. Thermal gating
+/// registers the depth frame closest in time into the thermal image; it needs a valid calibration and the depth ring
+/// of the Kinect it was calibrated against, otherwise thermal is only cropped. One instance per writer lane.
+class SparseEncoder
+{
+public:
+    SparseEncoder(const SparseConfig & config,
+                  const FrameSource & source,
+                  const FrameSource & depth = FrameSource(),
+                  const RigCalibration & calibration = RigCalibration());
+
+    /////////////////////////////////////frame is the upright frame of the lane, timestamp its capture time
+    void Encode(const cv::Mat & frame, int64_t timestamp, std::vector<uint8_t> & payload);
+
+    /////////////////////////////////////What gets stored, for session.txt
+    std::string Describe() const;
+
+    /////////////////////////////////////Thermal frames stored ungated because their depth partner was overwritten
+    /// while it was copied
+    int TornDepth() const;
+
+private:
+    enum Gate
+    {
+        None,
+        Depth,
+        Thermal
+    };
+
+    const FrameSource source;
+    const FrameSource depth;
+    const cv::Rect roi;
+    const uint16_t gateMin;
+    const uint16_t gateMax;
+    Gate gate;
+
+    cv::Mat mask;
+
+    /////////////////////////////////////Thermal gating: undistorted IR ray (x/z, y/z) per depth pixel, IR -> thermal
+    /// extrinsics and thermal pinhole, the depth frame last registered and its sequence
+    std::vector<cv::Point2f> rays;
+    float R[9];
+    float T[3];
+    float fx, fy, cx, cy;
+    cv::Mat dilation;
+    cv::Mat depthFrame;
+    cv::Mat depthMask;
+    int registeredSeq;
+    int tornDepth;
+
+    bool RegisterDepth(int64_t timestamp);
+};
+
+#endif /* SPARSERECORDING_H_ */
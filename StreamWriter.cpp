@@ -0,0 +1,512 @@
+#include "StreamWriter.h"
+#include "ThreadPolicy.h"
+
+#include <iostream>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <boost/lexical_cast.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+StreamWriter::StreamWriter(const FrameSource & source,
+                           const std::string & folder,
+                           SessionMetadata & metadata,
+                           const JournalConfig & journal,
+                           const ChangeConfig & change,
+                           SparseEncoder * sparse,
+                           StripeSet * stripes)
+ : name(source.name),
+   baseFolder(folder),
+   source(source),
+   metadata(metadata),
+   journal(journal),
+   containerMode(journal.container || sparse),
+   videoMode(journal.video && !sparse),
+   stripes(stripes),
+   stripeMember(0),
+   chunkLeft(0),
+   detector(0),
+   keyframeOffset(-1),
+   sparse(sparse),
+   writeThread(0)
+{
+    //Every frame of a video archive is encoded, there is nothing to reference
+    if(change.enabled && !videoMode)
+        detector = new ChangeDetector(change.For(name), change.blockSize, change.keyframeInterval);
+
+    writing.assignValue(false);
+    this->folder.assignValue(folder);
+    compression.assignValue(3);
+    decimation.assignValue(1);
+    backlog.assignValue(0);
+    latency.assignValue(0);
+    written.assignValue(0);
+    dropped.assignValue(0);
+    decimated.assignValue(0);
+    referenced.assignValue(0);
+}
+
+StreamWriter::~StreamWriter()
+{
+    Stop();
+    delete detector;
+    delete sparse;
+}
+
+void StreamWriter::Start(int compression)
+{
+    if(writeThread || writing.getValue())
+        return;
+
+    this->compression.assignValue(compression);
+
+    if(!index.Open(baseFolder + "/index.bin", name))
+        std::cout << "Could not open index for " << name << ", recording without it" << std::endl;
+
+    writing.assignValue(true);
+    writeThread = new boost::thread(boost::bind(&StreamWriter::WritingThread,
+                                                this));
+}
+
+void StreamWriter::Stop()
+{
+    if(!writeThread)
+        return;
+
+    writing.assignValue(false);
+    writeThread->join();
+    delete writeThread;
+    writeThread = 0;
+
+    index.Close();
+}
+
+bool StreamWriter::IsWriting()
+{
+    return writing.getValue();
+}
+
+void StreamWriter::SetCompression(int level)
+{
+    compression.assignValue(level);
+}
+
+void StreamWriter::SetDecimation(int factor)
+{
+    decimation.assignValue(std::max(1, factor));
+}
+
+void StreamWriter::SetFolder(const std::string & folder)
+{
+    this->folder.assignValue(folder);
+}
+
+int StreamWriter::GetCompression()
+{
+    return compression.getValue();
+}
+
+int StreamWriter::GetDecimation()
+{
+    return decimation.getValue();
+}
+
+int StreamWriter::Backlog()
+{
+    return backlog.getValue();
+}
+
+int StreamWriter::Capacity()
+{
+    return source.numBuffers;
+}
+
+float StreamWriter::LatencyMs()
+{
+    return latency.getValue();
+}
+
+int StreamWriter::Written()
+{
+    return written.getValue();
+}
+
+int StreamWriter::Dropped()
+{
+    return dropped.getValue();
+}
+
+int StreamWriter::Decimated()
+{
+    return decimated.getValue();
+}
+
+int StreamWriter::Referenced()
+{
+    return referenced.getValue();
+}
+
+int64_t StreamWriter::BytesWritten()
+{
+    return bytesWritten.Get();
+}
+
+void StreamWriter::WritingThread()
+{
+    ThreadPolicies::Apply("writer", "write-" + name);
+
+    cv::Mat frame(source.height, source.width, source.type);
+    cv::Mat fframe;
+
+    std::vector<int> params(2);
+    params[0] = CV_IMWRITE_PNG_COMPRESSION;
+
+    int nextSeq = -1;
+
+    //Consecutive frames that could not be stored, one event per run rather than per frame
+    int unstored = 0;
+
+    std::vector<uint8_t> payload;
+    lastCommit = boost::posix_time::microsec_clock::local_time();
+
+    while(writing.getValue())
+    {
+        int latest = source.latestIndex->getValue();
+        if(latest == -1 || latest < nextSeq)
+        {
+            //A quiet stream still gets its last frames committed on time
+            if(!pending.empty() &&
+               (boost::posix_time::microsec_clock::local_time() - lastCommit).total_milliseconds() >= journal.commitMs)
+                Commit();
+
+            backlog.assignValue(0);
+            boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+            continue;
+        }
+
+        //Recording starts at the newest frame
+        if(nextSeq == -1)
+            nextSeq = latest;
+
+        //The capture side is about to overwrite the slot we want, jump ahead and say so
+        if(latest - nextSeq >= source.numBuffers - 2)
+        {
+            int resume = latest - source.numBuffers / 2;
+            dropped.assignValue(dropped.getValue() + resume - nextSeq);
+            metadata.Event(name + " ring overrun, dropped frames " +
+                           boost::lexical_cast<std::string>(nextSeq) + "-" +
+                           boost::lexical_cast<std::string>(resume - 1));
+            nextSeq = resume;
+        }
+
+        backlog.assignValue(latest - nextSeq + 1);
+
+        int factor = decimation.getValue();
+        if(factor > 1 && nextSeq % factor != 0)
+        {
+            decimated++;
+            nextSeq++;
+            continue;
+        }
+
+        boost::posix_time::ptime begin = boost::posix_time::microsec_clock::local_time();
+
+        //A frame the capture side overwrote while we copied it is dropped rather than stored torn
+        int64_t timestamp;
+        if(!source.Read(nextSeq, frame.data, timestamp))
+        {
+            dropped.assignValue(dropped.getValue() + 1);
+            metadata.Event(name + " frame " + boost::lexical_cast<std::string>(nextSeq) + " overwritten while copying, dropped");
+            nextSeq++;
+            continue;
+        }
+
+        params[1] = compression.getValue();
+
+        //Spilling overrides the stripe; otherwise a new chunk starts on the root the stripe hands out
+        std::string currentFolder = folder.getValue();
+        uint32_t location = 0;
+        int member = -1;
+        if(currentFolder != baseFolder)
+        {
+            location = SESSIONINDEX_SPILL_LOCATION;
+        }
+        else if(stripes)
+        {
+            if(chunkLeft <= 0)
+            {
+                stripeMember = stripes->Next();
+                chunkLeft = stripes->chunkFrames;
+            }
+            chunkLeft--;
+            member = stripeMember;
+            location = stripes->Location(member);
+            currentFolder = stripes->Folder(member, baseFolder);
+        }
+        Output * output = OutputFor(currentFolder, location, member);
+
+        int64_t size = 0;
+        int64_t offset = -1;
+        uint32_t flags = 0;
+        bool stored = false;
+
+        //Unchanged frames repeat the last keyframe instead of being encoded again; a keyframe is only referenced
+        //from the folder it was written to
+        bool reference = false;
+        if(detector)
+        {
+            if(currentFolder != keyframeFolder)
+                detector->Reset();
+            reference = detector->IsRedundant(frame);
+        }
+
+        if(reference)
+        {
+            if(containerMode)
+            {
+                stored = output->container.AppendReference(nextSeq, timestamp, keyframeOffset) >= 0;
+                offset = keyframeOffset;
+                if(stored)
+                    size = sizeof(ContainerRecord) + sizeof(keyframeOffset);
+            }
+            else
+            {
+                std::string imagename = currentFolder + "/" + boost::lexical_cast<std::string>(timestamp) + ".png";
+                stored = link(keyframePath.c_str(), imagename.c_str()) == 0;
+            }
+
+            if(stored)
+            {
+                flags |= INDEX_FLAG_REFERENCE;
+                referenced++;
+            }
+            else
+            {
+                //Could not reference it, store it in full as the new keyframe
+                detector->Reset();
+                detector->IsRedundant(frame);
+            }
+        }
+
+        if(!stored)
+        {
+            if(source.flip)
+                cv::flip(frame, fframe, 0);
+            const cv::Mat & image = source.flip ? fframe : frame;
+
+            if(containerMode)
+            {
+                if(output->container.IsOpen())
+                {
+                    if(sparse)
+                        sparse->Encode(image, timestamp, payload);
+                    else
+                        ContainerEncode(image, CONTAINER_PNG, params[1], payload);
+                    offset = output->container.Append(nextSeq, timestamp, payload.empty() ? 0 : &payload[0], payload.size());
+                    stored = offset >= 0;
+                    if(stored)
+                        size = sizeof(ContainerRecord) + payload.size();
+                }
+                keyframeOffset = offset;
+            }
+            else if(videoMode)
+            {
+                if(output->video.IsOpen())
+                {
+                    int64_t before = output->video.BytesWritten();
+                    int64_t pts = output->video.Append(image, timestamp);
+                    stored = pts >= 0;
+                    if(stored)
+                    {
+                        offset = ArchiveVideoOffset(output->videoSegment, pts);
+                        flags |= INDEX_FLAG_VIDEO;
+                        size = output->video.BytesWritten() - before;
+                    }
+                }
+            }
+            else
+            {
+                std::string imagename = currentFolder + "/" + boost::lexical_cast<std::string>(timestamp) + ".png";
+                cv::imwrite(imagename, image, params);
+
+                boost::system::error_code error;
+                boost::uintmax_t fileSize = boost::filesystem::file_size(imagename, error);
+                stored = !error;
+                if(stored)
+                    size = fileSize;
+                keyframePath = imagename;
+            }
+            keyframeFolder = currentFolder;
+        }
+
+        //The index always lives in the session folder, frames elsewhere are found through their location. Records
+        //only reach it once their group is committed.
+        output->dirty = true;
+        if(stored)
+        {
+            IndexRecord record;
+            record.sequence = nextSeq;
+            record.timestamp = timestamp;
+            record.offset = offset;
+            record.flags = flags | (location == SESSIONINDEX_SPILL_LOCATION ? INDEX_FLAG_SPILLED : 0);
+            record.location = location;
+            pending.push_back(record);
+
+            bytesWritten.Add(size);
+            output->bytes += size;
+        }
+
+        int64_t elapsed = (boost::posix_time::microsec_clock::local_time() - begin).total_microseconds();
+        output->microseconds += elapsed;
+
+        float ms = elapsed / 1000.0f;
+        float smoothed = latency.getValue();
+        latency.assignValue(smoothed == 0 ? ms : smoothed * 0.9f + ms * 0.1f);
+
+        //Commits are amortized over the group and stay out of the per-frame latency the backpressure policy watches
+        if(int(pending.size()) >= journal.commitFrames ||
+           (boost::posix_time::microsec_clock::local_time() - lastCommit).total_milliseconds() >= journal.commitMs)
+            Commit();
+
+        if(stored)
+        {
+            if(unstored > 0)
+                metadata.Event(name + " stored again from frame " + boost::lexical_cast<std::string>(nextSeq) + " after " +
+                               boost::lexical_cast<std::string>(unstored) + " unstored frames");
+            unstored = 0;
+            written++;
+        }
+        else
+        {
+            if(unstored == 0)
+                metadata.Event(name + " frame " + boost::lexical_cast<std::string>(nextSeq) + " could not be stored, dropped");
+            unstored++;
+            dropped.assignValue(dropped.getValue() + 1);
+        }
+        nextSeq++;
+    }
+
+    Commit();
+    if(unstored > 0)
+        metadata.Event(name + " last " + boost::lexical_cast<std::string>(unstored) + " frames could not be stored, dropped");
+    if(sparse && sparse->TornDepth() > 0)
+        metadata.Event(name + " stored " + boost::lexical_cast<std::string>(sparse->TornDepth()) +
+                       " frames ungated, their depth partner was overwritten while copying");
+    for(size_t i = 0; i < outputs.size(); i++)
+        delete outputs[i];
+    outputs.clear();
+
+    backlog.assignValue(0);
+}
+
+void StreamWriter::Commit()
+{
+    bool durable = true;
+
+    //Data first, on every folder written since the last commit...
+    for(size_t i = 0; i < outputs.size(); i++)
+    {
+        Output * output = outputs[i];
+        if(!output->dirty)
+            continue;
+
+        boost::posix_time::ptime begin = boost::posix_time::microsec_clock::local_time();
+        if(containerMode)
+        {
+            durable = (output->container.IsOpen() ? output->container.Sync() : true) && durable;
+        }
+        else if(videoMode)
+        {
+            durable = (output->video.IsOpen() ? output->video.Sync() : true) && durable;
+        }
+        else
+        {
+            //One syncfs per folder instead of an fsync per frame file
+            int fd = open(output->folder.c_str(), O_RDONLY | O_DIRECTORY);
+            durable = fd >= 0 && syncfs(fd) == 0 && durable;
+            if(fd >= 0)
+                close(fd);
+        }
+
+        //A stripe root is as fast as it stores and syncs
+        output->microseconds += (boost::posix_time::microsec_clock::local_time() - begin).total_microseconds();
+        if(stripes && output->member >= 0)
+            stripes->Report(output->member, output->bytes, output->microseconds);
+
+        output->dirty = false;
+        output->bytes = 0;
+        output->microseconds = 0;
+    }
+
+    //...then the records that point at it
+    for(size_t i = 0; i < pending.size(); i++)
+        index.Append(pending[i].sequence, pending[i].timestamp, pending[i].offset, pending[i].flags, pending[i].location);
+    if(!pending.empty())
+        durable = index.Sync() && durable;
+
+    if(!durable)
+        metadata.Event(name + " commit failed, last " + boost::lexical_cast<std::string>(pending.size()) +
+                       " frames may not survive a power loss");
+
+    pending.clear();
+    lastCommit = boost::posix_time::microsec_clock::local_time();
+}
+
+StreamWriter::Output * StreamWriter::OutputFor(const std::string & folder, uint32_t location, int member)
+{
+    for(size_t i = 0; i < outputs.size(); i++)
+    {
+        if(outputs[i]->folder == folder)
+            return outputs[i];
+    }
+
+    Output * output = new Output;
+    output->folder = folder;
+    output->location = location;
+    output->member = member;
+    output->videoSegment = 0;
+    output->dirty = false;
+    output->bytes = 0;
+    output->microseconds = 0;
+    outputs.push_back(output);
+
+    //A folder that fails to open stays closed for this recording, its frames are not stored
+    if(containerMode)
+        OpenContainer(output);
+    else if(videoMode)
+        OpenVideo(output);
+
+    return output;
+}
+
+bool StreamWriter::OpenContainer(Output * output)
+{
+    if(!output->container.Open(output->folder + "/" + CONTAINER_FILE, name, source.width, source.height, source.type,
+                               sparse ? CONTAINER_SPARSE : CONTAINER_PNG))
+    {
+        metadata.Event(name + " cannot open container in " + output->folder);
+        return false;
+    }
+    return true;
+}
+
+bool StreamWriter::OpenVideo(Output * output)
+{
+    //Archives are never appended to, every recording into the folder starts the next segment
+    IndexRecord record;
+    for(output->videoSegment = 0; ; output->videoSegment++)
+    {
+        record.offset = ArchiveVideoOffset(output->videoSegment, 0);
+        if(!boost::filesystem::exists(output->folder + "/" + record.VideoFileName()))
+            break;
+    }
+
+    if(!output->video.Open(output->folder + "/" + record.VideoFileName(), name, source.width, source.height, source.type,
+                           journal.videoThreads))
+    {
+        metadata.Event(name + " cannot open video archive in " + output->folder);
+        return false;
+    }
+    return true;
+}
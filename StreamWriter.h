@@ -0,0 +1,155 @@
+/*
+ * StreamWriter.h
+ *
+ *  Created on: 19/10 2026
+ *      Author: Baobei Xu
+ */
+
+#ifndef STREAMWRITER_H_
+#define STREAMWRITER_H_
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <opencv2/opencv.hpp>
+#include <boost/thread.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include "ThreadMutexObject.h"
+#include "FrameSource.h"
+#include "SessionMetadata.h"
+#include "SessionIndex.h"
+#include "Telemetry.h"
+#include "SessionJournal.h"
+#include "SessionContainer.h"
+#include "ArchiveVideo.h"
+#include "ChangeDetector.h"
+#include "SparseRecording.h"
+#include "Striping.h"
+
+/////////////////////////////////////Writes every frame of one capture ring to <folder>/<timestamp>.png, or to
+/// <folder>/frames.fks in container mode, in sequence order. Frames are only skipped when the ring overruns
+/// (logged) or when decimation is requested. Frames are committed in groups (see SessionJournal.h): once a group's
+/// data is durable its records are appended to <folder>/index.bin (see SessionIndex.h). With change detection,
+/// frames that match the last keyframe are stored as a hard link to its PNG or a reference record in the container.
+/// Lanes with a SparseEncoder (ROI / depth-gated recording) always record sparse frames into a container. In video
+/// mode frames go to a lossless <folder>/frames.mkv instead (a new frames_<n>.mkv per recording), without change
+/// detection. With a StripeSet, chunks of frames go to <root>/<folder> of the stripe roots in turn; every root keeps
+/// its own open PNG folder, container or archive, and the one index in the session folder records each frame's
+/// location.
+class StreamWriter
+{
+public:
+    StreamWriter(const FrameSource & source,
+                 const std::string & folder,
+                 SessionMetadata & metadata,
+                 const JournalConfig & journal = JournalConfig(),
+                 const ChangeConfig & change = ChangeConfig(),
+                 SparseEncoder * sparse = 0,
+                 StripeSet * stripes = 0);
+    virtual ~StreamWriter();
+
+    void Start(int compression);
+    void Stop();
+    bool IsWriting();
+
+    const std::string name;
+    const std::string baseFolder;
+
+    /////////////////////////////////////Knobs for the backpressure policy, safe to call while writing
+    void SetCompression(int level);
+    void SetDecimation(int factor);
+    void SetFolder(const std::string & folder);
+    int GetCompression();
+    int GetDecimation();
+
+    /////////////////////////////////////Frames captured but not yet written, and the ring size that bounds it
+    int Backlog();
+    int Capacity();
+
+    /////////////////////////////////////Smoothed encode + write time of one frame
+    float LatencyMs();
+
+    /////////////////////////////////////Frames stored; dropped counts ring overruns, torn copies and failed stores
+    int Written();
+    int Dropped();
+    int Decimated();
+
+    /////////////////////////////////////Frames stored as references to an unchanged keyframe
+    int Referenced();
+
+    /////////////////////////////////////Bytes of encoded frames on disk so far
+    int64_t BytesWritten();
+
+private:
+    const FrameSource source;
+    SessionMetadata & metadata;
+    SessionIndexWriter index;
+
+    const JournalConfig journal;
+    bool containerMode;
+    bool videoMode;
+
+    /////////////////////////////////////A folder frames went to this recording (stream folder, spill folder or stripe
+    /// root), opened on first use and kept open until Stop
+    struct Output
+    {
+        std::string folder;
+        uint32_t location;
+
+        /////////////////////////////////////Stripe member, -1 outside the stripe
+        int member;
+
+        SessionContainerWriter container;
+        ArchiveVideoWriter video;
+        int videoSegment;
+
+        /////////////////////////////////////Written since the last commit: whether anything was, bytes and the time
+        /// spent storing them
+        bool dirty;
+        int64_t bytes;
+        int64_t microseconds;
+    };
+    std::vector<Output *> outputs;
+
+    /////////////////////////////////////Shared with the other lanes, 0 without striping; member and frames left of
+    /// the current chunk
+    StripeSet * stripes;
+    int stripeMember;
+    int chunkLeft;
+
+    /////////////////////////////////////Static-scene suppression, 0 when disabled; where the current keyframe lives
+    ChangeDetector * detector;
+    std::string keyframeFolder;
+    std::string keyframePath;
+    int64_t keyframeOffset;
+
+    /////////////////////////////////////ROI / depth-gated encoding, owned, 0 for full frames
+    SparseEncoder * sparse;
+
+    /////////////////////////////////////Index records written since the last commit
+    std::vector<IndexRecord> pending;
+    boost::posix_time::ptime lastCommit;
+
+    boost::thread * writeThread;
+    ThreadMutexObject<bool> writing;
+
+    ThreadMutexObject<std::string> folder;
+    ThreadMutexObject<int> compression;
+    ThreadMutexObject<int> decimation;
+    ThreadMutexObject<int> backlog;
+    ThreadMutexObject<float> latency;
+    ThreadMutexObject<int> written;
+    ThreadMutexObject<int> dropped;
+    ThreadMutexObject<int> decimated;
+    ThreadMutexObject<int> referenced;
+    TelemetryCounter bytesWritten;
+
+    void WritingThread();
+    void Commit();
+    Output * OutputFor(const std::string & folder, uint32_t location, int member);
+    bool OpenContainer(Output * output);
+    bool OpenVideo(Output * output);
+};
+
+#endif /* STREAMWRITER_H_ */
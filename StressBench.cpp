@@ -0,0 +1,660 @@
+/*
+ * StressBench.cpp
+ *
+ *  Created on: 19/10 2026
+ *      Author: Baobei Xu
+ *
+ *  Stress tests of the capture-ring handoff and microbenchmarks of the per-frame conversions, built with
+ *  -DBUILD_BENCHMARKS=ON and run by ctest. The stress tests run the onNewFrame pattern (seqlock the slot of
+ *  latest + 1, write it, then increment latest) against the FrameSource reads, with every 16 bit word of frame n
+ *  set to n, so a copy that mixes two frames is caught:
+ *
+ *      mutex   ThreadMutexObject increments and assignments from many threads, no update may be lost
+ *      writer  StreamWriter's lane: FrameSource::Read of every frame in order, jumping ahead on ring overrun
+ *      latest  TimerCallback: FrameSource::Snapshot of the newest frame
+ *
+ *  Copies the producer overwrote must be rejected by the reads (counted), any torn copy they return fails the run.
+ *  The benchmarks print the best time per call; with --baseline, a benchmark that got slower than the baseline by
+ *  more than --tolerance percent fails the run.
+ *
+ *      StressBench [--stress mutex,writer,latest] [--seconds S] [--slots N] [--rate HZ]
+ *                  [--bench] [--bench-ms MS] [--baseline FILE] [--save FILE] [--tolerance PERCENT]
+ */
+
+#include <map>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/algorithm/string.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <opencv2/opencv.hpp>
+
+#include "ThreadMutexObject.h"
+#include "DisplayConvert.h"
+#include "SessionClock.h"
+#include "SessionIndex.h"
+#include "FrameSource.h"
+#include "ThermalFilter.h"
+#include "ThermalUpsampler.h"
+
+//Frame sizes of the Kinect depth / infrared and FLIR thermal rings
+static const int depthWidth = 512;
+static const int depthHeight = 424;
+static const int thermalWidth = 640;
+static const int thermalHeight = 512;
+
+struct StressOptions
+{
+    StressOptions()
+     : seconds(2),
+       slots(4),
+       rate(0)
+    {}
+
+    double seconds;
+
+    /////////////////////////////////////Ring size; the capture rings have 100 slots, a small ring makes the
+    /// producer lap the readers within seconds instead of hours
+    int slots;
+
+    /////////////////////////////////////Frames per second of the producer, 0 for as fast as it can
+    int rate;
+};
+
+struct Ring
+{
+    Ring(int numBuffers, int width, int height)
+     : numBuffers(numBuffers),
+       width(width),
+       height(height),
+       memory(size_t(numBuffers) * width * height * 2),
+       frameBuffers(numBuffers),
+       slots(numBuffers),
+       latestIndex(-1)
+    {
+        for(int i = 0; i < numBuffers; i++)
+        {
+            frameBuffers[i].first = &memory[size_t(i) * width * height * 2];
+            frameBuffers[i].second = -1;
+        }
+    }
+
+    FrameSource Source()
+    {
+        return FrameSource("stress", &frameBuffers[0], numBuffers, latestIndex, width, height, CV_16UC1, false, &slots[0]);
+    }
+
+    const int numBuffers;
+    const int width, height;
+    std::vector<uint8_t> memory;
+    std::vector<std::pair<uint8_t *, int64_t> > frameBuffers;
+    std::vector<FrameSlot> slots;
+    ThreadMutexObject<int> latestIndex;
+};
+
+struct HandoffResult
+{
+    HandoffResult()
+     : produced(0),
+       copied(0),
+       overruns(0),
+       rejected(0),
+       torn(0)
+    {}
+
+    int produced;
+    int copied;
+    int overruns;
+
+    /////////////////////////////////////Reads that failed because the producer reused the slot
+    int rejected;
+
+    /////////////////////////////////////Copies returned as good that mix frames or carry another frame's timestamp
+    int torn;
+};
+
+static void Produce(Ring & ring, ThreadMutexObject<bool> & running, int rate, int & produced)
+{
+    const size_t words = size_t(ring.width) * ring.height;
+    boost::posix_time::ptime start = boost::posix_time::microsec_clock::local_time();
+    int seq = 0;
+
+    while(running.getValue())
+    {
+        //Same steps as onNewFrame
+        int sequence = ring.latestIndex.getValue() + 1;
+        int bufferIndex = sequence % ring.numBuffers;
+        FrameSlotBeginWrite(ring.slots[bufferIndex]);
+        uint16_t * data = (uint16_t *)ring.frameBuffers[bufferIndex].first;
+        std::fill(data, data + words, uint16_t(sequence));
+        ring.frameBuffers[bufferIndex].second = sequence;
+        FrameSlotEndWrite(ring.slots[bufferIndex], sequence);
+        ring.latestIndex++;
+        seq++;
+
+        if(rate > 0)
+        {
+            boost::posix_time::ptime due = start + boost::posix_time::microseconds(int64_t(seq) * 1000000 / rate);
+            boost::this_thread::sleep(due);
+        }
+    }
+
+    produced = seq;
+}
+
+//A copy is whole if all of its words and its timestamp belong to frame seq
+static bool Intact(const std::vector<uint8_t> & frame, int64_t timestamp, int seq)
+{
+    if(timestamp != seq)
+        return false;
+
+    const uint16_t * words = (const uint16_t *)&frame[0];
+    const size_t count = frame.size() / 2;
+    const uint16_t expected = uint16_t(seq);
+    for(size_t i = 0; i < count; i++)
+    {
+        if(words[i] != expected)
+            return false;
+    }
+    return true;
+}
+
+static void ConsumeWriter(Ring & ring, ThreadMutexObject<bool> & running, HandoffResult & result)
+{
+    FrameSource source = ring.Source();
+    std::vector<uint8_t> frame(source.FrameSize());
+    int nextSeq = -1;
+
+    while(running.getValue())
+    {
+        int latest = source.latestIndex->getValue();
+        if(latest == -1 || latest < nextSeq)
+        {
+            boost::this_thread::yield();
+            continue;
+        }
+
+        if(nextSeq == -1)
+            nextSeq = latest;
+
+        //StreamWriter::WriteThread's overrun rule
+        if(latest - nextSeq >= source.numBuffers - 2)
+        {
+            result.overruns++;
+            nextSeq = latest - source.numBuffers / 2;
+        }
+
+        int64_t timestamp;
+        if(!source.Read(nextSeq, &frame[0], timestamp))
+            result.rejected++;
+        else if(!Intact(frame, timestamp, nextSeq))
+            result.torn++;
+        result.copied++;
+        nextSeq++;
+    }
+}
+
+static void ConsumeLatest(Ring & ring, ThreadMutexObject<bool> & running, HandoffResult & result)
+{
+    FrameSource source = ring.Source();
+    std::vector<uint8_t> frame(source.FrameSize());
+    int lastSeq = -1;
+
+    while(running.getValue())
+    {
+        if(source.latestIndex->getValue() == lastSeq)
+        {
+            boost::this_thread::yield();
+            continue;
+        }
+
+        int sequence;
+        int64_t timestamp;
+        if(!source.Snapshot(&frame[0], sequence, timestamp))
+        {
+            result.rejected++;
+            continue;
+        }
+
+        if(!Intact(frame, timestamp, sequence))
+            result.torn++;
+        result.copied++;
+        lastSeq = sequence;
+    }
+}
+
+static void Increment(ThreadMutexObject<int> & counter, int times)
+{
+    for(int i = 0; i < times; i++)
+        counter++;
+}
+
+//Both halves always carry the same number, so a reader can tell a value that was copied half way through an update
+static void AssignHalves(ThreadMutexObject<uint64_t> & value, ThreadMutexObject<bool> & running)
+{
+    for(uint64_t n = 1; running.getValue(); n = (n + 1) & 0xFFFFFFFF)
+        value.assignValue((n << 32) | n);
+}
+
+static void ReadHalves(ThreadMutexObject<uint64_t> & value, ThreadMutexObject<bool> & running, int & mixed)
+{
+    while(running.getValue())
+    {
+        uint64_t current = value.getValue();
+        if(current >> 32 != (current & 0xFFFFFFFF))
+            mixed++;
+    }
+}
+
+static bool StressMutex(const StressOptions & options)
+{
+    const int numThreads = std::max(4, int(boost::thread::hardware_concurrency()));
+    const int increments = 100000;
+
+    ThreadMutexObject<int> counter(0);
+    boost::thread_group incrementers;
+    for(int i = 0; i < numThreads; i++)
+        incrementers.create_thread(boost::bind(&Increment, boost::ref(counter), increments));
+    incrementers.join_all();
+
+    ThreadMutexObject<uint64_t> value(0);
+    ThreadMutexObject<bool> running(true);
+    std::vector<int> mixed(numThreads / 2, 0);
+    boost::thread_group pairs;
+    for(int i = 0; i < numThreads / 2; i++)
+    {
+        pairs.create_thread(boost::bind(&AssignHalves, boost::ref(value), boost::ref(running)));
+        pairs.create_thread(boost::bind(&ReadHalves, boost::ref(value), boost::ref(running), boost::ref(mixed[i])));
+    }
+    boost::this_thread::sleep(boost::posix_time::milliseconds(int64_t(options.seconds * 1000)));
+    running.assignValue(false);
+    pairs.join_all();
+
+    int totalMixed = 0;
+    for(size_t i = 0; i < mixed.size(); i++)
+        totalMixed += mixed[i];
+
+    std::cout << "mutex: " << counter.getValue() << " of " << numThreads * increments << " increments, "
+              << totalMixed << " mixed reads" << std::endl;
+
+    bool passed = counter.getValue() == numThreads * increments && totalMixed == 0;
+    if(!passed)
+        std::cout << "mutex: FAILED" << std::endl;
+    return passed;
+}
+
+static void PrintHandoff(const std::string & name, const HandoffResult & result, double seconds)
+{
+    std::cout << name << ": " << result.produced << " frames produced, " << result.copied << " copied in "
+              << seconds << " s, " << result.overruns << " overruns, " << result.rejected << " overwritten copies rejected, "
+              << result.torn << " torn" << std::endl;
+}
+
+static bool StressHandoff(const std::string & name, const StressOptions & options)
+{
+    Ring ring(options.slots, depthWidth, depthHeight);
+    ThreadMutexObject<bool> running(true);
+    HandoffResult result;
+
+    boost::thread producer(boost::bind(&Produce, boost::ref(ring), boost::ref(running), options.rate,
+                                       boost::ref(result.produced)));
+    boost::thread consumer(name == "writer" ? boost::bind(&ConsumeWriter, boost::ref(ring), boost::ref(running), boost::ref(result))
+                                            : boost::bind(&ConsumeLatest, boost::ref(ring), boost::ref(running), boost::ref(result)));
+
+    boost::this_thread::sleep(boost::posix_time::milliseconds(int64_t(options.seconds * 1000)));
+    running.assignValue(false);
+    producer.join();
+    consumer.join();
+
+    PrintHandoff(name, result, options.seconds);
+
+    bool passed = result.copied > 0 && result.torn == 0;
+    if(!passed)
+        std::cout << name << ": FAILED" << std::endl;
+    return passed;
+}
+
+struct Benchmark
+{
+    std::string name;
+    boost::function<void()> run;
+
+    /////////////////////////////////////Bytes of frame data one call goes through, 0 if not a frame operation
+    size_t bytes;
+};
+
+//Best time of one call over batches of about a millisecond each, in nanoseconds
+static double Measure(const boost::function<void()> & run, int milliseconds)
+{
+    run();
+
+    int batch = 1;
+    while(true)
+    {
+        boost::posix_time::ptime begin = boost::posix_time::microsec_clock::local_time();
+        for(int i = 0; i < batch; i++)
+            run();
+        if((boost::posix_time::microsec_clock::local_time() - begin).total_microseconds() >= 1000 || batch >= (1 << 24))
+            break;
+        batch *= 2;
+    }
+
+    double best = -1;
+    boost::posix_time::ptime end = boost::posix_time::microsec_clock::local_time() + boost::posix_time::milliseconds(milliseconds);
+    do
+    {
+        boost::posix_time::ptime begin = boost::posix_time::microsec_clock::local_time();
+        for(int i = 0; i < batch; i++)
+            run();
+        double elapsed = (boost::posix_time::microsec_clock::local_time() - begin).total_microseconds() * 1000.0 / batch;
+        if(best < 0 || elapsed < best)
+            best = elapsed;
+    }
+    while(boost::posix_time::microsec_clock::local_time() < end);
+
+    return best;
+}
+
+static void Copy(const cv::Mat & src, cv::Mat & dst)
+{
+    memcpy(dst.data, src.data, src.total() * src.elemSize());
+}
+
+static void NormalizeDepth(const cv::Mat & src, cv::Mat & dst)
+{
+    Normalize(src, dst, 8.0);
+}
+
+static void Flip(const cv::Mat & src, cv::Mat & dst)
+{
+    cv::flip(src, dst, 0);
+}
+
+static void GrayToRgb(const cv::Mat & src, cv::Mat & dst)
+{
+    cv::cvtColor(src, dst, CV_GRAY2RGB);
+}
+
+//Two noisy frames in turn, so every call runs the whole filter and none is taken for an FFC freeze
+static void FilterThermal(ThermalFilter & filter, const cv::Mat & a, const cv::Mat & b, cv::Mat & dst, int & calls)
+{
+    filter.Process((calls++ & 1) ? b.data : a.data, dst.data);
+}
+
+static void UpsampleThermal(ThermalUpsampler & upsampler, const cv::Mat & depth, const cv::Mat & thermal, cv::Mat & dst)
+{
+    upsampler.Process(depth.ptr<uint16_t>(0), 0, thermal.data, dst.data);
+}
+
+//Roughly the Kinect v2 IR and A65 (45 degree) intrinsics, 3 cm apart
+static RigCalibration BenchRig()
+{
+    RigCalibration rig;
+    rig.irCamera = (cv::Mat_<double>(3, 3) << 365, 0, depthWidth / 2, 0, 365, depthHeight / 2, 0, 0, 1);
+    rig.irDistortion = cv::Mat::zeros(1, 5, CV_64F);
+    rig.irSize = cv::Size(depthWidth, depthHeight);
+    rig.thermalCamera = (cv::Mat_<double>(3, 3) << 773, 0, thermalWidth / 2, 0, 773, thermalHeight / 2, 0, 0, 1);
+    rig.thermalDistortion = cv::Mat::zeros(1, 5, CV_64F);
+    rig.thermalSize = cv::Size(thermalWidth, thermalHeight);
+    rig.R = cv::Mat::eye(3, 3, CV_64F);
+    rig.T = (cv::Mat_<double>(3, 1) << 0.03, 0, 0);
+    return rig;
+}
+
+//Kept in a global so the formatting is not optimised away
+static size_t formatted = 0;
+
+static void FormatFileName(IndexRecord & record)
+{
+    record.timestamp += 33333;
+    formatted += record.FileName().size();
+}
+
+static void FormatTimestamp(int64_t & timestamp)
+{
+    timestamp += 33333;
+    formatted += (boost::lexical_cast<std::string>(timestamp) + ".png").size();
+}
+
+static void ReadClock()
+{
+    formatted += size_t(SessionClock::Now());
+}
+
+static void Add(std::vector<Benchmark> & benchmarks, const std::string & name, size_t bytes, const boost::function<void()> & run)
+{
+    Benchmark benchmark;
+    benchmark.name = name;
+    benchmark.run = run;
+    benchmark.bytes = bytes;
+    benchmarks.push_back(benchmark);
+}
+
+static bool LoadBaseline(const std::string & path, std::map<std::string, double> & baseline)
+{
+    std::ifstream file(path.c_str());
+    if(!file)
+        return false;
+
+    std::string name;
+    double nanoseconds;
+    while(file >> name >> nanoseconds)
+        baseline[name] = nanoseconds;
+    return true;
+}
+
+static bool Bench(int milliseconds, const std::string & baselinePath, const std::string & savePath, double tolerance)
+{
+    //Frame contents matter for Normalize only through the float conversion, any spread of values will do
+    cv::Mat depth(depthHeight, depthWidth, CV_16UC1);
+    for(int y = 0; y < depth.rows; y++)
+        for(int x = 0; x < depth.cols; x++)
+            depth.at<uint16_t>(y, x) = uint16_t(500 + (x * 7 + y * 13) % 4000);
+    cv::Mat depthCopy(depthHeight, depthWidth, CV_16UC1);
+    cv::Mat depth8(depthHeight, depthWidth, CV_8UC1);
+    cv::Mat depthRgb(depthHeight, depthWidth, CV_8UC3);
+
+    cv::Mat thermal(thermalHeight, thermalWidth, CV_8UC1);
+    for(int y = 0; y < thermal.rows; y++)
+        for(int x = 0; x < thermal.cols; x++)
+            thermal.at<uint8_t>(y, x) = uint8_t(x + y);
+    cv::Mat thermalCopy(thermalHeight, thermalWidth, CV_8UC1);
+    cv::Mat thermalFlipped(thermalHeight, thermalWidth, CV_8UC1);
+    cv::Mat thermalRgb(thermalHeight, thermalWidth, CV_8UC3);
+    cv::Mat thermalNoisy(thermalHeight, thermalWidth, CV_8UC1);
+    for(int y = 0; y < thermal.rows; y++)
+        for(int x = 0; x < thermal.cols; x++)
+            thermalNoisy.at<uint8_t>(y, x) = uint8_t(x + y + (x * 5 + y * 3) % 4);
+    cv::Mat thermalFiltered(thermalHeight, thermalWidth, CV_8UC1);
+
+    ThreadMutexObject<int> thermalLatest;
+    thermalLatest.assignValue(-1);
+    FrameSource thermalSource("thermal", 0, 0, thermalLatest, thermalWidth, thermalHeight, CV_8UC1, true);
+    ThermalFilter thermalFilter(ThermalFilterConfig(), thermalSource);
+    int filterCalls = 0;
+
+    //One thread, as the other conversions; the live stage divides this by its thread count
+    ThreadMutexObject<int> depthLatest;
+    depthLatest.assignValue(-1);
+    FrameSource depthSource("depth", 0, 0, depthLatest, depthWidth, depthHeight, CV_16UC1, false);
+    ThermalUpsampler upsampler(UpsampleConfig(), BenchRig(), depthSource, FrameSource(), thermalSource);
+    cv::Mat thermalDepth(depthHeight, depthWidth, CV_8UC1);
+
+    IndexRecord record;
+    record.sequence = 0;
+    record.timestamp = SessionClock::Now();
+    record.offset = -1;
+    record.flags = 0;
+    record.location = 0;
+    int64_t timestamp = record.timestamp;
+
+    const size_t depthBytes = depth.total() * depth.elemSize();
+    const size_t thermalBytes = thermal.total() * thermal.elemSize();
+
+    std::vector<Benchmark> benchmarks;
+    Add(benchmarks, "memcpy_depth", depthBytes, boost::bind(&Copy, boost::cref(depth), boost::ref(depthCopy)));
+    Add(benchmarks, "memcpy_thermal", thermalBytes, boost::bind(&Copy, boost::cref(thermal), boost::ref(thermalCopy)));
+    Add(benchmarks, "normalize_depth", depthBytes, boost::bind(&NormalizeDepth, boost::cref(depth), boost::ref(depth8)));
+    Add(benchmarks, "gray2rgb_depth", depth8.total(), boost::bind(&GrayToRgb, boost::cref(depth8), boost::ref(depthRgb)));
+    Add(benchmarks, "flip_thermal", thermalBytes, boost::bind(&Flip, boost::cref(thermal), boost::ref(thermalFlipped)));
+    Add(benchmarks, "gray2rgb_thermal", thermalBytes, boost::bind(&GrayToRgb, boost::cref(thermal), boost::ref(thermalRgb)));
+    Add(benchmarks, "thermal_filter", thermalBytes, boost::bind(&FilterThermal, boost::ref(thermalFilter), boost::cref(thermal),
+                                                               boost::cref(thermalNoisy), boost::ref(thermalFiltered), boost::ref(filterCalls)));
+    Add(benchmarks, "thermal_upsample", depthBytes, boost::bind(&UpsampleThermal, boost::ref(upsampler), boost::cref(depth),
+                                                                 boost::cref(thermal), boost::ref(thermalDepth)));
+    Add(benchmarks, "index_filename", 0, boost::bind(&FormatFileName, boost::ref(record)));
+    Add(benchmarks, "timestamp_filename", 0, boost::bind(&FormatTimestamp, boost::ref(timestamp)));
+    Add(benchmarks, "session_clock", 0, &ReadClock);
+
+    std::map<std::string, double> baseline;
+    if(!baselinePath.empty() && !LoadBaseline(baselinePath, baseline))
+    {
+        std::cout << "Cannot read baseline " << baselinePath << std::endl;
+        return false;
+    }
+
+    bool passed = true;
+    std::map<std::string, double> results;
+
+    for(size_t i = 0; i < benchmarks.size(); i++)
+    {
+        double nanoseconds = Measure(benchmarks[i].run, milliseconds);
+        results[benchmarks[i].name] = nanoseconds;
+
+        std::cout << std::left << std::setw(20) << benchmarks[i].name << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(12) << nanoseconds << " ns";
+        if(benchmarks[i].bytes > 0)
+            std::cout << std::setw(10) << benchmarks[i].bytes / nanoseconds << " GB/s";
+
+        std::map<std::string, double>::const_iterator it = baseline.find(benchmarks[i].name);
+        if(it != baseline.end())
+        {
+            double change = (nanoseconds / it->second - 1) * 100;
+            std::cout << std::showpos << std::setw(10) << change << "%" << std::noshowpos;
+            if(change > tolerance)
+            {
+                std::cout << " REGRESSION";
+                passed = false;
+            }
+        }
+        std::cout << std::endl;
+    }
+
+    if(!savePath.empty())
+    {
+        std::ofstream file(savePath.c_str());
+        for(std::map<std::string, double>::const_iterator it = results.begin(); it != results.end(); ++it)
+            file << it->first << " " << it->second << std::endl;
+        if(!file)
+        {
+            std::cout << "Cannot write " << savePath << std::endl;
+            passed = false;
+        }
+    }
+
+    return passed;
+}
+
+static void Usage()
+{
+    std::cout << "StressBench [--stress mutex,writer,latest] [--seconds S] [--slots N] [--rate HZ]" << std::endl
+              << "            [--bench] [--bench-ms MS] [--baseline FILE] [--save FILE] [--tolerance PERCENT]" << std::endl;
+}
+
+int main(int argc, char ** argv)
+{
+    StressOptions options;
+    std::vector<std::string> stress;
+    bool bench = false;
+    int benchMs = 200;
+    std::string baseline;
+    std::string save;
+    double tolerance = 25;
+
+    for(int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if(arg == "--stress" && hasValue)
+        {
+            boost::split(stress, argv[++i], boost::is_any_of(","));
+        }
+        else if(arg == "--seconds" && hasValue)
+        {
+            options.seconds = atof(argv[++i]);
+        }
+        else if(arg == "--slots" && hasValue)
+        {
+            options.slots = std::max(3, atoi(argv[++i]));
+        }
+        else if(arg == "--rate" && hasValue)
+        {
+            options.rate = std::max(0, atoi(argv[++i]));
+        }
+        else if(arg == "--bench")
+        {
+            bench = true;
+        }
+        else if(arg == "--bench-ms" && hasValue)
+        {
+            benchMs = std::max(1, atoi(argv[++i]));
+        }
+        else if(arg == "--baseline" && hasValue)
+        {
+            baseline = argv[++i];
+            bench = true;
+        }
+        else if(arg == "--save" && hasValue)
+        {
+            save = argv[++i];
+            bench = true;
+        }
+        else if(arg == "--tolerance" && hasValue)
+        {
+            tolerance = atof(argv[++i]);
+        }
+        else
+        {
+            Usage();
+            return 1;
+        }
+    }
+
+    if(stress.empty() && !bench)
+    {
+        stress.push_back("mutex");
+        stress.push_back("writer");
+        stress.push_back("latest");
+        bench = true;
+    }
+
+    bool passed = true;
+
+    for(size_t i = 0; i < stress.size(); i++)
+    {
+        if(stress[i] == "mutex")
+            passed = StressMutex(options) && passed;
+        else if(stress[i] == "writer" || stress[i] == "latest")
+            passed = StressHandoff(stress[i], options) && passed;
+        else
+        {
+            std::cout << "Unknown stress test " << stress[i] << std::endl;
+            passed = false;
+        }
+    }
+
+    if(bench)
+        passed = Bench(benchMs, baseline, save, tolerance) && passed;
+
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,140 @@
+#include "Striping.h"
+
+#include <algorithm>
+#include <boost/lexical_cast.hpp>
+
+bool StripeConfig::Active() const
+{
+    return !roots.empty();
+}
+
+bool StripeConfig::Parse(const std::string & mode, StripeConfig & config)
+{
+    if(mode == "round-robin")
+        config.mode = RoundRobin;
+    else if(mode == "throughput")
+        config.mode = Throughput;
+    else
+        return false;
+    return true;
+}
+
+std::string StripeConfig::ToString() const
+{
+    if(roots.empty())
+        return "off";
+
+    std::string result = mode == Throughput ? "throughput" : "round-robin";
+    result += ", chunks of " + boost::lexical_cast<std::string>(chunkFrames) + " frames over";
+    for(size_t i = 0; i < roots.size(); i++)
+        result += " " + roots[i];
+    return result;
+}
+
+StripeSet::StripeSet(const StripeConfig & config)
+ : chunkFrames(std::max(1, config.chunkFrames)),
+   mode(config.mode),
+   roots(config.roots),
+   turn(0)
+{
+    //The session folder keeps location 0, the other roots are numbered in the order given
+    uint32_t next = STRIPE_FIRST_LOCATION;
+    for(size_t i = 0; i < roots.size(); i++)
+        locations.push_back(roots[i] == "." ? 0 : next++);
+
+    throughput.resize(roots.size(), 0);
+    share.resize(roots.size(), 0);
+    chunks.resize(roots.size(), 0);
+}
+
+StripeSet::~StripeSet()
+{
+
+}
+
+int StripeSet::Size()
+{
+    return roots.size();
+}
+
+uint32_t StripeSet::Location(int member)
+{
+    return locations[member];
+}
+
+std::string StripeSet::Root(int member)
+{
+    return roots[member];
+}
+
+std::string StripeSet::Folder(int member, const std::string & folder)
+{
+    return roots[member] == "." ? folder : roots[member] + "/" + folder;
+}
+
+int StripeSet::Next()
+{
+    boost::mutex::scoped_lock lock(mutex);
+
+    int member = 0;
+    if(mode == StripeConfig::RoundRobin)
+    {
+        member = turn;
+        turn = (turn + 1) % roots.size();
+    }
+    else
+    {
+        double sum = 0;
+        int measured = 0;
+        for(size_t i = 0; i < throughput.size(); i++)
+        {
+            if(throughput[i] > 0)
+            {
+                sum += throughput[i];
+                measured++;
+            }
+        }
+        double mean = measured ? sum / measured : 1;
+
+        //Recent chunks of each root against what it can take, older chunks fade so the shares follow the disks
+        double best = 0;
+        for(size_t i = 0; i < share.size(); i++)
+        {
+            double load = (share[i] + 1) / (throughput[i] > 0 ? throughput[i] : mean);
+            if(i == 0 || load < best)
+            {
+                best = load;
+                member = i;
+            }
+            share[i] *= 0.98;
+        }
+        share[member] += 1;
+    }
+
+    chunks[member]++;
+    return member;
+}
+
+void StripeSet::Report(int member, int64_t bytes, int64_t microseconds)
+{
+    if(bytes <= 0 || microseconds <= 0)
+        return;
+
+    //Bytes per microsecond is MB/s
+    double rate = double(bytes) / microseconds;
+
+    boost::mutex::scoped_lock lock(mutex);
+    throughput[member] = throughput[member] == 0 ? rate : throughput[member] * 0.9 + rate * 0.1;
+}
+
+float StripeSet::Throughput(int member)
+{
+    boost::mutex::scoped_lock lock(mutex);
+    return throughput[member];
+}
+
+int StripeSet::Chunks(int member)
+{
+    boost::mutex::scoped_lock lock(mutex);
+    return chunks[member];
+}
@@ -0,0 +1,102 @@
+/*
+ * Striping.h
+ *
+ *  Created on: 19/10 2026
+ *      Author: Baobei Xu
+ */
+
+#ifndef STRIPING_H_
+#define STRIPING_H_
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <boost/thread.hpp>
+
+#include "SessionIndex.h"
+
+/////////////////////////////////////Index location of the first stripe root; location 0 is the session folder and
+/// location 1 stays the backpressure spill root
+#define STRIPE_FIRST_LOCATION (SESSIONINDEX_SPILL_LOCATION + 1)
+
+/////////////////////////////////////Recording striped over several output roots (software RAID-0 of the writers)
+struct StripeConfig
+{
+    enum Mode
+    {
+        RoundRobin,
+        Throughput
+    };
+
+    StripeConfig()
+     : mode(RoundRobin),
+       chunkFrames(30)
+    {}
+
+    /////////////////////////////////////Roots frames are striped over, each writer goes to <root>/<folder>; "."
+    /// is the session folder itself. Empty disables striping.
+    std::vector<std::string> roots;
+
+    /////////////////////////////////////Round robin, or chunks shared out in proportion to each root's measured
+    /// throughput
+    Mode mode;
+
+    /////////////////////////////////////Consecutive frames of a stream that go to the same root, 1 stripes frames
+    int chunkFrames;
+
+    bool Active() const;
+
+    /////////////////////////////////////"round-robin" or "throughput"
+    static bool Parse(const std::string & mode, StripeConfig & config);
+    std::string ToString() const;
+};
+
+/////////////////////////////////////Hands out the roots of a stripe to the writer lanes, one chunk at a time, and
+/// keeps the throughput each root has shown so far. Shared by all lanes of a recording, so with round robin the
+/// chunks of all streams rotate over the disks together, and throughput mode weighs every lane's measurements.
+///
+/// Throughput mode gives the next chunk to the root with the fewest recent chunks (a decaying count) per MB/s it has
+/// shown, so a disk twice as fast gets twice the chunks and shares follow a disk that slows down. Roots not measured
+/// yet count as the mean of the measured ones.
+class StripeSet
+{
+public:
+    StripeSet(const StripeConfig & config);
+    virtual ~StripeSet();
+
+    const int chunkFrames;
+
+    int Size();
+
+    /////////////////////////////////////Index location of a member (0 for ".", else from STRIPE_FIRST_LOCATION)
+    uint32_t Location(int member);
+    std::string Root(int member);
+
+    /////////////////////////////////////Where a member stores the stream folder folder
+    std::string Folder(int member, const std::string & folder);
+
+    /////////////////////////////////////Member the next chunk goes to
+    int Next();
+
+    /////////////////////////////////////A lane stored bytes on member and spent microseconds writing and syncing them
+    void Report(int member, int64_t bytes, int64_t microseconds);
+
+    /////////////////////////////////////Smoothed MB/s of a member, 0 until measured
+    float Throughput(int member);
+
+    /////////////////////////////////////Chunks given to a member so far
+    int Chunks(int member);
+
+private:
+    const StripeConfig::Mode mode;
+    std::vector<std::string> roots;
+    std::vector<uint32_t> locations;
+
+    boost::mutex mutex;
+    std::vector<double> throughput;
+    std::vector<double> share;
+    std::vector<int> chunks;
+    int turn;
+};
+
+#endif /* STRIPING_H_ */
@@ -0,0 +1,62 @@
+#include "Telemetry.h"
+
+#include <sys/statvfs.h>
+
+TelemetrySampler::TelemetrySampler()
+{
+}
+
+std::vector<StreamTelemetry> TelemetrySampler::Update(const std::vector<StreamCounters> & counters)
+{
+    boost::posix_time::ptime now = boost::posix_time::microsec_clock::local_time();
+    float seconds = last.is_not_a_date_time() ? 0 : (now - last).total_microseconds() / 1000000.0f;
+    last = now;
+
+    std::vector<StreamTelemetry> rows;
+    for(size_t i = 0; i < counters.size(); i++)
+    {
+        StreamTelemetry row;
+        row.counters = counters[i];
+        row.captureFps = 0;
+        row.displayFps = 0;
+        row.writeMBs = 0;
+        row.stalled = false;
+        row.dropping = false;
+
+        std::map<std::string, StreamCounters>::iterator it = previous.find(counters[i].name);
+        if(it != previous.end() && seconds > 0)
+        {
+            const StreamCounters & before = it->second;
+            row.captureFps = (counters[i].captured - before.captured) / seconds;
+            row.displayFps = (counters[i].displayed - before.displayed) / seconds;
+
+            //A writer restarts from zero with every recording
+            if(counters[i].bytesWritten >= before.bytesWritten)
+                row.writeMBs = (counters[i].bytesWritten - before.bytesWritten) / seconds / (1024.0f * 1024.0f);
+
+            row.stalled = counters[i].captured == before.captured;
+            row.dropping = counters[i].deviceDropped > before.deviceDropped ||
+                           counters[i].ringDropped > before.ringDropped ||
+                           counters[i].blackBoxDropped > before.blackBoxDropped;
+        }
+
+        previous[counters[i].name] = counters[i];
+        rows.push_back(row);
+    }
+
+    return rows;
+}
+
+void TelemetrySampler::Reset()
+{
+    previous.clear();
+    last = boost::posix_time::ptime();
+}
+
+int64_t TelemetrySampler::DiskFree(const std::string & path)
+{
+    struct statvfs info;
+    if(statvfs(path.c_str(), &info) != 0)
+        return -1;
+    return int64_t(info.f_bavail) * info.f_frsize;
+}
@@ -0,0 +1,111 @@
+/*
+ * Telemetry.h
+ *
+ *  Created on: 19/10 2026
+ *      Author: Baobei Xu
+ */
+
+#ifndef TELEMETRY_H_
+#define TELEMETRY_H_
+
+#include <string>
+#include <vector>
+#include <map>
+#include <stdint.h>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+/////////////////////////////////////Event counter that is safe to bump from a capture callback: one relaxed atomic
+/// add, no lock. Readers (the telemetry panel) load it at any time.
+class TelemetryCounter
+{
+public:
+    TelemetryCounter()
+     : value(0)
+    {}
+
+    void Add(int64_t n = 1)
+    {
+        __atomic_fetch_add(&value, n, __ATOMIC_RELAXED);
+    }
+
+    int64_t Get() const
+    {
+        return __atomic_load_n(&value, __ATOMIC_RELAXED);
+    }
+
+private:
+    int64_t value;
+
+    TelemetryCounter(const TelemetryCounter &);
+    TelemetryCounter & operator=(const TelemetryCounter &);
+};
+
+/////////////////////////////////////Raw counters of one stream at one instant, all cumulative
+struct StreamCounters
+{
+    StreamCounters()
+     : captured(0),
+       deviceDropped(0),
+       ringDropped(0),
+       blackBoxDropped(0),
+       displayed(0),
+       bytesWritten(0),
+       backlog(0),
+       capacity(0),
+       recording(false)
+    {}
+
+    std::string name;
+
+    /////////////////////////////////////Frames pushed into the ring, frames the device or transport lost before that,
+    /// frames the writer lost to ring overruns, frames a black box dump lost to its full queue, and frames drawn by
+    /// the preview
+    int64_t captured;
+    int64_t deviceDropped;
+    int64_t ringDropped;
+    int64_t blackBoxDropped;
+    int64_t displayed;
+
+    /////////////////////////////////////Writer lane, only meaningful while recording
+    int64_t bytesWritten;
+    int backlog;
+    int capacity;
+    bool recording;
+};
+
+/////////////////////////////////////One row of the telemetry panel, rates over the last sampling interval
+struct StreamTelemetry
+{
+    StreamCounters counters;
+
+    float captureFps;
+    float displayFps;
+    float writeMBs;
+
+    /////////////////////////////////////No new frame, or new device / ring drops, since the previous sample
+    bool stalled;
+    bool dropping;
+};
+
+/////////////////////////////////////Turns periodic counter snapshots into rates. Runs on the GUI timer, never on
+/// the frame path; the first sample of a stream only establishes its baseline.
+class TelemetrySampler
+{
+public:
+    TelemetrySampler();
+
+    std::vector<StreamTelemetry> Update(const std::vector<StreamCounters> & counters);
+
+    /////////////////////////////////////Forget all baselines, e.g. when the capture restarts
+    void Reset();
+
+    /////////////////////////////////////Bytes available to unprivileged users on the filesystem holding path,
+    /// -1 if it cannot be queried
+    static int64_t DiskFree(const std::string & path);
+
+private:
+    std::map<std::string, StreamCounters> previous;
+    boost::posix_time::ptime last;
+};
+
+#endif /* TELEMETRY_H_ */
@@ -0,0 +1,353 @@
+#include "ThermalFilter.h"
+#include "ThreadPolicy.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+#include <boost/lexical_cast.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <opencv2/opencv.hpp>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+ThermalFilter::ThermalFilter(const ThermalFilterConfig & config, const FrameSource & thermal)
+ : config(config),
+   thermal(thermal),
+   width(thermal.width),
+   height(thermal.height),
+   alphaQ15(int16_t(std::max(0.0f, std::min(0.999f, config.alpha)) * 32768)),
+   state(thermal.width * thermal.height, 0),
+   offsets(thermal.width * thermal.height, 0),
+   raw(thermal.width * thermal.height, 0),
+   previous(thermal.width * thermal.height, 0),
+   hasPrevious(false),
+   restart(true),
+   freezeStart(0),
+   freezeLength(0),
+   accumulated(0),
+   filterThread(0)
+{
+    capturing.assignValue(false);
+    running.assignValue(false);
+    latency.assignValue(0);
+    frozen.assignValue(0);
+    latestThermalIndex.assignValue(-1);
+
+    for(int i = 0; i < numBuffers; i++)
+    {
+        uint8_t * newThermal = (uint8_t *)calloc(width * height, sizeof(uint8_t));
+        frameBuffers[i] = std::pair<uint8_t *, int64_t>(newThermal, 0);
+    }
+
+    if(config.fixedPattern && !config.offsetPath.empty())
+        LoadOffsets();
+}
+
+ThermalFilter::~ThermalFilter()
+{
+    Stop();
+
+    for(int i = 0; i < numBuffers; i++)
+        free(frameBuffers[i].first);
+}
+
+FrameSource ThermalFilter::Output()
+{
+    return FrameSource(thermal.name,
+                       frameBuffers,
+                       numBuffers,
+                       latestThermalIndex,
+                       width,
+                       height,
+                       thermal.type,
+                       thermal.flip,
+                       slots,
+                       thermal.pixels);
+}
+
+float ThermalFilter::LatencyMs()
+{
+    return latency.getValue();
+}
+
+int ThermalFilter::Frozen()
+{
+    return frozen.getValue();
+}
+
+void ThermalFilter::SetEventCallback(const boost::function<void (const std::string &)> & callback)
+{
+    eventCallback = callback;
+}
+
+void ThermalFilter::Event(const std::string & what)
+{
+    std::cout << what << std::endl;
+    if(eventCallback)
+        eventCallback(what);
+}
+
+void ThermalFilter::CaptureOffsets()
+{
+    capturing.assignValue(true);
+}
+
+bool ThermalFilter::CapturingOffsets()
+{
+    return capturing.getValue();
+}
+
+void ThermalFilter::Start()
+{
+    if(filterThread)
+        return;
+
+    running.assignValue(true);
+    filterThread = new boost::thread(boost::bind(&ThermalFilter::FilterThread, this));
+}
+
+void ThermalFilter::Stop()
+{
+    if(!filterThread)
+        return;
+
+    running.assignValue(false);
+    filterThread->join();
+    delete filterThread;
+    filterThread = 0;
+}
+
+void ThermalFilter::FilterThread()
+{
+    ThreadPolicies::Apply("filter", "tfilter");
+
+    int nextSeq = -1;
+
+    while(running.getValue())
+    {
+        int latest = thermal.latestIndex->getValue();
+        if(latest == -1 || latest < nextSeq)
+        {
+            boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+            continue;
+        }
+
+        //Live stage like the depth filter: always the newest frame
+        int64_t timestamp;
+        if(!thermal.Snapshot(&raw[0], nextSeq, timestamp))
+            continue;
+
+        boost::posix_time::ptime begin = boost::posix_time::microsec_clock::local_time();
+
+        int outSeq = latestThermalIndex.getValue() + 1;
+        int outIndex = outSeq % numBuffers;
+        FrameSlotBeginWrite(slots[outIndex]);
+        bool freeze = Process(&raw[0], frameBuffers[outIndex].first);
+        frameBuffers[outIndex].second = timestamp;
+        FrameSlotEndWrite(slots[outIndex], outSeq);
+        latestThermalIndex++;
+
+        //One event per freeze, once the camera delivers new frames again
+        if(freeze)
+        {
+            if(freezeLength == 0)
+                freezeStart = timestamp;
+            freezeLength++;
+            frozen++;
+        }
+        else if(freezeLength > 0)
+        {
+            Event(thermal.name + " FFC freeze, " + boost::lexical_cast<std::string>(freezeLength) + " frames from " +
+                  boost::lexical_cast<std::string>(freezeStart) + " to " + boost::lexical_cast<std::string>(timestamp));
+            freezeLength = 0;
+        }
+
+        //Reference frames for the offset map, repeats would only weigh one frame twice
+        if(capturing.getValue() && !freeze)
+        {
+            Accumulate(&raw[0]);
+            if(accumulated >= config.offsetFrames)
+            {
+                bool saved = SaveOffsets();
+                Event(thermal.name + " offset map captured from " + boost::lexical_cast<std::string>(accumulated) +
+                      " frames" + (saved ? ", saved to " + config.offsetPath : config.offsetPath.empty() ? "" : ", could not save it"));
+                accumulated = 0;
+                capturing.assignValue(false);
+            }
+        }
+
+        float ms = (boost::posix_time::microsec_clock::local_time() - begin).total_microseconds() / 1000.0f;
+        float smoothed = latency.getValue();
+        latency.assignValue(smoothed == 0 ? ms : smoothed * 0.9f + ms * 0.1f);
+
+        nextSeq++;
+    }
+}
+
+bool ThermalFilter::Process(const uint8_t * input, uint8_t * output)
+{
+    //During FFC / NUC the camera repeats its last frame
+    bool freeze = config.freeze && hasPrevious && Difference(input, &previous[0]) < config.freezeThreshold;
+    memcpy(&previous[0], input, previous.size());
+    hasPrevious = true;
+
+    //A freeze is not filtered, and the correction after it shifts every pixel: the state starts over
+    Filter(input, output, config.temporal && !freeze && !restart);
+    restart = freeze;
+    return freeze;
+}
+
+float ThermalFilter::Difference(const uint8_t * a, const uint8_t * b)
+{
+    const int size = width * height;
+    uint64_t sum = 0;
+    int i = 0;
+
+#ifdef __SSE2__
+    __m128i total = _mm_setzero_si128();
+    for(; i + 16 <= size; i += 16)
+    {
+        __m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+        total = _mm_add_epi64(total, _mm_sad_epu8(va, vb));
+    }
+    uint64_t halves[2];
+    _mm_storeu_si128((__m128i *)halves, total);
+    sum = halves[0] + halves[1];
+#endif
+
+    for(; i < size; i++)
+        sum += std::abs(int(a[i]) - int(b[i]));
+
+    return float(double(sum) / size);
+}
+
+void ThermalFilter::Filter(const uint8_t * input, uint8_t * output, bool smooth)
+{
+    const int size = width * height;
+    const int16_t threshold = int16_t(config.motionThreshold << THERMALFILTER_SHIFT);
+    const int16_t * offset = &offsets[0];
+    int16_t * s = &state[0];
+    int i = 0;
+
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i valpha = _mm_set1_epi16(alphaQ15);
+    const __m128i vthreshold = _mm_set1_epi16(threshold);
+    const __m128i vround = _mm_set1_epi16(1 << (THERMALFILTER_SHIFT - 1));
+
+    for(; i + 16 <= size; i += 16)
+    {
+        __m128i in = _mm_loadu_si128((const __m128i *)(input + i));
+        __m128i half[2] = { _mm_unpacklo_epi8(in, zero), _mm_unpackhi_epi8(in, zero) };
+        __m128i out[2];
+
+        for(int h = 0; h < 2; h++)
+        {
+            //Offset-corrected frame in fixed point, clamped at 0
+            __m128i c = _mm_slli_epi16(half[h], THERMALFILTER_SHIFT);
+            c = _mm_max_epi16(_mm_subs_epi16(c, _mm_loadu_si128((const __m128i *)(offset + i + h * 8))), zero);
+
+            if(smooth)
+            {
+                //s + alpha * (c - s), or c where the difference is motion rather than noise
+                __m128i st = _mm_loadu_si128((const __m128i *)(s + i + h * 8));
+                __m128i diff = _mm_sub_epi16(c, st);
+                __m128i absdiff = _mm_max_epi16(diff, _mm_sub_epi16(zero, diff));
+                __m128i motion = _mm_cmpgt_epi16(absdiff, vthreshold);
+                __m128i smoothed = _mm_add_epi16(st, _mm_slli_epi16(_mm_mulhi_epi16(diff, valpha), 1));
+                c = _mm_or_si128(_mm_and_si128(motion, c), _mm_andnot_si128(motion, smoothed));
+            }
+
+            _mm_storeu_si128((__m128i *)(s + i + h * 8), c);
+            out[h] = _mm_srli_epi16(_mm_adds_epu16(c, vround), THERMALFILTER_SHIFT);
+        }
+
+        _mm_storeu_si128((__m128i *)(output + i), _mm_packus_epi16(out[0], out[1]));
+    }
+#endif
+
+    for(; i < size; i++)
+    {
+        int c = std::max(0, std::min(32767, (int(input[i]) << THERMALFILTER_SHIFT) - offset[i]));
+
+        if(smooth)
+        {
+            int diff = c - s[i];
+            if(std::abs(diff) <= threshold)
+                c = s[i] + ((diff * alphaQ15) >> 16) * 2;
+        }
+
+        s[i] = int16_t(c);
+        output[i] = uint8_t(std::min(255, (c + (1 << (THERMALFILTER_SHIFT - 1))) >> THERMALFILTER_SHIFT));
+    }
+}
+
+void ThermalFilter::Accumulate(const uint8_t * input)
+{
+    if(accumulated == 0)
+        accumulator.assign(width * height, 0);
+
+    for(int i = 0; i < width * height; i++)
+        accumulator[i] += input[i];
+    accumulated++;
+}
+
+bool ThermalFilter::LoadOffsets()
+{
+    cv::FileStorage file(config.offsetPath, cv::FileStorage::READ);
+    if(!file.isOpened())
+    {
+        std::cout << "No thermal offset map " << config.offsetPath << " yet" << std::endl;
+        return false;
+    }
+
+    cv::Mat map;
+    file["offsets"] >> map;
+    if(map.rows != height || map.cols != width || map.type() != CV_16SC1)
+    {
+        std::cout << "Thermal offset map " << config.offsetPath << " does not match the camera" << std::endl;
+        return false;
+    }
+
+    for(int y = 0; y < height; y++)
+        memcpy(&offsets[y * width], map.ptr<int16_t>(y), width * sizeof(int16_t));
+    return true;
+}
+
+bool ThermalFilter::SaveOffsets()
+{
+    //Per-pixel mean minus the frame mean: only the pattern is removed, not the level of the reference
+    const int size = width * height;
+    uint64_t total = 0;
+    for(int i = 0; i < size; i++)
+        total += accumulator[i];
+    const double mean = double(total) / (double(size) * accumulated);
+
+    std::vector<int16_t> map(size);
+    for(int i = 0; i < size; i++)
+    {
+        double offset = (double(accumulator[i]) / accumulated - mean) * (1 << THERMALFILTER_SHIFT);
+        map[i] = int16_t(std::max(-32767.0, std::min(32767.0, offset + (offset < 0 ? -0.5 : 0.5))));
+    }
+
+    //Used right away when the stage is on, otherwise only saved for a later run
+    if(config.fixedPattern)
+        offsets = map;
+
+    if(config.offsetPath.empty())
+        return false;
+
+    cv::FileStorage file(config.offsetPath, cv::FileStorage::WRITE);
+    if(!file.isOpened())
+        return false;
+
+    file << "frames" << accumulated;
+    file << "shift" << THERMALFILTER_SHIFT;
+    file << "offsets" << cv::Mat(height, width, CV_16SC1, &map[0]);
+    file.release();
+    return true;
+}
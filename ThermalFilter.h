@@ -0,0 +1,142 @@
+/*
+ * ThermalFilter.h
+ *
+ *  Created on: 19/10 2026
+ *      Author: Baobei Xu
+ */
+
+#ifndef THERMALFILTER_H_
+#define THERMALFILTER_H_
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <boost/thread.hpp>
+#include <boost/function.hpp>
+
+#include "ThreadMutexObject.h"
+#include "FrameSource.h"
+
+/////////////////////////////////////Fixed point of the filter state: gray levels << 7
+#define THERMALFILTER_SHIFT 7
+
+struct ThermalFilterConfig
+{
+    ThermalFilterConfig()
+     : enabled(false),
+       temporal(true),
+       fixedPattern(true),
+       freeze(true),
+       alpha(0.25f),
+       motionThreshold(6),
+       freezeThreshold(0.02f),
+       offsetFrames(64),
+       preview(true),
+       record(false)
+    {}
+
+    bool enabled;
+
+    /////////////////////////////////////Stages
+    bool temporal;
+    bool fixedPattern;
+    bool freeze;
+
+    /////////////////////////////////////Temporal: state += alpha * (frame - state), reset where the change exceeds
+    /// motionThreshold gray levels
+    float alpha;
+    int motionThreshold;
+
+    /////////////////////////////////////A frame whose mean absolute difference to the previous one is below this
+    /// (gray levels) is a repeat: the camera holds its output during FFC / NUC
+    float freezeThreshold;
+
+    /////////////////////////////////////Offset map file (cv::FileStorage), loaded at start and written by a capture;
+    /// frames averaged for a capture
+    std::string offsetPath;
+    int offsetFrames;
+
+    /////////////////////////////////////Use the filtered stream for the preview / the recorders
+    bool preview;
+    bool record;
+};
+
+/////////////////////////////////////Optional stage between the FLIR thermal ring and its consumers: subtracts a
+/// fixed-pattern offset map, then runs a per-pixel recursive filter that restarts where the scene moved (SSE2,
+/// one thread, a fraction of a millisecond per 640x512 frame). Offset maps are captured from a sequence of a
+/// uniform reference (lens cap or shutter in front of the camera): per-pixel mean minus the frame mean.
+///
+/// Frames the camera repeats during a flat-field correction are passed through with the offsets subtracted but not
+/// filtered and reported as one event per freeze; the filter state restarts after it, as the correction shifts
+/// every pixel.
+class ThermalFilter
+{
+public:
+    ThermalFilter(const ThermalFilterConfig & config, const FrameSource & thermal);
+    virtual ~ThermalFilter();
+
+    void Start();
+    void Stop();
+
+    /////////////////////////////////////Filter one frame synchronously, true if it was an FFC / NUC freeze
+    bool Process(const uint8_t * input, uint8_t * output);
+
+    /////////////////////////////////////Average the next frames (config.offsetFrames) into a new offset map and save
+    /// it to config.offsetPath. Safe to call while running.
+    void CaptureOffsets();
+    bool CapturingOffsets();
+
+    /////////////////////////////////////Reports freezes and offset captures from the filter thread, set before Start
+    void SetEventCallback(const boost::function<void (const std::string &)> & callback);
+
+    /////////////////////////////////////Filtered ring, same layout and timestamps as the raw one
+    static const int numBuffers = 30;
+    ThreadMutexObject<int> latestThermalIndex;
+    std::pair<uint8_t *, int64_t> frameBuffers[numBuffers];
+    FrameSlot slots[numBuffers];
+    FrameSource Output();
+
+    /////////////////////////////////////Smoothed processing time of one frame, frames flagged as freezes so far
+    float LatencyMs();
+    int Frozen();
+
+private:
+    const ThermalFilterConfig config;
+    const FrameSource thermal;
+    const int width, height;
+    int16_t alphaQ15;
+
+    std::vector<int16_t> state;
+    std::vector<int16_t> offsets;
+    std::vector<uint8_t> raw;
+    std::vector<uint8_t> previous;
+    bool hasPrevious;
+    bool restart;
+
+    /////////////////////////////////////Current freeze: first timestamp and length, 0 when none
+    int64_t freezeStart;
+    int freezeLength;
+
+    std::vector<uint32_t> accumulator;
+    int accumulated;
+    ThreadMutexObject<bool> capturing;
+
+    boost::thread * filterThread;
+    ThreadMutexObject<bool> running;
+    ThreadMutexObject<float> latency;
+    ThreadMutexObject<int> frozen;
+
+    boost::function<void (const std::string &)> eventCallback;
+
+    void FilterThread();
+    void Event(const std::string & what);
+
+    /////////////////////////////////////Mean absolute difference of two frames in gray levels
+    float Difference(const uint8_t * a, const uint8_t * b);
+    void Filter(const uint8_t * input, uint8_t * output, bool smooth);
+    void Accumulate(const uint8_t * input);
+    bool LoadOffsets();
+    bool SaveOffsets();
+};
+
+#endif /* THERMALFILTER_H_ */
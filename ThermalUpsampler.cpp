@@ -0,0 +1,459 @@
+#include "ThermalUpsampler.h"
+#include "ThreadPolicy.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+#include <boost/lexical_cast.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+//Range weights below exp(-4.5) are left out of the tables
+static const float RANGE_SIGMAS = 3.0f;
+static const int MAX_RANGE_LUT = 4096;
+
+ThermalUpsampler::ThermalUpsampler(const UpsampleConfig & config,
+                                   const RigCalibration & calibration,
+                                   const FrameSource & depth,
+                                   const FrameSource & infrared,
+                                   const FrameSource & thermal)
+ : config(config),
+   depth(depth),
+   infrared(infrared),
+   thermal(thermal),
+   width(depth.width),
+   height(depth.height),
+   thermalWidth(thermal.width),
+   thermalHeight(thermal.height),
+   useInfrared(config.sigmaInfrared > 0 && infrared.width == depth.width && infrared.height == depth.height),
+   numThreads(config.threads),
+   valid(false),
+   fx(0),
+   fy(0),
+   cx(0),
+   cy(0),
+   infraredShift(0),
+   samples(depth.width * depth.height, 0),
+   sampled(depth.width * depth.height, 0),
+   depthFrame(0),
+   infraredFrame(0),
+   thermalFrame(0),
+   output(0),
+   rawDepth(depth.width * depth.height, 0),
+   rawInfrared(depth.width * depth.height, 0),
+   rawThermal(thermal.width * thermal.height, 0),
+   uprightThermal(thermal.width * thermal.height, 0),
+   upsampleThread(0),
+   barrier(0),
+   stopping(false)
+{
+    if(numThreads <= 0)
+        numThreads = std::max(1u, boost::thread::hardware_concurrency() / 2);
+    numThreads = std::max(1, std::min(numThreads, height));
+
+    running.assignValue(false);
+    banded.assignValue(false);
+    latency.assignValue(0);
+    unpaired.assignValue(0);
+    latestThermalIndex.assignValue(-1);
+
+    for(int i = 0; i < numBuffers; i++)
+    {
+        uint8_t * newThermal = (uint8_t *)calloc(width * height, sizeof(uint8_t));
+        frameBuffers[i] = std::pair<uint8_t *, int64_t>(newThermal, 0);
+    }
+
+    if(!config.mapPath.empty())
+    {
+        cv::FileStorage file(config.mapPath, cv::FileStorage::READ);
+        if(file.isOpened())
+            file["map"] >> map;
+
+        valid = map.rows == height && map.cols == width && map.type() == CV_32FC2;
+        if(!valid)
+            std::cout << "Correspondence map " << config.mapPath << " is missing or does not match the Kinect" << std::endl;
+    }
+    else if(calibration.IsValid() && thermalWidth > 1 && thermalHeight > 1 &&
+            calibration.irSize == cv::Size(width, height) &&
+            calibration.thermalSize == cv::Size(thermalWidth, thermalHeight))
+    {
+        std::vector<cv::Point2f> pixels;
+        pixels.reserve(width * height);
+        for(int y = 0; y < height; y++)
+        {
+            for(int x = 0; x < width; x++)
+                pixels.push_back(cv::Point2f(x, y));
+        }
+        cv::undistortPoints(pixels, rays, calibration.irCamera, calibration.irDistortion);
+
+        //Thermal lens distortion is ignored as in the sparse gate, the bilateral pass hides the rest at the FLIR's FOV
+        cv::Mat r, t, k;
+        calibration.R.convertTo(r, CV_32F);
+        calibration.T.convertTo(t, CV_32F);
+        calibration.thermalCamera.convertTo(k, CV_32F);
+        for(int i = 0; i < 9; i++)
+            R[i] = r.at<float>(i / 3, i % 3);
+        for(int i = 0; i < 3; i++)
+            T[i] = t.at<float>(i, 0);
+        fx = k.at<float>(0, 0);
+        fy = k.at<float>(1, 1);
+        cx = k.at<float>(0, 2);
+        cy = k.at<float>(1, 2);
+        valid = true;
+    }
+    else
+    {
+        std::cout << "Thermal upsampling needs a rig calibration (--calibration) or a correspondence map "
+                  << "(--upsample-map) matching the Kinect and FLIR" << std::endl;
+    }
+
+    const int radius = std::max(0, config.radius);
+    const float spatial = std::max(0.1f, config.sigmaSpatial);
+    for(int dy = -radius; dy <= radius; dy++)
+    {
+        for(int dx = -radius; dx <= radius; dx++)
+            spatialLut.push_back(expf(-(dx * dx + dy * dy) / (2 * spatial * spatial)));
+    }
+
+    //A zero sigma only keeps neighbours at exactly the same depth
+    const float sigmaDepth = std::max(0.0f, config.sigmaDepth);
+    const int depthRange = std::min(MAX_RANGE_LUT, int(RANGE_SIGMAS * sigmaDepth) + 1);
+    for(int d = 0; d < depthRange; d++)
+        depthLut.push_back(sigmaDepth > 0 ? expf(-(d * d) / (2 * sigmaDepth * sigmaDepth)) : 1.0f);
+    depthLut.push_back(0);
+
+    //IR spans 16 bits, coarser steps keep the table small
+    if(useInfrared)
+    {
+        const int infraredRange = int(RANGE_SIGMAS * config.sigmaInfrared);
+        while((infraredRange >> infraredShift) >= MAX_RANGE_LUT)
+            infraredShift++;
+        for(int d = 0; d <= infraredRange >> infraredShift; d++)
+        {
+            float difference = float(d << infraredShift);
+            infraredLut.push_back(expf(-(difference * difference) / (2 * config.sigmaInfrared * config.sigmaInfrared)));
+        }
+        infraredLut.push_back(0);
+    }
+}
+
+ThermalUpsampler::~ThermalUpsampler()
+{
+    Stop();
+
+    for(int i = 0; i < numBuffers; i++)
+        free(frameBuffers[i].first);
+}
+
+bool ThermalUpsampler::IsValid()
+{
+    return valid;
+}
+
+FrameSource ThermalUpsampler::Output()
+{
+    return FrameSource("thermal_depth",
+                       frameBuffers,
+                       numBuffers,
+                       latestThermalIndex,
+                       width,
+                       height,
+                       CV_8UC1,
+                       false,
+                       slots);
+}
+
+float ThermalUpsampler::LatencyMs()
+{
+    return latency.getValue();
+}
+
+int ThermalUpsampler::Unpaired()
+{
+    return unpaired.getValue();
+}
+
+void ThermalUpsampler::Start()
+{
+    if(upsampleThread || !valid)
+        return;
+
+    running.assignValue(true);
+    banded.assignValue(true);
+    stopping = false;
+
+    //The dispatcher works on band 0 itself
+    barrier = new boost::barrier(numThreads);
+    for(int band = 1; band < numThreads; band++)
+        workers.create_thread(boost::bind(&ThermalUpsampler::WorkerThread, this, band));
+
+    upsampleThread = new boost::thread(boost::bind(&ThermalUpsampler::UpsampleThread, this));
+}
+
+void ThermalUpsampler::Stop()
+{
+    if(!upsampleThread)
+        return;
+
+    running.assignValue(false);
+    upsampleThread->join();
+    delete upsampleThread;
+    upsampleThread = 0;
+
+    workers.join_all();
+    banded.assignValue(false);
+    delete barrier;
+    barrier = 0;
+}
+
+void ThermalUpsampler::WorkerThread(int band)
+{
+    ThreadPolicies::Apply("filter", "upsample-" + boost::lexical_cast<std::string>(band));
+
+    while(true)
+    {
+        barrier->wait();
+        if(stopping)
+            break;
+        RunStages(band);
+        barrier->wait();
+    }
+}
+
+void ThermalUpsampler::UpsampleThread()
+{
+    ThreadPolicies::Apply("filter", "upsample-0");
+
+    int nextSeq = -1;
+
+    while(running.getValue())
+    {
+        int latest = depth.latestIndex->getValue();
+        if(latest == -1 || latest < nextSeq)
+        {
+            boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+            continue;
+        }
+
+        //Driven by depth, the grid of the output: newest depth frame and the thermal / IR frames closest to it
+        int64_t timestamp;
+        if(!depth.Snapshot((uint8_t *)&rawDepth[0], nextSeq, timestamp))
+            continue;
+
+        boost::posix_time::ptime begin = boost::posix_time::microsec_clock::local_time();
+
+        if(!Nearest(thermal, timestamp, &rawThermal[0]) ||
+           (useInfrared && !Nearest(infrared, timestamp, (uint8_t *)&rawInfrared[0])))
+        {
+            unpaired++;
+            nextSeq++;
+            continue;
+        }
+
+        //Calibration and maps refer to the upright thermal image
+        const uint8_t * upright = &rawThermal[0];
+        if(thermal.flip)
+        {
+            for(int y = 0; y < thermalHeight; y++)
+                memcpy(&uprightThermal[y * thermalWidth], &rawThermal[(thermalHeight - 1 - y) * thermalWidth], thermalWidth);
+            upright = &uprightThermal[0];
+        }
+
+        int outSeq = latestThermalIndex.getValue() + 1;
+        int outIndex = outSeq % numBuffers;
+        FrameSlotBeginWrite(slots[outIndex]);
+        Process(&rawDepth[0], useInfrared ? &rawInfrared[0] : 0, upright, frameBuffers[outIndex].first);
+        frameBuffers[outIndex].second = timestamp;
+        FrameSlotEndWrite(slots[outIndex], outSeq);
+        latestThermalIndex++;
+
+        float ms = (boost::posix_time::microsec_clock::local_time() - begin).total_microseconds() / 1000.0f;
+        float smoothed = latency.getValue();
+        latency.assignValue(smoothed == 0 ? ms : smoothed * 0.9f + ms * 0.1f);
+
+        nextSeq++;
+    }
+
+    //Release the workers waiting for the next frame
+    stopping = true;
+    barrier->wait();
+}
+
+bool ThermalUpsampler::Nearest(const FrameSource & source, int64_t timestamp, uint8_t * data)
+{
+    int latest = source.latestIndex->getValue();
+    if(latest == -1)
+        return false;
+
+    //Only recent slots, older ones are about to be overwritten; Read catches the rest
+    int best = -1;
+    int64_t bestDt = config.maxDtMs * 1000LL + 1;
+    for(int seq = latest; seq >= 0 && seq > latest - std::min(8, source.numBuffers / 2); seq--)
+    {
+        int64_t slotTimestamp;
+        if(!source.Timestamp(seq, slotTimestamp))
+            continue;
+        int64_t dt = llabs(slotTimestamp - timestamp);
+        if(dt < bestDt)
+        {
+            best = seq;
+            bestDt = dt;
+        }
+    }
+
+    int64_t read;
+    return best != -1 && source.Read(best, data, read) && llabs(read - timestamp) <= config.maxDtMs * 1000LL;
+}
+
+void ThermalUpsampler::Process(const uint16_t * depth, const uint16_t * infrared, const uint8_t * thermal, uint8_t * output)
+{
+    depthFrame = depth;
+    infraredFrame = infrared;
+    thermalFrame = thermal;
+    this->output = output;
+
+    if(banded.getValue())
+    {
+        barrier->wait();
+        RunStages(0);
+        barrier->wait();
+    }
+    else
+    {
+        int threads = numThreads;
+        numThreads = 1;
+        RunStages(0);
+        numThreads = threads;
+    }
+}
+
+void ThermalUpsampler::RunStages(int band)
+{
+    Project(height * band / numThreads, height * (band + 1) / numThreads);
+
+    //The bilateral pass reads samples across band borders
+    if(numThreads > 1)
+        barrier->wait();
+
+    //Round-robin keeps the tiles of each thread spread over the frame, so busy and empty areas even out
+    const int tile = std::max(8, config.tileSize);
+    const int tilesX = (width + tile - 1) / tile;
+    const int tilesY = (height + tile - 1) / tile;
+    for(int t = band; t < tilesX * tilesY; t += numThreads)
+    {
+        int x0 = (t % tilesX) * tile;
+        int y0 = (t / tilesX) * tile;
+        Bilateral(x0, y0, std::min(width, x0 + tile), std::min(height, y0 + tile));
+    }
+}
+
+void ThermalUpsampler::Project(int y0, int y1)
+{
+    const float maxX = float(thermalWidth - 1);
+    const float maxY = float(thermalHeight - 1);
+    const bool mapped = !map.empty();
+
+    for(int y = y0; y < y1; y++)
+    {
+        const float * m = mapped ? map.ptr<float>(y) : 0;
+
+        for(int x = 0; x < width; x++)
+        {
+            const int i = y * width + x;
+            float u, v;
+
+            if(mapped)
+            {
+                u = m[2 * x];
+                v = m[2 * x + 1];
+            }
+            else
+            {
+                if(!depthFrame[i])
+                {
+                    sampled[i] = 0;
+                    continue;
+                }
+
+                float z = depthFrame[i] * 0.001f;
+                float px = rays[i].x * z;
+                float py = rays[i].y * z;
+
+                float tz = R[6] * px + R[7] * py + R[8] * z + T[2];
+                if(tz <= 0)
+                {
+                    sampled[i] = 0;
+                    continue;
+                }
+                u = fx * (R[0] * px + R[1] * py + R[2] * z + T[0]) / tz + cx;
+                v = fy * (R[3] * px + R[4] * py + R[5] * z + T[1]) / tz + cy;
+            }
+
+            if(!(u >= 0 && v >= 0 && u <= maxX && v <= maxY))
+            {
+                sampled[i] = 0;
+                continue;
+            }
+
+            //Bilinear; the last row / column interpolates towards itself
+            int tx = std::min(int(u), thermalWidth - 2);
+            int ty = std::min(int(v), thermalHeight - 2);
+            float ax = u - tx;
+            float ay = v - ty;
+            const uint8_t * t = thermalFrame + ty * thermalWidth + tx;
+            float top = t[0] + (t[1] - t[0]) * ax;
+            float bottom = t[thermalWidth] + (t[thermalWidth + 1] - t[thermalWidth]) * ax;
+            samples[i] = top + (bottom - top) * ay;
+            sampled[i] = 1;
+        }
+    }
+}
+
+void ThermalUpsampler::Bilateral(int x0, int y0, int x1, int y1)
+{
+    const int radius = std::max(0, config.radius);
+    const int taps = 2 * radius + 1;
+    const int depthRange = int(depthLut.size()) - 1;
+    const int infraredRange = int(infraredLut.size()) - 1;
+    const bool guideInfrared = useInfrared && infraredFrame;
+
+    for(int y = y0; y < y1; y++)
+    {
+        const int ky0 = std::max(-radius, -y);
+        const int ky1 = std::min(radius, height - 1 - y);
+
+        for(int x = x0; x < x1; x++)
+        {
+            const int i = y * width + x;
+            const int kx0 = std::max(-radius, -x);
+            const int kx1 = std::min(radius, width - 1 - x);
+            const int dp = depthFrame[i];
+            const int ip = guideInfrared ? infraredFrame[i] : 0;
+
+            float sum = 0, weight = 0;
+            for(int ky = ky0; ky <= ky1; ky++)
+            {
+                const int row = i + ky * width;
+                const float * spatial = &spatialLut[(ky + radius) * taps + radius];
+
+                for(int kx = kx0; kx <= kx1; kx++)
+                {
+                    const int j = row + kx;
+                    //Multiplied rather than branched on: no sample, or no depth on one side only (an edge to a
+                    //hole), weighs 0; the last table entries are 0 for differences out of range
+                    const int dq = depthFrame[j];
+                    float w = spatial[kx] * sampled[j] * float((dp == 0) == (dq == 0)) *
+                              depthLut[std::min(std::abs(dp - dq), depthRange)];
+                    if(guideInfrared)
+                        w *= infraredLut[std::min(std::abs(ip - int(infraredFrame[j])) >> infraredShift, infraredRange)];
+
+                    sum += w * samples[j];
+                    weight += w;
+                }
+            }
+
+            output[i] = weight > 0 ? uint8_t(std::max(1, std::min(255, int(sum / weight + 0.5f)))) : 0;
+        }
+    }
+}
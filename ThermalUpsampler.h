@@ -0,0 +1,160 @@
+/*
+ * ThermalUpsampler.h
+ *
+ *  Created on: 19/10 2026
+ *      Author: Baobei Xu
+ */
+
+#ifndef THERMALUPSAMPLER_H_
+#define THERMALUPSAMPLER_H_
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <boost/thread.hpp>
+#include <boost/thread/barrier.hpp>
+#include <opencv2/opencv.hpp>
+
+#include "ThreadMutexObject.h"
+#include "FrameSource.h"
+#include "RigCalibration.h"
+
+struct UpsampleConfig
+{
+    UpsampleConfig()
+     : enabled(false),
+       radius(2),
+       sigmaSpatial(1.5f),
+       sigmaDepth(30.0f),
+       sigmaInfrared(0),
+       maxDtMs(20),
+       threads(0),
+       tileSize(32)
+    {}
+
+    bool enabled;
+
+    /////////////////////////////////////Joint bilateral kernel: (2 * radius + 1)^2 taps, Gaussian in pixels, in depth
+    /// (mm) and in IR intensity; sigmaInfrared 0 leaves the IR out
+    int radius;
+    float sigmaSpatial;
+    float sigmaDepth;
+    float sigmaInfrared;
+
+    /////////////////////////////////////Thermal / IR frames further than this from the depth frame are not paired
+    int maxDtMs;
+
+    /////////////////////////////////////Worker threads including the dispatcher, 0 picks half the cores; square tiles
+    /// of the bilateral pass, dealt out round-robin
+    int threads;
+    int tileSize;
+
+    /////////////////////////////////////Fixed correspondence map (cv::FileStorage, "map": CV_32FC2 of the depth size
+    /// holding the upright thermal x, y of every depth pixel, negative for none) used instead of the calibration
+    std::string mapPath;
+};
+
+/////////////////////////////////////Thermal image on the depth grid for fusion. Every depth pixel is projected into
+/// the thermal image through the rig calibration (or looked up in a correspondence map) and sampled bilinearly,
+/// then a joint bilateral pass guided by depth, and optionally IR, pulls each pixel towards neighbours on the same
+/// surface so edges follow the depth edges rather than the coarse, parallax-shifted thermal ones.
+///
+/// Projection runs in row bands, the bilateral pass in tiles, on a fixed set of threads like the depth filter;
+/// kernel weights come from lookup tables built once. Output is 8-bit like the thermal ring, 0 where no thermal
+/// value reaches the pixel (real values are clamped to 1).
+class ThermalUpsampler
+{
+public:
+    ThermalUpsampler(const UpsampleConfig & config,
+                     const RigCalibration & calibration,
+                     const FrameSource & depth,
+                     const FrameSource & infrared,
+                     const FrameSource & thermal);
+    virtual ~ThermalUpsampler();
+
+    /////////////////////////////////////False without a usable map or calibration for these frame sizes
+    bool IsValid();
+
+    void Start();
+    void Stop();
+
+    /////////////////////////////////////Upsample one set synchronously (worker threads are used if started). Thermal is
+    /// upright; infrared may be 0 when sigmaInfrared is 0.
+    void Process(const uint16_t * depth, const uint16_t * infrared, const uint8_t * thermal, uint8_t * output);
+
+    /////////////////////////////////////Thermal on the depth grid, depth timestamps
+    static const int numBuffers = 30;
+    ThreadMutexObject<int> latestThermalIndex;
+    std::pair<uint8_t *, int64_t> frameBuffers[numBuffers];
+    FrameSlot slots[numBuffers];
+    FrameSource Output();
+
+    /////////////////////////////////////Smoothed processing time of one frame, depth frames without a thermal partner
+    float LatencyMs();
+    int Unpaired();
+
+private:
+    const UpsampleConfig config;
+    const FrameSource depth;
+    const FrameSource infrared;
+    const FrameSource thermal;
+    const int width, height;
+    const int thermalWidth, thermalHeight;
+    const bool useInfrared;
+    int numThreads;
+    bool valid;
+
+    /////////////////////////////////////Correspondence: fixed map, or IR rays and the IR -> thermal transform
+    cv::Mat map;
+    std::vector<cv::Point2f> rays;
+    float R[9];
+    float T[3];
+    float fx, fy, cx, cy;
+
+    /////////////////////////////////////Kernel lookup tables: spatial by tap, range by absolute difference
+    std::vector<float> spatialLut;
+    std::vector<float> depthLut;
+    std::vector<float> infraredLut;
+    int infraredShift;
+
+    /////////////////////////////////////Thermal sampled at every depth pixel, and 1 / 0 whether there is a sample
+    std::vector<float> samples;
+    std::vector<float> sampled;
+
+    const uint16_t * depthFrame;
+    const uint16_t * infraredFrame;
+    const uint8_t * thermalFrame;
+    uint8_t * output;
+
+    std::vector<uint16_t> rawDepth;
+    std::vector<uint16_t> rawInfrared;
+    std::vector<uint8_t> rawThermal;
+    std::vector<uint8_t> uprightThermal;
+
+    boost::thread * upsampleThread;
+    boost::thread_group workers;
+    boost::barrier * barrier;
+    ThreadMutexObject<bool> running;
+
+    /////////////////////////////////////Set by the dispatcher before its last barrier round, so it and the workers
+    /// always agree whether a round is a frame or the end; the barrier orders the accesses
+    bool stopping;
+
+    /////////////////////////////////////Set before the dispatcher and workers start and cleared once they are joined;
+    /// Process only splits the frame over the barrier while it is set
+    ThreadMutexObject<bool> banded;
+    ThreadMutexObject<float> latency;
+    ThreadMutexObject<int> unpaired;
+
+    void UpsampleThread();
+    void WorkerThread(int band);
+    void RunStages(int band);
+
+    /////////////////////////////////////Copy of the frame of source closest in time, false if none is within maxDtMs
+    bool Nearest(const FrameSource & source, int64_t timestamp, uint8_t * data);
+
+    void Project(int y0, int y1);
+    void Bilateral(int x0, int y0, int x1, int y1);
+};
+
+#endif /* THERMALUPSAMPLER_H_ */
@@ -63,15 +63,17 @@ class ThreadMutexObject
             lock.unlock();
         }
 
+        //The value is returned from a copy taken under the lock, lastCopy may already be overwritten by
+        //another reader once the lock is released
         T getValue()
         {
             boost::mutex::scoped_lock lock(mutex);
 
-            lastCopy = object;
+            T value = lastCopy = object;
 
             lock.unlock();
 
-            return lastCopy;
+            return value;
         }
 
         T waitForSignal()
@@ -80,11 +82,11 @@ class ThreadMutexObject
 
             signal.wait(mutex);
 
-            lastCopy = object;
+            T value = lastCopy = object;
 
             lock.unlock();
 
-            return lastCopy;
+            return value;
         }
 
         T getValueWait(int wait = 33000)
@@ -93,11 +95,11 @@ class ThreadMutexObject
 
             boost::mutex::scoped_lock lock(mutex);
 
-            lastCopy = object;
+            T value = lastCopy = object;
 
             lock.unlock();
 
-            return lastCopy;
+            return value;
         }
 
         T & getReferenceWait(int wait = 33000)
@@ -0,0 +1,162 @@
+#include "ThreadPolicy.h"
+
+#include <map>
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <boost/thread.hpp>
+#include <boost/lexical_cast.hpp>
+
+static boost::mutex policyMutex;
+static std::map<std::string, ThreadPolicy> policies;
+static std::vector<std::string> failures;
+
+static bool ParseCores(const std::string & text, std::vector<int> & cores)
+{
+    std::string::size_type start = 0;
+    while(start < text.size())
+    {
+        std::string::size_type end = text.find(',', start);
+        if(end == std::string::npos)
+            end = text.size();
+        std::string item = text.substr(start, end - start);
+        std::string::size_type dash = item.find('-');
+        try
+        {
+            if(dash == std::string::npos)
+            {
+                cores.push_back(boost::lexical_cast<int>(item));
+            }
+            else
+            {
+                int first = boost::lexical_cast<int>(item.substr(0, dash));
+                int last = boost::lexical_cast<int>(item.substr(dash + 1));
+                for(int i = first; i <= last; i++)
+                    cores.push_back(i);
+            }
+        }
+        catch(const boost::bad_lexical_cast &)
+        {
+            return false;
+        }
+        start = end + 1;
+    }
+    return true;
+}
+
+void ThreadPolicies::Set(const std::string & role, const ThreadPolicy & policy)
+{
+    boost::mutex::scoped_lock lock(policyMutex);
+    policies[role] = policy;
+}
+
+bool ThreadPolicies::Parse(const std::string & spec)
+{
+    std::string::size_type first = spec.find(':');
+    if(first == std::string::npos || first == 0)
+        return false;
+
+    std::string role = spec.substr(0, first);
+    std::string::size_type second = spec.find(':', first + 1);
+    std::string cores = spec.substr(first + 1, second == std::string::npos ? std::string::npos : second - first - 1);
+
+    ThreadPolicy policy;
+    if(cores != "*" && !cores.empty() && !ParseCores(cores, policy.cores))
+        return false;
+
+    if(second != std::string::npos)
+    {
+        std::string sched = spec.substr(second + 1);
+        try
+        {
+            if(sched.compare(0, 4, "fifo") == 0)
+            {
+                policy.realtime = true;
+                policy.priority = sched.size() > 4 ? boost::lexical_cast<int>(sched.substr(4)) : 50;
+            }
+            else if(sched.compare(0, 4, "nice") == 0)
+            {
+                policy.priority = boost::lexical_cast<int>(sched.substr(4));
+            }
+            else
+            {
+                return false;
+            }
+        }
+        catch(const boost::bad_lexical_cast &)
+        {
+            return false;
+        }
+    }
+
+    Set(role, policy);
+    return true;
+}
+
+bool ThreadPolicies::Apply(const std::string & role, const std::string & name)
+{
+    //Linux limits thread names to 15 characters
+    pthread_setname_np(pthread_self(), name.substr(0, 15).c_str());
+
+    ThreadPolicy policy;
+    {
+        boost::mutex::scoped_lock lock(policyMutex);
+        std::map<std::string, ThreadPolicy>::iterator it = policies.find(role);
+        if(it == policies.end())
+            return true;
+        policy = it->second;
+    }
+
+    std::string problems;
+
+    if(!policy.cores.empty())
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for(size_t i = 0; i < policy.cores.size(); i++)
+            CPU_SET(policy.cores[i], &set);
+
+        int rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if(rc != 0)
+            problems += std::string(" affinity: ") + strerror(rc) + ";";
+    }
+
+    if(policy.realtime)
+    {
+        sched_param param;
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = policy.priority;
+        int rc = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if(rc != 0)
+            problems += std::string(" SCHED_FIFO ") + boost::lexical_cast<std::string>(policy.priority) + ": " + strerror(rc) + ";";
+    }
+    else if(policy.priority != 0)
+    {
+        //On Linux nice values are per thread when addressed by tid
+        pid_t tid = syscall(SYS_gettid);
+        if(setpriority(PRIO_PROCESS, tid, policy.priority) != 0)
+            problems += std::string(" nice ") + boost::lexical_cast<std::string>(policy.priority) + ": " + strerror(errno) + ";";
+    }
+
+    if(problems.empty())
+        return true;
+
+    std::string failure = name + " (" + role + "):" + problems;
+    std::cout << "Thread policy not applied for " << failure << std::endl;
+
+    boost::mutex::scoped_lock lock(policyMutex);
+    failures.push_back(failure);
+    return false;
+}
+
+std::vector<std::string> ThreadPolicies::Failures()
+{
+    boost::mutex::scoped_lock lock(policyMutex);
+    return failures;
+}
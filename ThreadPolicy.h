@@ -0,0 +1,47 @@
+/*
+ * ThreadPolicy.h
+ *
+ *  Created on: 19/10 2026
+ *      Author: Baobei Xu
+ */
+
+#ifndef THREADPOLICY_H_
+#define THREADPOLICY_H_
+
+#include <string>
+#include <vector>
+
+/////////////////////////////////////Scheduling policy of one pipeline role (acquire, callback, writer, ...)
+struct ThreadPolicy
+{
+    ThreadPolicy()
+     : realtime(false),
+       priority(0)
+    {}
+
+    /////////////////////////////////////Cores the thread may run on, empty means any core
+    std::vector<int> cores;
+
+    /////////////////////////////////////SCHED_FIFO with priority 1-99 if realtime, otherwise priority is a nice value
+    bool realtime;
+    int priority;
+};
+
+class ThreadPolicies
+{
+public:
+    /////////////////////////////////////Set the policy of a role, e.g. "acquire", "callback", "writer"
+    static void Set(const std::string & role, const ThreadPolicy & policy);
+
+    /////////////////////////////////////Parse "role:cores[:fifoN|:niceN]", cores as "2", "2,3" or "4-7"
+    static bool Parse(const std::string & spec);
+
+    /////////////////////////////////////Name the calling thread and apply the policy of its role.
+    /// Returns false and reports it if any part of the policy could not be applied.
+    static bool Apply(const std::string & role, const std::string & name);
+
+    /////////////////////////////////////One line per thread that failed to get its policy
+    static std::vector<std::string> Failures();
+};
+
+#endif /* THREADPOLICY_H_ */
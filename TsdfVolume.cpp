@@ -0,0 +1,658 @@
+#include "TsdfVolume.h"
+#include "WorkStealingPool.h"
+
+#include <cmath>
+#include <limits>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <boost/bind.hpp>
+#include <boost/unordered_set.hpp>
+
+Pose::Pose()
+{
+    for(int i = 0; i < 9; i++)
+        R[i] = i % 4 == 0 ? 1 : 0;
+    t[0] = t[1] = t[2] = 0;
+}
+
+void Pose::Apply(const float in[3], float out[3]) const
+{
+    for(int r = 0; r < 3; r++)
+        out[r] = float(R[r * 3] * in[0] + R[r * 3 + 1] * in[1] + R[r * 3 + 2] * in[2] + t[r]);
+}
+
+void Pose::Rotate(const float in[3], float out[3]) const
+{
+    for(int r = 0; r < 3; r++)
+        out[r] = float(R[r * 3] * in[0] + R[r * 3 + 1] * in[1] + R[r * 3 + 2] * in[2]);
+}
+
+Pose Pose::Inverse() const
+{
+    Pose inverse;
+    for(int r = 0; r < 3; r++)
+    {
+        for(int c = 0; c < 3; c++)
+            inverse.R[r * 3 + c] = R[c * 3 + r];
+    }
+    for(int r = 0; r < 3; r++)
+        inverse.t[r] = -(inverse.R[r * 3] * t[0] + inverse.R[r * 3 + 1] * t[1] + inverse.R[r * 3 + 2] * t[2]);
+    return inverse;
+}
+
+Pose Pose::Compose(const Pose & other) const
+{
+    Pose result;
+    for(int r = 0; r < 3; r++)
+    {
+        for(int c = 0; c < 3; c++)
+            result.R[r * 3 + c] = R[r * 3] * other.R[c] + R[r * 3 + 1] * other.R[3 + c] + R[r * 3 + 2] * other.R[6 + c];
+        result.t[r] = R[r * 3] * other.t[0] + R[r * 3 + 1] * other.t[1] + R[r * 3 + 2] * other.t[2] + t[r];
+    }
+    return result;
+}
+
+Pose Pose::Twist(const double w[3], const double v[3])
+{
+    Pose twist;
+    double angle = sqrt(w[0] * w[0] + w[1] * w[1] + w[2] * w[2]);
+    if(angle > 1e-12)
+    {
+        double k[3] = {w[0] / angle, w[1] / angle, w[2] / angle};
+        double s = sin(angle), c = cos(angle), C = 1 - c;
+        double rotation[9] = {c + k[0] * k[0] * C,        k[0] * k[1] * C - k[2] * s, k[0] * k[2] * C + k[1] * s,
+                              k[1] * k[0] * C + k[2] * s, c + k[1] * k[1] * C,        k[1] * k[2] * C - k[0] * s,
+                              k[2] * k[0] * C - k[1] * s, k[2] * k[1] * C + k[0] * s, c + k[2] * k[2] * C};
+        memcpy(twist.R, rotation, sizeof(rotation));
+    }
+    for(int i = 0; i < 3; i++)
+        twist.t[i] = v[i];
+    return twist;
+}
+
+TsdfVolume::TsdfVolume(float voxelSize, float truncation, int maxWeight, int maxBlocks)
+ : voxelSize(voxelSize),
+   truncation(std::max(truncation, 2 * voxelSize)),
+   maxWeight(std::max(1, std::min(65535, maxWeight))),
+   maxBlocks(maxBlocks)
+{
+}
+
+TsdfVolume::~TsdfVolume()
+{
+    Reset();
+
+    for(size_t i = 0; i < freeBlocks.size(); i++)
+        delete freeBlocks[i];
+}
+
+int64_t TsdfVolume::Key(int x, int y, int z)
+{
+    //21 bits per axis: +-1M blocks, far more than any scan
+    return (int64_t(x & 0x1FFFFF) << 42) | (int64_t(y & 0x1FFFFF) << 21) | int64_t(z & 0x1FFFFF);
+}
+
+VoxelBlock * TsdfVolume::Find(int x, int y, int z)
+{
+    boost::unordered_map<int64_t, VoxelBlock *>::iterator it = blocks.find(Key(x, y, z));
+    return it == blocks.end() ? 0 : it->second;
+}
+
+//Floor division for negative grid coordinates
+static inline int BlockOf(int voxel)
+{
+    return voxel >= 0 ? voxel / TSDF_BLOCK_SIDE : -((-voxel + TSDF_BLOCK_SIDE - 1) / TSDF_BLOCK_SIDE);
+}
+
+const Voxel * TsdfVolume::Lookup(int x, int y, int z, VoxelBlock *& cached)
+{
+    int bx = BlockOf(x), by = BlockOf(y), bz = BlockOf(z);
+    if(!cached || cached->x != bx || cached->y != by || cached->z != bz)
+    {
+        cached = Find(bx, by, bz);
+        if(!cached)
+            return 0;
+    }
+
+    int lx = x - bx * TSDF_BLOCK_SIDE, ly = y - by * TSDF_BLOCK_SIDE, lz = z - bz * TSDF_BLOCK_SIDE;
+    return &cached->voxels[(lz * TSDF_BLOCK_SIDE + ly) * TSDF_BLOCK_SIDE + lx];
+}
+
+bool TsdfVolume::Interpolate(const float p[3], float & sdf, VoxelBlock *& cached)
+{
+    const float inverseVoxel = 1.0f / voxelSize;
+    float g[3] = {p[0] * inverseVoxel, p[1] * inverseVoxel, p[2] * inverseVoxel};
+    int base[3] = {int(floorf(g[0])), int(floorf(g[1])), int(floorf(g[2]))};
+    float f[3] = {g[0] - base[0], g[1] - base[1], g[2] - base[2]};
+
+    sdf = 0;
+    for(int c = 0; c < 8; c++)
+    {
+        int dx = c & 1, dy = (c >> 1) & 1, dz = c >> 2;
+        const Voxel * voxel = Lookup(base[0] + dx, base[1] + dy, base[2] + dz, cached);
+        if(!voxel || !voxel->weight)
+            return false;
+        sdf += voxel->sdf * (dx ? f[0] : 1 - f[0]) * (dy ? f[1] : 1 - f[1]) * (dz ? f[2] : 1 - f[2]);
+    }
+    return true;
+}
+
+bool TsdfVolume::Allocate(const uint16_t * depth, const CameraIntrinsics & camera, const Pose & pose,
+                          float minDepth, float maxDepth, int step, std::vector<VoxelBlock *> & visible)
+{
+    const float blockSize = voxelSize * TSDF_BLOCK_SIDE;
+    const float stride = std::min(truncation, blockSize * 0.5f);
+    boost::unordered_set<int64_t> seen;
+    bool complete = true;
+
+    visible.clear();
+    step = std::max(1, step);
+
+    for(int y = 0; y < camera.height; y += step)
+    {
+        for(int x = 0; x < camera.width; x += step)
+        {
+            float d = depth[y * camera.width + x] * 0.001f;
+            if(d < minDepth || d > maxDepth)
+                continue;
+
+            //Walk the truncation band along the ray, finely enough not to step over a block
+            float rx = (x - camera.cx) / camera.fx;
+            float ry = (y - camera.cy) / camera.fy;
+            for(float z = d - truncation; z <= d + truncation; z += stride)
+            {
+                float p[3] = {rx * z, ry * z, z}, w[3];
+                pose.Apply(p, w);
+
+                int bx = int(floorf(w[0] / blockSize));
+                int by = int(floorf(w[1] / blockSize));
+                int bz = int(floorf(w[2] / blockSize));
+                if(!seen.insert(Key(bx, by, bz)).second)
+                    continue;
+
+                VoxelBlock * block = Find(bx, by, bz);
+                if(!block)
+                {
+                    if(int(blocks.size()) >= maxBlocks)
+                    {
+                        complete = false;
+                        continue;
+                    }
+
+                    if(freeBlocks.empty())
+                    {
+                        block = new VoxelBlock;
+                    }
+                    else
+                    {
+                        block = freeBlocks.back();
+                        freeBlocks.pop_back();
+                    }
+
+                    block->x = bx;
+                    block->y = by;
+                    block->z = bz;
+                    for(int i = 0; i < TSDF_BLOCK_VOXELS; i++)
+                    {
+                        block->voxels[i].sdf = 1;
+                        block->voxels[i].temperature = 0;
+                        block->voxels[i].weight = 0;
+                        block->voxels[i].thermalWeight = 0;
+                    }
+                    blocks[Key(bx, by, bz)] = block;
+                }
+                visible.push_back(block);
+            }
+        }
+    }
+
+    return complete;
+}
+
+void TsdfVolume::Integrate(VoxelBlock * const * list, int count, const uint16_t * depth, const uint8_t * thermal,
+                           const CameraIntrinsics & camera, const Pose & pose, float maxDepth)
+{
+    const Pose view = pose.Inverse();
+    const float inverseTruncation = 1.0f / truncation;
+    const float thermalBand = truncation * 0.5f;
+
+    //Camera-space steps of one voxel along each world axis
+    float axis[3][3];
+    for(int a = 0; a < 3; a++)
+    {
+        for(int r = 0; r < 3; r++)
+            axis[a][r] = float(view.R[r * 3 + a]) * voxelSize;
+    }
+
+    for(int b = 0; b < count; b++)
+    {
+        VoxelBlock * block = list[b];
+        float origin[3] = {block->x * TSDF_BLOCK_SIDE * voxelSize,
+                           block->y * TSDF_BLOCK_SIDE * voxelSize,
+                           block->z * TSDF_BLOCK_SIDE * voxelSize};
+        float base[3];
+        view.Apply(origin, base);
+
+        Voxel * voxel = block->voxels;
+        for(int z = 0; z < TSDF_BLOCK_SIDE; z++)
+        {
+            for(int y = 0; y < TSDF_BLOCK_SIDE; y++)
+            {
+                float p[3];
+                for(int r = 0; r < 3; r++)
+                    p[r] = base[r] + axis[1][r] * y + axis[2][r] * z;
+
+                for(int x = 0; x < TSDF_BLOCK_SIDE; x++, voxel++, p[0] += axis[0][0], p[1] += axis[0][1], p[2] += axis[0][2])
+                {
+                    if(p[2] <= 0)
+                        continue;
+
+                    int u = int(camera.fx * p[0] / p[2] + camera.cx + 0.5f);
+                    int v = int(camera.fy * p[1] / p[2] + camera.cy + 0.5f);
+                    if(u < 0 || v < 0 || u >= camera.width || v >= camera.height)
+                        continue;
+
+                    const int i = v * camera.width + u;
+                    float d = depth[i] * 0.001f;
+                    if(d == 0 || d > maxDepth)
+                        continue;
+
+                    //Along the optical axis; behind the band the voxel is occluded, not empty
+                    float sdf = d - p[2];
+                    if(sdf < -truncation)
+                        continue;
+
+                    float tsdf = std::min(1.0f, sdf * inverseTruncation);
+                    voxel->sdf = (voxel->sdf * voxel->weight + tsdf) / (voxel->weight + 1);
+                    voxel->weight = uint16_t(std::min(maxWeight, voxel->weight + 1));
+
+                    if(thermal && thermal[i] && fabsf(sdf) < thermalBand)
+                    {
+                        voxel->temperature = (voxel->temperature * voxel->thermalWeight + thermal[i]) / (voxel->thermalWeight + 1);
+                        voxel->thermalWeight = uint16_t(std::min(maxWeight, voxel->thermalWeight + 1));
+                    }
+                }
+            }
+        }
+    }
+}
+
+void TsdfVolume::Raycast(const CameraIntrinsics & camera, const Pose & pose, float minDepth, float maxDepth,
+                         int y0, int y1, float * vertices, float * normals)
+{
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    const float inverseVoxel = 1.0f / voxelSize;
+    const float origin[3] = {float(pose.t[0]), float(pose.t[1]), float(pose.t[2])};
+
+    for(int y = y0; y < y1; y++)
+    {
+        for(int x = 0; x < camera.width; x++)
+        {
+            float * vertex = vertices + 3 * (y * camera.width + x);
+            float * normal = normals + 3 * (y * camera.width + x);
+            vertex[0] = normal[0] = nan;
+
+            float ray[3] = {(x - camera.cx) / camera.fx, (y - camera.cy) / camera.fy, 1};
+            float length = sqrtf(ray[0] * ray[0] + ray[1] * ray[1] + 1);
+            for(int r = 0; r < 3; r++)
+                ray[r] /= length;
+            float direction[3];
+            pose.Rotate(ray, direction);
+
+            VoxelBlock * cached = 0;
+            float previous = 0, previousT = 0;
+            bool hasPrevious = false;
+            float hit = -1;
+
+            for(float t = minDepth * length; t < maxDepth * length; )
+            {
+                float p[3] = {origin[0] + direction[0] * t, origin[1] + direction[1] * t, origin[2] + direction[2] * t};
+                const Voxel * voxel = Lookup(int(floorf(p[0] * inverseVoxel + 0.5f)), int(floorf(p[1] * inverseVoxel + 0.5f)),
+                                             int(floorf(p[2] * inverseVoxel + 0.5f)), cached);
+
+                if(!voxel || voxel->weight == 0)
+                {
+                    hasPrevious = false;
+                    t += truncation * 0.8f;
+                    continue;
+                }
+
+                if(hasPrevious && previous > 0 && voxel->sdf <= 0)
+                {
+                    //Nearest voxels find the crossing, trilinear values place it without their staircase
+                    float before = previous, after = voxel->sdf;
+                    float q[3] = {origin[0] + direction[0] * previousT, origin[1] + direction[1] * previousT,
+                                  origin[2] + direction[2] * previousT};
+                    float a, b;
+                    if(Interpolate(q, a, cached) && Interpolate(p, b, cached) && a > 0 && b <= 0)
+                    {
+                        before = a;
+                        after = b;
+                    }
+                    hit = previousT + (t - previousT) * before / (before - after);
+                    break;
+                }
+
+                //Seen from behind
+                if(hasPrevious && previous < 0 && voxel->sdf > 0)
+                    break;
+
+                previous = voxel->sdf;
+                previousT = t;
+                hasPrevious = true;
+
+                //The field bounds the distance to the surface, close to it the steps get as fine as a voxel
+                t += std::max(voxelSize, fabsf(voxel->sdf) * truncation * 0.8f);
+            }
+
+            if(hit < 0)
+                continue;
+
+            float p[3] = {origin[0] + direction[0] * hit, origin[1] + direction[1] * hit, origin[2] + direction[2] * hit};
+            int gx = int(floorf(p[0] * inverseVoxel + 0.5f));
+            int gy = int(floorf(p[1] * inverseVoxel + 0.5f));
+            int gz = int(floorf(p[2] * inverseVoxel + 0.5f));
+
+            //Central differences point away from the surface, towards the camera
+            const Voxel * around[6] = {Lookup(gx + 1, gy, gz, cached), Lookup(gx - 1, gy, gz, cached),
+                                       Lookup(gx, gy + 1, gz, cached), Lookup(gx, gy - 1, gz, cached),
+                                       Lookup(gx, gy, gz + 1, cached), Lookup(gx, gy, gz - 1, cached)};
+            bool complete = true;
+            for(int i = 0; i < 6; i++)
+                complete = complete && around[i] && around[i]->weight;
+            if(!complete)
+                continue;
+
+            float gradient[3] = {around[0]->sdf - around[1]->sdf, around[2]->sdf - around[3]->sdf, around[4]->sdf - around[5]->sdf};
+            float norm = sqrtf(gradient[0] * gradient[0] + gradient[1] * gradient[1] + gradient[2] * gradient[2]);
+            if(norm < 1e-6f)
+                continue;
+
+            for(int r = 0; r < 3; r++)
+            {
+                vertex[r] = p[r];
+                normal[r] = gradient[r] / norm;
+            }
+        }
+    }
+}
+
+int TsdfVolume::Evict(const float point[3], float distance)
+{
+    const float blockSize = voxelSize * TSDF_BLOCK_SIDE;
+    const float limit = distance * distance;
+    int evicted = 0;
+
+    for(boost::unordered_map<int64_t, VoxelBlock *>::iterator it = blocks.begin(); it != blocks.end(); )
+    {
+        VoxelBlock * block = it->second;
+        float dx = (block->x + 0.5f) * blockSize - point[0];
+        float dy = (block->y + 0.5f) * blockSize - point[1];
+        float dz = (block->z + 0.5f) * blockSize - point[2];
+        if(dx * dx + dy * dy + dz * dz > limit)
+        {
+            freeBlocks.push_back(block);
+            it = blocks.erase(it);
+            evicted++;
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    return evicted;
+}
+
+void TsdfVolume::Reset()
+{
+    for(boost::unordered_map<int64_t, VoxelBlock *>::iterator it = blocks.begin(); it != blocks.end(); ++it)
+        freeBlocks.push_back(it->second);
+    blocks.clear();
+}
+
+int TsdfVolume::NumBlocks()
+{
+    return int(blocks.size());
+}
+
+int TsdfVolume::MaxBlocks()
+{
+    return maxBlocks;
+}
+
+size_t TsdfVolume::BytesUsed()
+{
+    return (blocks.size() + freeBlocks.size()) * sizeof(VoxelBlock);
+}
+
+//Cube corners and the six tetrahedra around the 0-6 diagonal that tile the cube without cracks between neighbours
+static const int CORNERS[8][3] = {{0, 0, 0}, {1, 0, 0}, {1, 1, 0}, {0, 1, 0}, {0, 0, 1}, {1, 0, 1}, {1, 1, 1}, {0, 1, 1}};
+static const int TETRAHEDRA[6][4] = {{0, 5, 1, 6}, {0, 1, 2, 6}, {0, 2, 3, 6}, {0, 3, 7, 6}, {0, 7, 4, 6}, {0, 4, 5, 6}};
+
+static inline int64_t GridKey(int x, int y, int z)
+{
+    return (int64_t(x & 0x1FFFFF) << 42) | (int64_t(y & 0x1FFFFF) << 21) | int64_t(z & 0x1FFFFF);
+}
+
+void TsdfVolume::MeshBlocks(const std::vector<VoxelBlock *> & list, size_t begin, size_t end, std::vector<float> & corners,
+                            std::vector<int64_t> & edges)
+{
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    VoxelBlock * cached = 0;
+
+    for(size_t b = begin; b < end; b++)
+    {
+        const int x0 = list[b]->x * TSDF_BLOCK_SIDE, y0 = list[b]->y * TSDF_BLOCK_SIDE, z0 = list[b]->z * TSDF_BLOCK_SIDE;
+
+        for(int z = z0; z < z0 + TSDF_BLOCK_SIDE; z++)
+        {
+            for(int y = y0; y < y0 + TSDF_BLOCK_SIDE; y++)
+            {
+                for(int x = x0; x < x0 + TSDF_BLOCK_SIDE; x++)
+                {
+                    //Cells reaching into the next block read it too, a missing neighbour leaves the cell out
+                    const Voxel * cell[8];
+                    int inside = 0;
+                    bool complete = true;
+                    for(int c = 0; c < 8 && complete; c++)
+                    {
+                        cell[c] = Lookup(x + CORNERS[c][0], y + CORNERS[c][1], z + CORNERS[c][2], cached);
+                        complete = cell[c] && cell[c]->weight;
+                        inside += complete && cell[c]->sdf < 0;
+                    }
+                    if(!complete || inside == 0 || inside == 8)
+                        continue;
+
+                    for(int t = 0; t < 6; t++)
+                    {
+                        const int * tetra = TETRAHEDRA[t];
+                        int in[4], out[4], numIn = 0, numOut = 0;
+                        for(int k = 0; k < 4; k++)
+                        {
+                            if(cell[tetra[k]]->sdf < 0)
+                                in[numIn++] = tetra[k];
+                            else
+                                out[numOut++] = tetra[k];
+                        }
+                        if(numIn == 0 || numOut == 0)
+                            continue;
+
+                        //Crossing edges, in an order that walks around the cut: 3 make a triangle, 4 a quad
+                        int crossing[4][2], numCrossing = 0;
+                        if(numIn == 2)
+                        {
+                            int order[4][2] = {{in[0], out[0]}, {in[0], out[1]}, {in[1], out[1]}, {in[1], out[0]}};
+                            memcpy(crossing, order, sizeof(order));
+                            numCrossing = 4;
+                        }
+                        else
+                        {
+                            const int * single = numIn == 1 ? in : out;
+                            const int * others = numIn == 1 ? out : in;
+                            for(int k = 0; k < 3; k++)
+                            {
+                                crossing[k][0] = single[0];
+                                crossing[k][1] = others[k];
+                            }
+                            numCrossing = 3;
+                        }
+
+                        float points[4][4];
+                        int64_t keys[4][2];
+                        for(int k = 0; k < numCrossing; k++)
+                        {
+                            const int a = crossing[k][0], c = crossing[k][1];
+                            const Voxel * va = cell[a];
+                            const Voxel * vc = cell[c];
+                            float f = va->sdf / (va->sdf - vc->sdf);
+                            for(int r = 0; r < 3; r++)
+                            {
+                                float pa = float((r == 0 ? x : r == 1 ? y : z) + CORNERS[a][r]);
+                                float pc = float((r == 0 ? x : r == 1 ? y : z) + CORNERS[c][r]);
+                                points[k][r] = (pa + (pc - pa) * f) * voxelSize;
+                            }
+
+                            if(va->thermalWeight && vc->thermalWeight)
+                                points[k][3] = va->temperature + (vc->temperature - va->temperature) * f;
+                            else
+                                points[k][3] = va->thermalWeight ? va->temperature : vc->thermalWeight ? vc->temperature : nan;
+
+                            int64_t ka = GridKey(x + CORNERS[a][0], y + CORNERS[a][1], z + CORNERS[a][2]);
+                            int64_t kc = GridKey(x + CORNERS[c][0], y + CORNERS[c][1], z + CORNERS[c][2]);
+                            keys[k][0] = std::min(ka, kc);
+                            keys[k][1] = std::max(ka, kc);
+                        }
+
+                        //Wind the faces so their normal points out of the surface, from the inside corners outwards
+                        float outward[3] = {0, 0, 0};
+                        for(int k = 0; k < 4; k++)
+                        {
+                            float sign = cell[tetra[k]]->sdf < 0 ? -1.0f : 1.0f;
+                            for(int r = 0; r < 3; r++)
+                                outward[r] += sign * CORNERS[tetra[k]][r];
+                        }
+
+                        int triangles[2][3] = {{0, 1, 2}, {0, 2, 3}};
+                        for(int f = 0; f < numCrossing - 2; f++)
+                        {
+                            int * tri = triangles[f];
+                            float e1[3], e2[3];
+                            for(int r = 0; r < 3; r++)
+                            {
+                                e1[r] = points[tri[1]][r] - points[tri[0]][r];
+                                e2[r] = points[tri[2]][r] - points[tri[0]][r];
+                            }
+                            float n[3] = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0]};
+                            if(n[0] * outward[0] + n[1] * outward[1] + n[2] * outward[2] < 0)
+                                std::swap(tri[1], tri[2]);
+
+                            for(int k = 0; k < 3; k++)
+                            {
+                                corners.insert(corners.end(), points[tri[k]], points[tri[k]] + 4);
+                                edges.push_back(keys[tri[k]][0]);
+                                edges.push_back(keys[tri[k]][1]);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+//Blue - red - yellow - white ramp over the 8-bit level
+static void FalseColour(float level, uint8_t rgb[3])
+{
+    if(level != level)
+    {
+        rgb[0] = rgb[1] = rgb[2] = 128;
+        return;
+    }
+
+    float v = std::max(0.0f, std::min(1.0f, level / 255.0f));
+    rgb[0] = uint8_t(255 * std::min(1.0f, v * 2.0f));
+    rgb[1] = uint8_t(255 * std::max(0.0f, std::min(1.0f, v * 2.0f - 0.8f)));
+    rgb[2] = uint8_t(255 * std::max(0.0f, v < 0.3f ? 0.6f - v * 2.0f : v * 2.5f - 1.5f));
+}
+
+bool TsdfVolume::ExportPly(const std::string & path, float scale, float offset, int threads)
+{
+    std::vector<VoxelBlock *> list;
+    list.reserve(blocks.size());
+    for(boost::unordered_map<int64_t, VoxelBlock *>::iterator it = blocks.begin(); it != blocks.end(); ++it)
+        list.push_back(it->second);
+
+    //Chunks of blocks meshed in parallel, each into its own triangle soup keyed by grid edge
+    const size_t chunk = 64;
+    const size_t numChunks = (list.size() + chunk - 1) / chunk;
+    std::vector<std::vector<float> > corners(numChunks);
+    std::vector<std::vector<int64_t> > edges(numChunks);
+    {
+        WorkStealingPool pool(threads, 0, "reconstruct");
+        for(size_t c = 0; c < numChunks; c++)
+            pool.Submit(boost::bind(&TsdfVolume::MeshBlocks, this, boost::cref(list), c * chunk,
+                                    std::min(list.size(), (c + 1) * chunk), boost::ref(corners[c]), boost::ref(edges[c])));
+        pool.Wait();
+    }
+
+    //Vertices on the same grid edge are the same vertex, shared across cells and chunks
+    boost::unordered_map<std::pair<int64_t, int64_t>, int> shared;
+    std::vector<float> vertices;
+    std::vector<int> faces;
+    for(size_t c = 0; c < numChunks; c++)
+    {
+        for(size_t k = 0; k < edges[c].size() / 2; k++)
+        {
+            std::pair<int64_t, int64_t> key(edges[c][2 * k], edges[c][2 * k + 1]);
+            boost::unordered_map<std::pair<int64_t, int64_t>, int>::iterator it = shared.find(key);
+            if(it == shared.end())
+            {
+                it = shared.insert(std::make_pair(key, int(vertices.size() / 4))).first;
+                vertices.insert(vertices.end(), &corners[c][4 * k], &corners[c][4 * k] + 4);
+            }
+            faces.push_back(it->second);
+        }
+    }
+
+    //Cells split into tetrahedra produce slivers whose corners all land on one vertex
+    std::vector<int> kept;
+    kept.reserve(faces.size());
+    for(size_t f = 0; f + 2 < faces.size(); f += 3)
+    {
+        if(faces[f] != faces[f + 1] && faces[f + 1] != faces[f + 2] && faces[f] != faces[f + 2])
+            kept.insert(kept.end(), &faces[f], &faces[f] + 3);
+    }
+
+    FILE * file = fopen(path.c_str(), "wb");
+    if(!file)
+        return false;
+
+    const int numVertices = int(vertices.size() / 4);
+    const int numFaces = int(kept.size() / 3);
+    fprintf(file, "ply\nformat binary_little_endian 1.0\ncomment thermal TSDF mesh, temperature = level * %g + %g\n"
+                  "element vertex %d\nproperty float x\nproperty float y\nproperty float z\n"
+                  "property uchar red\nproperty uchar green\nproperty uchar blue\nproperty float temperature\n"
+                  "element face %d\nproperty list uchar int vertex_indices\nend_header\n",
+            scale, offset, numVertices, numFaces);
+
+    bool ok = true;
+    for(int v = 0; v < numVertices && ok; v++)
+    {
+        const float * vertex = &vertices[4 * v];
+        uint8_t rgb[3];
+        FalseColour(vertex[3], rgb);
+        float temperature = vertex[3] * scale + offset;
+        ok = fwrite(vertex, sizeof(float), 3, file) == 3 && fwrite(rgb, 1, 3, file) == 3 &&
+             fwrite(&temperature, sizeof(float), 1, file) == 1;
+    }
+
+    for(int f = 0; f < numFaces && ok; f++)
+    {
+        uint8_t three = 3;
+        ok = fwrite(&three, 1, 1, file) == 1 && fwrite(&kept[3 * f], sizeof(int), 3, file) == 3;
+    }
+
+    return fclose(file) == 0 && ok;
+}
@@ -0,0 +1,142 @@
+/*
+ * TsdfVolume.h
+ *
+ *  Created on: 19/10 2026
+ *      Author: Baobei Xu
+ */
+
+#ifndef TSDFVOLUME_H_
+#define TSDFVOLUME_H_
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <boost/unordered_map.hpp>
+
+/////////////////////////////////////Pinhole camera of the depth grid
+struct CameraIntrinsics
+{
+    CameraIntrinsics()
+     : fx(0), fy(0), cx(0), cy(0), width(0), height(0)
+    {}
+
+    CameraIntrinsics(float fx, float fy, float cx, float cy, int width, int height)
+     : fx(fx), fy(fy), cx(cx), cy(cy), width(width), height(height)
+    {}
+
+    /////////////////////////////////////Same camera on a grid decimated by factor (pixel x here is x * factor)
+    CameraIntrinsics Scaled(int factor) const
+    {
+        return CameraIntrinsics(fx / factor, fy / factor, cx / factor, cy / factor, width / factor, height / factor);
+    }
+
+    float fx, fy, cx, cy;
+    int width, height;
+};
+
+/////////////////////////////////////Rigid camera -> world transform: world = R * camera + t (metres, R row-major)
+struct Pose
+{
+    Pose();
+
+    double R[9];
+    double t[3];
+
+    void Apply(const float in[3], float out[3]) const;
+    void Rotate(const float in[3], float out[3]) const;
+    Pose Inverse() const;
+
+    /////////////////////////////////////this * other
+    Pose Compose(const Pose & other) const;
+
+    /////////////////////////////////////Small motion: rotation by the vector w (radians, Rodrigues) and translation v
+    static Pose Twist(const double w[3], const double v[3]);
+};
+
+/////////////////////////////////////Voxel of the truncated signed distance field with the fused thermal level
+struct Voxel
+{
+    /////////////////////////////////////Distance to the surface in truncation units (-1 behind, 1 in front)
+    float sdf;
+
+    /////////////////////////////////////Weighted mean thermal level (8-bit ring scale) of the surface here
+    float temperature;
+
+    uint16_t weight;
+    uint16_t thermalWeight;
+};
+
+#define TSDF_BLOCK_SIDE 8
+#define TSDF_BLOCK_VOXELS (TSDF_BLOCK_SIDE * TSDF_BLOCK_SIDE * TSDF_BLOCK_SIDE)
+
+struct VoxelBlock
+{
+    /////////////////////////////////////Block coordinates, the first voxel is at (x, y, z) * TSDF_BLOCK_SIDE
+    int x, y, z;
+    Voxel voxels[TSDF_BLOCK_VOXELS];
+};
+
+/////////////////////////////////////Sparse TSDF: 8^3 voxel blocks allocated around observed surfaces only and found
+/// through a hash of their coordinates, so memory follows the scanned surface rather than a bounding box. Voxels sit
+/// on the grid points (x, y, z) * voxelSize of the world frame.
+///
+/// Not synchronised: Allocate, Evict and Reset change the hash and must not overlap anything else; Integrate calls on
+/// disjoint block sets and Raycast calls may run in parallel with each other.
+class TsdfVolume
+{
+public:
+    TsdfVolume(float voxelSize, float truncation, int maxWeight, int maxBlocks);
+    virtual ~TsdfVolume();
+
+    /////////////////////////////////////Blocks within the truncation band of a depth frame (every step-th pixel),
+    /// allocated as needed. False if maxBlocks left some of them out.
+    bool Allocate(const uint16_t * depth, const CameraIntrinsics & camera, const Pose & pose,
+                  float minDepth, float maxDepth, int step, std::vector<VoxelBlock *> & blocks);
+
+    /////////////////////////////////////Fuse a depth frame (mm) and the thermal levels on its grid (0 for none, or no
+    /// thermal at all) into blocks
+    void Integrate(VoxelBlock * const * blocks, int count, const uint16_t * depth, const uint8_t * thermal,
+                   const CameraIntrinsics & camera, const Pose & pose, float maxDepth);
+
+    /////////////////////////////////////World vertices and normals (3 floats per pixel) of the surface seen from pose,
+    /// rows y0 to y1 of camera; x is NaN where a ray hits nothing
+    void Raycast(const CameraIntrinsics & camera, const Pose & pose, float minDepth, float maxDepth,
+                 int y0, int y1, float * vertices, float * normals);
+
+    /////////////////////////////////////Drop blocks whose centre is further than distance from point, returns how many
+    int Evict(const float point[3], float distance);
+    void Reset();
+
+    int NumBlocks();
+    int MaxBlocks();
+    size_t BytesUsed();
+
+    /////////////////////////////////////Triangle mesh of the zero crossing (marching tetrahedra) as binary PLY with a
+    /// false-colour and a "temperature" property (level * scale + offset, NaN where none was fused). Blocks are
+    /// meshed in parallel on threads threads.
+    bool ExportPly(const std::string & path, float scale, float offset, int threads);
+
+private:
+    const float voxelSize;
+    const float truncation;
+    const int maxWeight;
+    const int maxBlocks;
+
+    boost::unordered_map<int64_t, VoxelBlock *> blocks;
+    std::vector<VoxelBlock *> freeBlocks;
+
+    static int64_t Key(int x, int y, int z);
+    VoxelBlock * Find(int x, int y, int z);
+
+    /////////////////////////////////////Voxel at a grid point, 0 if its block is not allocated; cached remembers the
+    /// last block for runs of lookups in the same one
+    const Voxel * Lookup(int x, int y, int z, VoxelBlock *& cached);
+
+    /////////////////////////////////////Trilinear distance at a world point, false if a corner is unobserved
+    bool Interpolate(const float p[3], float & sdf, VoxelBlock *& cached);
+
+    void MeshBlocks(const std::vector<VoxelBlock *> & blocks, size_t begin, size_t end, std::vector<float> & corners,
+                    std::vector<int64_t> & edges);
+};
+
+#endif /* TSDFVOLUME_H_ */
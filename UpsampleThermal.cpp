@@ -0,0 +1,218 @@
+/*
+ * UpsampleThermal.cpp
+ *
+ *  Created on: 19/10 2026
+ *      Author: Baobei Xu
+ *
+ *  Offline run of the thermal upsampler (ThermalUpsampler.h) on recorded sessions: every depth frame is paired with
+ *  the nearest thermal (and IR) frame and the thermal image on the depth grid is written as <timestamp>.png. The
+ *  correspondence comes from a fixed map (--map) or from a rig calibration (--calibration).
+ *
+ *      UpsampleThermal (--map map.yml | --calibration calibration.yml) [--radius 2] [--sigma 1.5 30 0]
+ *                      [--max-dt 20] [--depth-stream depth] [--ir-stream infrared] [--thermal-stream thermal]
+ *                      [--step N] [--out DIR]
+ *                      session...
+ */
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <opencv2/opencv.hpp>
+
+#include "SessionIndex.h"
+#include "SessionContainer.h"
+#include "RigCalibration.h"
+#include "ThermalUpsampler.h"
+
+struct UpsampleOptions
+{
+    UpsampleOptions()
+     : step(1),
+       depthStream("depth"),
+       irStream("infrared"),
+       thermalStream("thermal"),
+       out("thermal_depth")
+    {}
+
+    UpsampleConfig upsample;
+    std::string calibration;
+    int step;
+    std::string depthStream;
+    std::string irStream;
+    std::string thermalStream;
+    std::string out;
+};
+
+//Only the frame layout, the upsampler does not read rings offline
+static FrameSource Shape(const std::string & name, const cv::Mat & frame)
+{
+    FrameSource source;
+    source.name = name;
+    source.width = frame.cols;
+    source.height = frame.rows;
+    source.type = frame.type();
+    return source;
+}
+
+static bool Load(SessionIndex & index, const std::string & stream, const IndexRecord & record, int type, cv::Mat & frame)
+{
+    frame = ContainerLoad(index.FramePath(stream, record), record.offset);
+    return !frame.empty() && frame.type() == type;
+}
+
+static int Upsample(const UpsampleOptions & options, const RigCalibration & calibration, const std::string & session,
+                    ThermalUpsampler *& upsampler, double & totalMs)
+{
+    SessionIndex index;
+    index.Open(session);
+
+    const bool useInfrared = options.upsample.sigmaInfrared > 0;
+    std::vector<IndexRecord> depth;
+    if(!index.Frames(options.depthStream, depth) || !index.Stream(options.thermalStream) ||
+       (useInfrared && !index.Stream(options.irStream)))
+    {
+        std::cout << session << ": needs " << options.depthStream << ", " << options.thermalStream
+                  << (useInfrared ? " and " + options.irStream : "") << std::endl;
+        return 0;
+    }
+
+    boost::filesystem::path folder = boost::filesystem::path(session) / options.out;
+    boost::filesystem::create_directories(folder);
+
+    const int64_t maxDt = options.upsample.maxDtMs * 1000LL;
+    int count = 0, unpaired = 0, unreadable = 0;
+    cv::Mat depthFrame, infraredFrame, thermalFrame, output;
+
+    for(size_t i = 0; i < depth.size(); i += options.step)
+    {
+        IndexRecord thermal, infrared;
+        if(!index.Nearest(options.thermalStream, depth[i].timestamp, thermal) ||
+           llabs(thermal.timestamp - depth[i].timestamp) > maxDt ||
+           (useInfrared && (!index.Nearest(options.irStream, depth[i].timestamp, infrared) ||
+                            llabs(infrared.timestamp - depth[i].timestamp) > maxDt)))
+        {
+            unpaired++;
+            continue;
+        }
+
+        //Recorded thermal frames are upright already
+        if(!Load(index, options.depthStream, depth[i], CV_16UC1, depthFrame) ||
+           !Load(index, options.thermalStream, thermal, CV_8UC1, thermalFrame) ||
+           (useInfrared && !Load(index, options.irStream, infrared, CV_16UC1, infraredFrame)))
+        {
+            unreadable++;
+            continue;
+        }
+
+        if(!upsampler)
+        {
+            upsampler = new ThermalUpsampler(options.upsample, calibration, Shape(options.depthStream, depthFrame),
+                                             useInfrared ? Shape(options.irStream, infraredFrame) : FrameSource(),
+                                             Shape(options.thermalStream, thermalFrame));
+            if(!upsampler->IsValid())
+                return -1;
+        }
+
+        output.create(depthFrame.rows, depthFrame.cols, CV_8UC1);
+
+        boost::posix_time::ptime begin = boost::posix_time::microsec_clock::local_time();
+        upsampler->Process(depthFrame.ptr<uint16_t>(0), useInfrared ? infraredFrame.ptr<uint16_t>(0) : 0,
+                           thermalFrame.ptr<uint8_t>(0), output.ptr<uint8_t>(0));
+        totalMs += (boost::posix_time::microsec_clock::local_time() - begin).total_microseconds() / 1000.0;
+
+        cv::imwrite((folder / depth[i].FileName()).string(), output);
+        count++;
+    }
+
+    std::cout << session << ": " << count << " frames written to " << folder.string() << ", " << unpaired
+              << " without a partner within " << options.upsample.maxDtMs << " ms, " << unreadable << " unreadable" << std::endl;
+    return count;
+}
+
+static void Usage()
+{
+    std::cout << "UpsampleThermal (--map map.yml | --calibration calibration.yml) [--radius 2] [--sigma 1.5 30 0]" << std::endl
+              << "                [--max-dt 20] [--depth-stream depth] [--ir-stream infrared] [--thermal-stream thermal]" << std::endl
+              << "                [--step N] [--out DIR]" << std::endl
+              << "                session..." << std::endl;
+}
+
+int main(int argc, char ** argv)
+{
+    UpsampleOptions options;
+    std::vector<std::string> sessions;
+
+    for(int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if(arg == "--map" && hasValue)
+            options.upsample.mapPath = argv[++i];
+        else if(arg == "--calibration" && hasValue)
+            options.calibration = argv[++i];
+        else if(arg == "--radius" && hasValue)
+            options.upsample.radius = std::max(0, atoi(argv[++i]));
+        else if(arg == "--sigma" && i + 3 < argc)
+        {
+            options.upsample.sigmaSpatial = atof(argv[++i]);
+            options.upsample.sigmaDepth = atof(argv[++i]);
+            options.upsample.sigmaInfrared = atof(argv[++i]);
+        }
+        else if(arg == "--max-dt" && hasValue)
+            options.upsample.maxDtMs = atoi(argv[++i]);
+        else if(arg == "--depth-stream" && hasValue)
+            options.depthStream = argv[++i];
+        else if(arg == "--ir-stream" && hasValue)
+            options.irStream = argv[++i];
+        else if(arg == "--thermal-stream" && hasValue)
+            options.thermalStream = argv[++i];
+        else if(arg == "--step" && hasValue)
+            options.step = std::max(1, atoi(argv[++i]));
+        else if(arg == "--out" && hasValue)
+            options.out = argv[++i];
+        else if(arg.compare(0, 2, "--") == 0)
+        {
+            Usage();
+            return 1;
+        }
+        else
+            sessions.push_back(arg);
+    }
+
+    RigCalibration calibration;
+    if(sessions.empty() || (options.upsample.mapPath.empty() && options.calibration.empty()))
+    {
+        Usage();
+        return 1;
+    }
+
+    if(options.upsample.mapPath.empty() && !calibration.Load(options.calibration))
+    {
+        std::cout << "Cannot read " << options.calibration << std::endl;
+        return 1;
+    }
+
+    ThermalUpsampler * upsampler = 0;
+    double totalMs = 0;
+    int count = 0;
+    for(size_t i = 0; i < sessions.size(); i++)
+    {
+        int written = Upsample(options, calibration, sessions[i], upsampler, totalMs);
+        if(written < 0)
+            break;
+        count += written;
+    }
+
+    delete upsampler;
+
+    if(count == 0)
+        return 1;
+
+    std::cout << count << " frames, " << totalMs / count << " ms per frame on one thread" << std::endl;
+    return 0;
+}
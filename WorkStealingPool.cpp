@@ -0,0 +1,140 @@
+#include "WorkStealingPool.h"
+#include "ThreadPolicy.h"
+
+#include <boost/lexical_cast.hpp>
+
+WorkStealingPool::WorkStealingPool(int threads, int maxPending, const std::string & role)
+ : role(role),
+   pending(0),
+   nextWorker(0),
+   stopping(false)
+{
+    if(threads <= 0)
+        threads = std::max(1u, boost::thread::hardware_concurrency());
+
+    this->maxPending = maxPending > 0 ? maxPending : threads * 4;
+
+    steals.assignValue(0);
+
+    for(int i = 0; i < threads; i++)
+        workers.push_back(new Worker);
+
+    for(int i = 0; i < threads; i++)
+        this->threads.create_thread(boost::bind(&WorkStealingPool::WorkerThread, this, i));
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+    Wait();
+
+    boost::mutex::scoped_lock lock(stateMutex);
+    stopping = true;
+    workAvailable.notify_all();
+    lock.unlock();
+
+    threads.join_all();
+
+    for(size_t i = 0; i < workers.size(); i++)
+        delete workers[i];
+}
+
+void WorkStealingPool::Submit(const Task & task)
+{
+    boost::mutex::scoped_lock lock(stateMutex);
+
+    while(pending >= maxPending)
+        taskFinished.wait(lock);
+
+    pending++;
+    Worker * worker = workers[nextWorker++ % workers.size()];
+    lock.unlock();
+
+    boost::mutex::scoped_lock workerLock(worker->mutex);
+    worker->tasks.push_back(task);
+    workerLock.unlock();
+
+    workAvailable.notify_one();
+}
+
+void WorkStealingPool::Wait()
+{
+    boost::mutex::scoped_lock lock(stateMutex);
+
+    while(pending > 0)
+        taskFinished.wait(lock);
+}
+
+int WorkStealingPool::NumThreads()
+{
+    return workers.size();
+}
+
+int WorkStealingPool::MaxPending()
+{
+    return maxPending;
+}
+
+int WorkStealingPool::Steals()
+{
+    return steals.getValue();
+}
+
+bool WorkStealingPool::Pop(int id, Task & task)
+{
+    //Own work first, newest task while its inputs are still warm in cache
+    Worker * own = workers[id];
+    boost::mutex::scoped_lock lock(own->mutex);
+    if(!own->tasks.empty())
+    {
+        task = own->tasks.back();
+        own->tasks.pop_back();
+        return true;
+    }
+    lock.unlock();
+
+    //Then the oldest task of the others, starting next to us so thieves spread out
+    for(size_t i = 1; i < workers.size(); i++)
+    {
+        Worker * victim = workers[(id + i) % workers.size()];
+        boost::mutex::scoped_lock victimLock(victim->mutex, boost::try_to_lock);
+        if(!victimLock.owns_lock() || victim->tasks.empty())
+            continue;
+
+        task = victim->tasks.front();
+        victim->tasks.pop_front();
+        victimLock.unlock();
+
+        steals++;
+        return true;
+    }
+
+    return false;
+}
+
+void WorkStealingPool::WorkerThread(int id)
+{
+    ThreadPolicies::Apply(role, role + "-" + boost::lexical_cast<std::string>(id));
+
+    Task task;
+
+    while(true)
+    {
+        if(Pop(id, task))
+        {
+            task();
+            task.clear();
+
+            boost::mutex::scoped_lock lock(stateMutex);
+            pending--;
+            taskFinished.notify_all();
+            continue;
+        }
+
+        boost::mutex::scoped_lock lock(stateMutex);
+        if(stopping)
+            break;
+
+        //A task pushed between Pop and here is picked up after at most a millisecond
+        workAvailable.timed_wait(lock, boost::posix_time::milliseconds(1));
+    }
+}
@@ -0,0 +1,66 @@
+/*
+ * WorkStealingPool.h
+ *
+ *  Created on: 19/10 2026
+ *      Author: Baobei Xu
+ */
+
+#ifndef WORKSTEALINGPOOL_H_
+#define WORKSTEALINGPOOL_H_
+
+#include <deque>
+#include <vector>
+#include <string>
+#include <boost/thread.hpp>
+#include <boost/function.hpp>
+
+#include "ThreadMutexObject.h"
+
+/////////////////////////////////////Fixed set of worker threads with one task deque each. A worker runs its own
+/// tasks newest first and, when it runs dry, steals the oldest task of another worker, so uneven task costs
+/// (e.g. PNG decode times) balance out without a shared queue everyone contends on.
+class WorkStealingPool
+{
+public:
+    typedef boost::function<void()> Task;
+
+    /////////////////////////////////////threads 0 means one per core, maxPending 0 means four per thread
+    WorkStealingPool(int threads = 0, int maxPending = 0, const std::string & role = "worker");
+    virtual ~WorkStealingPool();
+
+    /////////////////////////////////////Blocks while maxPending tasks are queued or running, which bounds memory
+    void Submit(const Task & task);
+
+    /////////////////////////////////////Blocks until every submitted task has finished
+    void Wait();
+
+    int NumThreads();
+    int MaxPending();
+    int Steals();
+
+private:
+    struct Worker
+    {
+        boost::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<Worker *> workers;
+    boost::thread_group threads;
+    const std::string role;
+
+    boost::mutex stateMutex;
+    boost::condition_variable workAvailable;
+    boost::condition_variable taskFinished;
+    int pending;
+    int maxPending;
+    unsigned nextWorker;
+    bool stopping;
+
+    ThreadMutexObject<int> steals;
+
+    void WorkerThread(int id);
+    bool Pop(int id, Task & task);
+};
+
+#endif /* WORKSTEALINGPOOL_H_ */
@@ -1,4 +1,6 @@
 #include "main.h"
+#include "ThreadPolicy.h"
+#include "DisplayConvert.h"
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/video/video.hpp>
 #include <fstream>
@@ -7,26 +9,349 @@ int main(int argc, char **argv)
 {
     QApplication app(argc, argv);
 
+    LoggerOptions options;
+    PlaybackConfig playback;
+    std::string playbackRoot;
+
+    //Previews are the first thing to give way, --thread-policy preview:... overrides this
+    ThreadPolicy background;
+    background.priority = 10;
+    ThreadPolicies::Set("preview", background);
+
+    for(int i = 1; i < argc; i++)
+    {
+        std::string arg(argv[i]);
+        if(arg == "--thread-policy" && i + 1 < argc)
+        {
+            if(!ThreadPolicies::Parse(argv[++i]))
+                std::cout << "Invalid thread policy " << argv[i] << std::endl;
+        }
+        else if(arg == "--backpressure" && i + 1 < argc)
+        {
+            if(!BackpressureConfig::Parse(argv[++i], options.backpressure))
+                std::cout << "Invalid backpressure policy " << argv[i] << std::endl;
+        }
+        else if(arg == "--png-compression" && i + 1 < argc)
+        {
+            options.pngCompression = std::max(0, std::min(9, atoi(argv[++i])));
+        }
+        else if(arg == "--black-box" && i + 1 < argc)
+        {
+            options.blackBox.historySeconds = atof(argv[++i]);
+        }
+        else if(arg == "--black-box-post" && i + 1 < argc)
+        {
+            options.blackBox.postSeconds = atof(argv[++i]);
+        }
+        else if(arg == "--black-box-compress")
+        {
+            options.blackBox.compress = true;
+        }
+        else if(arg == "--black-box-memory" && i + 1 < argc)
+        {
+            options.blackBox.maxMegabytes = atoi(argv[++i]);
+        }
+        else if(arg == "--roi" && i + 1 < argc)
+        {
+            Roi roi;
+            if(Roi::Parse(argv[++i], roi))
+                options.roi.rois.push_back(roi);
+            else
+                std::cout << "Invalid ROI " << argv[i] << std::endl;
+        }
+        else if(arg == "--roi-rule" && i + 1 < argc)
+        {
+            RoiRule rule;
+            if(RoiRule::Parse(argv[++i], rule))
+                options.roi.rules.push_back(rule);
+            else
+                std::cout << "Invalid ROI rule " << argv[i] << std::endl;
+        }
+        else if(arg == "--roi-percentiles" && i + 1 < argc)
+        {
+            std::string list(argv[++i]);
+            options.roi.percentiles.clear();
+            for(size_t start = 0; list != "none" && start < list.size(); )
+            {
+                size_t end = std::min(list.find(',', start), list.size());
+                options.roi.percentiles.push_back(atoi(list.substr(start, end - start).c_str()));
+                start = end + 1;
+            }
+        }
+        else if(arg == "--roi-scale" && i + 2 < argc)
+        {
+            options.roi.scale = atof(argv[++i]);
+            options.roi.offset = atof(argv[++i]);
+        }
+        else if(arg == "--roi-log" && i + 1 < argc)
+        {
+            options.roi.logPath = argv[++i];
+        }
+        else if(arg == "--depth-filter" && i + 1 < argc)
+        {
+            //Comma separated stages out of temporal, holes, spatial, or "all"
+            std::string stages(argv[++i]);
+            options.depthFilter.enabled = true;
+            options.depthFilter.temporal = stages == "all" || stages.find("temporal") != std::string::npos;
+            options.depthFilter.holes = stages == "all" || stages.find("holes") != std::string::npos;
+            options.depthFilter.spatial = stages == "all" || stages.find("spatial") != std::string::npos;
+        }
+        else if(arg == "--kinect" && i + 1 < argc)
+        {
+            options.kinects.push_back(argv[++i]);
+        }
+        else if(arg == "--flir" && i + 1 < argc)
+        {
+            options.flirs.push_back(argv[++i]);
+        }
+        else if(arg == "--record-format" && i + 1 < argc)
+        {
+            std::string format(argv[++i]);
+            options.journal.container = format == "container";
+            options.journal.video = format == "mkv";
+        }
+        else if(arg == "--video-threads" && i + 1 < argc)
+        {
+            options.journal.videoThreads = std::max(0, atoi(argv[++i]));
+        }
+        else if(arg == "--commit-frames" && i + 1 < argc)
+        {
+            options.journal.commitFrames = std::max(1, atoi(argv[++i]));
+        }
+        else if(arg == "--commit-ms" && i + 1 < argc)
+        {
+            options.journal.commitMs = std::max(1, atoi(argv[++i]));
+        }
+        else if(arg == "--record-infrared")
+        {
+            options.recordInfrared = true;
+        }
+        else if(arg == "--record-root" && i + 1 < argc)
+        {
+            options.stripes.roots.push_back(argv[++i]);
+        }
+        else if(arg == "--stripe" && i + 1 < argc)
+        {
+            if(!StripeConfig::Parse(argv[++i], options.stripes))
+                std::cout << "Invalid stripe mode " << argv[i] << std::endl;
+        }
+        else if(arg == "--stripe-chunk" && i + 1 < argc)
+        {
+            options.stripes.chunkFrames = std::max(1, atoi(argv[++i]));
+        }
+        else if(arg == "--no-recover")
+        {
+            options.journal.recover = false;
+        }
+        else if(arg == "--suppress-static")
+        {
+            options.change.enabled = true;
+        }
+        else if(arg == "--static-threshold" && i + 1 < argc)
+        {
+            //<stream>=<mean>,<max>[,<blocks>], e.g. thermal=1,10 or kinect1/depth=6,80,4
+            if(!options.change.Parse(argv[++i]))
+                std::cout << "Invalid static threshold " << argv[i] << std::endl;
+        }
+        else if(arg == "--static-block" && i + 1 < argc)
+        {
+            options.change.blockSize = std::max(4, atoi(argv[++i]));
+        }
+        else if(arg == "--keyframe-interval" && i + 1 < argc)
+        {
+            options.change.keyframeInterval = std::max(1, atoi(argv[++i]));
+        }
+        else if(arg == "--record-roi" && i + 1 < argc)
+        {
+            //<stream>=x,y,w,h, e.g. thermal=120,80,400,300 or kinect1/depth=0,100,512,200
+            if(!options.sparse.ParseRoi(argv[++i]))
+                std::cout << "Invalid recording ROI " << argv[i] << std::endl;
+        }
+        else if(arg == "--depth-gate" && i + 1 < argc)
+        {
+            //<min>,<max> in mm, e.g. 500,2000
+            if(!options.sparse.ParseGate(argv[++i]))
+                std::cout << "Invalid depth gate " << argv[i] << std::endl;
+        }
+        else if(arg == "--preview" && i + 1 < argc)
+        {
+            //Scale down by 4 or 8 (any power of two)
+            int scale = atoi(argv[++i]);
+            options.preview.enabled = scale >= 2 && (scale & (scale - 1)) == 0;
+            if(options.preview.enabled)
+                options.preview.scale = scale;
+            else
+                std::cout << "Invalid preview scale " << argv[i] << std::endl;
+        }
+        else if(arg == "--contact-sheets")
+        {
+            options.preview.enabled = true;
+            options.preview.contactSheets = true;
+        }
+        else if(arg == "--sheet-columns" && i + 1 < argc)
+        {
+            options.preview.sheetColumns = std::max(1, atoi(argv[++i]));
+        }
+        else if(arg == "--playback" && i + 1 < argc)
+        {
+            playbackRoot = argv[++i];
+        }
+        else if(arg == "--playback-cache" && i + 1 < argc)
+        {
+            playback.cacheMegabytes = std::max(16, atoi(argv[++i]));
+        }
+        else if(arg == "--playback-threads" && i + 1 < argc)
+        {
+            playback.threads = std::max(1, atoi(argv[++i]));
+        }
+        else if(arg == "--calibration" && i + 1 < argc)
+        {
+            options.calibration = argv[++i];
+        }
+        else if(arg == "--list-devices")
+        {
+            std::vector<std::string> uris = OpenNI2Interface::EnumerateDevices();
+            for(size_t d = 0; d < uris.size(); d++)
+                std::cout << "kinect " << uris[d] << std::endl;
+            std::vector<std::string> ids = EbusFlirInterface::EnumerateDevices();
+            for(size_t d = 0; d < ids.size(); d++)
+                std::cout << "flir " << ids[d] << std::endl;
+            return 0;
+        }
+        else if(arg == "--frame-bus")
+        {
+            options.frameBus = i + 1 < argc && argv[i + 1][0] == '/' ? argv[++i] : FRAMEBUS_DEFAULT_NAME;
+        }
+        else if(arg == "--depth-filter-threads" && i + 1 < argc)
+        {
+            options.depthFilter.threads = atoi(argv[++i]);
+        }
+        else if(arg == "--depth-filter-use" && i + 1 < argc)
+        {
+            //Which consumers get the filtered depth: preview, record, both or none
+            std::string use(argv[++i]);
+            options.depthFilter.preview = use == "preview" || use == "both";
+            options.depthFilter.record = use == "record" || use == "both";
+        }
+        else if(arg == "--thermal-filter" && i + 1 < argc)
+        {
+            //Comma separated stages out of temporal, fpn, freeze, or "all"
+            std::string stages(argv[++i]);
+            options.thermalFilter.enabled = true;
+            options.thermalFilter.temporal = stages == "all" || stages.find("temporal") != std::string::npos;
+            options.thermalFilter.fixedPattern = stages == "all" || stages.find("fpn") != std::string::npos;
+            options.thermalFilter.freeze = stages == "all" || stages.find("freeze") != std::string::npos;
+        }
+        else if(arg == "--thermal-filter-use" && i + 1 < argc)
+        {
+            std::string use(argv[++i]);
+            options.thermalFilter.preview = use == "preview" || use == "both";
+            options.thermalFilter.record = use == "record" || use == "both";
+        }
+        else if(arg == "--thermal-offsets" && i + 1 < argc)
+        {
+            options.thermalFilter.offsetPath = argv[++i];
+        }
+        else if(arg == "--thermal-offset-frames" && i + 1 < argc)
+        {
+            options.thermalFilter.offsetFrames = std::max(1, atoi(argv[++i]));
+        }
+        else if(arg == "--thermal-upsample")
+        {
+            options.upsample.enabled = true;
+        }
+        else if(arg == "--upsample-map" && i + 1 < argc)
+        {
+            options.upsample.enabled = true;
+            options.upsample.mapPath = argv[++i];
+        }
+        else if(arg == "--upsample-radius" && i + 1 < argc)
+        {
+            options.upsample.radius = std::max(0, atoi(argv[++i]));
+        }
+        else if(arg == "--upsample-sigma" && i + 3 < argc)
+        {
+            //Spatial (pixels), depth (mm) and IR, 0 leaves the IR out
+            options.upsample.sigmaSpatial = atof(argv[++i]);
+            options.upsample.sigmaDepth = atof(argv[++i]);
+            options.upsample.sigmaInfrared = atof(argv[++i]);
+        }
+        else if(arg == "--upsample-threads" && i + 1 < argc)
+        {
+            options.upsample.threads = atoi(argv[++i]);
+        }
+        else if(arg == "--reconstruct")
+        {
+            options.reconstruction.enabled = true;
+        }
+        else if(arg == "--reconstruct-voxel" && i + 1 < argc)
+        {
+            //Metres, the truncation band follows at four voxels
+            options.reconstruction.voxelSize = std::max(0.002, atof(argv[++i]));
+            options.reconstruction.truncation = options.reconstruction.voxelSize * 4;
+        }
+        else if(arg == "--reconstruct-blocks" && i + 1 < argc)
+        {
+            options.reconstruction.maxBlocks = std::max(64, atoi(argv[++i]));
+        }
+        else if(arg == "--reconstruct-threads" && i + 1 < argc)
+        {
+            options.reconstruction.threads = atoi(argv[++i]);
+        }
+        else if(arg == "--mesh" && i + 1 < argc)
+        {
+            options.reconstruction.meshPath = argv[++i];
+        }
+    }
+
+    //Rules and percentiles may come in any order, rules are checked against the percentiles once both are known
+    options.roi.CheckRules();
+
+    //kill -USR1 <pid> triggers the black box
+    signal(SIGUSR1, BlackBox::SignalHandler);
+
+    //Review a recorded session without any camera
+    if(!playbackRoot.empty())
+    {
+        PlaybackWindow * viewer = new PlaybackWindow(playbackRoot, playback);
+        if(!viewer->IsOpen())
+        {
+            std::cout << "No recorded streams in " << playbackRoot << std::endl;
+            return 1;
+        }
+        viewer->show();
+        return app.exec();
+    }
+
     int width = 640;
     int height = 512;
 
-    MainWindow * window = new MainWindow(width, height);
+    MainWindow * window = new MainWindow(width, height, options, playback);
     window->show();
 
     return app.exec();
 }
 
-MainWindow::MainWindow(int width, int height)
-    : logger(0),
+MainWindow::MainWindow(int width, int height, const LoggerOptions & options, const PlaybackConfig & playback)
+    : options(options),
+      playback(playback),
+      logger(0),
       thermalImage(640, 512, QImage::Format_RGB888),
       depthImage(512, 424, QImage::Format_RGB888),
       infraredImage(512, 424, QImage::Format_RGB888),
+      timer(0),
+      telemetryTimer(0),
+      depthDisplayed(0),
+      infraredDisplayed(0),
+      thermalDisplayed(0),
       lastDepthDrawn(-1),
       lastInfraredDrawn(-1),
       lastThermalDrawn(-1)
 {
-    this->setMaximumSize(width + 2 * 512, height + 80);
-    this->setMinimumSize(width + 2 * 512, height + 80);
+    const int telemetryHeight = 130;
+
+    this->setMaximumSize(width + 2 * 512, height + 80 + telemetryHeight);
+    this->setMinimumSize(width + 2 * 512, height + 80 + telemetryHeight);
 
     deviceWnd = new PvGenBrowserWnd;
     communicationWnd = new PvGenBrowserWnd;
@@ -52,6 +377,17 @@ MainWindow::MainWindow(int width, int height)
     infraredLabel->setPixmap(QPixmap::fromImage(infraredImage));
     mainLayout->addWidget(infraredLabel);
 
+    telemetryLabel = new QLabel(this);
+    telemetryLabel->setFixedHeight(telemetryHeight);
+    telemetryLabel->setAlignment(Qt::AlignLeft | Qt::AlignTop);
+    telemetryLabel->setTextFormat(Qt::RichText);
+    wrapperLayout->addWidget(telemetryLabel);
+
+    //Independent of the preview timer so a stalled capture still shows up
+    telemetryTimer = new QTimer(this);
+    connect(telemetryTimer, SIGNAL(timeout()), this, SLOT(TelemetryCallback()));
+    telemetryTimer->start(500);
+
     wrapperLayout->addLayout(buttonLayout);
     selectButton = new QPushButton("Select Camera", this);
     connect(selectButton, SIGNAL(clicked()), this, SLOT(SelectCamera()));
@@ -82,6 +418,18 @@ MainWindow::MainWindow(int width, int height)
     connect(singleRButton, SIGNAL(clicked()), this, SLOT(SingleRecording()));
     recordLayout->addWidget(singleRButton);
 
+    openSessionButton = new QPushButton("Open Session", this);
+    connect(openSessionButton, SIGNAL(clicked()), this, SLOT(OpenSession()));
+    recordLayout->addWidget(openSessionButton);
+
+    offsetButton = new QPushButton("Capture Thermal Offsets", this);
+    connect(offsetButton, SIGNAL(clicked()), this, SLOT(CaptureThermalOffsets()));
+    recordLayout->addWidget(offsetButton);
+
+    meshButton = new QPushButton("Export Mesh", this);
+    connect(meshButton, SIGNAL(clicked()), this, SLOT(ExportMesh()));
+    recordLayout->addWidget(meshButton);
+
     wrapperLayout->addLayout(parameterLayout);
     communicationButton = new QPushButton("Communication control", this);
     connect(communicationButton, SIGNAL(clicked()), this, SLOT(OnShowCommParameters()));
@@ -108,44 +456,42 @@ MainWindow::~MainWindow()
 
 void MainWindow::TimerCallback()
 {
-    int lastDepth = logger->getKinect()->latestDepthIndex.getValue();
-    int lastThermal = logger->getFlir()->latestThermalIndex.getValue();
-    int lastInfrared = logger->getKinect()->latestInfraredIndex.getValue();
-    if(lastDepth == -1 || lastThermal == -1 || lastThermal == -1)
-        return;
+    FrameSource depthSource = logger->PreviewDepthSource();
+    FrameSource infraredSource = logger->InfraredSource();
+    FrameSource thermalSource = logger->PreviewThermalSource();
+
+    //Snapshots come back whole even if the capture side wraps round the ring meanwhile
+    int sequence;
+    int64_t timestamp;
 
-    int bufferDIndex = lastDepth % OpenNI2Interface::numBuffers;
-    int bufferIIndex = lastInfrared % OpenNI2Interface::numBuffers;
-    int bufferTIndex = lastThermal % EbusFlirInterface::numBuffers;
-    if(bufferDIndex != lastDepthDrawn)
+    if(depthSource.latestIndex->getValue() != lastDepthDrawn && depthSource.Snapshot(&depthBuffer[0], sequence, timestamp))
     {
-        memcpy(&depthBuffer[0], logger->getKinect()->frameBuffers[bufferDIndex].first, logger->getKinect()->width * logger->getKinect()->height * 2);
         cv::Mat1w depth(logger->getKinect()->height, logger->getKinect()->width, (unsigned short *)&depthBuffer[0]);
         cv::Mat tmp(logger->getKinect()->height, logger->getKinect()->width, CV_8UC1);
         Normalize(depth, tmp, 8.0);
         cv::Mat3b depthImg(logger->getKinect()->height, logger->getKinect()->width, (cv::Vec<unsigned char, 3> *)depthImage.bits());
         cv::cvtColor(tmp, depthImg, CV_GRAY2RGB);
 
-        lastDepthDrawn = bufferDIndex;
+        lastDepthDrawn = sequence;
+        depthDisplayed++;
         depthLabel->setPixmap(QPixmap::fromImage(depthImage));
     }
 
-    if(bufferIIndex != lastInfraredDrawn)
+    if(infraredSource.latestIndex->getValue() != lastInfraredDrawn && infraredSource.Snapshot(&infraredBuffer[0], sequence, timestamp))
     {
-        memcpy(&infraredBuffer[0], logger->getKinect()->infraredFrameBuffers[bufferIIndex].first, logger->getKinect()->width * logger->getKinect()->height * 2);
         cv::Mat1w infrared(logger->getKinect()->height, logger->getKinect()->width, (unsigned short *)&infraredBuffer[0]);
         cv::Mat tmp(logger->getKinect()->height, logger->getKinect()->width, CV_8UC1);
         Normalize(infrared, tmp, 1.0);
         cv::Mat3b infraredImg(logger->getKinect()->height, logger->getKinect()->width, (cv::Vec<unsigned char, 3> *)infraredImage.bits());
         cv::cvtColor(tmp, infraredImg, CV_GRAY2RGB);
 
-        lastInfraredDrawn = bufferIIndex;
+        lastInfraredDrawn = sequence;
+        infraredDisplayed++;
         infraredLabel->setPixmap(QPixmap::fromImage(infraredImage));
     }
 
-    if(bufferTIndex != lastThermalDrawn)
+    if(thermalSource.latestIndex->getValue() != lastThermalDrawn && thermalSource.Snapshot(&thermalBuffer[0], sequence, timestamp))
     {
-        memcpy(&thermalBuffer[0], logger->getFlir()->frameBuffers[bufferTIndex].first, logger->getFlir()->width * logger->getFlir()->height);
         cv::Mat1b thermal(logger->getFlir()->height, logger->getFlir()->width, (unsigned char *)&thermalBuffer[0]);
         cv::Mat fthermal;
         cv::flip(thermal, fthermal, 0);
@@ -154,16 +500,95 @@ void MainWindow::TimerCallback()
         cv::cvtColor(fthermal, thermalImg, CV_GRAY2RGB);
 //        cv::applyColorMap(fthermal, thermalImg, cv::COLORMAP_JET);
 
-        lastThermalDrawn = bufferTIndex;
+        lastThermalDrawn = sequence;
+        thermalDisplayed++;
         thermalLabel->setPixmap(QPixmap::fromImage(thermalImage));
     }
 }
 
+void MainWindow::TelemetryCallback()
+{
+    if(!logger)
+    {
+        telemetryLabel->setText("No camera connected");
+        return;
+    }
+
+    std::vector<StreamCounters> counters = logger->CollectTelemetry();
+
+    //The preview only draws the first devices
+    DeviceRegistry & devices = logger->getDevices();
+    for(size_t i = 0; i < counters.size(); i++)
+    {
+        if(devices.NumKinects() > 0 && counters[i].name == devices.Depth(0).name)
+            counters[i].displayed = depthDisplayed;
+        else if(devices.NumKinects() > 0 && counters[i].name == devices.Infrared(0).name)
+            counters[i].displayed = infraredDisplayed;
+        else if(devices.NumFlirs() > 0 && counters[i].name == devices.Thermal(0).name)
+            counters[i].displayed = thermalDisplayed;
+    }
+
+    std::vector<StreamTelemetry> rows = telemetry.Update(counters);
+    bool capturing = logger->IsCapturing();
+
+    QString html = "<table cellspacing=\"0\" cellpadding=\"1\">"
+                   "<tr><th align=\"left\">stream</th><th>capture fps</th><th>display fps</th>"
+                   "<th>dropped device</th><th>dropped ring</th><th>dropped black box</th><th>backlog</th><th>write MB/s</th></tr>";
+    for(size_t i = 0; i < rows.size(); i++)
+    {
+        const StreamTelemetry & row = rows[i];
+        bool failing = (capturing && row.stalled) || row.dropping;
+
+        html += failing ? "<tr style=\"color:#c00000\">" : "<tr>";
+        html += "<td>" + QString::fromStdString(row.counters.name) + (capturing && row.stalled ? " (stalled)" : "") + "</td>";
+        html += "<td align=\"right\">" + QString::number(row.captureFps, 'f', 1) + "</td>";
+        html += "<td align=\"right\">" + QString::number(row.displayFps, 'f', 1) + "</td>";
+        html += "<td align=\"right\">" + QString::number(row.counters.deviceDropped) + "</td>";
+        if(row.counters.recording)
+            html += "<td align=\"right\">" + QString::number(row.counters.ringDropped) + "</td>";
+        else
+            html += "<td align=\"right\">-</td>";
+        html += "<td align=\"right\">" + QString::number(row.counters.blackBoxDropped) + "</td>";
+        if(row.counters.recording)
+        {
+            html += "<td align=\"right\">" + QString::number(row.counters.backlog) + " / " + QString::number(row.counters.capacity) + "</td>";
+            html += "<td align=\"right\">" + QString::number(row.writeMBs, 'f', 2) + "</td>";
+        }
+        else
+        {
+            html += "<td align=\"right\">-</td><td align=\"right\">-</td>";
+        }
+        html += "</tr>";
+    }
+    html += "</table>";
+
+    std::vector<std::string> roots(1, ".");
+    if(options.backpressure.action == BackpressureConfig::Spill)
+        roots.push_back(options.backpressure.spillRoot);
+    for(size_t i = 0; i < options.stripes.roots.size(); i++)
+    {
+        if(options.stripes.roots[i] != ".")
+            roots.push_back(options.stripes.roots[i]);
+    }
+
+    QString disks = "Disk free:";
+    for(size_t i = 0; i < roots.size(); i++)
+    {
+        int64_t available = TelemetrySampler::DiskFree(roots[i]);
+        disks += " " + QString::fromStdString(roots[i]) + " " +
+                 (available < 0 ? QString("?") : QString::number(available / (1024.0 * 1024.0 * 1024.0), 'f', 1) + " GB");
+    }
+    html += disks;
+
+    telemetryLabel->setText(html);
+}
+
 void MainWindow::SelectCamera()
 {
     if(logger)
         return;
-    logger = new Logger();
+    logger = new Logger(options);
+    logger->ConnectKinectAsync();
     if(!logger->ConnectCamera())
     {
         delete logger;
@@ -184,11 +609,15 @@ void MainWindow::StartCapture()
 {
     if(!logger)
         return;
-    if(!logger->ConnectKinect()){
-        std::cout << "Connect Kinect Failed\n";
+    if(!logger->StartCapture()){
+        std::cout << "Start Capture Failed\n";
         return;
     }
-    logger->getFlir()->StartAcquire();
+    telemetry.Reset();
+    logger->StartFilter();
+    logger->StartFrameBus();
+    logger->StartBlackBox();
+    logger->StartAnalysis();
     if(!timer)
     {
         timer = new QTimer(this);
@@ -201,7 +630,17 @@ void MainWindow::StopCapture()
 {
     if(!logger)
         return;
-    logger->getFlir()->StopAcquire();
+    //A recording reads the capture and filter rings, it ends with the capture
+    if(logger->IsWriting())
+    {
+        logger->StopWriting();
+        std::cout << "Stop Recording" << std::endl;
+    }
+    logger->StopBlackBox();
+    logger->StopAnalysis();
+    logger->StopFrameBus();
+    logger->StopFilter();
+    logger->StopCapture();
     if(timer){
         timer->stop();
         delete timer;
@@ -262,21 +701,47 @@ void MainWindow::SingleRecording()
 {
     if(!logger)
         return;
-    logger->SingleWriting();
-    std::cout << "Save Single Image Success" << std::endl;
+    if(logger->BlackBoxEnabled())
+    {
+        logger->Trigger("button");
+        return;
+    }
+    int ticket = logger->SingleWriting();
+    if(ticket < 0)
+        std::cout << "No frames to snapshot" << std::endl;
+    else
+        std::cout << "Snapshot " << ticket << " queued" << std::endl;
+}
+
+void MainWindow::CaptureThermalOffsets()
+{
+    if(!logger)
+        return;
+    if(!logger->CaptureThermalOffsets())
+        std::cout << "Thermal offsets need --thermal-filter and a running capture" << std::endl;
+}
+
+void MainWindow::ExportMesh()
+{
+    if(!logger)
+        return;
+    if(!logger->ExportMesh())
+        std::cout << "Mesh export needs --reconstruct and a running capture" << std::endl;
 }
 
-void MainWindow::Normalize(const cv::Mat& src, cv::Mat& dst, float scale)
+void MainWindow::OpenSession()
 {
-    int width = src.rows;
-    int height = src.cols;
-    for(int i = 0; i < width; ++i)
+    QString folder = QFileDialog::getExistingDirectory(this, "Open recorded session");
+    if(folder.isEmpty())
+        return;
+
+    PlaybackWindow * viewer = new PlaybackWindow(folder.toStdString(), playback);
+    viewer->setAttribute(Qt::WA_DeleteOnClose);
+    if(!viewer->IsOpen())
     {
-        const unsigned short * s = src.ptr<unsigned short>(i);
-        unsigned char * d = dst.ptr<unsigned char>(i);
-        for(int j = 0; j < height; ++j)
-        {
-            d[j] = float(s[j]) * scale / 65535.0 * 255.0;
-        }
+        QMessageBox::warning(this, "Open Session", "No recorded streams in " + folder);
+        delete viewer;
+        return;
     }
+    viewer->show();
 }
@@ -31,17 +31,19 @@
 #include <QPainter>
 
 #include "Logger.h"
+#include "PlaybackWindow.h"
 
 class MainWindow : public QWidget
 {
     Q_OBJECT;
 
 public:
-    MainWindow(int width, int height);
+    MainWindow(int width, int height, const LoggerOptions & options, const PlaybackConfig & playback = PlaybackConfig());
     virtual ~MainWindow();
 
 private slots:
     void TimerCallback();
+    void TelemetryCallback();
     void SelectCamera();
     void DisconnectCamera();
     void StartCapture();
@@ -52,8 +54,13 @@ private slots:
     void StartRecording();
     void StopRecording();
     void SingleRecording();
+    void OpenSession();
+    void CaptureThermalOffsets();
+    void ExportMesh();
 
 private:
+    LoggerOptions options;
+    PlaybackConfig playback;
     Logger * logger;
 
     QImage depthImage;
@@ -65,6 +72,14 @@ private:
 
     QTimer * timer;
 
+    /////////////////////////////////////Per-stream telemetry below the previews, refreshed twice a second
+    QLabel * telemetryLabel;
+    QTimer * telemetryTimer;
+    TelemetrySampler telemetry;
+    int64_t depthDisplayed;
+    int64_t infraredDisplayed;
+    int64_t thermalDisplayed;
+
     QPushButton * selectButton;
     QPushButton * disconnectButton;
 
@@ -74,6 +89,9 @@ private:
     QPushButton * startRButton;
     QPushButton * stopRButton;
     QPushButton * singleRButton;
+    QPushButton * openSessionButton;
+    QPushButton * offsetButton;
+    QPushButton * meshButton;
 
     QPushButton *communicationButton;
     QPushButton *deviceButton;
@@ -88,8 +106,6 @@ private:
     int lastDepthDrawn;
     int lastInfraredDrawn;
     int lastThermalDrawn;
-
-    void Normalize(const cv::Mat& src, cv::Mat& dst, float scale);
 };
 
 #endif //////End of MAIN_H_